@@ -11,7 +11,7 @@ License:	GPLv3+
 URL:		https://github.com/NIF-au/TissueStack
 Source:		%{name}-%{version}.tar.gz
 
-BuildRequires:	minc GraphicsMagick-devel
+BuildRequires:	minc GraphicsMagick-devel libpng-devel libjpeg-turbo-devel
 Requires:	minc nifticlib GraphicsMagick dcmtk
 
 %description
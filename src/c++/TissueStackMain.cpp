@@ -32,6 +32,16 @@ void cleanUp()
 		// can be safely ignored
 	}
 
+	try
+	{
+		// remember the hot slices for the next start up (needs the data set store still)
+		if (tissuestack::imaging::TissueStackSliceCache::doesInstanceExist())
+			tissuestack::imaging::TissueStackSliceCache::instance()->persistHotSetSnapshot();
+	} catch (...)
+	{
+		// can be safely ignored
+	}
+
 	try
 	{
 		// deallocate global singleton objects
@@ -44,6 +54,8 @@ void cleanUp()
 		if (tissuestack::imaging::TissueStackLabelLookupStore::doesInstanceExist())
 			tissuestack::imaging::TissueStackLabelLookupStore::instance()->purgeInstance();
 
+		if (tissuestack::imaging::TissueStackLookupTableStore::doesInstanceExist())
+			tissuestack::imaging::TissueStackLookupTableStore::instance()->purgeInstance();
 		if (tissuestack::imaging::TissueStackColorMapStore::doesInstanceExist())
 			tissuestack::imaging::TissueStackColorMapStore::instance()->purgeInstance();
 
@@ -53,6 +65,12 @@ void cleanUp()
 		if (tissuestack::imaging::TissueStackSliceCache::doesInstanceExist())
 			tissuestack::imaging::TissueStackSliceCache::instance()->purgeInstance();
 
+		if (tissuestack::imaging::TissueStackTileDiskCache::doesInstanceExist())
+			tissuestack::imaging::TissueStackTileDiskCache::instance()->purgeInstance();
+
+		if (tissuestack::utils::MemoryAccounting::doesInstanceExist())
+			tissuestack::utils::MemoryAccounting::instance()->purgeInstance();
+
 		if (tissuestack::database::TissueStackPostgresConnector::doesInstanceExist())
 			tissuestack::database::TissueStackPostgresConnector::instance()->purgeInstance();
 
@@ -147,7 +165,8 @@ int main(int argc, char * args[])
 				"\t# Configuration database port\n\tdb_port=5432\n" <<
 				"\t# Configuration database name\n\tdb_name=tissuestack\n" <<
 				"\t# Configuration database user\n\tdb_user=tissuestack\n" <<
-				"\t# Configuration database password\n\tdb_password=tissuestack\n\n" << std::endl;
+				"\t# Configuration database password\n\tdb_password=tissuestack\n" <<
+				"\t# Root of the cgroup hierarchy used for memory accounting\n\tcgroup_root=/sys/fs/cgroup\n\n" << std::endl;
 			Params->purgeInstance();
 			exit(-1);
 		}
@@ -176,6 +195,26 @@ int main(int argc, char * args[])
 		Params->purgeInstance();
 		exit(-1);
 	}
+
+	try
+	{
+		// memory accounting is cgroup aware so that we don't rely on host figures within containers
+		tissuestack::utils::MemoryAccounting * accounting =
+			tissuestack::utils::MemoryAccounting::instance(Params->getParameter("cgroup_root"));
+		if (accounting->isLimitedByCGroup())
+			Logger->info("Memory is limited by cgroup (v%u) %s to %llu bytes\n",
+				accounting->getCGroupVersion(),
+				accounting->getCGroupMemoryDirectory().c_str(),
+				accounting->getMemoryLimit());
+	} catch (std::exception & bad)
+	{
+		std::cerr << "Failed to instantiate the memory accounting!" << std::endl;
+		Logger->purgeInstance();
+		Params->purgeInstance();
+		exit(-1);
+	}
+	Logger->info("Pixel kernels use %s\n",
+		tissuestack::imaging::PixelKernels::getInstructionSet().c_str());
 	
 	try
 	{
@@ -243,10 +282,14 @@ int main(int argc, char * args[])
 		exit(-1);
 	}
 
+	// png/jpeg encoder settings
+	tissuestack::imaging::TissueStackImageEncoder::loadSettings();
+
 	try
 	{
 		tissuestack::imaging::TissueStackDataSetStore::instance(); // the data set store
 		//tissuestack::imaging::TissueStackDataSetStore::instance()->dumpDataSetStoreIntoDebugLog();
+		tissuestack::imaging::TissueStackDataSetStore::instance()->pinConfiguredDataSets(); // preload pinned atlases
 	} catch (std::exception & bad)
 	{
 		std::cerr << "Could not instantiate TissueStackDataSetStore!" << std::endl;
@@ -255,6 +298,17 @@ int main(int argc, char * args[])
 		exit(-1);
 	}
 
+	try
+	{
+		tissuestack::imaging::TissueStackTileDiskCache::instance(); // the tile disk cache (recovers from disk)
+	} catch (std::exception & bad)
+	{
+		std::cerr << "Could not instantiate TissueStackTileDiskCache!" << std::endl;
+		Logger->error("Could not instantiate TissueStackTileDiskCache:\n%s\n", bad.what());
+		cleanUp();
+		exit(-1);
+	}
+
 	try
 	{
 		tissuestack::services::TissueStackTaskQueue::instance();
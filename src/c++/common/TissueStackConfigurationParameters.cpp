@@ -107,6 +107,7 @@ tissuestack::TissueStackConfigurationParameters::TissueStackConfigurationParamet
 	this->_parameters["db_name"] = new tissuestack::database::Configuration("db_name", "tissuestack");
 	this->_parameters["db_user"] = new tissuestack::database::Configuration("db_user", "tissuestack");
 	this->_parameters["db_password"] = new tissuestack::database::Configuration("db_password", "tissuestack");
+	this->_parameters["cgroup_root"] = new tissuestack::database::Configuration("cgroup_root", "/sys/fs/cgroup");
 }
 
 
@@ -62,6 +62,12 @@ namespace tissuestack
 			explicit TissueStackFileUploadException(std::string what);
     };
 
+    class TissueStackServiceUnavailableException : public TissueStackApplicationException
+    {
+    	public:
+			explicit TissueStackServiceUnavailableException(std::string what);
+    };
+
 
     class TissueStackInvalidRequestException : public TissueStackApplicationException
     {
@@ -30,6 +30,7 @@
 #define LABEL_LOOKUP_PATH CONCAT_APP_PATH("lookup")
 #define TASKS_PATH CONCAT_APP_PATH("tasks")
 #define UPLOAD_PATH CONCAT_APP_PATH("upload")
+#define TILE_DISK_CACHE_PATH CONCAT_APP_PATH("tile_cache")
 #define TISSUESTACK_TMP_DIR "/tmp"
 
 #endif	/* __GLOBALS_H__ */
@@ -89,6 +89,11 @@ namespace tissuestack
 					HTTP,
 					TS_IMAGE,
 					TS_QUERY,
+					TS_BATCH_QUERY,
+					TS_OBLIQUE,
+					TS_PROJECTION,
+					TS_STATISTICS,
+					TS_LABELS,
 					TS_TILING,
 					TS_CONVERSION,
 					TS_SERVICES
@@ -107,6 +107,31 @@ void tissuestack::execution::TissueStackOnlineExecutor::execute(
 					processing_strategy,
 					static_cast<const tissuestack::networking::TissueStackQueryRequest *>(req.get()),
 					client_descriptor);
+		else if (req.get()->getType() == tissuestack::common::Request::Type::TS_BATCH_QUERY) /* BATCH QUERY REQUEST */
+			this->_imageExtractor->processBatchQueryRequest(
+					processing_strategy,
+					static_cast<const tissuestack::networking::TissueStackBatchQueryRequest *>(req.get()),
+					client_descriptor);
+		else if (req.get()->getType() == tissuestack::common::Request::Type::TS_OBLIQUE) /* OBLIQUE PLANE REQUEST */
+			this->_imageExtractor->processObliqueRequest(
+					processing_strategy,
+					static_cast<const tissuestack::networking::TissueStackObliqueRequest *>(req.get()),
+					client_descriptor);
+		else if (req.get()->getType() == tissuestack::common::Request::Type::TS_PROJECTION) /* PROJECTION REQUEST */
+			this->_imageExtractor->processProjectionRequest(
+					processing_strategy,
+					static_cast<const tissuestack::networking::TissueStackProjectionRequest *>(req.get()),
+					client_descriptor);
+		else if (req.get()->getType() == tissuestack::common::Request::Type::TS_STATISTICS) /* STATISTICS REQUEST */
+			this->_imageExtractor->processStatisticsRequest(
+					processing_strategy,
+					static_cast<const tissuestack::networking::TissueStackStatisticsRequest *>(req.get()),
+					client_descriptor);
+		else if (req.get()->getType() == tissuestack::common::Request::Type::TS_LABELS) /* LABEL INDEX REQUEST */
+			this->_imageExtractor->processLabelIndexRequest(
+					processing_strategy,
+					static_cast<const tissuestack::networking::TissueStackLabelIndexRequest *>(req.get()),
+					client_descriptor);
 		else if (req.get()->getType() == tissuestack::common::Request::Type::TS_SERVICES) /* SERVICES REQUEST */
 			this->_serviesDelegator->processRequest(
 					processing_strategy,
@@ -168,6 +193,14 @@ void tissuestack::execution::TissueStackOnlineExecutor::execute(
 				"200 OK",
 				"application/json",
 				tissuestack::services::TissueStackServiceError(uploadException).toJson());
+	} catch (tissuestack::common::TissueStackServiceUnavailableException& overloaded)
+	{
+		tissuestack::logging::TissueStackLogger::instance()->error("Shedding Request: %s\n", overloaded.what());
+		response =
+			tissuestack::utils::Misc::composeHttpResponse(
+				"503 Service Unavailable",
+				"application/json",
+				tissuestack::services::TissueStackServiceError(overloaded).toJson());
 	} catch (tissuestack::common::TissueStackApplicationException& ex)
 	{
 		tissuestack::logging::TissueStackLogger::instance()->error("Failed to execute Process: %s\n", ex.what());
@@ -45,6 +45,11 @@ void tissuestack::execution::TissueStackSliceCacheCleaner::init()
 				"Slice Cache Cleaner Thread %u is ready\n",
 				std::hash<std::thread::id>()(std::this_thread::get_id()));
 
+			// prefetch what was hot before the last shutdown, the server accepts requests in the meantime
+			if (!this->hasNoTasksQueued())
+				tissuestack::imaging::TissueStackSliceCache::instance()->warmUpFromHotSetSnapshot(this);
+
+			unsigned int iterations = 0;
 			while (!this->isStopFlagRaised())
 			{
 				usleep(5000000); // 5,000,000 micro seconds /5 seconds
@@ -52,7 +57,15 @@ void tissuestack::execution::TissueStackSliceCacheCleaner::init()
 				if (this->hasNoTasksQueued())
 					break;
 
-				if (tissuestack::utils::System::getFreeRam() > tissuestack::imaging::TissueStackSliceCache::MINIMUM_FREE_RAM_IN_BYTES)
+				// every 5 minutes we persist the hot set
+				iterations++;
+				if (iterations % 60 == 0)
+				{
+					tissuestack::imaging::TissueStackSliceCache::instance()->persistHotSetSnapshot();
+					tissuestack::imaging::TissueStackSliceCache::instance()->dumpCacheStatisticsIntoLog();
+				}
+
+				if (tissuestack::utils::MemoryAccounting::instance()->getAvailableMemory() > tissuestack::imaging::TissueStackSliceCache::MINIMUM_FREE_RAM_IN_BYTES)
 					continue;
 
 				tissuestack::imaging::TissueStackSliceCache::instance()->cleanUpCache();
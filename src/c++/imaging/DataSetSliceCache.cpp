@@ -17,25 +17,46 @@
 #include "networking.h"
 #include "imaging.h"
 
+#ifdef USE_LZ4
+const tissuestack::imaging::RAW_CODEC tissuestack::imaging::DataSetSliceCache::SLICE_CODEC =
+	tissuestack::imaging::RAW_CODEC::LZ4;
+#else
+const tissuestack::imaging::RAW_CODEC tissuestack::imaging::DataSetSliceCache::SLICE_CODEC =
+	tissuestack::imaging::RAW_CODEC::ZLIB;
+#endif
+
 tissuestack::imaging::DataSetSliceCache::~DataSetSliceCache()
 {
 	if (this->_cache == nullptr) return;
 
 	for (unsigned long int i=0;i<this->_numberOfCachedSlices;i++)
 		if (this->_cache[i])
+		{
+			if (tissuestack::utils::MemoryAccounting::doesInstanceExist())
+				tissuestack::utils::MemoryAccounting::instance()->removeCacheBytes(this->_cache[i]->getSizeInBytes());
 			delete this->_cache[i];
+		}
 
 	delete [] this->_cache;
 }
 
-tissuestack::imaging::DataSetSliceCache::DataSetSliceCache(const TissueStackRawData * image) : _numberOfCachedSlices(0), _cache(nullptr)
+tissuestack::imaging::DataSetSliceCache::DataSetSliceCache(const TissueStackRawData * image, const bool use_compression) :
+	_numberOfCachedSlices(0), _use_compression(use_compression), _cache(nullptr)
 {
 	if (image == nullptr)
 		THROW_TS_EXCEPTION(tissuestack::common::TissueStackNullPointerException,
 			"image param is null");
 
+	const unsigned long long int multiplier =
+		image->getType() != tissuestack::imaging::RAW_TYPE::UCHAR_8_BIT ? 3 : 1;
 	for (auto dim : image->getDimensionOrder())
-		this->_numberOfCachedSlices += image->getDimensionByLongName(dim)->getNumberOfSlices();
+	{
+		const tissuestack::imaging::TissueStackDataDimension * d = image->getDimensionByLongName(dim);
+		this->_numberOfCachedSlices += d->getNumberOfSlices();
+		this->_slice_sizes.push_back(
+			std::pair<unsigned long int, unsigned long long int>(
+				this->_numberOfCachedSlices, d->getSliceSize() * multiplier));
+	}
 
 	this->_cache = new tissuestack::imaging::SliceCacheEntry * [this->_numberOfCachedSlices];
 	for (unsigned long int x=0;x<this->_numberOfCachedSlices;x++)
@@ -47,6 +68,59 @@ const unsigned long int tissuestack::imaging::DataSetSliceCache::getNumberOfCach
 	return this->_numberOfCachedSlices;
 }
 
+const unsigned long long int tissuestack::imaging::DataSetSliceCache::getSliceSizeInBytes(const unsigned long int slice) const
+{
+	for (auto bound : this->_slice_sizes)
+		if (slice < bound.first)
+			return bound.second;
+
+	return 0;
+}
+
+const bool tissuestack::imaging::DataSetSliceCache::isCompressionEnabled() const
+{
+	return this->_use_compression;
+}
+
+const unsigned long long int tissuestack::imaging::DataSetSliceCache::getResidentBytes() const
+{
+	return this->_resident_bytes;
+}
+
+const unsigned long long int tissuestack::imaging::DataSetSliceCache::getUncompressedBytes() const
+{
+	return this->_uncompressed_bytes;
+}
+
+tissuestack::imaging::SliceCacheEntry * tissuestack::imaging::DataSetSliceCache::createSliceCacheEntry(
+	const unsigned long int slice,
+	const unsigned char * data,
+	const unsigned long long int access_count) const
+{
+	const unsigned long long int sliceSize = this->getSliceSizeInBytes(slice);
+	if (data == nullptr || sliceSize == 0)
+		return nullptr;
+
+	if (this->_use_compression)
+	{
+		std::vector<unsigned char> compressed;
+
+		// only worth it if we save a decent amount, otherwise we'd decompress for nothing
+		if (tissuestack::imaging::TissueStackRawData::compressBrick(
+				tissuestack::imaging::DataSetSliceCache::SLICE_CODEC, data, sliceSize, compressed) &&
+			compressed.size() < sliceSize - sliceSize / 4)
+		{
+			// don't hang on to the worst case bound
+			unsigned char * shrunk = new unsigned char[compressed.size()];
+			memcpy(shrunk, compressed.data(), compressed.size());
+			delete [] data;
+			return new tissuestack::imaging::SliceCacheEntry(shrunk, compressed.size(), access_count, sliceSize);
+		}
+	}
+
+	return new tissuestack::imaging::SliceCacheEntry(data, sliceSize, access_count);
+}
+
 const long int tissuestack::imaging::DataSetSliceCache::getMostRecentCacheFailure() const
 {
 	return this->_mostRecentCacheFailure;
@@ -70,6 +144,9 @@ const bool tissuestack::imaging::DataSetSliceCache::setSlice(
 	}
 
 	this->_cache[slice] = cache_data;
+	this->_resident_bytes += cache_data->getSizeInBytes();
+	this->_uncompressed_bytes += cache_data->getUncompressedSizeInBytes();
+	tissuestack::utils::MemoryAccounting::instance()->addCacheBytes(cache_data->getSizeInBytes());
 
 	return true;
 }
@@ -95,7 +172,11 @@ void tissuestack::imaging::DataSetSliceCache::eraseSlice(const unsigned long int
 
 	if (this->_cache[slice])
 	{
+		const unsigned long long int sizeInBytes = this->_cache[slice]->getSizeInBytes();
+		this->_resident_bytes -= sizeInBytes;
+		this->_uncompressed_bytes -= this->_cache[slice]->getUncompressedSizeInBytes();
 		delete this->_cache[slice];
 		this->_cache[slice] = nullptr;
+		tissuestack::utils::MemoryAccounting::instance()->removeCacheBytes(sizeInBytes);
 	}
 }
@@ -36,14 +36,6 @@ tissuestack::imaging::NoCacheAdapter::~NoCacheAdapter()
 		delete this->_uncached_extraction;
 }
 
-Image * tissuestack::imaging::NoCacheAdapter::applyPostExtractionTasks(
-		Image * img,
-		const tissuestack::imaging::TissueStackRawData * image,
-		const tissuestack::networking::TissueStackImageRequest * request) const
-{
-	return this->_uncached_extraction->applyPostExtractionTasks(img, image, request);
-}
-
 
 const std::array<unsigned long long int, 3> tissuestack::imaging::NoCacheAdapter::performQuery(
 	const tissuestack::common::ProcessingStrategy * processing_strategy,
@@ -58,6 +50,10 @@ const std::array<unsigned long long int, 3> tissuestack::imaging::NoCacheAdapter
 		THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
 			"Image Query: Coordinate (x/y) exceeds the width/height of the image slice!");
 
+	// bricked raws read the voxel's brick rather than a whole slice
+	if (image->isBricked())
+		return this->_uncached_extraction->performQuery(processing_strategy, image, request);
+
 	const unsigned char * cache_data = this->_uncached_extraction->extractImageOnly(image, request);
 	if (cache_data == nullptr)
 		THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
@@ -66,7 +62,7 @@ const std::array<unsigned long long int, 3> tissuestack::imaging::NoCacheAdapter
 	std::array<unsigned long long int, 3> pixel_value;
 	if ((image->getRawVersion() == tissuestack::imaging::RAW_FILE_VERSION::LEGACY &&
 			image->getFormat() == tissuestack::imaging::FORMAT::RAW) ||
-			image->getRawVersion() == tissuestack::imaging::RAW_FILE_VERSION::V1)
+			image->getRawVersion() != tissuestack::imaging::RAW_FILE_VERSION::LEGACY)
 	{
 		unsigned long long int multiplier = 1;
 		if (image->getType() != tissuestack::imaging::RAW_TYPE::UCHAR_8_BIT)
@@ -79,9 +75,10 @@ const std::array<unsigned long long int, 3> tissuestack::imaging::NoCacheAdapter
 						request->getYCoordinate())*actualDimension->getWidth()*multiplier +
 					static_cast<unsigned long long int>(request->getXCoordinate()*multiplier));
 
+		// single channel data is gray: all three are the same
 		pixel_value[0] = static_cast<unsigned long long int>(cache_data[actualOffset]);
-		pixel_value[1] = static_cast<unsigned long long int>(cache_data[actualOffset+1]);
-		pixel_value[2] = static_cast<unsigned long long int>(cache_data[actualOffset+2]);
+		pixel_value[1] = static_cast<unsigned long long int>(cache_data[actualOffset+(multiplier == 3 ? 1 : 0)]);
+		pixel_value[2] = static_cast<unsigned long long int>(cache_data[actualOffset+(multiplier == 3 ? 2 : 0)]);
 	} else
 	{
 		Image * img =
@@ -112,24 +109,88 @@ const std::array<unsigned long long int, 3> tissuestack::imaging::NoCacheAdapter
 	return pixel_value;
 }
 
-const Image *  tissuestack::imaging::NoCacheAdapter::extractImage(
+const std::vector<unsigned char> tissuestack::imaging::NoCacheAdapter::performBatchQuery(
 	const tissuestack::common::ProcessingStrategy * processing_strategy,
-	const TissueStackRawData * image,
+	const tissuestack::imaging::TissueStackRawData * image,
+	const tissuestack::networking::TissueStackBatchQueryRequest * request) const
+{
+	return this->_uncached_extraction->performBatchQuery(processing_strategy, image, request);
+}
+
+const std::vector<unsigned long long int> tissuestack::imaging::NoCacheAdapter::computeHistograms(
+	const tissuestack::common::ProcessingStrategy * processing_strategy,
+	const tissuestack::imaging::TissueStackRawData * image,
+	const tissuestack::networking::TissueStackStatisticsRequest * request) const
+{
+	return this->_uncached_extraction->computeHistograms(image, request);
+}
+
+const std::shared_ptr<const std::vector<unsigned char> > tissuestack::imaging::NoCacheAdapter::findBlankTile(
+	const tissuestack::common::ProcessingStrategy * processing_strategy,
+	const tissuestack::imaging::TissueStackRawData * image,
 	const tissuestack::networking::TissueStackImageRequest * request) const
 {
+	return this->_uncached_extraction->findBlankTile(image, request);
+}
+
+const unsigned char * tissuestack::imaging::NoCacheAdapter::encodeImage(
+	const tissuestack::common::ProcessingStrategy * processing_strategy,
+	const TissueStackRawData * image,
+	const tissuestack::networking::TissueStackImageRequest * request,
+	unsigned long long int & length) const
+{
+	// zoomed out views are served from the pyramid levels if the raw has them
+	const unsigned char * fromPyramid =
+		this->_uncached_extraction->encodeImageFromPyramid(image, request, length);
+	if (fromPyramid != nullptr)
+		return fromPyramid;
+
+	// bricked raws only read the bricks the tile touches
+	if (image->isBricked())
+		return this->_uncached_extraction->encodeImageFromBricks(image, request, length);
+
 	const unsigned char * cache_data = this->_uncached_extraction->extractImageOnly(image, request);
 	if (cache_data == nullptr)
 		THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
 			"Could not extract image data");
 
-	const tissuestack::imaging::TissueStackDataDimension * actualDimension =
-			image->getDimensionByLongName(request->getDimensionName());
+	const std::unique_ptr<const unsigned char[]> data(cache_data);
 
-	const Image * img =
-		this->_uncached_extraction->createImageFromDataRead(image, actualDimension, cache_data);
+	return this->_uncached_extraction->encodeImage(image, request, data.get(), length);
+}
 
-	delete [] cache_data;
+const unsigned char * tissuestack::imaging::NoCacheAdapter::encodeObliqueImage(
+	const tissuestack::common::ProcessingStrategy * processing_strategy,
+	const TissueStackRawData * image,
+	const tissuestack::networking::TissueStackObliqueRequest * request,
+	unsigned long long int & length) const
+{
+	// oblique planes span many slices: there is nothing in the slice cache for them
+	return this->_uncached_extraction->encodeObliqueImage(image, request, length);
+}
+
+const unsigned char * tissuestack::imaging::NoCacheAdapter::encodeProjectionImage(
+	const tissuestack::common::ProcessingStrategy * processing_strategy,
+	const TissueStackRawData * image,
+	const tissuestack::networking::TissueStackProjectionRequest * request,
+	unsigned long long int & length) const
+{
+	return this->_uncached_extraction->encodeProjectionImage(image, request, length);
+}
 
-	return img;
+const unsigned char * tissuestack::imaging::NoCacheAdapter::encodeCompositeImage(
+	const tissuestack::common::ProcessingStrategy * processing_strategy,
+	const std::vector<const TissueStackRawData *> & images,
+	const tissuestack::networking::TissueStackImageRequest * request,
+	unsigned long long int & length) const
+{
+	std::vector<std::unique_ptr<const unsigned char[]> > slices;
+	std::vector<const unsigned char *> data;
+	for (auto image : images)
+	{
+		slices.push_back(std::unique_ptr<const unsigned char[]>(this->_uncached_extraction->extractImageOnly(image, request)));
+		data.push_back(slices.back().get());
+	}
 
+	return this->_uncached_extraction->encodeCompositeImage(images, request, data, length);
 }
@@ -0,0 +1,98 @@
+/*
+ * This file is part of TissueStack.
+ *
+ * TissueStack is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TissueStack is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TissueStack.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "networking.h"
+#include "imaging.h"
+
+tissuestack::imaging::PixelBuffer::PixelBuffer(
+	const unsigned int width, const unsigned int height, const unsigned short channels) :
+		_width(width < 1 ? 1 : width), _height(height < 1 ? 1 : height), _channels(channels == 1 ? 1 : 3)
+{
+	this->_data = new unsigned char[this->getSizeInBytes()];
+}
+
+tissuestack::imaging::PixelBuffer::~PixelBuffer()
+{
+	if (this->_data)
+		delete [] this->_data;
+}
+
+tissuestack::imaging::PixelBuffer * tissuestack::imaging::PixelBuffer::clone() const
+{
+	tissuestack::imaging::PixelBuffer * copy =
+		new tissuestack::imaging::PixelBuffer(this->_width, this->_height, this->_channels);
+	memcpy(copy->getData(), this->_data, this->getSizeInBytes());
+
+	return copy;
+}
+
+Image * tissuestack::imaging::PixelBuffer::toImage() const
+{
+	ExceptionInfo exception;
+	GetExceptionInfo(&exception);
+
+	// graphics magick copies the pixels, we keep ownership of ours
+	Image * img = ConstituteImage(
+		this->_width,
+		this->_height,
+		this->_channels == 1 ? "I" : "RGB",
+		CharPixel,
+		this->_data, &exception);
+
+	if (img == NULL)
+	{
+		CatchException(&exception);
+		THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
+			"Could not constitute Image!");
+	}
+
+	return img;
+}
+
+const unsigned int tissuestack::imaging::PixelBuffer::getWidth() const
+{
+	return this->_width;
+}
+
+const unsigned int tissuestack::imaging::PixelBuffer::getHeight() const
+{
+	return this->_height;
+}
+
+const unsigned short tissuestack::imaging::PixelBuffer::getChannels() const
+{
+	return this->_channels;
+}
+
+const unsigned long long int tissuestack::imaging::PixelBuffer::getRowLength() const
+{
+	return static_cast<unsigned long long int>(this->_width) * static_cast<unsigned long long int>(this->_channels);
+}
+
+const unsigned long long int tissuestack::imaging::PixelBuffer::getSizeInBytes() const
+{
+	return this->getRowLength() * static_cast<unsigned long long int>(this->_height);
+}
+
+unsigned char * tissuestack::imaging::PixelBuffer::getData() const
+{
+	return this->_data;
+}
+
+unsigned char * tissuestack::imaging::PixelBuffer::getRow(const unsigned int row) const
+{
+	return this->_data + static_cast<unsigned long long int>(row) * this->getRowLength();
+}
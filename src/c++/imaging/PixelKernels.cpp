@@ -0,0 +1,618 @@
+/*
+ * This file is part of TissueStack.
+ *
+ * TissueStack is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TissueStack is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TissueStack.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "networking.h"
+#include "imaging.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+	#include <immintrin.h>
+	#define TISSUESTACK_X86_KERNELS
+#endif
+
+namespace
+{
+	typedef void (*ReduceRowsFunction)(const unsigned char *, unsigned char *, const unsigned long long int);
+	typedef void (*AccumulateRowsFunction)(const unsigned char *, unsigned int *, const unsigned long long int);
+
+	void maximumRowsScalar(const unsigned char * source, unsigned char * accumulator, const unsigned long long int length)
+	{
+		for (unsigned long long int i=0;i<length;i++)
+			if (source[i] > accumulator[i])
+				accumulator[i] = source[i];
+	}
+
+	void minimumRowsScalar(const unsigned char * source, unsigned char * accumulator, const unsigned long long int length)
+	{
+		for (unsigned long long int i=0;i<length;i++)
+			if (source[i] < accumulator[i])
+				accumulator[i] = source[i];
+	}
+
+	void accumulateRowsScalar(const unsigned char * source, unsigned int * sums, const unsigned long long int length)
+	{
+		for (unsigned long long int i=0;i<length;i++)
+			sums[i] += source[i];
+	}
+
+#ifdef TISSUESTACK_X86_KERNELS
+	void maximumRowsSSE2(const unsigned char * source, unsigned char * accumulator, const unsigned long long int length)
+	{
+		unsigned long long int i = 0;
+		for (;i+16<=length;i+=16)
+			_mm_storeu_si128(
+				reinterpret_cast<__m128i *>(accumulator + i),
+				_mm_max_epu8(
+					_mm_loadu_si128(reinterpret_cast<const __m128i *>(source + i)),
+					_mm_loadu_si128(reinterpret_cast<const __m128i *>(accumulator + i))));
+
+		if (i < length)
+			maximumRowsScalar(source + i, accumulator + i, length - i);
+	}
+
+	void minimumRowsSSE2(const unsigned char * source, unsigned char * accumulator, const unsigned long long int length)
+	{
+		unsigned long long int i = 0;
+		for (;i+16<=length;i+=16)
+			_mm_storeu_si128(
+				reinterpret_cast<__m128i *>(accumulator + i),
+				_mm_min_epu8(
+					_mm_loadu_si128(reinterpret_cast<const __m128i *>(source + i)),
+					_mm_loadu_si128(reinterpret_cast<const __m128i *>(accumulator + i))));
+
+		if (i < length)
+			minimumRowsScalar(source + i, accumulator + i, length - i);
+	}
+
+	void accumulateRowsSSE2(const unsigned char * source, unsigned int * sums, const unsigned long long int length)
+	{
+		const __m128i zero = _mm_setzero_si128();
+
+		unsigned long long int i = 0;
+		for (;i+16<=length;i+=16)
+		{
+			// widen 16 bytes to 4 x 4 unsigned ints
+			const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(source + i));
+			const __m128i low = _mm_unpacklo_epi8(bytes, zero);
+			const __m128i high = _mm_unpackhi_epi8(bytes, zero);
+			const __m128i words[4] =
+			{
+				_mm_unpacklo_epi16(low, zero), _mm_unpackhi_epi16(low, zero),
+				_mm_unpacklo_epi16(high, zero), _mm_unpackhi_epi16(high, zero)
+			};
+			for (unsigned short w=0;w<4;w++)
+			{
+				__m128i * sum = reinterpret_cast<__m128i *>(sums + i + w * 4);
+				_mm_storeu_si128(sum, _mm_add_epi32(_mm_loadu_si128(sum), words[w]));
+			}
+		}
+
+		if (i < length)
+			accumulateRowsScalar(source + i, sums + i, length - i);
+	}
+
+	__attribute__((target("avx2")))
+	void maximumRowsAVX2(const unsigned char * source, unsigned char * accumulator, const unsigned long long int length)
+	{
+		unsigned long long int i = 0;
+		for (;i+32<=length;i+=32)
+			_mm256_storeu_si256(
+				reinterpret_cast<__m256i *>(accumulator + i),
+				_mm256_max_epu8(
+					_mm256_loadu_si256(reinterpret_cast<const __m256i *>(source + i)),
+					_mm256_loadu_si256(reinterpret_cast<const __m256i *>(accumulator + i))));
+
+		if (i < length)
+			maximumRowsSSE2(source + i, accumulator + i, length - i);
+	}
+
+	__attribute__((target("avx2")))
+	void minimumRowsAVX2(const unsigned char * source, unsigned char * accumulator, const unsigned long long int length)
+	{
+		unsigned long long int i = 0;
+		for (;i+32<=length;i+=32)
+			_mm256_storeu_si256(
+				reinterpret_cast<__m256i *>(accumulator + i),
+				_mm256_min_epu8(
+					_mm256_loadu_si256(reinterpret_cast<const __m256i *>(source + i)),
+					_mm256_loadu_si256(reinterpret_cast<const __m256i *>(accumulator + i))));
+
+		if (i < length)
+			minimumRowsSSE2(source + i, accumulator + i, length - i);
+	}
+
+	__attribute__((target("avx2")))
+	void accumulateRowsAVX2(const unsigned char * source, unsigned int * sums, const unsigned long long int length)
+	{
+		unsigned long long int i = 0;
+		for (;i+8<=length;i+=8)
+		{
+			// 8 bytes widened straight to 8 unsigned ints
+			__m256i * sum = reinterpret_cast<__m256i *>(sums + i);
+			_mm256_storeu_si256(
+				sum,
+				_mm256_add_epi32(
+					_mm256_loadu_si256(sum),
+					_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(source + i)))));
+		}
+
+		if (i < length)
+			accumulateRowsScalar(source + i, sums + i, length - i);
+	}
+#endif
+
+	struct ReductionFunctions
+	{
+		ReduceRowsFunction maximum;
+		ReduceRowsFunction minimum;
+		AccumulateRowsFunction accumulate;
+		std::string instruction_set;
+	};
+
+	const ReductionFunctions selectReductionFunctions()
+	{
+#ifdef TISSUESTACK_X86_KERNELS
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2"))
+			return { &maximumRowsAVX2, &minimumRowsAVX2, &accumulateRowsAVX2, "AVX2 reductions" };
+		if (__builtin_cpu_supports("sse2"))
+			return { &maximumRowsSSE2, &minimumRowsSSE2, &accumulateRowsSSE2, "SSE2 reductions" };
+#endif
+		return { &maximumRowsScalar, &minimumRowsScalar, &accumulateRowsScalar, "SCALAR reductions" };
+	}
+
+	const ReductionFunctions & getReductionFunctions()
+	{
+		// initialized once (thread safe as of C++11)
+		static const ReductionFunctions selected = selectReductionFunctions();
+		return selected;
+	}
+}
+
+namespace
+{
+	typedef void (*LookupFunction)(const unsigned char *, unsigned char *, const unsigned long long int, const unsigned char *);
+	typedef void (*ShuffleBlocksFunction)(
+		const unsigned char *, unsigned char *, const unsigned char *, const unsigned long long int *, const unsigned long long int);
+
+	void lookupScalar(
+		const unsigned char * source,
+		unsigned char * destination,
+		const unsigned long long int length,
+		const unsigned char * table)
+	{
+		unsigned long long int i = 0;
+		for (;i+4<=length;i+=4)
+		{
+			destination[i] = table[source[i]];
+			destination[i+1] = table[source[i+1]];
+			destination[i+2] = table[source[i+2]];
+			destination[i+3] = table[source[i+3]];
+		}
+		for (;i<length;i++)
+			destination[i] = table[source[i]];
+	}
+
+	// every output byte comes from the 16 bytes at its block's start, as given by the block's shuffle mask
+	void shuffleBlocksScalar(
+		const unsigned char * source,
+		unsigned char * destination,
+		const unsigned char * masks,
+		const unsigned long long int * starts,
+		const unsigned long long int number_of_blocks)
+	{
+		for (unsigned long long int b=0;b<number_of_blocks;b++)
+			for (unsigned short i=0;i<16;i++)
+				destination[b*16+i] = source[starts[b] + masks[b*16+i]];
+	}
+
+#ifdef TISSUESTACK_X86_KERNELS
+	// with byte permutes across 128 entries the whole table takes 2 permutes and a blend on the index's top bit
+	__attribute__((target("avx512f,avx512bw,avx512vbmi")))
+	void lookupAVX512(
+		const unsigned char * source,
+		unsigned char * destination,
+		const unsigned long long int length,
+		const unsigned char * table)
+	{
+		const __m512i quarter0 = _mm512_loadu_si512(table);
+		const __m512i quarter1 = _mm512_loadu_si512(table + 64);
+		const __m512i quarter2 = _mm512_loadu_si512(table + 128);
+		const __m512i quarter3 = _mm512_loadu_si512(table + 192);
+
+		unsigned long long int i = 0;
+		for (;i+64<=length;i+=64)
+		{
+			const __m512i index = _mm512_loadu_si512(source + i);
+			const __m512i lower = _mm512_permutex2var_epi8(quarter0, index, quarter1);
+			const __m512i upper = _mm512_permutex2var_epi8(quarter2, index, quarter3);
+			_mm512_storeu_si512(destination + i, _mm512_mask_blend_epi8(_mm512_movepi8_mask(index), lower, upper));
+		}
+
+		if (i < length)
+			lookupScalar(source + i, destination + i, length - i, table);
+	}
+
+	__attribute__((target("ssse3")))
+	void shuffleBlocksSSSE3(
+		const unsigned char * source,
+		unsigned char * destination,
+		const unsigned char * masks,
+		const unsigned long long int * starts,
+		const unsigned long long int number_of_blocks)
+	{
+		for (unsigned long long int b=0;b<number_of_blocks;b++)
+			_mm_storeu_si128(
+				reinterpret_cast<__m128i *>(destination + b * 16),
+				_mm_shuffle_epi8(
+					_mm_loadu_si128(reinterpret_cast<const __m128i *>(source + starts[b])),
+					_mm_loadu_si128(reinterpret_cast<const __m128i *>(masks + b * 16))));
+	}
+
+#endif
+
+	struct ResamplingFunctions
+	{
+		LookupFunction lookup;
+		ShuffleBlocksFunction shuffle;
+		std::string instruction_set;
+	};
+
+	const ResamplingFunctions selectResamplingFunctions()
+	{
+#ifdef TISSUESTACK_X86_KERNELS
+		__builtin_cpu_init();
+		// a lookup built from 16 byte shuffles (SSSE3/AVX2) measured no faster than the scalar one,
+		// only the 128 entry byte permutes of AVX-512 VBMI pay off
+		if (__builtin_cpu_supports("avx512vbmi"))
+			return { &lookupAVX512, &shuffleBlocksSSSE3, "AVX512VBMI lookups, SSSE3 shuffles" };
+		if (__builtin_cpu_supports("ssse3"))
+			return { &lookupScalar, &shuffleBlocksSSSE3, "SCALAR lookups, SSSE3 shuffles" };
+#endif
+		return { &lookupScalar, &shuffleBlocksScalar, "SCALAR lookups, SCALAR shuffles" };
+	}
+
+	const ResamplingFunctions & getResamplingFunctions()
+	{
+		static const ResamplingFunctions selected = selectResamplingFunctions();
+		return selected;
+	}
+
+	// output bytes in blocks of 16 whose sources lie within 16 bytes of each other (upsampling) are shuffled
+	// into place, the rest (downsampling) is gathered byte by byte. offsets are the source byte of every output byte
+	struct ShufflePlan
+	{
+		std::vector<unsigned char> masks;
+		std::vector<unsigned long long int> starts;
+		unsigned long long int number_of_blocks = 0;
+	};
+
+	const ShufflePlan planShuffle(
+		const std::vector<unsigned long long int> & offsets,
+		const unsigned long long int source_length)
+	{
+		ShufflePlan plan;
+		if (source_length < 16)
+			return plan;
+
+		const unsigned long long int numberOfBlocks = offsets.size() / 16;
+		plan.masks.resize(numberOfBlocks * 16);
+		plan.starts.resize(numberOfBlocks);
+		for (unsigned long long int b=0;b<numberOfBlocks;b++)
+		{
+			// channels of a repeated pixel go back and forth, the span has to be taken over the whole block
+			const auto span = std::minmax_element(offsets.begin() + b * 16, offsets.begin() + b * 16 + 16);
+			if (*span.second - *span.first >= 16)
+				return ShufflePlan();
+
+			// the 16 bytes loaded must not reach past the row
+			const unsigned long long int start = std::min(*span.first, source_length - 16);
+			plan.starts[b] = start;
+			for (unsigned short i=0;i<16;i++)
+				plan.masks[b*16+i] = static_cast<unsigned char>(offsets[b*16+i] - start);
+		}
+		plan.number_of_blocks = numberOfBlocks;
+
+		return plan;
+	}
+}
+
+const std::string tissuestack::imaging::PixelKernels::getInstructionSet()
+{
+	// what the dispatches picked for this cpu
+	return getResamplingFunctions().instruction_set + ", " + getReductionFunctions().instruction_set;
+}
+
+const unsigned int tissuestack::imaging::PixelKernels::getNearestSampleOffset(
+	const unsigned int position,
+	const unsigned int source_length,
+	const unsigned int destination_length)
+{
+	if (source_length == destination_length)
+		return position;
+
+	// same sampling points as graphics magick's SampleImage to give identical results
+	const unsigned int offset =
+		static_cast<unsigned int>(
+			(static_cast<double>(position) + 0.5) * source_length / destination_length);
+
+	return offset >= source_length ? source_length - 1 : offset;
+}
+
+void tissuestack::imaging::PixelKernels::buildWindowLevelTable(
+	unsigned char table[256],
+	const unsigned short minimum,
+	const unsigned short maximum,
+	const unsigned short dataset_min,
+	const unsigned short dataset_max)
+{
+	const float contrast_min = static_cast<float>(minimum);
+	const float contrast_max = static_cast<float>(maximum);
+
+	for (unsigned int i=0;i<256;i++)
+	{
+		const float val = static_cast<float>(i);
+
+		if (val <= contrast_min)
+			table[i] = static_cast<unsigned char>(dataset_min);
+		else if (val >= contrast_max)
+			table[i] = static_cast<unsigned char>(dataset_max);
+		else
+			table[i] =
+				static_cast<unsigned char>(
+					lround(((val - contrast_min) / (contrast_max - contrast_min))
+						* static_cast<float>(dataset_max - dataset_min)));
+	}
+}
+
+void tissuestack::imaging::PixelKernels::applyLookupTable(
+	const unsigned char * source,
+	unsigned char * destination,
+	const unsigned long long int length,
+	const unsigned char table[256])
+{
+	getResamplingFunctions().lookup(source, destination, length, table);
+}
+
+void tissuestack::imaging::PixelKernels::applyColorLookupTable(
+	const unsigned char * source,
+	const unsigned short source_channels,
+	unsigned char * destination,
+	const unsigned long long int number_of_pixels,
+	const unsigned char table[256][3])
+{
+	// the first (red/gray) channel is the index, for in place application source and destination need 3 channels
+	unsigned long long int i = 0;
+	if (number_of_pixels >= 256)
+	{
+		// one 4 byte store per pixel, the next pixel overwrites the spare byte. the last one gets 3
+		unsigned int packed[256];
+		memset(packed, 0, sizeof(packed));
+		for (unsigned short v=0;v<256;v++)
+			memcpy(packed + v, table[v], 3);
+		// the index of the next pixel is read before the spare byte lands on it (in place application)
+		unsigned char index = source[0];
+		for (;i+1<number_of_pixels;i++)
+		{
+			const unsigned char next = source[(i + 1) * source_channels];
+			memcpy(destination + i * 3, packed + index, 4);
+			index = next;
+		}
+		memcpy(destination + i * 3, table[index], 3);
+		i++;
+	}
+	for (;i<number_of_pixels;i++)
+	{
+		const unsigned char * rgb = table[source[i * source_channels]];
+		unsigned char * out = destination + i * 3;
+		out[0] = rgb[0];
+		out[1] = rgb[1];
+		out[2] = rgb[2];
+	}
+}
+
+void tissuestack::imaging::PixelKernels::resampleNearest(
+	const unsigned char * source,
+	const unsigned int source_width,
+	const unsigned int source_height,
+	const unsigned short channels,
+	unsigned char * destination,
+	const unsigned int destination_width,
+	const unsigned int destination_height)
+{
+	if (source_width == 0 || source_height == 0 || destination_width == 0 || destination_height == 0)
+		return;
+
+	std::vector<unsigned long long int> xOffsets(destination_width);
+	for (unsigned int x=0;x<destination_width;x++)
+		xOffsets[x] =
+			static_cast<unsigned long long int>(
+				tissuestack::imaging::PixelKernels::getNearestSampleOffset(x, source_width, destination_width)) * channels;
+
+	const unsigned long long int destinationRowLength =
+		static_cast<unsigned long long int>(destination_width) * channels;
+	const unsigned long long int sourceRowLength =
+		static_cast<unsigned long long int>(source_width) * channels;
+
+	// upsampled rows are shuffled together 16 bytes at a time
+	std::vector<unsigned long long int> byteOffsets(destinationRowLength);
+	for (unsigned long long int i=0;i<destinationRowLength;i++)
+		byteOffsets[i] = xOffsets[i / channels] + i % channels;
+	const ShufflePlan plan = planShuffle(byteOffsets, sourceRowLength);
+	const ShuffleBlocksFunction shuffle = getResamplingFunctions().shuffle;
+
+	long long int previousRow = -1;
+	for (unsigned int y=0;y<destination_height;y++)
+	{
+		const long long int row =
+			tissuestack::imaging::PixelKernels::getNearestSampleOffset(y, source_height, destination_height);
+
+		unsigned char * out = destination + y * destinationRowLength;
+
+		// upscaling repeats rows: copy the one we've already done
+		if (row == previousRow)
+		{
+			memcpy(out, out - destinationRowLength, destinationRowLength);
+			continue;
+		}
+
+		const unsigned char * in = source + row * sourceRowLength;
+		if (plan.number_of_blocks > 0)
+		{
+			shuffle(in, out, plan.masks.data(), plan.starts.data(), plan.number_of_blocks);
+			for (unsigned long long int i=plan.number_of_blocks*16;i<destinationRowLength;i++)
+				out[i] = in[byteOffsets[i]];
+		} else if (channels == 1)
+			for (unsigned int x=0;x<destination_width;x++)
+				out[x] = in[xOffsets[x]];
+		else
+			for (unsigned int x=0;x<destination_width;x++)
+			{
+				const unsigned char * pixel = in + xOffsets[x];
+				out[x*3] = pixel[0];
+				out[x*3+1] = pixel[1];
+				out[x*3+2] = pixel[2];
+			}
+		previousRow = row;
+	}
+}
+
+void tissuestack::imaging::PixelKernels::crop(
+	const unsigned char * source,
+	const unsigned int source_width,
+	const unsigned short channels,
+	const unsigned int x,
+	const unsigned int y,
+	const unsigned int width,
+	const unsigned int height,
+	unsigned char * destination)
+{
+	const unsigned long long int sourceRowLength =
+		static_cast<unsigned long long int>(source_width) * channels;
+	const unsigned long long int destinationRowLength =
+		static_cast<unsigned long long int>(width) * channels;
+
+	for (unsigned int row=0;row<height;row++)
+		memcpy(
+			destination + row * destinationRowLength,
+			source + (static_cast<unsigned long long int>(y) + row) * sourceRowLength + static_cast<unsigned long long int>(x) * channels,
+			destinationRowLength);
+}
+
+void tissuestack::imaging::PixelKernels::flipVertically(
+	unsigned char * data,
+	const unsigned int width,
+	const unsigned int height,
+	const unsigned short channels)
+{
+	// nothing to flip, and height - 1 must not wrap around
+	if (height < 2)
+		return;
+
+	const unsigned long long int rowLength =
+		static_cast<unsigned long long int>(width) * channels;
+	std::vector<unsigned char> tmp(rowLength);
+
+	for (unsigned int top=0, bottom=height-1;top<bottom;top++, bottom--)
+	{
+		memcpy(tmp.data(), data + top * rowLength, rowLength);
+		memcpy(data + top * rowLength, data + bottom * rowLength, rowLength);
+		memcpy(data + bottom * rowLength, tmp.data(), rowLength);
+	}
+}
+
+void tissuestack::imaging::PixelKernels::maximumRows(
+	const unsigned char * source,
+	unsigned char * accumulator,
+	const unsigned long long int length)
+{
+	getReductionFunctions().maximum(source, accumulator, length);
+}
+
+void tissuestack::imaging::PixelKernels::minimumRows(
+	const unsigned char * source,
+	unsigned char * accumulator,
+	const unsigned long long int length)
+{
+	getReductionFunctions().minimum(source, accumulator, length);
+}
+
+void tissuestack::imaging::PixelKernels::accumulateRows(
+	const unsigned char * source,
+	unsigned int * sums,
+	const unsigned long long int length)
+{
+	getReductionFunctions().accumulate(source, sums, length);
+}
+
+void tissuestack::imaging::PixelKernels::countValues(
+	const unsigned char * source,
+	const unsigned short channels,
+	const unsigned long long int number_of_pixels,
+	unsigned int * counts)
+{
+	if (channels != 1 || number_of_pixels < 1024)
+	{
+		// the channels interleave: consecutive increments hit different tables anyway.
+		// short runs do not make up for setting up and merging the banks below
+		for (unsigned long long int i=0;i<number_of_pixels;i++)
+			for (unsigned short c=0;c<channels;c++)
+				counts[c * 256 + source[i * channels + c]]++;
+		return;
+	}
+
+	// byte histograms do not vectorize: 4 banks keep runs of equal values from stalling on the same counter
+	unsigned int banks[3][256];
+	memset(banks, 0, sizeof(banks));
+
+	unsigned long long int i = 0;
+	for (;i+4<=number_of_pixels;i+=4)
+	{
+		counts[source[i]]++;
+		banks[0][source[i+1]]++;
+		banks[1][source[i+2]]++;
+		banks[2][source[i+3]]++;
+	}
+	for (;i<number_of_pixels;i++)
+		counts[source[i]]++;
+
+	for (unsigned short v=0;v<256;v++)
+		counts[v] += banks[0][v] + banks[1][v] + banks[2][v];
+}
+
+void tissuestack::imaging::PixelKernels::markLabelBoundaries(
+	const unsigned short * labels,
+	const unsigned int width,
+	const unsigned int height,
+	unsigned char * boundaries)
+{
+	for (unsigned int y=0;y<height;y++)
+	{
+		const unsigned short * row = labels + static_cast<unsigned long long int>(y) * width;
+		const unsigned short * above = y > 0 ? row - width : row;
+		const unsigned short * below = y+1 < height ? row + width : row;
+		unsigned char * out = boundaries + static_cast<unsigned long long int>(y) * width;
+
+		// the border pixels compare against themselves where a neighbor is missing
+		for (unsigned int x=0;x<width;x++)
+		{
+			const unsigned short label = row[x];
+			const unsigned short left = row[x > 0 ? x-1 : x];
+			const unsigned short right = row[x+1 < width ? x+1 : x];
+			out[x] =
+				(label != 0 && ((left ^ label) | (right ^ label) | (above[x] ^ label) | (below[x] ^ label)) != 0) ? 255 : 0;
+		}
+	}
+}
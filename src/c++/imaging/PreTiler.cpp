@@ -187,18 +187,15 @@ inline void tissuestack::imaging::PreTiler::loopOverDimensions(
 			if (this->hasBeenCancelledOrShutDown(processing_strategy, pretiling_task))
 				return;
 
-			Image * img =
+			std::unique_ptr<tissuestack::imaging::PixelBuffer> img(
 				this->_extractor->extractImageForPreTiling(
 					static_cast<const tissuestack::imaging::TissueStackRawData *>(pretiling_task->getInputImageData()),
 					actualDimension,
-					sliceNumber);
+					sliceNumber));
 
 			// shutdown/cancellation check
 			if (this->hasBeenCancelledOrShutDown(processing_strategy, pretiling_task))
-			{
-				DestroyImage(img);
 				return;
-			}
 
 			if (img)
 			{
@@ -223,43 +220,25 @@ inline void tissuestack::imaging::PreTiler::loopOverDimensions(
 
 					if (!tissuestack::utils::System::directoryExists(subDir) &&
 						!tissuestack::utils::System::createDirectory(subDir, 0755))
-					{
-						DestroyImage(img);
-							THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
-								"Could not create tiling sub directory!");
-					}
+						THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
+							"Could not create tiling sub directory!");
 
 					// apply zoom and colormap if necessary
 					unsigned long int width = actualDimension->getAnisotropicWidth();
 					unsigned long int height = actualDimension->getAnisotropicHeight();
 
-					ExceptionInfo exception;
-					GetExceptionInfo(&exception);
-					Image * img_processed =
-						CloneImage(img, 0, 0, 1, &exception);
-					if (img_processed == NULL)
-					{
-						DestroyImage(img);
-							THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
-								"Could not clone image for processsing!");
-					}
-
-					img_processed =
+					std::unique_ptr<tissuestack::imaging::PixelBuffer> img_processed(
 						this->_extractor->applyPreTilingProcessing(
-							img_processed,
+							img->clone(),
 							pretiling_task->getColorMap(),
 							width,
 							height,
 							pretiling_task->getInputImageData()->getZoomLevels()[zoom]
-					);
+					));
 
 					// shutdown/cancellation check
 					if (this->hasBeenCancelledOrShutDown(processing_strategy, pretiling_task))
-					{
-						DestroyImage(img);
-						DestroyImage(img_processed);
 						return;
-					}
 
 					// chop up into tiles first
 					// the x/y loop
@@ -284,7 +263,7 @@ inline void tissuestack::imaging::PreTiler::loopOverDimensions(
 						{
 							Image * tile =
 								this->_extractor->getImageTileForPreTiling(
-									img_processed, x, y, pretiling_task->getSquareLength());
+									img_processed.get(), x, y, pretiling_task->getSquareLength());
 							if (tile)
 							{
 								this->writeImageToFile(
@@ -303,21 +282,17 @@ inline void tissuestack::imaging::PreTiler::loopOverDimensions(
 
 					// shutdown/cancellation check
 					if (this->hasBeenCancelledOrShutDown(processing_strategy, pretiling_task))
-					{
-						DestroyImage(img);
-						DestroyImage(img_processed);
 						return;
-					}
 
 					// generate preview last
-					img_processed =
+					img_processed.reset(
 						this->_extractor->degradeImage(
-							img_processed,
+							img_processed.get(),
 							width,
 							height,
-							0.05);
+							0.05));
 					this->writeImageToFile(
-						img_processed,
+						img_processed->toImage(),
 						subDir,
 						sliceNumber,
 						pretiling_task->getColorMap(),
@@ -342,18 +317,11 @@ inline void tissuestack::imaging::PreTiler::loopOverDimensions(
 								<< std::to_string(pretiling_task->getProgress()) << "%\r" << std::flush;
 
 						if (finished)
-						{
-							if (img) DestroyImage(img);
 							return;
-						}
 					} else
-					{
-						if (img) DestroyImage(img);
 						return;
-					}
 				}
 			}
-			if (img) DestroyImage(img);
 		}
 
 	}
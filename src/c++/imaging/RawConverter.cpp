@@ -145,8 +145,36 @@ void tissuestack::imaging::RawConverter::convert(
 			return;
 		}
 
+		// the raw is complete: gray data is rewritten with one byte per voxel
+		close(this->_file_descriptor);
+		this->_file_descriptor = -1;
+		if ((processing_strategy->isOnlineStrategy() || dimension.empty() ||
+				converter_task->getInputImageData()->get2DDimension() != nullptr) &&
+				tissuestack::imaging::RawConverter::compactToSingleChannel(outFile))
+		{
+			if (processing_strategy->isOnlineStrategy())
+				tissuestack::logging::TissueStackLogger::instance()->info(
+					"Stored gray data as single channel RAW: %s", outFile.c_str());
+			else
+				std::cout << "\nStored gray data as single channel RAW." << std::endl;
+		}
+
 		if (processing_strategy->isOnlineStrategy())
 		{
+			// the converter tool does the slice statistics last, the server does them here
+			try
+			{
+				const std::unique_ptr<const tissuestack::imaging::TissueStackImageData> raw(
+					tissuestack::imaging::TissueStackImageData::fromFile(outFile));
+				tissuestack::imaging::TissueStackRawStatistics::build(
+					static_cast<const tissuestack::imaging::TissueStackRawData *>(raw.get()));
+			} catch (const std::exception & bad)
+			{
+				// nothing lost, statistics are computed from the voxels then
+				tissuestack::logging::TissueStackLogger::instance()->error(
+					"Failed to compute slice statistics for %s: %s", outFile.c_str(), bad.what());
+			}
+
 			tissuestack::services::TissueStackTaskQueue::instance()->flagTaskAsFinished(
 				ptr_converter_task.release()->getId());
 
@@ -186,6 +214,329 @@ void tissuestack::imaging::RawConverter::convert(
 	}
 }
 
+const bool tissuestack::imaging::RawConverter::compactToSingleChannel(const std::string & raw_file)
+{
+	unsigned long long int dataStart = 0;
+	unsigned long long int fileSize = 0;
+	try
+	{
+		std::unique_ptr<const tissuestack::imaging::TissueStackImageData> data(
+			tissuestack::imaging::TissueStackImageData::fromFile(raw_file));
+		if (!data || !data->isRaw())
+			return false;
+
+		const tissuestack::imaging::TissueStackRawData * raw =
+			static_cast<const tissuestack::imaging::TissueStackRawData *>(data.get());
+		if (raw->getRawVersion() != tissuestack::imaging::RAW_FILE_VERSION::V1 ||
+				raw->getType() != tissuestack::imaging::RAW_TYPE::RGB_24BIT)
+			return false;
+
+		// the data starts where the first plane starts
+		dataStart = raw->getFileSizeInBytes();
+		for (auto dim : raw->getDimensionOrder())
+			if (raw->getDimensionByLongName(dim) != nullptr)
+				dataStart = std::min(dataStart, raw->getDimensionByLongName(dim)->getOffset());
+		fileSize = raw->getFileSizeInBytes();
+	} catch (...)
+	{
+		// not a raw we can read: nothing to compact
+		return false;
+	}
+
+	if (dataStart == 0 || dataStart >= fileSize || (fileSize - dataStart) % 3 != 0)
+		return false;
+
+	const int in = open(raw_file.c_str(), O_RDONLY);
+	if (in < 0)
+		return false;
+
+	// same header as before: V2 and the number of channels at the end
+	std::string header(dataStart, '\0');
+	if (pread(in, &header[0], dataStart, 0) != static_cast<ssize_t>(dataStart) ||
+			header.compare(0, 11, "@IaMraW@V1|") != 0 || header.find('|', 11) == std::string::npos)
+	{
+		close(in);
+		return false;
+	}
+	std::string content = header.substr(header.find('|', 11) + 1);
+	if (content.empty() || content.back() != '|')
+		content += "|";
+	content += "1|";
+	const std::string newHeader =
+		std::string("@IaMraW@V") +
+		std::to_string(tissuestack::imaging::RAW_FILE_VERSION::V2) +
+		"|" + std::to_string(content.length()) + "|" + content;
+
+	// a running server must never see a half written raw: we write next to it and swap
+	const std::string tmpFile = raw_file + ".tmp";
+	const int out = open(tmpFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (out < 0)
+	{
+		close(in);
+		return false;
+	}
+
+	bool isGray =
+		write(out, newHeader.c_str(), newHeader.length()) == static_cast<ssize_t>(newHeader.length());
+
+	// one pass: we stop at the first voxel that is not gray
+	const unsigned long long int CHUNK_SIZE = 3 * 1024 * 1024;
+	std::vector<unsigned char> rgb(CHUNK_SIZE);
+	std::vector<unsigned char> gray(CHUNK_SIZE / 3);
+	unsigned long long int position = dataStart;
+	while (isGray && position < fileSize)
+	{
+		const unsigned long long int length = std::min(CHUNK_SIZE, fileSize - position);
+		if (pread(in, rgb.data(), length, position) != static_cast<ssize_t>(length))
+		{
+			isGray = false;
+			break;
+		}
+
+		for (unsigned long long int i=0;i<length/3;i++)
+		{
+			if (rgb[i*3] != rgb[i*3+1] || rgb[i*3] != rgb[i*3+2])
+			{
+				isGray = false;
+				break;
+			}
+			gray[i] = rgb[i*3];
+		}
+
+		if (isGray && write(out, gray.data(), length/3) != static_cast<ssize_t>(length/3))
+			isGray = false;
+		position += length;
+	}
+
+	close(in);
+	close(out);
+	if (!isGray || rename(tmpFile.c_str(), raw_file.c_str()) != 0)
+	{
+		unlink(tmpFile.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+const bool tissuestack::imaging::RawConverter::convertToBricked(
+	const std::string & raw_file,
+	const unsigned short brick_edge,
+	const tissuestack::imaging::RAW_CODEC codec)
+{
+	if (brick_edge == 0)
+		return false;
+
+	// check the codec is built in before writing anything
+	if (codec != tissuestack::imaging::RAW_CODEC::UNCOMPRESSED)
+	{
+		std::vector<unsigned char> probe;
+		const std::vector<unsigned char> zeroes(4096, 0);
+		if (!tissuestack::imaging::TissueStackRawData::compressBrick(codec, zeroes.data(), zeroes.size(), probe))
+			return false;
+	}
+
+	std::unique_ptr<const tissuestack::imaging::TissueStackImageData> data;
+	const tissuestack::imaging::TissueStackRawData * raw = nullptr;
+	try
+	{
+		data.reset(tissuestack::imaging::TissueStackImageData::fromFile(raw_file));
+		if (!data || !data->isRaw())
+			return false;
+
+		// bricked raws may be bricked again (e.g. to compress them)
+		raw = static_cast<const tissuestack::imaging::TissueStackRawData *>(data.get());
+		if (raw->getRawVersion() == tissuestack::imaging::RAW_FILE_VERSION::LEGACY ||
+				raw->get2DDimension() != nullptr || raw->getDimensionOrder().size() != 3 ||
+				raw->getDimension('x') == nullptr || raw->getDimension('y') == nullptr || raw->getDimension('z') == nullptr)
+			return false;
+
+	} catch (...)
+	{
+		// not a raw we can read: nothing to brick
+		return false;
+	}
+
+	const tissuestack::imaging::TissueStackDataDimension * xDim = raw->getDimension('x');
+	const tissuestack::imaging::TissueStackDataDimension * yDim = raw->getDimension('y');
+	const tissuestack::imaging::TissueStackDataDimension * zDim = raw->getDimension('z');
+	const unsigned long long int nx = xDim->getNumberOfSlices();
+	const unsigned long long int ny = yDim->getNumberOfSlices();
+	const unsigned long long int nz = zDim->getNumberOfSlices();
+	const unsigned long long int channels = raw->getType() == tissuestack::imaging::RAW_TYPE::UCHAR_8_BIT ? 1 : 3;
+	if (zDim->getWidth() != nx || zDim->getHeight() != ny ||
+			xDim->getWidth() * xDim->getHeight() != ny * nz || yDim->getWidth() * yDim->getHeight() != nx * nz)
+		return false;
+
+	// the V1 part of the header stays: then come the channels, the brick edge, the flips and, for V4, the codec
+	char header[4096];
+	const ssize_t headerBytes =
+		pread(const_cast<tissuestack::imaging::TissueStackRawData *>(raw)->getFileDescriptor(), header, sizeof(header), 0);
+	if (headerBytes <= 0)
+		return false;
+	const std::string oldHeader(header, headerBytes);
+	std::string content = "";
+	std::string::size_type pipe = oldHeader.find('|', oldHeader.find('|') + 1);
+	for (unsigned short t=0;t<5 && pipe != std::string::npos;t++)
+	{
+		const std::string::size_type next = oldHeader.find('|', pipe + 1);
+		if (next == std::string::npos)
+			return false;
+		content += oldHeader.substr(pipe + 1, next - pipe);
+		pipe = next;
+	}
+	content += std::to_string(channels) + "|" + std::to_string(brick_edge) + "|x00y00|";
+	if (codec != tissuestack::imaging::RAW_CODEC::UNCOMPRESSED)
+		content += std::to_string(codec) + "|";
+	const std::string newHeader =
+		std::string("@IaMraW@V") +
+		std::to_string(codec == tissuestack::imaging::RAW_CODEC::UNCOMPRESSED ?
+			tissuestack::imaging::RAW_FILE_VERSION::V3 : tissuestack::imaging::RAW_FILE_VERSION::V4) +
+		"|" + std::to_string(content.length()) + "|" + content;
+
+	const unsigned long long int edge = brick_edge;
+	const unsigned long long int bricksX = (nx + edge - 1) / edge;
+	const unsigned long long int bricksY = (ny + edge - 1) / edge;
+	const unsigned long long int bricksZ = (nz + edge - 1) / edge;
+	// compressed bricks come with their length
+	const unsigned short entriesPerBrick = codec == tissuestack::imaging::RAW_CODEC::UNCOMPRESSED ? 1 : 2;
+	std::vector<unsigned long long int> index(bricksX * bricksY * bricksZ * entriesPerBrick, 0);
+
+	// a running server must never see a half written raw: we write next to it and swap
+	const std::string tmpFile = raw_file + ".tmp";
+	const int out = open(tmpFile.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (out < 0)
+		return false;
+
+	const tissuestack::imaging::UncachedImageExtraction extraction;
+	try
+	{
+		unsigned long long int position = newHeader.length() + index.size() * sizeof(unsigned long long int);
+		if (write(out, newHeader.c_str(), newHeader.length()) != static_cast<ssize_t>(newHeader.length()))
+			THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException, "Failed to write bricked RAW header!");
+
+		// one layer of bricks at a time: their z slices are read in full
+		const unsigned long long int sliceBytes = nx * ny * channels;
+		std::vector<unsigned char> layer(sliceBytes * edge);
+		std::vector<unsigned char> brick(edge * edge * edge * channels);
+		std::vector<unsigned char> compressed;
+		for (unsigned long long int bz=0;bz<bricksZ;bz++)
+		{
+			const unsigned long long int depth = std::min(edge, nz - bz * edge);
+			for (unsigned long long int k=0;k<depth;k++)
+			{
+				const std::unique_ptr<const unsigned char[]> slice(
+					extraction.extractSliceOnly(raw, zDim, static_cast<unsigned int>(bz * edge + k)));
+				memcpy(layer.data() + k * sliceBytes, slice.get(), sliceBytes);
+			}
+
+			for (unsigned long long int by=0;by<bricksY;by++)
+				for (unsigned long long int bx=0;bx<bricksX;bx++)
+				{
+					const unsigned long long int bw = std::min(edge, nx - bx * edge);
+					const unsigned long long int bh = std::min(edge, ny - by * edge);
+					const unsigned long long int rowBytes = bw * channels;
+					unsigned char * p = brick.data();
+					for (unsigned long long int k=0;k<depth;k++)
+						for (unsigned long long int j=0;j<bh;j++, p+=rowBytes)
+							memcpy(
+								p,
+								layer.data() + k * sliceBytes + ((by * edge + j) * nx + bx * edge) * channels,
+								rowBytes);
+
+					// empty bricks are not stored
+					if (std::all_of(brick.data(), p, [] (const unsigned char v) { return v == 0; }))
+						continue;
+
+					// bricks that don't shrink are stored as they are
+					const unsigned char * brickData = brick.data();
+					unsigned long long int brickBytes = p - brick.data();
+					if (codec != tissuestack::imaging::RAW_CODEC::UNCOMPRESSED &&
+							tissuestack::imaging::TissueStackRawData::compressBrick(codec, brick.data(), brickBytes, compressed))
+					{
+						brickData = compressed.data();
+						brickBytes = compressed.size();
+					}
+					if (pwrite(out, brickData, brickBytes, position) != static_cast<ssize_t>(brickBytes))
+						THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException, "Failed to write brick!");
+					const unsigned long long int entry = ((bz * bricksY + by) * bricksX + bx) * entriesPerBrick;
+					index[entry] = position;
+					if (entriesPerBrick == 2)
+						index[entry + 1] = brickBytes;
+					position += brickBytes;
+				}
+		}
+
+		const ssize_t indexBytes = static_cast<ssize_t>(index.size() * sizeof(unsigned long long int));
+		if (pwrite(out, index.data(), indexBytes, newHeader.length()) != indexBytes)
+			THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException, "Failed to write brick index!");
+
+		// the x and y planes were not necessarily written in the z plane's orientation:
+		// we compare samples of them against the bricks to find their column and row flips
+		const std::unique_ptr<const tissuestack::imaging::TissueStackImageData> brickedData(
+			tissuestack::imaging::TissueStackImageData::fromFile(tmpFile));
+		const tissuestack::imaging::TissueStackRawData * bricked =
+			static_cast<const tissuestack::imaging::TissueStackRawData *>(brickedData.get());
+		std::string flips = "x00y00";
+		for (auto plane : { xDim, yDim })
+		{
+			const unsigned long long int w = plane->getWidth();
+			const unsigned long long int h = plane->getHeight();
+			std::array<bool, 4> candidates = {{ true, true, true, true }};
+			std::vector<unsigned char> fromBricks(w * h * channels);
+			const unsigned int samples = std::min(8u, static_cast<unsigned int>(plane->getNumberOfSlices()));
+			for (unsigned int s=0;s<samples;s++)
+			{
+				const unsigned int sliceNumber =
+					static_cast<unsigned int>(static_cast<unsigned long long int>(s) * plane->getNumberOfSlices() / samples);
+				const std::unique_ptr<const unsigned char[]> original(
+					extraction.extractSliceOnly(raw, plane, sliceNumber));
+				if (!bricked->readBrickedSlice(
+						bricked->getDimension(plane->getName().at(0)), sliceNumber, 0, 0, w, h, fromBricks.data(), w * channels))
+					THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException, "Failed to read bricks back!");
+				// candidates: no flip, row flip, column flip, both
+				for (unsigned short c=0;c<4;c++)
+					for (unsigned long long int r=0;candidates[c] && r<h;r++)
+						for (unsigned long long int col=0;candidates[c] && col<w;col++)
+							candidates[c] =
+								memcmp(
+									original.get() + (r * w + col) * channels,
+									fromBricks.data() + (((c & 1) ? h - 1 - r : r) * w + ((c & 2) ? w - 1 - col : col)) * channels,
+									channels) == 0;
+			}
+
+			const auto match = std::find(candidates.begin(), candidates.end(), true);
+			if (match == candidates.end())
+				THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
+					"The planes of the RAW are not reslices of each other!");
+			const unsigned short c = static_cast<unsigned short>(match - candidates.begin());
+			const unsigned short at = plane == xDim ? 1 : 4;
+			flips[at] = (c & 2) ? '1' : '0';
+			flips[at + 1] = (c & 1) ? '1' : '0';
+		}
+
+		const ssize_t flipsPosition = static_cast<ssize_t>(newHeader.rfind("x00y00|"));
+		if (pwrite(out, flips.c_str(), flips.length(), flipsPosition) != static_cast<ssize_t>(flips.length()))
+			THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException, "Failed to write flips!");
+	} catch (const std::exception & any)
+	{
+		tissuestack::logging::TissueStackLogger::instance()->error(
+			"Could not brick RAW %s: %s\n", raw_file.c_str(), any.what());
+		close(out);
+		unlink(tmpFile.c_str());
+		return false;
+	}
+
+	close(out);
+	if (rename(tmpFile.c_str(), raw_file.c_str()) != 0)
+	{
+		unlink(tmpFile.c_str());
+		return false;
+	}
+
+	return true;
+}
+
 inline void tissuestack::imaging::RawConverter::reconstructSliceFromDicom(
 		const tissuestack::common::ProcessingStrategy * processing_strategy,
 		const tissuestack::services::TissueStackConversionTask * converter_task,
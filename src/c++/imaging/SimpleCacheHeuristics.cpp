@@ -34,6 +34,8 @@ tissuestack::imaging::SimpleCacheHeuristics::~SimpleCacheHeuristics()
 {
 	if (this->_uncached_extraction)
 		delete this->_uncached_extraction;
+	if (this->_projection_cache_size > 0 && tissuestack::utils::MemoryAccounting::doesInstanceExist())
+		tissuestack::utils::MemoryAccounting::instance()->removeCacheBytes(this->_projection_cache_size);
 }
 
 
@@ -51,25 +53,44 @@ const std::array<unsigned long long int, 3> tissuestack::imaging::SimpleCacheHeu
 			"Image Query: Coordinate (x/y) exceeds the width/height of the image slice!");
 
 	bool needsToBeAddedToCache = false;
+	bool isCopy = false;
 
 	const unsigned char * cache_data =
-		this->findCacheHit(image, request);
+		this->findCacheHit(image, request, isCopy);
 
+	// bricked raws answer a cache miss from the voxel's brick rather than a whole slice
+	if (cache_data == nullptr && image->isBricked())
+		return this->_uncached_extraction->performQuery(processing_strategy, image, request);
+
+	bool isUncachedRead = false;
 	if (cache_data == nullptr)
 	{
-		if (tissuestack::utils::System::getFreeRam() > actualDimension->getSliceSize() * 3)
-			needsToBeAddedToCache = true;
-
-		cache_data = this->_uncached_extraction->extractImageOnly(image, request);
+		const unsigned long long int sliceBytes = this->reserveMemoryForUncachedRead(image, actualDimension);
+		try
+		{
+			cache_data = this->_uncached_extraction->extractImageOnly(image, request);
+		} catch (...)
+		{
+			tissuestack::utils::MemoryAccounting::instance()->removeInFlightBytes(sliceBytes);
+			throw;
+		}
+		tissuestack::utils::MemoryAccounting::instance()->removeInFlightBytes(sliceBytes);
 		if (cache_data == nullptr)
 			THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
 					"Could not extract image data");
+		isUncachedRead = true;
+
+		// pinned data sets are resident already, a cache entry would only duplicate them
+		if (!image->isPinned() &&
+				tissuestack::utils::MemoryAccounting::instance()->canAccommodate(
+					sliceBytes, tissuestack::imaging::TissueStackSliceCache::MINIMUM_FREE_RAM_IN_BYTES))
+			needsToBeAddedToCache = true;
 	}
 
 	std::array<unsigned long long int, 3> pixel_value;
 	if ((image->getRawVersion() == tissuestack::imaging::RAW_FILE_VERSION::LEGACY &&
 			image->getFormat() == tissuestack::imaging::FORMAT::RAW) ||
-			image->getRawVersion() == tissuestack::imaging::RAW_FILE_VERSION::V1)
+			image->getRawVersion() != tissuestack::imaging::RAW_FILE_VERSION::LEGACY)
 	{
 		unsigned long long int multiplier = 1;
 		if (image->getType() != tissuestack::imaging::RAW_TYPE::UCHAR_8_BIT)
@@ -83,9 +104,10 @@ const std::array<unsigned long long int, 3> tissuestack::imaging::SimpleCacheHeu
 						static_cast<unsigned long long int>(actualDimension->getWidth())*multiplier +
 					static_cast<unsigned long long int>(request->getXCoordinate())*multiplier);
 
+		// single channel data is gray: all three are the same
 		pixel_value[0] = static_cast<unsigned long long int>(cache_data[actualOffset]);
-		pixel_value[1] = static_cast<unsigned long long int>(cache_data[actualOffset+1]);
-		pixel_value[2] = static_cast<unsigned long long int>(cache_data[actualOffset+2]);
+		pixel_value[1] = static_cast<unsigned long long int>(cache_data[actualOffset+(multiplier == 3 ? 1 : 0)]);
+		pixel_value[2] = static_cast<unsigned long long int>(cache_data[actualOffset+(multiplier == 3 ? 2 : 0)]);
 	} else
 	{
 		Image * img =
@@ -117,52 +139,194 @@ const std::array<unsigned long long int, 3> tissuestack::imaging::SimpleCacheHeu
 			image,
 			request,
 			cache_data);
+	else if (isUncachedRead || isCopy)
+		delete [] cache_data;
 
 	return pixel_value;
 }
 
-Image * tissuestack::imaging::SimpleCacheHeuristics::applyPostExtractionTasks(
-		Image * img,
-		const tissuestack::imaging::TissueStackRawData * image,
-		const tissuestack::networking::TissueStackImageRequest * request) const
+const std::vector<unsigned char> tissuestack::imaging::SimpleCacheHeuristics::performBatchQuery(
+	const tissuestack::common::ProcessingStrategy * processing_strategy,
+	const tissuestack::imaging::TissueStackRawData * image,
+	const tissuestack::networking::TissueStackBatchQueryRequest * request) const
 {
-	return this->_uncached_extraction->applyPostExtractionTasks(img, image, request);
+	const tissuestack::imaging::TissueStackDataDimension * actualDimension =
+			image->getDimensionByLongName(request->getDimensionName());
+	const std::vector<std::array<unsigned int, 3> > & points = request->getPoints();
+	const unsigned short channels = image->getType() == tissuestack::imaging::RAW_TYPE::UCHAR_8_BIT ? 1 : 3;
+	const unsigned long long int sliceBytes = actualDimension->getSliceSize() * channels;
+
+	std::vector<unsigned char> values(points.size() * channels, 0);
+	const std::vector<unsigned int> order =
+		tissuestack::imaging::UncachedImageExtraction::sortPointsBySlice(points);
+	for (unsigned int first=0, last=0;first<order.size();first=last)
+	{
+		while (last < order.size() && points[order[last]][2] == points[order[first]][2])
+			last++;
+
+		if (request->hasExpired())
+			THROW_TS_EXCEPTION(tissuestack::common::TissueStackObsoleteRequestException,
+				"Old Batch Query Request!");
+
+		const unsigned int sliceNumber = points[order[first]][2];
+		if (sliceNumber >= actualDimension->getNumberOfSlices())
+			THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
+				"Batch Query: Slice number requested is out of bounds!");
+
+		// a peek: slices we are not going to cache must not hold up other requests for them
+		bool isCopy = false;
+		const unsigned long int cacheSlice =
+			this->getCacheSliceIndex(image, request->getDimensionName(), sliceNumber);
+		const unsigned char * cache_data =
+			tissuestack::imaging::TissueStackSliceCache::instance()->findCacheEntry(
+				image->getFileName(), cacheSlice, isCopy, true);
+		if (cache_data != nullptr)
+		{
+			std::unique_ptr<const unsigned char[]> copy(isCopy ? cache_data : nullptr);
+			this->_uncached_extraction->queryPointsOfSlice(
+				image, actualDimension, points, order.data() + first, last - first, cache_data, values.data());
+			continue;
+		}
+
+		// points that come close to reading the whole slice anyway read it once for the cache
+		const bool isDense =
+			(last - first) * tissuestack::imaging::UncachedImageExtraction::BYTES_READ_PER_QUERIED_POINT >= sliceBytes;
+		if (!isDense || image->isBricked() || image->isPinned())
+		{
+			this->_uncached_extraction->queryPointsOfSlice(
+				image, actualDimension, points, order.data() + first, last - first, nullptr, values.data());
+			continue;
+		}
+
+		this->reserveMemoryForUncachedRead(image, actualDimension);
+		std::unique_ptr<const unsigned char[]> slice_data;
+		try
+		{
+			slice_data.reset(this->_uncached_extraction->extractSliceOnly(image, actualDimension, sliceNumber));
+		} catch (...)
+		{
+			tissuestack::utils::MemoryAccounting::instance()->removeInFlightBytes(sliceBytes);
+			throw;
+		}
+		tissuestack::utils::MemoryAccounting::instance()->removeInFlightBytes(sliceBytes);
+		if (!slice_data)
+			THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
+					"Could not extract image data");
+
+		this->_uncached_extraction->queryPointsOfSlice(
+			image, actualDimension, points, order.data() + first, last - first, slice_data.get(), values.data());
+
+		if (tissuestack::utils::MemoryAccounting::instance()->canAccommodate(
+				sliceBytes, tissuestack::imaging::TissueStackSliceCache::MINIMUM_FREE_RAM_IN_BYTES) &&
+				tissuestack::imaging::TissueStackSliceCache::instance()->addCacheEntry(
+					image->getFileName(), cacheSlice, slice_data.get()))
+			slice_data.release();
+	}
+
+	return values;
 }
 
-const Image *  tissuestack::imaging::SimpleCacheHeuristics::extractImage(
+const std::shared_ptr<const std::vector<unsigned char> > tissuestack::imaging::SimpleCacheHeuristics::findBlankTile(
 	const tissuestack::common::ProcessingStrategy * processing_strategy,
-	const TissueStackRawData * image,
+	const tissuestack::imaging::TissueStackRawData * image,
 	const tissuestack::networking::TissueStackImageRequest * request) const
 {
+	return this->_uncached_extraction->findBlankTile(image, request);
+}
+
+const unsigned char * tissuestack::imaging::SimpleCacheHeuristics::encodeImage(
+	const tissuestack::common::ProcessingStrategy * processing_strategy,
+	const TissueStackRawData * image,
+	const tissuestack::networking::TissueStackImageRequest * request,
+	unsigned long long int & length) const
+{
+	// zoomed out views are served from the pyramid levels if the raw has them
+	const unsigned char * fromPyramid =
+		this->_uncached_extraction->encodeImageFromPyramid(image, request, length);
+	if (fromPyramid != nullptr)
+		return fromPyramid;
+
 	bool needsToBeAddedToCache = false;
+	bool isCopy = false;
 
 	const unsigned char * cache_data =
-		this->findCacheHit(image, request);
+		this->findCacheHit(image, request, isCopy);
 
+	// bricked raws only read the bricks a missed tile touches
+	if (cache_data == nullptr && image->isBricked())
+		return this->_uncached_extraction->encodeImageFromBricks(image, request, length);
+
+	bool isUncachedRead = false;
 	if (cache_data == nullptr)
 	{
-		const tissuestack::imaging::TissueStackDataDimension * actualDimension =
-				image->getDimensionByLongName(request->getDimensionName());
-		cache_data = this->_uncached_extraction->extractImageOnly(image, request);
-
-		if (tissuestack::utils::System::getFreeRam() > actualDimension->getSliceSize() * 3)
-			needsToBeAddedToCache = true;
+		cache_data = this->readUncachedSlice(image, request, needsToBeAddedToCache);
+		isUncachedRead = true;
 	}
 
-	const tissuestack::imaging::TissueStackDataDimension * actualDimension =
-			image->getDimensionByLongName(request->getDimensionName());
-
-	Image * img =
-		this->_uncached_extraction->createImageFromDataRead(image, actualDimension, cache_data);
+	const unsigned char * encoded = nullptr;
+	try
+	{
+		encoded = this->_uncached_extraction->encodeImage(image, request, cache_data, length);
+	} catch (...)
+	{
+		if (isUncachedRead || isCopy)
+			delete [] cache_data;
+		throw;
+	}
 
+	// the encoded image is a thing of its own, the slice data is either handed over to the cache or discarded
 	if (needsToBeAddedToCache)
 		this->addToCache(
 			processing_strategy,
 			image,
 			request,
 			cache_data);
+	else if (isUncachedRead || isCopy)
+		delete [] cache_data;
 
-	return img;
+	return encoded;
+}
+
+const unsigned char * tissuestack::imaging::SimpleCacheHeuristics::readUncachedSlice(
+	const TissueStackRawData * image,
+	const tissuestack::networking::TissueStackImageRequest * request,
+	bool & needs_to_be_added_to_cache) const
+{
+	const tissuestack::imaging::TissueStackDataDimension * actualDimension =
+			image->getDimensionByLongName(request->getDimensionName());
+
+	const unsigned char * data = nullptr;
+	const unsigned long long int sliceBytes = this->reserveMemoryForUncachedRead(image, actualDimension);
+	try
+	{
+		data = this->_uncached_extraction->extractImageOnly(image, request);
+	} catch (...)
+	{
+		tissuestack::utils::MemoryAccounting::instance()->removeInFlightBytes(sliceBytes);
+		throw;
+	}
+	tissuestack::utils::MemoryAccounting::instance()->removeInFlightBytes(sliceBytes);
+
+	// pinned data sets are resident already, a cache entry would only duplicate them
+	needs_to_be_added_to_cache =
+		!image->isPinned() &&
+		tissuestack::utils::MemoryAccounting::instance()->canAccommodate(
+			sliceBytes, tissuestack::imaging::TissueStackSliceCache::MINIMUM_FREE_RAM_IN_BYTES);
+
+	return data;
+}
+
+const unsigned long long int tissuestack::imaging::SimpleCacheHeuristics::reserveMemoryForUncachedRead(
+	const TissueStackRawData * image,
+	const tissuestack::imaging::TissueStackDataDimension * actualDimension) const
+{
+	const unsigned long long int sliceBytes =
+		actualDimension->getSliceSize() *
+		(image->getType() != tissuestack::imaging::RAW_TYPE::UCHAR_8_BIT ? 3 : 1);
+
+	tissuestack::imaging::TissueStackSliceCache::reserveInFlightBytes(sliceBytes);
+
+	return sliceBytes;
 }
 
 void tissuestack::imaging::SimpleCacheHeuristics::addToCache(
@@ -174,38 +338,248 @@ void tissuestack::imaging::SimpleCacheHeuristics::addToCache(
 
 	const std::string dataset = image->getFileName();
 
+	const unsigned long int slice =
+		this->getCacheSliceIndex(image, request->getDimensionName(), request->getSliceNumber());
+
+	if (!tissuestack::imaging::TissueStackSliceCache::instance()->addCacheEntry(
+							dataset, slice, data))
+		delete [] data;
+}
+
+const unsigned long int tissuestack::imaging::SimpleCacheHeuristics::getCacheSliceIndex(
+	const TissueStackRawData * image,
+	const std::string dimension_name,
+	const unsigned int slice_number) const
+{
 	unsigned long int slice = 0;
 
 	for (auto dim : image->getDimensionOrder())
 	{
-		if (request->getDimensionName().at(0) == dim.at(0))
+		if (dimension_name.at(0) == dim.at(0))
 			break;
 
 		slice += image->getDimensionByLongName(dim)->getNumberOfSlices();
 	}
-	slice += request->getSliceNumber();
 
-	if (!tissuestack::imaging::TissueStackSliceCache::instance()->addCacheEntry(
-							dataset, slice, data))
-		delete [] data;
+	return slice + slice_number;
 }
 
 const unsigned char * tissuestack::imaging::SimpleCacheHeuristics::findCacheHit(
 	const TissueStackRawData * image,
-	const tissuestack::networking::TissueStackImageRequest * request) const
+	const tissuestack::networking::TissueStackImageRequest * request,
+	bool & is_copy) const
 {
-	unsigned long int slice = 0;
+	const unsigned long int slice =
+		this->getCacheSliceIndex(image, request->getDimensionName(), request->getSliceNumber());
 
-	for (auto dim : image->getDimensionOrder())
+	// a miss is recorded for the slice to be added by whoever reads it. pinned data sets never add theirs,
+	// bricked ones only read the bricks a tile touches: a recorded miss would hold up every later request
+	// for that slice until the wait for it times out
+	const bool isPeek = image->isPinned() || image->isBricked();
+
+	return
+		tissuestack::imaging::TissueStackSliceCache::instance()->findCacheEntry(
+			image->getFileName(), slice, is_copy, isPeek);
+}
+
+const unsigned char * tissuestack::imaging::SimpleCacheHeuristics::encodeObliqueImage(
+	const tissuestack::common::ProcessingStrategy * processing_strategy,
+	const TissueStackRawData * image,
+	const tissuestack::networking::TissueStackObliqueRequest * request,
+	unsigned long long int & length) const
+{
+	// oblique planes span many slices: there is nothing in the slice cache for them
+	return this->_uncached_extraction->encodeObliqueImage(image, request, length);
+}
+
+const unsigned char * tissuestack::imaging::SimpleCacheHeuristics::encodeProjectionImage(
+	const tissuestack::common::ProcessingStrategy * processing_strategy,
+	const TissueStackRawData * image,
+	const tissuestack::networking::TissueStackProjectionRequest * request,
+	unsigned long long int & length) const
+{
+	const tissuestack::imaging::TissueStackDataDimension * actualDimension =
+			image->getDimensionByLongName(request->getDimensionName());
+	if (actualDimension == nullptr)
+		THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
+				"Image Dimension could not be found!");
+
+	// an open ended range and its explicit end project the same slices
+	const unsigned int lastSlice =
+		std::min(request->getLastSliceNumber(), static_cast<unsigned int>(actualDimension->getNumberOfSlices() - 1));
+	const std::string key =
+		image->getFileName() + "|" + actualDimension->getName() + "|" +
+		std::to_string(request->getSliceNumber()) + "|" + std::to_string(lastSlice) + "|" +
+		request->getProjectionName();
+
+	std::unique_ptr<const unsigned char[]> data;
 	{
-		if (request->getDimensionName().at(0) == dim.at(0))
+		std::lock_guard<std::mutex> lock(this->_projection_mutex);
+		for (auto entry = this->_projections.begin();entry != this->_projections.end();entry++)
+		{
+			if (entry->first.compare(key) != 0)
+				continue;
+
+			// a copy to work with outside the lock, the entry becomes the most recent one
+			unsigned char * copy = new unsigned char[entry->second.size()];
+			memcpy(copy, entry->second.data(), entry->second.size());
+			data.reset(copy);
+			std::pair<std::string, std::vector<unsigned char> > hit = std::move(*entry);
+			this->_projections.erase(entry);
+			this->_projections.push_back(std::move(hit));
 			break;
+		}
+	}
 
-		slice += image->getDimensionByLongName(dim)->getNumberOfSlices();
+	if (!data)
+	{
+		const unsigned long long int projectionBytes =
+			actualDimension->getSliceSize() * (image->getType() == tissuestack::imaging::RAW_TYPE::UCHAR_8_BIT ? 1 : 3);
+		data.reset(this->_uncached_extraction->projectSlices(image, request));
+
+		if (projectionBytes <= tissuestack::imaging::SimpleCacheHeuristics::MAXIMUM_PROJECTION_CACHE_SIZE_IN_BYTES &&
+				tissuestack::utils::MemoryAccounting::instance()->canAccommodate(
+					projectionBytes, tissuestack::imaging::TissueStackSliceCache::MINIMUM_FREE_RAM_IN_BYTES))
+		{
+			std::lock_guard<std::mutex> lock(this->_projection_mutex);
+
+			// another thread may have been quicker
+			bool isCached = false;
+			for (auto & entry : this->_projections)
+				if (entry.first.compare(key) == 0)
+				{
+					isCached = true;
+					break;
+				}
+
+			if (!isCached)
+			{
+				// least recently used ones make room
+				while (!this->_projections.empty() &&
+						this->_projection_cache_size + projectionBytes >
+							tissuestack::imaging::SimpleCacheHeuristics::MAXIMUM_PROJECTION_CACHE_SIZE_IN_BYTES)
+				{
+					const unsigned long long int evictedBytes = this->_projections.front().second.size();
+					this->_projections.erase(this->_projections.begin());
+					this->_projection_cache_size -= evictedBytes;
+					tissuestack::utils::MemoryAccounting::instance()->removeCacheBytes(evictedBytes);
+				}
+				this->_projections.push_back(
+					std::make_pair(key, std::vector<unsigned char>(data.get(), data.get() + projectionBytes)));
+				this->_projection_cache_size += projectionBytes;
+				// counted like the slice cache so that the free memory checks see it
+				tissuestack::utils::MemoryAccounting::instance()->addCacheBytes(projectionBytes);
+			}
+		}
 	}
-	slice += request->getSliceNumber();
 
-	return
-		tissuestack::imaging::TissueStackSliceCache::instance()->findCacheEntry(
-			image->getFileName(), slice);
+	return this->_uncached_extraction->encodeImage(image, request, data.get(), length);
+}
+
+const std::vector<unsigned long long int> tissuestack::imaging::SimpleCacheHeuristics::computeHistograms(
+	const tissuestack::common::ProcessingStrategy * processing_strategy,
+	const TissueStackRawData * image,
+	const tissuestack::networking::TissueStackStatisticsRequest * request) const
+{
+	const tissuestack::imaging::TissueStackDataDimension * actualDimension =
+			image->getDimensionByLongName(request->getDimensionName());
+	if (actualDimension == nullptr)
+		THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
+				"Image Dimension could not be found!");
+
+	// the same region through the same slices: an open ended range and its explicit end are one
+	const unsigned int lastSlice =
+		std::min(request->getLastSliceNumber(), static_cast<unsigned int>(actualDimension->getNumberOfSlices() - 1));
+	std::string key =
+		image->getFileName() + "|" + actualDimension->getName() + "|" +
+		std::to_string(request->getSliceNumber()) + "|" + std::to_string(lastSlice) + "|";
+	for (auto & vertex : request->getPolygon())
+		key += std::to_string(vertex[0]) + ":" + std::to_string(vertex[1]) + ",";
+
+	{
+		std::lock_guard<std::mutex> lock(this->_statistics_mutex);
+		for (auto entry = this->_statistics.begin();entry != this->_statistics.end();entry++)
+			if (entry->first.compare(key) == 0)
+			{
+				// the entry becomes the most recent one
+				this->_statistics.splice(this->_statistics.end(), this->_statistics, entry);
+				return this->_statistics.back().second;
+			}
+	}
+
+	// slices in the slice cache are counted from there, a peek does not hold up anybody waiting for the others
+	const std::vector<unsigned long long int> histograms =
+		this->_uncached_extraction->computeHistograms(
+			image,
+			request,
+			[this, image, request] (const unsigned int slice_number, bool & is_copy) -> const unsigned char *
+			{
+				return tissuestack::imaging::TissueStackSliceCache::instance()->findCacheEntry(
+					image->getFileName(),
+					this->getCacheSliceIndex(image, request->getDimensionName(), slice_number),
+					is_copy,
+					true);
+			});
+
+	std::lock_guard<std::mutex> lock(this->_statistics_mutex);
+	for (auto & entry : this->_statistics)
+		if (entry.first.compare(key) == 0) // another thread was quicker
+			return histograms;
+	if (this->_statistics.size() >= tissuestack::imaging::SimpleCacheHeuristics::MAXIMUM_NUMBER_OF_CACHED_STATISTICS)
+		this->_statistics.pop_front();
+	this->_statistics.push_back(std::make_pair(key, histograms));
+
+	return histograms;
+}
+
+const unsigned char * tissuestack::imaging::SimpleCacheHeuristics::encodeCompositeImage(
+	const tissuestack::common::ProcessingStrategy * processing_strategy,
+	const std::vector<const TissueStackRawData *> & images,
+	const tissuestack::networking::TissueStackImageRequest * request,
+	unsigned long long int & length) const
+{
+	// every layer's slice goes through the slice cache of its own data set
+	std::vector<const unsigned char *> data(images.size(), nullptr);
+	std::vector<bool> needsToBeAddedToCache(images.size(), false);
+	std::vector<bool> needsToBeDeleted(images.size(), false);
+
+	const auto releaseSlices = [&] (const bool add_to_cache)
+	{
+		for (unsigned short layer=0;layer<images.size();layer++)
+		{
+			if (data[layer] == nullptr)
+				continue;
+			if (add_to_cache && needsToBeAddedToCache[layer])
+				this->addToCache(processing_strategy, images[layer], request, data[layer]);
+			else if (needsToBeDeleted[layer])
+				delete [] data[layer];
+		}
+	};
+
+	const unsigned char * encoded = nullptr;
+	try
+	{
+		for (unsigned short layer=0;layer<images.size();layer++)
+		{
+			bool isCopy = false;
+			data[layer] = this->findCacheHit(images[layer], request, isCopy);
+			needsToBeDeleted[layer] = isCopy;
+			if (data[layer] != nullptr)
+				continue;
+
+			bool addToCache = false;
+			data[layer] = this->readUncachedSlice(images[layer], request, addToCache);
+			needsToBeAddedToCache[layer] = addToCache;
+			needsToBeDeleted[layer] = true;
+		}
+
+		encoded = this->_uncached_extraction->encodeCompositeImage(images, request, data, length);
+	} catch (...)
+	{
+		releaseSlices(false);
+		throw;
+	}
+	releaseSlices(true);
+
+	return encoded;
 }
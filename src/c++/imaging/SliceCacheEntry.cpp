@@ -23,8 +23,14 @@ tissuestack::imaging::SliceCacheEntry::~SliceCacheEntry()
 		delete [] this->_cache_data;
 }
 
-tissuestack::imaging::SliceCacheEntry::SliceCacheEntry(const unsigned char * cache_data) :
-	_cache_data(cache_data), _timestamp_accessed(tissuestack::utils::System::getSystemTimeInMillis()), _access_count(0)
+tissuestack::imaging::SliceCacheEntry::SliceCacheEntry(
+	const unsigned char * cache_data,
+	const unsigned long long int size_in_bytes,
+	const unsigned long long int access_count,
+	const unsigned long long int uncompressed_size_in_bytes) :
+	_cache_data(cache_data), _size_in_bytes(size_in_bytes),
+	_uncompressed_size_in_bytes(uncompressed_size_in_bytes == 0 ? size_in_bytes : uncompressed_size_in_bytes),
+	_timestamp_accessed(tissuestack::utils::System::getSystemTimeInMillis()), _access_count(access_count)
 {}
 
 
@@ -41,6 +47,33 @@ const unsigned char * tissuestack::imaging::SliceCacheEntry::getCacheData()
 	return this->_cache_data;
 }
 
+unsigned char * tissuestack::imaging::SliceCacheEntry::copyCacheData()
+{
+	const unsigned char * data = this->getCacheData();
+	if (data == nullptr)
+		return nullptr;
+
+	unsigned char * copy = new unsigned char[this->_size_in_bytes];
+	memcpy(copy, data, this->_size_in_bytes);
+
+	return copy;
+}
+
+const bool tissuestack::imaging::SliceCacheEntry::isCompressed() const
+{
+	return this->_size_in_bytes != this->_uncompressed_size_in_bytes;
+}
+
+const unsigned long long int tissuestack::imaging::SliceCacheEntry::getSizeInBytes() const
+{
+	return this->_size_in_bytes;
+}
+
+const unsigned long long int tissuestack::imaging::SliceCacheEntry::getUncompressedSizeInBytes() const
+{
+	return this->_uncompressed_size_in_bytes;
+}
+
 const unsigned long long int tissuestack::imaging::SliceCacheEntry::getAccessCount() const
 {
 	return this->_access_count;
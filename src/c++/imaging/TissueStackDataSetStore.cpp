@@ -258,4 +258,141 @@ const std::string tissuestack::imaging::TissueStackDataSetStore::getDataSetStore
 	return dir;
 }
 
+const std::vector<std::string> tissuestack::imaging::TissueStackDataSetStore::getPinnedDataSetsConfiguration()
+{
+	std::vector<std::string> pinned;
+
+	const std::string conf =
+		tissuestack::database::ConfigurationDataProvider::findSpecificApplicationDirectory("pinned_data_sets");
+	for (auto entry : tissuestack::utils::Misc::tokenizeString(conf, ','))
+	{
+		// only the blanks around an entry go, file names may have some of their own
+		const std::string::size_type first = entry.find_first_not_of(" \t");
+		if (first == std::string::npos)
+			continue;
+		pinned.push_back(entry.substr(first, entry.find_last_not_of(" \t") - first + 1));
+	}
+
+	return pinned;
+}
+
+const bool tissuestack::imaging::TissueStackDataSetStore::persistPinnedDataSetsConfiguration(
+	const std::vector<std::string> & pinned)
+{
+	std::string value = "";
+	for (auto entry : pinned)
+		value += (value.empty() ? "" : ",") + entry;
+
+	// the paths come from requests: quotes in them must not end the statement's string
+	const tissuestack::database::Configuration conf(
+		"pinned_data_sets", tissuestack::utils::Misc::sanitizeSqlQuote(value));
+	return tissuestack::database::ConfigurationDataProvider::updateConfiguration(&conf);
+}
+
+void tissuestack::imaging::TissueStackDataSetStore::pinConfiguredDataSets()
+{
+	for (auto id : tissuestack::imaging::TissueStackDataSetStore::getPinnedDataSetsConfiguration())
+		this->pinDataSet(id);
+}
+
+const bool tissuestack::imaging::TissueStackDataSetStore::pinDataSet(const std::string & id, const bool persist)
+{
+	const tissuestack::imaging::TissueStackDataSet * dataSet = this->findDataSet(id);
+	if (dataSet == nullptr || dataSet->getImageData() == nullptr || !dataSet->getImageData()->isRaw())
+	{
+		tissuestack::logging::TissueStackLogger::instance()->error(
+			"Data set %s cannot be pinned: it is not a raw data set in the store!\n", id.c_str());
+		return false;
+	}
+
+	tissuestack::imaging::TissueStackRawData * image =
+		const_cast<tissuestack::imaging::TissueStackRawData *>(
+			static_cast<const tissuestack::imaging::TissueStackRawData *>(dataSet->getImageData()));
+
+	if (!image->isPinned())
+	{
+		if (!tissuestack::utils::MemoryAccounting::instance()->canAccommodate(
+				image->getFileSizeInBytes(), tissuestack::imaging::TissueStackSliceCache::MINIMUM_FREE_RAM_IN_BYTES))
+		{
+			tissuestack::logging::TissueStackLogger::instance()->error(
+				"Not enough memory to pin data set %s (%llu bytes)!\n", id.c_str(), image->getFileSizeInBytes());
+			return false;
+		}
+
+		if (!image->pin())
+			return false;
+
+		// its cached slices are redundant now
+		if (tissuestack::imaging::TissueStackSliceCache::doesInstanceExist())
+			tissuestack::imaging::TissueStackSliceCache::instance()->eraseDataSet(id);
+
+		tissuestack::logging::TissueStackLogger::instance()->info(
+			"Pinned data set %s: %llu bytes resident%s\n",
+			id.c_str(), image->getResidentBytes(), image->isLockedInMemory() ? " and locked" : "");
+	}
+
+	if (!persist)
+		return true;
+
+	std::vector<std::string> pinned = tissuestack::imaging::TissueStackDataSetStore::getPinnedDataSetsConfiguration();
+	if (std::find(pinned.begin(), pinned.end(), id) == pinned.end())
+	{
+		pinned.push_back(id);
+		tissuestack::imaging::TissueStackDataSetStore::persistPinnedDataSetsConfiguration(pinned);
+	}
+
+	return true;
+}
+
+const bool tissuestack::imaging::TissueStackDataSetStore::unpinDataSet(const std::string & id, const bool persist)
+{
+	const tissuestack::imaging::TissueStackDataSet * dataSet = this->findDataSet(id);
+	if (dataSet != nullptr && dataSet->getImageData() != nullptr && dataSet->getImageData()->isRaw())
+		const_cast<tissuestack::imaging::TissueStackRawData *>(
+			static_cast<const tissuestack::imaging::TissueStackRawData *>(dataSet->getImageData()))->unpin();
+
+	if (!persist)
+		return true;
+
+	std::vector<std::string> pinned = tissuestack::imaging::TissueStackDataSetStore::getPinnedDataSetsConfiguration();
+	const std::vector<std::string>::iterator entry = std::find(pinned.begin(), pinned.end(), id);
+	if (entry != pinned.end())
+	{
+		pinned.erase(entry);
+		tissuestack::imaging::TissueStackDataSetStore::persistPinnedDataSetsConfiguration(pinned);
+	}
+
+	return true;
+}
+
+const std::string tissuestack::imaging::TissueStackDataSetStore::getPinnedDataSetsAsJson() const
+{
+	std::ostringstream json;
+	json << "[";
+
+	bool first = true;
+	for (auto entry : this->_data_sets)
+	{
+		if (!entry.second->getImageData()->isRaw())
+			continue;
+
+		const tissuestack::imaging::TissueStackRawData * image =
+			static_cast<const tissuestack::imaging::TissueStackRawData *>(entry.second->getImageData());
+		if (!image->isPinned())
+			continue;
+
+		if (!first)
+			json << ",";
+		json << "{\"id\": " << image->getDataBaseId()
+			<< ", \"filename\": \"" << tissuestack::utils::Misc::maskQuotesInJson(entry.first) << "\""
+			<< ", \"size\": " << image->getPinnedBytes()
+			<< ", \"resident\": " << image->getResidentBytes()
+			<< ", \"locked\": " << (image->isLockedInMemory() ? "true" : "false") << "}";
+		first = false;
+	}
+	json << "]";
+
+	return json.str();
+}
+
 tissuestack::imaging::TissueStackDataSetStore * tissuestack::imaging::TissueStackDataSetStore::_instance = nullptr;
@@ -0,0 +1,500 @@
+/*
+ * This file is part of TissueStack.
+ *
+ * TissueStack is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TissueStack is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TissueStack.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "networking.h"
+#include "imaging.h"
+#include "database.h"
+
+#include <setjmp.h>
+#include <png.h>
+#include <jpeglib.h>
+#ifdef USE_WEBP
+#include <webp/encode.h>
+#endif
+
+namespace
+{
+	const unsigned long long int INITIAL_OUTPUT_SIZE = 64 * 1024;
+	// a single big preview should not leave its buffer behind for the life time of the thread
+	const unsigned long long int MAXIMUM_RETAINED_OUTPUT_SIZE = 8 * 1024 * 1024;
+
+	struct EncoderContext
+	{
+		std::vector<unsigned char> output;
+		unsigned long long int length = 0;
+		bool is_busy = false;
+		png_structp png = nullptr;
+		png_infop png_info = nullptr;
+		bool has_jpeg = false;
+		jpeg_compress_struct jpeg;
+		jpeg_error_mgr jpeg_error;
+		jpeg_destination_mgr jpeg_destination;
+		jmp_buf jpeg_jump;
+		// libwebp takes the whole picture at once: rows are gathered here as rgb
+		std::vector<unsigned char> webp_rgb;
+		char message[JMSG_LENGTH_MAX > 256 ? JMSG_LENGTH_MAX : 256];
+
+		~EncoderContext()
+		{
+			if (this->png)
+				png_destroy_write_struct(&this->png, &this->png_info);
+			if (this->has_jpeg)
+				jpeg_destroy_compress(&this->jpeg);
+		}
+	};
+
+	thread_local EncoderContext context;
+
+	void ensureOutputSize(EncoderContext * ctx, const unsigned long long int size)
+	{
+		if (ctx->output.size() >= size)
+			return;
+
+		unsigned long long int newSize = ctx->output.empty() ? INITIAL_OUTPUT_SIZE : ctx->output.size();
+		while (newSize < size)
+			newSize *= 2;
+		ctx->output.resize(newSize);
+	}
+
+	void writePngData(png_structp png, png_bytep data, png_size_t length)
+	{
+		EncoderContext * ctx = static_cast<EncoderContext *>(png_get_io_ptr(png));
+		ensureOutputSize(ctx, ctx->length + length);
+		memcpy(ctx->output.data() + ctx->length, data, length);
+		ctx->length += length;
+	}
+
+	void flushPngData(png_structp /* png */) {}
+
+	void handlePngError(png_structp png, png_const_charp message)
+	{
+		EncoderContext * ctx = static_cast<EncoderContext *>(png_get_error_ptr(png));
+		strncpy(ctx->message, message, sizeof(ctx->message) - 1);
+		ctx->message[sizeof(ctx->message) - 1] = '\0';
+		png_longjmp(png, 1);
+	}
+
+	void handlePngWarning(png_structp /* png */, png_const_charp /* message */) {}
+
+	void initJpegDestination(j_compress_ptr jpeg)
+	{
+		EncoderContext * ctx = static_cast<EncoderContext *>(jpeg->client_data);
+		ensureOutputSize(ctx, INITIAL_OUTPUT_SIZE);
+		ctx->length = 0;
+		ctx->jpeg_destination.next_output_byte = ctx->output.data();
+		ctx->jpeg_destination.free_in_buffer = ctx->output.size();
+	}
+
+	boolean emptyJpegBuffer(j_compress_ptr jpeg)
+	{
+		// libjpeg hands back the whole buffer as full: double it and continue behind what's there
+		EncoderContext * ctx = static_cast<EncoderContext *>(jpeg->client_data);
+		const unsigned long long int used = ctx->output.size();
+		ensureOutputSize(ctx, used * 2);
+		ctx->jpeg_destination.next_output_byte = ctx->output.data() + used;
+		ctx->jpeg_destination.free_in_buffer = ctx->output.size() - used;
+
+		return TRUE;
+	}
+
+	void termJpegDestination(j_compress_ptr jpeg)
+	{
+		EncoderContext * ctx = static_cast<EncoderContext *>(jpeg->client_data);
+		ctx->length = ctx->output.size() - ctx->jpeg_destination.free_in_buffer;
+	}
+
+	void handleJpegError(j_common_ptr jpeg)
+	{
+		EncoderContext * ctx = static_cast<EncoderContext *>(jpeg->client_data);
+		(*jpeg->err->format_message)(jpeg, ctx->message);
+		longjmp(ctx->jpeg_jump, 1);
+	}
+
+	void handleJpegMessage(j_common_ptr /* jpeg */, int /* level */) {}
+}
+
+int tissuestack::imaging::TissueStackImageEncoder::_png_compression_level =
+	tissuestack::imaging::TissueStackImageEncoder::DEFAULT_PNG_COMPRESSION_LEVEL;
+int tissuestack::imaging::TissueStackImageEncoder::_png_filters = PNG_ALL_FILTERS;
+int tissuestack::imaging::TissueStackImageEncoder::_png_compression_strategy = Z_DEFAULT_STRATEGY;
+int tissuestack::imaging::TissueStackImageEncoder::_jpeg_quality =
+	tissuestack::imaging::TissueStackImageEncoder::DEFAULT_JPEG_QUALITY;
+// 0 means lossless for full quality images
+int tissuestack::imaging::TissueStackImageEncoder::_webp_quality = 0;
+
+const bool tissuestack::imaging::TissueStackImageEncoder::isSupportedFormat(const std::string & format)
+{
+	std::string formatLowerCase = format;
+	std::transform(formatLowerCase.begin(), formatLowerCase.end(), formatLowerCase.begin(), tolower);
+
+	return formatLowerCase.compare("png") == 0 ||
+#ifdef USE_WEBP
+			formatLowerCase.compare("webp") == 0 ||
+#endif
+			formatLowerCase.compare("jpeg") == 0 ||
+			formatLowerCase.compare("jpg") == 0;
+}
+
+const bool tissuestack::imaging::TissueStackImageEncoder::isPaletteSupported(const std::string & format)
+{
+	std::string formatLowerCase = format;
+	std::transform(formatLowerCase.begin(), formatLowerCase.end(), formatLowerCase.begin(), tolower);
+
+	return formatLowerCase.compare("png") == 0;
+}
+
+void tissuestack::imaging::TissueStackImageEncoder::loadSettings()
+{
+	const std::string level =
+		tissuestack::database::ConfigurationDataProvider::findSpecificApplicationDirectory("png_compression_level");
+	if (!level.empty() && tissuestack::utils::Misc::isNumber(level) && atoi(level.c_str()) <= Z_BEST_COMPRESSION)
+		tissuestack::imaging::TissueStackImageEncoder::_png_compression_level = atoi(level.c_str());
+
+	const std::string filter =
+		tissuestack::database::ConfigurationDataProvider::findSpecificApplicationDirectory("png_filter");
+	if (filter.compare("none") == 0)
+		tissuestack::imaging::TissueStackImageEncoder::_png_filters = PNG_FILTER_NONE;
+	else if (filter.compare("sub") == 0)
+		tissuestack::imaging::TissueStackImageEncoder::_png_filters = PNG_FILTER_SUB;
+	else if (filter.compare("up") == 0)
+		tissuestack::imaging::TissueStackImageEncoder::_png_filters = PNG_FILTER_UP;
+	else if (filter.compare("avg") == 0)
+		tissuestack::imaging::TissueStackImageEncoder::_png_filters = PNG_FILTER_AVG;
+	else if (filter.compare("paeth") == 0)
+		tissuestack::imaging::TissueStackImageEncoder::_png_filters = PNG_FILTER_PAETH;
+
+	const std::string strategy =
+		tissuestack::database::ConfigurationDataProvider::findSpecificApplicationDirectory("png_compression_strategy");
+	if (strategy.compare("filtered") == 0)
+		tissuestack::imaging::TissueStackImageEncoder::_png_compression_strategy = Z_FILTERED;
+	else if (strategy.compare("rle") == 0)
+		tissuestack::imaging::TissueStackImageEncoder::_png_compression_strategy = Z_RLE;
+	else if (strategy.compare("huffman") == 0)
+		tissuestack::imaging::TissueStackImageEncoder::_png_compression_strategy = Z_HUFFMAN_ONLY;
+
+	const std::string quality =
+		tissuestack::database::ConfigurationDataProvider::findSpecificApplicationDirectory("jpeg_quality");
+	if (!quality.empty() && tissuestack::utils::Misc::isNumber(quality) &&
+			atoi(quality.c_str()) > 0 && atoi(quality.c_str()) <= 100)
+		tissuestack::imaging::TissueStackImageEncoder::_jpeg_quality = atoi(quality.c_str());
+
+	const std::string webpQuality =
+		tissuestack::database::ConfigurationDataProvider::findSpecificApplicationDirectory("webp_quality");
+	if (!webpQuality.empty() && tissuestack::utils::Misc::isNumber(webpQuality) &&
+			atoi(webpQuality.c_str()) > 0 && atoi(webpQuality.c_str()) <= 100)
+		tissuestack::imaging::TissueStackImageEncoder::_webp_quality = atoi(webpQuality.c_str());
+
+	tissuestack::logging::TissueStackLogger::instance()->info(
+		"Image Encoder: png compression level %d, filter '%s', strategy '%s' - jpeg quality %d - webp %s\n",
+		tissuestack::imaging::TissueStackImageEncoder::_png_compression_level,
+		filter.empty() ? "all" : filter.c_str(),
+		strategy.empty() ? "default" : strategy.c_str(),
+		tissuestack::imaging::TissueStackImageEncoder::_jpeg_quality,
+#ifdef USE_WEBP
+		webpQuality.empty() ? "lossless" : webpQuality.c_str());
+#else
+		"not built in");
+#endif
+}
+
+tissuestack::imaging::TissueStackImageEncoder::TissueStackImageEncoder(
+	const std::string & format,
+	const unsigned int width,
+	const unsigned int height,
+	const unsigned short channels,
+	const float quality_factor,
+	const unsigned char * palette,
+	const unsigned short palette_size) : _width(width), _height(height), _channels(channels)
+{
+	if (!tissuestack::imaging::TissueStackImageEncoder::isSupportedFormat(format))
+		THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
+			"Image Encoder: Unsupported image format!");
+
+	EncoderContext * ctx = &context;
+	if (ctx->is_busy)
+		THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
+			"Image Encoder: This thread is still encoding another image!");
+
+	if (ctx->output.size() > MAXIMUM_RETAINED_OUTPUT_SIZE)
+		std::vector<unsigned char>(INITIAL_OUTPUT_SIZE).swap(ctx->output);
+	ctx->length = 0;
+
+	std::string formatLowerCase = format;
+	std::transform(formatLowerCase.begin(), formatLowerCase.end(), formatLowerCase.begin(), tolower);
+	if (formatLowerCase.compare("png") == 0)
+		this->_encoding = tissuestack::imaging::IMAGE_ENCODING::PNG;
+	else if (formatLowerCase.compare("webp") == 0)
+		this->_encoding = tissuestack::imaging::IMAGE_ENCODING::WEBP;
+	else
+		this->_encoding = tissuestack::imaging::IMAGE_ENCODING::JPEG;
+
+	if (palette != nullptr &&
+			(this->_encoding != tissuestack::imaging::IMAGE_ENCODING::PNG || channels != 1 || palette_size == 0 || palette_size > 256))
+		THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
+			"Image Encoder: Palettes need png, one index per pixel and no more than 256 colors!");
+
+	// degraded images are transient (e.g. while panning): favor speed
+	const bool isDegraded = quality_factor < static_cast<const float>(1.0);
+
+	if (this->_encoding == tissuestack::imaging::IMAGE_ENCODING::WEBP)
+	{
+		// full quality goes lossless unless a lossy quality is configured,
+		// degraded images are always lossy at the scaled quality
+		const int webpQuality = tissuestack::imaging::TissueStackImageEncoder::_webp_quality;
+		this->_is_lossless = webpQuality == 0 && !isDegraded;
+		long int quality = lround(static_cast<double>(
+			webpQuality == 0 ? tissuestack::imaging::TissueStackImageEncoder::DEFAULT_WEBP_QUALITY : webpQuality)
+				* quality_factor);
+		this->_quality = quality < 1 ? 1 : static_cast<int>(quality);
+
+		ctx->webp_rgb.resize(static_cast<unsigned long long int>(width) * height * 3);
+		ctx->is_busy = true;
+
+		return;
+	}
+
+	if (this->_encoding == tissuestack::imaging::IMAGE_ENCODING::PNG)
+	{
+		ctx->png =
+			png_create_write_struct(PNG_LIBPNG_VER_STRING, ctx, handlePngError, handlePngWarning);
+		if (ctx->png == nullptr)
+			THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
+				"Image Encoder: Could not create png write struct!");
+		ctx->png_info = png_create_info_struct(ctx->png);
+		if (ctx->png_info == nullptr)
+		{
+			png_destroy_write_struct(&ctx->png, nullptr);
+			ctx->png = nullptr;
+			THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
+				"Image Encoder: Could not create png info struct!");
+		}
+		ctx->is_busy = true;
+
+		if (setjmp(png_jmpbuf(ctx->png)))
+			this->abortAfterError();
+
+		png_set_write_fn(ctx->png, ctx, writePngData, flushPngData);
+
+		// small palettes get packed into fewer bits per pixel
+		int bitDepth = 8;
+		if (palette != nullptr)
+			bitDepth = palette_size <= 2 ? 1 : (palette_size <= 4 ? 2 : (palette_size <= 16 ? 4 : 8));
+
+		png_set_IHDR(
+			ctx->png,
+			ctx->png_info,
+			width,
+			height,
+			bitDepth,
+			palette != nullptr ? PNG_COLOR_TYPE_PALETTE :
+				(channels == 1 ? PNG_COLOR_TYPE_GRAY : PNG_COLOR_TYPE_RGB),
+			PNG_INTERLACE_NONE,
+			PNG_COMPRESSION_TYPE_DEFAULT,
+			PNG_FILTER_TYPE_DEFAULT);
+		if (palette != nullptr)
+		{
+			png_color colors[256];
+			for (unsigned short i=0;i<palette_size;i++)
+			{
+				colors[i].red = palette[i*3];
+				colors[i].green = palette[i*3+1];
+				colors[i].blue = palette[i*3+2];
+			}
+			png_set_PLTE(ctx->png, ctx->png_info, colors, palette_size);
+		}
+		png_set_compression_level(
+			ctx->png,
+			isDegraded ? Z_BEST_SPEED : tissuestack::imaging::TissueStackImageEncoder::_png_compression_level);
+		png_set_compression_strategy(
+			ctx->png, tissuestack::imaging::TissueStackImageEncoder::_png_compression_strategy);
+		// filters don't pay off for indexed images
+		png_set_filter(
+			ctx->png,
+			PNG_FILTER_TYPE_BASE,
+			palette != nullptr ? PNG_FILTER_NONE :
+				(isDegraded ? PNG_FILTER_SUB : tissuestack::imaging::TissueStackImageEncoder::_png_filters));
+		png_write_info(ctx->png, ctx->png_info);
+		if (bitDepth < 8)
+			png_set_packing(ctx->png);
+
+		return;
+	}
+
+	// the jpeg compressor is created once per thread and reused from then on
+	if (!ctx->has_jpeg)
+	{
+		ctx->jpeg.err = jpeg_std_error(&ctx->jpeg_error);
+		ctx->jpeg_error.error_exit = handleJpegError;
+		ctx->jpeg_error.emit_message = handleJpegMessage;
+		jpeg_create_compress(&ctx->jpeg);
+		ctx->jpeg.client_data = ctx;
+		ctx->jpeg_destination.init_destination = initJpegDestination;
+		ctx->jpeg_destination.empty_output_buffer = emptyJpegBuffer;
+		ctx->jpeg_destination.term_destination = termJpegDestination;
+		ctx->jpeg.dest = &ctx->jpeg_destination;
+		ctx->has_jpeg = true;
+	}
+	ctx->is_busy = true;
+
+	if (setjmp(ctx->jpeg_jump))
+		this->abortAfterError();
+
+	ctx->jpeg.image_width = width;
+	ctx->jpeg.image_height = height;
+	ctx->jpeg.input_components = channels == 1 ? 1 : 3;
+	ctx->jpeg.in_color_space = channels == 1 ? JCS_GRAYSCALE : JCS_RGB;
+	jpeg_set_defaults(&ctx->jpeg);
+
+	// the request's quality factor scales the configured quality
+	long int quality =
+		lround(static_cast<double>(tissuestack::imaging::TissueStackImageEncoder::_jpeg_quality) * quality_factor);
+	if (quality < 1)
+		quality = 1;
+	jpeg_set_quality(&ctx->jpeg, static_cast<int>(quality), TRUE);
+
+	// like graphics magick: no chroma subsampling for high quality, 4:2:0 otherwise
+	if (channels != 1 && !isDegraded && quality >= 90)
+	{
+		ctx->jpeg.comp_info[0].h_samp_factor = 1;
+		ctx->jpeg.comp_info[0].v_samp_factor = 1;
+	}
+
+	jpeg_start_compress(&ctx->jpeg, TRUE);
+}
+
+tissuestack::imaging::TissueStackImageEncoder::~TissueStackImageEncoder()
+{
+	if (!this->_is_finished)
+		this->abort();
+}
+
+void tissuestack::imaging::TissueStackImageEncoder::abort()
+{
+	EncoderContext * ctx = &context;
+
+	if (this->_encoding == tissuestack::imaging::IMAGE_ENCODING::PNG)
+	{
+		if (ctx->png)
+			png_destroy_write_struct(&ctx->png, &ctx->png_info);
+		ctx->png = nullptr;
+		ctx->png_info = nullptr;
+	} else if (this->_encoding == tissuestack::imaging::IMAGE_ENCODING::JPEG && ctx->has_jpeg)
+		jpeg_abort_compress(&ctx->jpeg);
+
+	ctx->is_busy = false;
+	this->_is_finished = true;
+}
+
+void tissuestack::imaging::TissueStackImageEncoder::abortAfterError()
+{
+	// we got here via longjmp out of libpng/libjpeg
+	this->abort();
+	tissuestack::logging::TissueStackLogger::instance()->error(
+		"Image Encoder: %s\n", context.message);
+	THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
+		"Image Encoder: Failed to encode image!");
+}
+
+void tissuestack::imaging::TissueStackImageEncoder::writeRow(const unsigned char * pixels)
+{
+	EncoderContext * ctx = &context;
+
+	if (this->_is_finished || this->_rows_written >= this->_height)
+		THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
+			"Image Encoder: More rows given than the image has!");
+
+	if (this->_encoding == tissuestack::imaging::IMAGE_ENCODING::WEBP)
+	{
+		unsigned char * rgb =
+			ctx->webp_rgb.data() + static_cast<unsigned long long int>(this->_rows_written) * this->_width * 3;
+		if (this->_channels == 1)
+			for (unsigned int x=0;x<this->_width;x++)
+			{
+				rgb[x*3] = rgb[x*3+1] = rgb[x*3+2] = pixels[x];
+			}
+		else
+			memcpy(rgb, pixels, this->_width * 3);
+	} else if (this->_encoding == tissuestack::imaging::IMAGE_ENCODING::PNG)
+	{
+		if (setjmp(png_jmpbuf(ctx->png)))
+			this->abortAfterError();
+		png_write_row(ctx->png, const_cast<png_bytep>(pixels));
+	} else
+	{
+		if (setjmp(ctx->jpeg_jump))
+			this->abortAfterError();
+		JSAMPROW row = const_cast<JSAMPROW>(pixels);
+		jpeg_write_scanlines(&ctx->jpeg, &row, 1);
+	}
+
+	this->_rows_written++;
+}
+
+const unsigned char * tissuestack::imaging::TissueStackImageEncoder::finish(unsigned long long int & length)
+{
+	EncoderContext * ctx = &context;
+	length = 0;
+
+	if (this->_is_finished || this->_rows_written != this->_height)
+		THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
+			"Image Encoder: Image has not been completely written!");
+
+	if (this->_encoding == tissuestack::imaging::IMAGE_ENCODING::WEBP)
+	{
+#ifdef USE_WEBP
+		uint8_t * webp = nullptr;
+		size_t webpLength = 0;
+		if (this->_is_lossless)
+			webpLength = WebPEncodeLosslessRGB(
+				ctx->webp_rgb.data(), this->_width, this->_height, this->_width * 3, &webp);
+		else
+			webpLength = WebPEncodeRGB(
+				ctx->webp_rgb.data(), this->_width, this->_height, this->_width * 3,
+				static_cast<float>(this->_quality), &webp);
+		if (webpLength == 0 || webp == nullptr)
+		{
+			if (webp) WebPFree(webp);
+			strcpy(ctx->message, "libwebp could not encode the image");
+			this->abortAfterError();
+		}
+		ensureOutputSize(ctx, webpLength);
+		memcpy(ctx->output.data(), webp, webpLength);
+		ctx->length = webpLength;
+		WebPFree(webp);
+#endif
+		if (ctx->webp_rgb.size() > MAXIMUM_RETAINED_OUTPUT_SIZE)
+			std::vector<unsigned char>().swap(ctx->webp_rgb);
+	} else if (this->_encoding == tissuestack::imaging::IMAGE_ENCODING::PNG)
+	{
+		if (setjmp(png_jmpbuf(ctx->png)))
+			this->abortAfterError();
+		png_write_end(ctx->png, nullptr);
+		png_destroy_write_struct(&ctx->png, &ctx->png_info);
+		ctx->png = nullptr;
+		ctx->png_info = nullptr;
+	} else
+	{
+		if (setjmp(ctx->jpeg_jump))
+			this->abortAfterError();
+		jpeg_finish_compress(&ctx->jpeg);
+	}
+
+	ctx->is_busy = false;
+	this->_is_finished = true;
+	length = ctx->length;
+
+	return ctx->output.data();
+}
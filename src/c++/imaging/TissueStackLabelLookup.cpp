@@ -31,6 +31,7 @@ tissuestack::imaging::TissueStackLabelLookup::TissueStackLabelLookup(
 	const tissuestack::database::AtlasInfo * atlasInfo) :
 	_labellookup_id(filename), _database_id(id), _atlas_info(atlasInfo)
 {
+	tissuestack::imaging::TissueStackColorMap::preFillColorMapArray(this->_gray_indexed_rgb_mapping);
 	if (!content.empty())
 	{
 		std::string new_content = tissuestack::utils::Misc::eraseCharacterFromString(content, '{');
@@ -45,6 +46,7 @@ tissuestack::imaging::TissueStackLabelLookup::TissueStackLabelLookup(
 				this->_label_lookups[nameValue[0]] = nameValue[1];
 		}
 	}
+	this->indexLabels();
 }
 
 tissuestack::imaging::TissueStackLabelLookup::TissueStackLabelLookup(const std::string & filename) :
@@ -156,15 +158,17 @@ void tissuestack::imaging::TissueStackLabelLookup::updateLabelLookup(const std::
 					std::to_string(red) + "/" + std::to_string(green) + "/" + std::to_string(blue);
 				this->_label_lookups[rgbTripleKey] = label;
 				// try and add also the gray lookup but only if we don't overwrite an rgb lookup!
-				if (gray >=0 && this->getLabel(gray, gray, gray).empty())
+				if (gray >=0)
 				{
 					rgbTripleKey = "" +
 						std::to_string(gray) + "/" + std::to_string(gray) + "/" + std::to_string(gray);
-					this->_label_lookups[rgbTripleKey] = label;
+					if (this->_label_lookups.count(rgbTripleKey) == 0)
+						this->_label_lookups[rgbTripleKey] = label;
 				}
 			}
 		}
 		file_stream.close();
+		this->indexLabels();
 
 		if (tissuestack::logging::TissueStackLogger::doesInstanceExist())
 			tissuestack::logging::TissueStackLogger::instance()->info("Finished Loading label lookup file.\n");
@@ -179,17 +183,158 @@ void tissuestack::imaging::TissueStackLabelLookup::updateLabelLookup(const std::
 
 const std::string tissuestack::imaging::TissueStackLabelLookup::getLabel(const unsigned short & red, const unsigned short & green, const unsigned short & blue) const
 {
-	std::ostringstream in;
-	in << std::to_string(red) << "/" << std::to_string(green) << "/" + std::to_string(blue);
-	std::string rgbTripleKey = in.str();
+	if (red > 255 || green > 255 || blue > 255)
+		return std::string("");
 
-	try
-	{
-		return this->_label_lookups.at(rgbTripleKey);
+	while (this->isBeingUpdated())
+		usleep(10000); // 10,000 micro seconds /10 milli seconds
+
+	return this->getLabelName(
+		this->getLabelIndex(
+			tissuestack::imaging::TissueStackLabelLookup::packRgb(
+				static_cast<unsigned char>(red), static_cast<unsigned char>(green), static_cast<unsigned char>(blue))));
+}
+
+const unsigned int tissuestack::imaging::TissueStackLabelLookup::packRgb(
+	const unsigned char red, const unsigned char green, const unsigned char blue)
+{
+	return (static_cast<unsigned int>(red) << 16) | (static_cast<unsigned int>(green) << 8) | blue;
+}
+
+const std::shared_ptr<const tissuestack::imaging::TissueStackLabelLookup::LabelIndex>
+	tissuestack::imaging::TissueStackLabelLookup::getLabelIndexSnapshot() const
+{
+	return std::atomic_load(&this->_label_index);
+}
+
+inline const unsigned short tissuestack::imaging::TissueStackLabelLookup::getLabelIndex(
+	const tissuestack::imaging::TissueStackLabelLookup::LabelIndex * index, const unsigned int rgb)
+{
+	if (index == nullptr)
+		return 0;
 
-	} catch (std::out_of_range & not_found) {
+	return index->indices[(index->pages[(rgb >> 8) & 0xFFFF] << 8) | (rgb & 0xFF)];
+}
+
+const unsigned short tissuestack::imaging::TissueStackLabelLookup::getLabelIndex(const unsigned int rgb) const
+{
+	return tissuestack::imaging::TissueStackLabelLookup::getLabelIndex(this->getLabelIndexSnapshot().get(), rgb);
+}
+
+const std::string tissuestack::imaging::TissueStackLabelLookup::getLabelName(const unsigned short label_index) const
+{
+	const std::shared_ptr<const tissuestack::imaging::TissueStackLabelLookup::LabelIndex> index =
+		this->getLabelIndexSnapshot();
+	if (!index || label_index == 0 || label_index > index->names.size())
 		return std::string("");
+
+	return index->names[label_index-1];
+}
+
+const unsigned short tissuestack::imaging::TissueStackLabelLookup::findLabelIndex(const std::string & label_name) const
+{
+	const std::shared_ptr<const tissuestack::imaging::TissueStackLabelLookup::LabelIndex> index =
+		this->getLabelIndexSnapshot();
+	if (!index)
+		return 0;
+
+	for (unsigned int i=0;i<index->names.size();i++)
+		if (index->names[i].compare(label_name) == 0)
+			return static_cast<unsigned short>(i+1);
+
+	return 0;
+}
+
+const unsigned short tissuestack::imaging::TissueStackLabelLookup::getNumberOfLabels() const
+{
+	const std::shared_ptr<const tissuestack::imaging::TissueStackLabelLookup::LabelIndex> index =
+		this->getLabelIndexSnapshot();
+	if (!index)
+		return 0;
+
+	return static_cast<unsigned short>(index->names.size());
+}
+
+void tissuestack::imaging::TissueStackLabelLookup::findLabelIndices(
+	const unsigned char * voxels,
+	const unsigned short channels,
+	const unsigned long long int number_of_voxels,
+	unsigned short * label_indices) const
+{
+	while (this->isBeingUpdated())
+		usleep(10000); // 10,000 micro seconds /10 milli seconds
+
+	// one snapshot for the whole run, an update in between doesn't mix two indices
+	const std::shared_ptr<const tissuestack::imaging::TissueStackLabelLookup::LabelIndex> index =
+		this->getLabelIndexSnapshot();
+
+	if (channels == 1)
+	{
+		// a gray value can only ever hit one of 256 entries: look them up once
+		unsigned short grayIndices[256];
+		for (unsigned short v=0;v<256;v++)
+			grayIndices[v] =
+				tissuestack::imaging::TissueStackLabelLookup::getLabelIndex(
+					index.get(), tissuestack::imaging::TissueStackLabelLookup::packRgb(v, v, v));
+		for (unsigned long long int i=0;i<number_of_voxels;i++)
+			label_indices[i] = grayIndices[voxels[i]];
+		return;
+	}
+
+	for (unsigned long long int i=0;i<number_of_voxels;i++)
+	{
+		const unsigned char * voxel = voxels + i * channels;
+		label_indices[i] =
+			tissuestack::imaging::TissueStackLabelLookup::getLabelIndex(
+				index.get(), tissuestack::imaging::TissueStackLabelLookup::packRgb(voxel[0], voxel[1], voxel[2]));
+	}
+}
+
+void tissuestack::imaging::TissueStackLabelLookup::indexLabels()
+{
+	// colors of the same label name get the same index, so that outlines only run between different labels
+	std::shared_ptr<tissuestack::imaging::TissueStackLabelLookup::LabelIndex> index =
+		std::make_shared<tissuestack::imaging::TissueStackLabelLookup::LabelIndex>();
+	std::vector<unsigned int> & pages = index->pages;
+	std::vector<unsigned short> & indices = index->indices;
+	std::vector<std::string> & names = index->names;
+	pages.assign(256 * 256, 0);
+	indices.assign(256, 0);
+	std::unordered_map<std::string, unsigned short> indexOfName;
+
+	for (auto entry : this->_label_lookups)
+	{
+		const std::vector<std::string> rgb = tissuestack::utils::Misc::tokenizeString(entry.first, '/');
+		if (rgb.size() != 3)
+			continue;
+		const unsigned long int red = strtoul(rgb[0].c_str(), NULL, 10);
+		const unsigned long int green = strtoul(rgb[1].c_str(), NULL, 10);
+		const unsigned long int blue = strtoul(rgb[2].c_str(), NULL, 10);
+		if (red > 255 || green > 255 || blue > 255)
+			continue;
+
+		auto name = indexOfName.find(entry.second);
+		if (name == indexOfName.end())
+		{
+			if (names.size() >= 65535) // the index is 16 bit
+				continue;
+			names.push_back(entry.second);
+			name = indexOfName.emplace(entry.second, static_cast<unsigned short>(names.size())).first;
+		}
+
+		const unsigned int redGreen = (red << 8) | green;
+		if (pages[redGreen] == 0)
+		{
+			pages[redGreen] = indices.size() / 256;
+			indices.resize(indices.size() + 256, 0);
+		}
+		indices[(pages[redGreen] << 8) | blue] = name->second;
 	}
+
+	// readers still holding the old index keep it alive until they are done
+	std::atomic_store(
+		&this->_label_index,
+		std::shared_ptr<const tissuestack::imaging::TissueStackLabelLookup::LabelIndex>(std::move(index)));
 }
 
 void tissuestack::imaging::TissueStackLabelLookup::copyGrayIndexedRgbMapping(std::array<unsigned short[3], 256> & grayIndexedRgbMapping) const
@@ -0,0 +1,332 @@
+/*
+ * This file is part of TissueStack.
+ *
+ * TissueStack is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TissueStack is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TissueStack.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "networking.h"
+#include "imaging.h"
+
+tissuestack::imaging::TissueStackLabelSpatialIndex::TissueStackLabelSpatialIndex(
+	const tissuestack::imaging::TissueStackLabelLookup * lookup,
+	const std::array<unsigned int, 3> & volume) :
+		_lookup(lookup), _lookup_modification(lookup->getLastModified()), _volume(volume)
+{
+	const unsigned long long int numberOfLabels = lookup->getNumberOfLabels() + 1;
+	this->_voxels.resize(numberOfLabels, 0);
+	this->_sums.resize(numberOfLabels, {{ 0, 0, 0 }});
+	for (unsigned short a=0;a<3;a++)
+		this->_presence[a].resize(numberOfLabels * volume[a], 0);
+}
+
+tissuestack::imaging::TissueStackLabelSpatialIndex * tissuestack::imaging::TissueStackLabelSpatialIndex::build(
+	const tissuestack::imaging::TissueStackRawData * raw,
+	const tissuestack::imaging::TissueStackLabelLookup * lookup)
+{
+	if (raw == nullptr || lookup == nullptr)
+		THROW_TS_EXCEPTION(tissuestack::common::TissueStackNullPointerException,
+			"A label index needs a raw file and a label lookup!");
+	if (raw->getDimension('x') == nullptr || raw->getDimension('y') == nullptr || raw->getDimension('z') == nullptr)
+		THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
+			"A label index needs a data set with x, y and z dimensions!");
+
+	// the label indices must not change underneath us
+	while (lookup->isBeingUpdated())
+		usleep(10000); // 10,000 micro seconds /10 milli seconds
+
+	const tissuestack::imaging::TissueStackDataDimension * zDimension = raw->getDimension('z');
+	const std::array<unsigned int, 3> volume =
+		{{ zDimension->getWidth(), zDimension->getHeight(), static_cast<unsigned int>(zDimension->getNumberOfSlices()) }};
+	std::unique_ptr<tissuestack::imaging::TissueStackLabelSpatialIndex> index(
+		new tissuestack::imaging::TissueStackLabelSpatialIndex(lookup, volume));
+
+	// gray labels are fully described by the per slice histograms written at conversion
+	if (raw->getType() == tissuestack::imaging::RAW_TYPE::UCHAR_8_BIT && raw->getStatistics() != nullptr &&
+			index->indexFromStatistics(raw->getStatistics()))
+		return index.release();
+
+	// everything else takes a pass over the z slices, every thread a band of them into its own index
+	const unsigned int numberOfThreads =
+		std::max(1u,
+			std::min(
+				std::min(
+					tissuestack::utils::System::getNumberOfCores(),
+					static_cast<unsigned int>(tissuestack::imaging::TissueStackLabelSpatialIndex::MAXIMUM_NUMBER_OF_THREADS)),
+				volume[2]));
+	const unsigned int slicesPerThread = (volume[2] + numberOfThreads - 1) / numberOfThreads;
+	// the first band goes straight into the index
+	std::vector<std::unique_ptr<tissuestack::imaging::TissueStackLabelSpatialIndex> > partials;
+	std::unique_ptr<bool[]> succeeded(new bool[numberOfThreads]);
+	// declared after the partial indices: the bands are joined before those can go away
+	tissuestack::utils::WorkerThreads threads;
+	for (unsigned int t=0;t<numberOfThreads;t++)
+	{
+		succeeded[t] = true;
+		if (t * slicesPerThread >= volume[2])
+			continue;
+		if (t > 0)
+			partials.push_back(
+				std::unique_ptr<tissuestack::imaging::TissueStackLabelSpatialIndex>(
+					new tissuestack::imaging::TissueStackLabelSpatialIndex(lookup, volume)));
+		threads.start(
+			std::bind(
+				&tissuestack::imaging::TissueStackLabelSpatialIndex::indexSliceRange,
+				raw,
+				t * slicesPerThread,
+				std::min(volume[2] - 1, (t + 1) * slicesPerThread - 1),
+				t == 0 ? index.get() : partials.back().get(),
+				std::ref(succeeded[t])));
+	}
+	threads.join();
+
+	bool allSucceeded = true;
+	for (unsigned int t=0;t<numberOfThreads;t++)
+		allSucceeded = allSucceeded && succeeded[t];
+	if (!allSucceeded)
+		THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
+			"Label index: Could not read the slices of the raw file!");
+
+	for (auto & partial : partials)
+		index->merge(partial.get());
+
+	return index.release();
+}
+
+const bool tissuestack::imaging::TissueStackLabelSpatialIndex::indexFromStatistics(
+	const tissuestack::imaging::TissueStackRawStatistics * statistics)
+{
+	// which label every gray value stands for
+	unsigned short grayIndices[256];
+	for (unsigned short v=0;v<256;v++)
+		grayIndices[v] =
+			this->_lookup->getLabelIndex(tissuestack::imaging::TissueStackLabelLookup::packRgb(v, v, v));
+
+	const std::string dimensions[3] = { "x", "y", "z" };
+	unsigned long long int histogram[256];
+	for (unsigned short a=0;a<3;a++)
+		for (unsigned int s=0;s<this->_volume[a];s++)
+		{
+			memset(histogram, 0, sizeof(histogram));
+			if (!statistics->addHistograms(dimensions[a], s, histogram))
+				return false;
+
+			for (unsigned short v=0;v<256;v++)
+			{
+				const unsigned short label = grayIndices[v];
+				if (label == 0 || histogram[v] == 0)
+					continue;
+
+				this->_presence[a][static_cast<unsigned long long int>(label) * this->_volume[a] + s] = 1;
+				this->_sums[label][a] += histogram[v] * s;
+				// every voxel is on exactly one z slice
+				if (a == 2)
+					this->_voxels[label] += histogram[v];
+			}
+		}
+
+	return true;
+}
+
+void tissuestack::imaging::TissueStackLabelSpatialIndex::indexSliceRange(
+	const tissuestack::imaging::TissueStackRawData * raw,
+	const unsigned int first_slice,
+	const unsigned int last_slice,
+	tissuestack::imaging::TissueStackLabelSpatialIndex * partial,
+	bool & succeeded)
+{
+	const tissuestack::imaging::TissueStackDataDimension * zDimension = raw->getDimension('z');
+	const unsigned short channels =
+		raw->getType() == tissuestack::imaging::RAW_TYPE::UCHAR_8_BIT ? 1 : 3;
+	const unsigned int width = partial->_volume[0];
+	const unsigned int height = partial->_volume[1];
+	const unsigned long long int rowLength = static_cast<unsigned long long int>(width) * channels;
+	std::vector<unsigned char> slice(rowLength * height);
+	std::vector<unsigned short> labels(static_cast<unsigned long long int>(width) * height);
+
+	for (unsigned int s=first_slice;s<=last_slice;s++)
+	{
+		if (!raw->readSliceRegion(zDimension, s, 0, 0, width, height, slice.data(), rowLength))
+		{
+			succeeded = false;
+			return;
+		}
+		partial->_lookup->findLabelIndices(slice.data(), channels, labels.size(), labels.data());
+
+		// the columns of a z slice are x, its rows y
+		for (unsigned int y=0;y<height;y++)
+		{
+			const unsigned short * row = labels.data() + static_cast<unsigned long long int>(y) * width;
+			for (unsigned int x=0;x<width;x++)
+			{
+				const unsigned short label = row[x];
+				if (label == 0)
+					continue;
+
+				partial->_voxels[label]++;
+				partial->_sums[label][0] += x;
+				partial->_sums[label][1] += y;
+				partial->_sums[label][2] += s;
+				partial->_presence[0][static_cast<unsigned long long int>(label) * width + x] = 1;
+				partial->_presence[1][static_cast<unsigned long long int>(label) * height + y] = 1;
+				partial->_presence[2][static_cast<unsigned long long int>(label) * partial->_volume[2] + s] = 1;
+			}
+		}
+	}
+}
+
+void tissuestack::imaging::TissueStackLabelSpatialIndex::merge(
+	const tissuestack::imaging::TissueStackLabelSpatialIndex * partial)
+{
+	for (unsigned long long int l=0;l<this->_voxels.size();l++)
+	{
+		this->_voxels[l] += partial->_voxels[l];
+		for (unsigned short a=0;a<3;a++)
+			this->_sums[l][a] += partial->_sums[l][a];
+	}
+	for (unsigned short a=0;a<3;a++)
+		for (unsigned long long int i=0;i<this->_presence[a].size();i++)
+			this->_presence[a][i] |= partial->_presence[a][i];
+}
+
+const bool tissuestack::imaging::TissueStackLabelSpatialIndex::isUpToDate(
+	const tissuestack::imaging::TissueStackLabelLookup * lookup) const
+{
+	return lookup == this->_lookup && lookup->getLastModified() == this->_lookup_modification;
+}
+
+const unsigned long long int tissuestack::imaging::TissueStackLabelSpatialIndex::getNumberOfVoxels(
+	const unsigned short label_index) const
+{
+	if (label_index == 0 || label_index >= this->_voxels.size())
+		return 0;
+
+	return this->_voxels[label_index];
+}
+
+const bool tissuestack::imaging::TissueStackLabelSpatialIndex::getBounds(
+	const unsigned short label_index,
+	std::array<unsigned int, 6> & bounds) const
+{
+	if (this->getNumberOfVoxels(label_index) == 0)
+		return false;
+
+	for (unsigned short a=0;a<3;a++)
+	{
+		const unsigned char * presence =
+			this->_presence[a].data() + static_cast<unsigned long long int>(label_index) * this->_volume[a];
+		unsigned int first = 0;
+		while (presence[first] == 0)
+			first++;
+		unsigned int last = this->_volume[a] - 1;
+		while (presence[last] == 0)
+			last--;
+		bounds[a] = first;
+		bounds[a + 3] = last;
+	}
+
+	return true;
+}
+
+const std::array<double, 3> tissuestack::imaging::TissueStackLabelSpatialIndex::getCentroid(
+	const unsigned short label_index) const
+{
+	std::array<double, 3> centroid = {{ 0, 0, 0 }};
+	const unsigned long long int numberOfVoxels = this->getNumberOfVoxels(label_index);
+	if (numberOfVoxels == 0)
+		return centroid;
+
+	for (unsigned short a=0;a<3;a++)
+		centroid[a] = static_cast<double>(this->_sums[label_index][a]) / numberOfVoxels;
+
+	return centroid;
+}
+
+const std::vector<std::pair<unsigned int, unsigned int> > tissuestack::imaging::TissueStackLabelSpatialIndex::getSliceRanges(
+	const unsigned short label_index,
+	const char dimension) const
+{
+	std::vector<std::pair<unsigned int, unsigned int> > ranges;
+	if (this->getNumberOfVoxels(label_index) == 0 || dimension < 'x' || dimension > 'z')
+		return ranges;
+
+	const unsigned short a = dimension - 'x';
+	const unsigned char * presence =
+		this->_presence[a].data() + static_cast<unsigned long long int>(label_index) * this->_volume[a];
+	for (unsigned int s=0;s<this->_volume[a];s++)
+	{
+		if (presence[s] == 0)
+			continue;
+		if (!ranges.empty() && ranges.back().second + 1 == s)
+			ranges.back().second = s;
+		else
+			ranges.push_back(std::pair<unsigned int, unsigned int>(s, s));
+	}
+
+	return ranges;
+}
+
+const unsigned long long int tissuestack::imaging::TissueStackLabelSpatialIndex::measureSlice(
+	const tissuestack::imaging::TissueStackRawData * raw,
+	const tissuestack::imaging::TissueStackLabelLookup * lookup,
+	const tissuestack::imaging::TissueStackDataDimension * dimension,
+	const unsigned int slice_number,
+	const unsigned short label_index,
+	std::array<unsigned int, 4> & bounds,
+	std::array<double, 2> & centroid)
+{
+	bounds = {{ 0, 0, 0, 0 }};
+	centroid = {{ 0, 0 }};
+	if (raw == nullptr || lookup == nullptr || dimension == nullptr || label_index == 0)
+		return 0;
+
+	const unsigned short channels =
+		raw->getType() == tissuestack::imaging::RAW_TYPE::UCHAR_8_BIT ? 1 : 3;
+	const unsigned int width = dimension->getWidth();
+	const unsigned int height = dimension->getHeight();
+	const unsigned long long int rowLength = static_cast<unsigned long long int>(width) * channels;
+	std::vector<unsigned char> slice(rowLength * height);
+	if (!raw->readSliceRegion(dimension, slice_number, 0, 0, width, height, slice.data(), rowLength))
+		THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
+			"Label index: Could not read the slice of the raw file!");
+	std::vector<unsigned short> labels(static_cast<unsigned long long int>(width) * height);
+	lookup->findLabelIndices(slice.data(), channels, labels.size(), labels.data());
+
+	unsigned long long int numberOfVoxels = 0;
+	unsigned long long int sumX = 0, sumY = 0;
+	unsigned int left = width, top = height, right = 0, bottom = 0;
+	for (unsigned int y=0;y<height;y++)
+	{
+		const unsigned short * row = labels.data() + static_cast<unsigned long long int>(y) * width;
+		for (unsigned int x=0;x<width;x++)
+		{
+			if (row[x] != label_index)
+				continue;
+
+			numberOfVoxels++;
+			sumX += x;
+			sumY += y;
+			left = std::min(left, x);
+			right = std::max(right, x + 1);
+			top = std::min(top, y);
+			bottom = y + 1;
+		}
+	}
+
+	if (numberOfVoxels == 0)
+		return 0;
+
+	bounds = {{ left, top, right, bottom }};
+	centroid = {{ static_cast<double>(sumX) / numberOfVoxels, static_cast<double>(sumY) / numberOfVoxels }};
+
+	return numberOfVoxels;
+}
@@ -0,0 +1,178 @@
+/*
+ * This file is part of TissueStack.
+ *
+ * TissueStack is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TissueStack is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TissueStack.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "networking.h"
+#include "imaging.h"
+
+tissuestack::imaging::TissueStackLookupTable::TissueStackLookupTable(
+	const unsigned short minimum,
+	const unsigned short maximum,
+	const unsigned short dataset_min,
+	const unsigned short dataset_max,
+	const tissuestack::imaging::TissueStackColorMap * color_map)
+{
+	// the full range means no contrast adjustment
+	if (minimum == 0 && maximum == 255)
+		for (unsigned int i=0;i<256;i++)
+			this->_gray[i] = static_cast<unsigned char>(i);
+	else
+	{
+		tissuestack::imaging::PixelKernels::buildWindowLevelTable(
+			this->_gray, minimum, maximum, dataset_min, dataset_max);
+		this->_is_identity = false;
+	}
+
+	if (color_map == nullptr)
+		return;
+
+	this->_is_colored = true;
+	this->_is_identity = false;
+	for (unsigned short i=0;i<256;i++)
+	{
+		const std::array<const unsigned short, 3> mapping =
+				color_map->getRGBMapForGrayValue(this->_gray[i]);
+		this->_rgb[i][0] = static_cast<unsigned char>(mapping[0]);
+		this->_rgb[i][1] = static_cast<unsigned char>(mapping[1]);
+		this->_rgb[i][2] = static_cast<unsigned char>(mapping[2]);
+	}
+}
+
+const bool tissuestack::imaging::TissueStackLookupTable::isColored() const
+{
+	return this->_is_colored;
+}
+
+const bool tissuestack::imaging::TissueStackLookupTable::isIdentity() const
+{
+	return this->_is_identity;
+}
+
+const unsigned char * tissuestack::imaging::TissueStackLookupTable::getPalette() const
+{
+	// the color table doubles as png palette: the source value is the index
+	return this->_is_colored ? &this->_rgb[0][0] : nullptr;
+}
+
+tissuestack::imaging::PixelBuffer * tissuestack::imaging::TissueStackLookupTable::apply(
+	const tissuestack::imaging::PixelBuffer * buffer) const
+{
+	if (buffer == nullptr)
+		return nullptr;
+
+	if (this->_is_colored)
+	{
+		// the gray value (or red for rgb data) is looked up
+		tissuestack::imaging::PixelBuffer * colored =
+			new tissuestack::imaging::PixelBuffer(buffer->getWidth(), buffer->getHeight(), 3);
+		tissuestack::imaging::PixelKernels::applyColorLookupTable(
+			buffer->getData(),
+			buffer->getChannels(),
+			colored->getData(),
+			static_cast<unsigned long long int>(buffer->getWidth()) * static_cast<unsigned long long int>(buffer->getHeight()),
+			this->_rgb);
+		return colored;
+	}
+
+	tissuestack::imaging::PixelBuffer * adjusted =
+		new tissuestack::imaging::PixelBuffer(buffer->getWidth(), buffer->getHeight(), buffer->getChannels());
+	if (this->_is_identity)
+		memcpy(adjusted->getData(), buffer->getData(), buffer->getSizeInBytes());
+	else
+		tissuestack::imaging::PixelKernels::applyLookupTable(
+			buffer->getData(),
+			adjusted->getData(),
+			buffer->getSizeInBytes(),
+			this->_gray);
+
+	return adjusted;
+}
+
+void tissuestack::imaging::TissueStackLookupTable::applyToRow(
+	const unsigned char * source_row,
+	const unsigned short source_channels,
+	const unsigned long long int * column_offsets,
+	const unsigned int width,
+	unsigned char * destination) const
+{
+	// gathers the sampled columns and maps them in the same go
+	if (this->_is_colored)
+	{
+		for (unsigned int x=0;x<width;x++)
+		{
+			const unsigned char * rgb = this->_rgb[source_row[column_offsets[x]]];
+			destination[x*3] = rgb[0];
+			destination[x*3+1] = rgb[1];
+			destination[x*3+2] = rgb[2];
+		}
+		return;
+	}
+
+	if (source_channels == 1)
+	{
+		if (this->_is_identity)
+			for (unsigned int x=0;x<width;x++)
+				destination[x] = source_row[column_offsets[x]];
+		else
+			for (unsigned int x=0;x<width;x++)
+				destination[x] = this->_gray[source_row[column_offsets[x]]];
+		return;
+	}
+
+	for (unsigned int x=0;x<width;x++)
+	{
+		const unsigned char * pixel = source_row + column_offsets[x];
+		destination[x*3] = this->_gray[pixel[0]];
+		destination[x*3+1] = this->_gray[pixel[1]];
+		destination[x*3+2] = this->_gray[pixel[2]];
+	}
+}
+
+void tissuestack::imaging::TissueStackLookupTable::blendRowOnto(
+	const unsigned char * source_row,
+	const unsigned short source_channels,
+	const unsigned long long int * column_offsets,
+	const unsigned int width,
+	const unsigned short weight,
+	unsigned char * destination) const
+{
+	const unsigned int remainder = 256 - weight;
+	unsigned char mapped[3];
+	for (unsigned int x=0;x<width;x++)
+	{
+		const unsigned char * pixel = source_row + column_offsets[x];
+		if (pixel[0] == 0 && (source_channels == 1 || (pixel[1] == 0 && pixel[2] == 0)))
+			continue;
+
+		const unsigned char * rgb = mapped;
+		if (this->_is_colored)
+			rgb = this->_rgb[pixel[0]];
+		else if (source_channels == 1)
+			mapped[0] = mapped[1] = mapped[2] = this->_gray[pixel[0]];
+		else
+		{
+			mapped[0] = this->_gray[pixel[0]];
+			mapped[1] = this->_gray[pixel[1]];
+			mapped[2] = this->_gray[pixel[2]];
+		}
+
+		unsigned char * out = destination + x * 3;
+		for (unsigned short c=0;c<3;c++)
+			out[c] =
+				static_cast<unsigned char>(
+					(static_cast<unsigned int>(out[c]) * remainder +
+					 static_cast<unsigned int>(rgb[c]) * weight + 128) >> 8);
+	}
+}
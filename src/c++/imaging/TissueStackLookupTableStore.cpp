@@ -0,0 +1,93 @@
+/*
+ * This file is part of TissueStack.
+ *
+ * TissueStack is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TissueStack is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TissueStack.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "networking.h"
+#include "imaging.h"
+
+tissuestack::imaging::TissueStackLookupTableStore::TissueStackLookupTableStore() {}
+
+tissuestack::imaging::TissueStackLookupTableStore * tissuestack::imaging::TissueStackLookupTableStore::instance()
+{
+	if (tissuestack::imaging::TissueStackLookupTableStore::_instance == nullptr)
+		tissuestack::imaging::TissueStackLookupTableStore::_instance = new tissuestack::imaging::TissueStackLookupTableStore();
+
+	return tissuestack::imaging::TissueStackLookupTableStore::_instance;
+}
+
+const bool tissuestack::imaging::TissueStackLookupTableStore::doesInstanceExist()
+{
+	return (tissuestack::imaging::TissueStackLookupTableStore::_instance != nullptr);
+}
+
+void tissuestack::imaging::TissueStackLookupTableStore::purgeInstance()
+{
+	this->_tables.clear();
+	this->_usage.clear();
+
+	delete tissuestack::imaging::TissueStackLookupTableStore::_instance;
+	tissuestack::imaging::TissueStackLookupTableStore::_instance = nullptr;
+}
+
+const std::shared_ptr<const tissuestack::imaging::TissueStackLookupTable> tissuestack::imaging::TissueStackLookupTableStore::findLookupTable(
+	const unsigned short minimum,
+	const unsigned short maximum,
+	const unsigned short dataset_min,
+	const unsigned short dataset_max,
+	const std::string & color_map_name)
+{
+	// the color map is looked up once, its modification time invalidates tables of older versions
+	const tissuestack::imaging::TissueStackColorMap * colorMap = nullptr;
+	if (color_map_name.compare("gray") != 0 && color_map_name.compare("grey") != 0)
+	{
+		colorMap = tissuestack::imaging::TissueStackColorMapStore::instance()->findColorMap(color_map_name);
+		if (colorMap == nullptr)
+			THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
+				"Colormap Application: Could not find color map!");
+	}
+
+	// the data set range only matters for contrast adjustments
+	const bool fullRange = (minimum == 0 && maximum == 255);
+	const std::string signature =
+		std::to_string(minimum) + ":" + std::to_string(maximum) + ":" +
+		(fullRange ? "" : (std::to_string(dataset_min) + ":" + std::to_string(dataset_max))) + ":" +
+		(colorMap == nullptr ? "gray" :
+			(color_map_name + "@" + std::to_string(static_cast<long long int>(colorMap->getLastModified()))));
+
+	std::lock_guard<std::mutex> lock(this->_tables_mutex);
+
+	const auto hit = this->_tables.find(signature);
+	if (hit != this->_tables.end())
+	{
+		this->_usage.splice(this->_usage.end(), this->_usage, hit->second.second);
+		return hit->second.first;
+	}
+
+	const std::shared_ptr<const tissuestack::imaging::TissueStackLookupTable> table(
+		new tissuestack::imaging::TissueStackLookupTable(
+			minimum, maximum, dataset_min, dataset_max, colorMap));
+
+	// once full the least recently used table makes room, pipelines still holding it keep it alive
+	if (this->_tables.size() >= tissuestack::imaging::TissueStackLookupTableStore::MAXIMUM_NUMBER_OF_TABLES)
+	{
+		this->_tables.erase(this->_usage.front());
+		this->_usage.pop_front();
+	}
+	this->_tables[signature] = std::make_pair(table, this->_usage.insert(this->_usage.end(), signature));
+
+	return table;
+}
+
+tissuestack::imaging::TissueStackLookupTableStore * tissuestack::imaging::TissueStackLookupTableStore::_instance = nullptr;
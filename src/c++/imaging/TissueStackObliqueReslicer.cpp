@@ -0,0 +1,354 @@
+/*
+ * This file is part of TissueStack.
+ *
+ * TissueStack is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TissueStack is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TissueStack.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "networking.h"
+#include "imaging.h"
+#include <thread>
+
+namespace
+{
+	inline const unsigned int interpolate(const unsigned int a, const unsigned int b, const unsigned int weight)
+	{
+		return (a * (256 - weight) + b * weight + 128) >> 8;
+	}
+
+	// regions this small (in voxels) are read in one go even if the plane needs only part of them
+	const unsigned long long int MINIMUM_REGION_READ = 16384;
+}
+
+tissuestack::imaging::TissueStackObliqueReslicer::TissueStackObliqueReslicer(
+	const tissuestack::imaging::TissueStackRawData * image,
+	const tissuestack::networking::TissueStackObliqueRequest * request) :
+		_image(image), _request(request)
+{
+	if (image == nullptr || request == nullptr)
+		THROW_TS_EXCEPTION(tissuestack::common::TissueStackNullPointerException,
+			"Oblique reslicing needs a raw and a request!");
+
+	if (image->get2DDimension() != nullptr ||
+			image->getDimension('x') == nullptr || image->getDimension('y') == nullptr || image->getDimension('z') == nullptr)
+		THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
+			"Oblique planes can only be cut from volumes with x, y and z!");
+
+	this->_volume[0] = image->getDimension('z')->getWidth();
+	this->_volume[1] = image->getDimension('z')->getHeight();
+	this->_volume[2] = image->getDimension('z')->getNumberOfSlices();
+	this->_channels = image->getType() == tissuestack::imaging::RAW_TYPE::UCHAR_8_BIT ? 1 : 3;
+}
+
+tissuestack::imaging::TissueStackObliqueReslicer::~TissueStackObliqueReslicer()
+{
+	if (this->_reserved_bytes > 0 && tissuestack::utils::MemoryAccounting::doesInstanceExist())
+		tissuestack::utils::MemoryAccounting::instance()->removeInFlightBytes(this->_reserved_bytes);
+}
+
+const unsigned short tissuestack::imaging::TissueStackObliqueReslicer::getChannels() const
+{
+	return this->_channels;
+}
+
+inline const bool tissuestack::imaging::TissueStackObliqueReslicer::locate(
+	const unsigned int column,
+	const unsigned int row,
+	std::array<unsigned int, 3> & lower,
+	std::array<unsigned int, 3> & upper,
+	std::array<unsigned int, 3> & weights) const
+{
+	const std::array<float, 3> origin = this->_request->getOrigin();
+	const std::array<float, 3> u = this->_request->getColumnDirection();
+	const std::array<float, 3> v = this->_request->getRowDirection();
+
+	for (unsigned short a=0;a<3;a++)
+	{
+		const double position =
+			static_cast<double>(origin[a]) +
+			static_cast<double>(column) * static_cast<double>(u[a]) +
+			static_cast<double>(row) * static_cast<double>(v[a]);
+		const double last = static_cast<double>(this->_volume[a] - 1);
+
+		// anything further than half a voxel away from the volume is outside
+		if (position < -0.5 || position >= last + 0.5)
+			return false;
+
+		if (!this->_request->isTrilinear())
+		{
+			lower[a] = upper[a] = static_cast<unsigned int>(floor(position + 0.5));
+			weights[a] = 0;
+			continue;
+		}
+
+		const double clamped = position < 0 ? 0 : (position > last ? last : position);
+		lower[a] = static_cast<unsigned int>(floor(clamped));
+		upper[a] = lower[a] + 1 > this->_volume[a] - 1 ? lower[a] : lower[a] + 1;
+		weights[a] = static_cast<unsigned int>(floor((clamped - lower[a]) * 256 + 0.5));
+	}
+
+	return true;
+}
+
+inline const unsigned char * tissuestack::imaging::TissueStackObliqueReslicer::getVoxel(
+	const unsigned int i,
+	const unsigned int j,
+	const unsigned int k) const
+{
+	const unsigned long long int span = this->_row_base[k] + (j - this->_first_row[k]);
+	return this->_voxels.data() +
+		this->_span_offset[span] + static_cast<unsigned long long int>(i - this->_span_start[span]) * this->_channels;
+}
+
+void tissuestack::imaging::TissueStackObliqueReslicer::readVoxels()
+{
+	const unsigned int width = this->_request->getPlaneWidth();
+	const unsigned int height = this->_request->getPlaneHeight();
+	std::array<unsigned int, 3> lower;
+	std::array<unsigned int, 3> upper;
+	std::array<unsigned int, 3> weights;
+
+	// first pass: the rows each z slice has to provide
+	std::vector<unsigned int> lastRow(this->_volume[2], 0);
+	this->_first_row.assign(this->_volume[2], UINT_MAX);
+	for (unsigned int r=0;r<height;r++)
+		for (unsigned int c=0;c<width;c++)
+		{
+			if (!this->locate(c, r, lower, upper, weights))
+				continue;
+			for (auto k : { lower[2], upper[2] })
+			{
+				this->_first_row[k] = std::min(this->_first_row[k], lower[1]);
+				lastRow[k] = std::max(lastRow[k], upper[1]);
+			}
+		}
+
+	this->_row_base.assign(this->_volume[2], 0);
+	unsigned long long int numberOfRows = 0;
+	for (unsigned int k=0;k<this->_volume[2];k++)
+	{
+		if (this->_first_row[k] == UINT_MAX)
+			continue;
+		this->_row_base[k] = numberOfRows;
+		numberOfRows += lastRow[k] - this->_first_row[k] + 1;
+	}
+
+	// second pass: the columns of each of those rows
+	this->_span_start.assign(numberOfRows, UINT_MAX);
+	this->_span_end.assign(numberOfRows, 0);
+	this->_span_offset.assign(numberOfRows, 0);
+	for (unsigned int r=0;r<height;r++)
+		for (unsigned int c=0;c<width;c++)
+		{
+			if (!this->locate(c, r, lower, upper, weights))
+				continue;
+			for (auto k : { lower[2], upper[2] })
+				for (auto j : { lower[1], upper[1] })
+				{
+					const unsigned long long int span = this->_row_base[k] + (j - this->_first_row[k]);
+					this->_span_start[span] = std::min(this->_span_start[span], lower[0]);
+					this->_span_end[span] = std::max(this->_span_end[span], upper[0]);
+				}
+		}
+
+	// slices whose spans fill most of their bounding box get it in one read, the others row by row
+	std::vector<bool> readAsRegion(this->_volume[2], false);
+	std::vector<unsigned int> regionStart(this->_volume[2], UINT_MAX);
+	std::vector<unsigned int> regionEnd(this->_volume[2], 0);
+	unsigned long long int numberOfVoxels = 0;
+	for (unsigned int k=0;k<this->_volume[2];k++)
+	{
+		if (this->_first_row[k] == UINT_MAX)
+			continue;
+
+		unsigned long long int needed = 0;
+		const unsigned int rows = lastRow[k] - this->_first_row[k] + 1;
+		for (unsigned long long int span=this->_row_base[k];span<this->_row_base[k]+rows;span++)
+		{
+			if (this->_span_start[span] > this->_span_end[span])
+				continue;
+			needed += this->_span_end[span] - this->_span_start[span] + 1;
+			regionStart[k] = std::min(regionStart[k], this->_span_start[span]);
+			regionEnd[k] = std::max(regionEnd[k], this->_span_end[span]);
+		}
+
+		const unsigned long long int region =
+			static_cast<unsigned long long int>(rows) * (regionEnd[k] - regionStart[k] + 1);
+		readAsRegion[k] = region <= 2 * needed + MINIMUM_REGION_READ;
+		numberOfVoxels += readAsRegion[k] ? region : needed;
+	}
+
+	// the voxels and the plane sampled from them, turned away like any other read if memory is short
+	const unsigned long long int bytes =
+		(numberOfVoxels + static_cast<unsigned long long int>(width) * height) * this->_channels;
+	tissuestack::imaging::TissueStackSliceCache::reserveInFlightBytes(bytes);
+	this->_reserved_bytes = bytes;
+
+	this->_voxels.resize(numberOfVoxels * this->_channels);
+	const tissuestack::imaging::TissueStackDataDimension * zDimension = this->_image->getDimension('z');
+	unsigned long long int offset = 0;
+	for (unsigned int k=0;k<this->_volume[2];k++)
+	{
+		if (this->_first_row[k] == UINT_MAX)
+			continue;
+
+		// timeout/shutdown check
+		if (this->_request->hasExpired())
+			THROW_TS_EXCEPTION(tissuestack::common::TissueStackObsoleteRequestException,
+				"Old Image Request!");
+
+		const unsigned int rows = lastRow[k] - this->_first_row[k] + 1;
+		if (readAsRegion[k])
+		{
+			const unsigned int regionWidth = regionEnd[k] - regionStart[k] + 1;
+			if (!this->_image->readSliceRegion(
+					zDimension,
+					k,
+					regionStart[k],
+					this->_first_row[k],
+					regionWidth,
+					rows,
+					this->_voxels.data() + offset,
+					static_cast<unsigned long long int>(regionWidth) * this->_channels))
+				THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
+					"Failed to read oblique plane from RAW file!");
+			for (unsigned int r=0;r<rows;r++)
+			{
+				const unsigned long long int span = this->_row_base[k] + r;
+				this->_span_start[span] = regionStart[k];
+				this->_span_end[span] = regionEnd[k];
+				this->_span_offset[span] = offset;
+				offset += static_cast<unsigned long long int>(regionWidth) * this->_channels;
+			}
+			continue;
+		}
+
+		for (unsigned int r=0;r<rows;r++)
+		{
+			const unsigned long long int span = this->_row_base[k] + r;
+			if (this->_span_start[span] > this->_span_end[span])
+				continue;
+			const unsigned int spanWidth = this->_span_end[span] - this->_span_start[span] + 1;
+			if (!this->_image->readSliceRegion(
+					zDimension,
+					k,
+					this->_span_start[span],
+					this->_first_row[k] + r,
+					spanWidth,
+					1,
+					this->_voxels.data() + offset,
+					static_cast<unsigned long long int>(spanWidth) * this->_channels))
+				THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
+					"Failed to read oblique plane from RAW file!");
+			this->_span_offset[span] = offset;
+			offset += static_cast<unsigned long long int>(spanWidth) * this->_channels;
+		}
+	}
+}
+
+void tissuestack::imaging::TissueStackObliqueReslicer::sampleRows(
+	const unsigned int first_row,
+	const unsigned int last_row,
+	unsigned char * out) const
+{
+	const unsigned int width = this->_request->getPlaneWidth();
+	std::array<unsigned int, 3> lower;
+	std::array<unsigned int, 3> upper;
+	std::array<unsigned int, 3> weights;
+
+	for (unsigned int r=first_row;r<=last_row;r++)
+	{
+		unsigned char * pixel = out + static_cast<unsigned long long int>(r) * width * this->_channels;
+		for (unsigned int c=0;c<width;c++, pixel+=this->_channels)
+		{
+			if (!this->locate(c, r, lower, upper, weights))
+			{
+				memset(pixel, 0, this->_channels);
+				continue;
+			}
+
+			if (!this->_request->isTrilinear())
+			{
+				memcpy(pixel, this->getVoxel(lower[0], lower[1], lower[2]), this->_channels);
+				continue;
+			}
+
+			// the 8 neighbors: along x first, then y, then z
+			const unsigned char * v000 = this->getVoxel(lower[0], lower[1], lower[2]);
+			const unsigned char * v100 = this->getVoxel(upper[0], lower[1], lower[2]);
+			const unsigned char * v010 = this->getVoxel(lower[0], upper[1], lower[2]);
+			const unsigned char * v110 = this->getVoxel(upper[0], upper[1], lower[2]);
+			const unsigned char * v001 = this->getVoxel(lower[0], lower[1], upper[2]);
+			const unsigned char * v101 = this->getVoxel(upper[0], lower[1], upper[2]);
+			const unsigned char * v011 = this->getVoxel(lower[0], upper[1], upper[2]);
+			const unsigned char * v111 = this->getVoxel(upper[0], upper[1], upper[2]);
+			for (unsigned short ch=0;ch<this->_channels;ch++)
+				pixel[ch] =
+					static_cast<unsigned char>(
+						interpolate(
+							interpolate(
+								interpolate(v000[ch], v100[ch], weights[0]),
+								interpolate(v010[ch], v110[ch], weights[0]),
+								weights[1]),
+							interpolate(
+								interpolate(v001[ch], v101[ch], weights[0]),
+								interpolate(v011[ch], v111[ch], weights[0]),
+								weights[1]),
+							weights[2]));
+		}
+	}
+}
+
+unsigned char * tissuestack::imaging::TissueStackObliqueReslicer::reslice()
+{
+	this->readVoxels();
+
+	const unsigned int height = this->_request->getPlaneHeight();
+	std::unique_ptr<unsigned char[]> out(
+		new unsigned char[
+			static_cast<unsigned long long int>(this->_request->getPlaneWidth()) * height * this->_channels]);
+
+	// bands of rows, the calling thread takes the first
+	const unsigned int numberOfThreads =
+		std::max(1u,
+			std::min(
+				std::min(
+					tissuestack::utils::System::getNumberOfCores(),
+					static_cast<unsigned int>(tissuestack::imaging::TissueStackObliqueReslicer::MAXIMUM_NUMBER_OF_THREADS)),
+				height / 64));
+	const unsigned int rowsPerThread = (height + numberOfThreads - 1) / numberOfThreads;
+	// declared after the plane: the bands are joined before it can go away
+	tissuestack::utils::WorkerThreads threads;
+	for (unsigned int t=1;t<numberOfThreads;t++)
+	{
+		const unsigned int firstRow = t * rowsPerThread;
+		if (firstRow >= height)
+			break;
+		threads.start(
+			std::bind(
+				&tissuestack::imaging::TissueStackObliqueReslicer::sampleRows,
+				this,
+				firstRow,
+				std::min(height, firstRow + rowsPerThread) - 1,
+				out.get()));
+	}
+	this->sampleRows(0, std::min(height, rowsPerThread) - 1, out.get());
+	threads.join();
+
+	// the plane has been sampled, the voxels are of no use anymore
+	const unsigned long long int voxelBytes = this->_voxels.size();
+	std::vector<unsigned char>().swap(this->_voxels);
+	tissuestack::utils::MemoryAccounting::instance()->removeInFlightBytes(voxelBytes);
+	this->_reserved_bytes -= voxelBytes;
+
+	return out.release();
+}
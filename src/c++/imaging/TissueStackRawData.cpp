@@ -16,10 +16,146 @@
  */
 #include "networking.h"
 #include "imaging.h"
+#ifdef USE_LZ4
+#include <lz4.h>
+#endif
 
 tissuestack::imaging::TissueStackRawData::~TissueStackRawData()
 {
+	this->unpin();
+	if (this->_inflated_bricks_size > 0 && tissuestack::utils::MemoryAccounting::doesInstanceExist())
+		tissuestack::utils::MemoryAccounting::instance()->removeCacheBytes(this->_inflated_bricks_size);
+	if (this->_pyramid)
+		delete this->_pyramid;
+	if (this->_statistics)
+		delete this->_statistics;
+}
+
+const bool tissuestack::imaging::TissueStackRawData::pin()
+{
+	std::lock_guard<std::mutex> lock(this->_pin_mutex);
+
+	if (this->_pinned_data != nullptr)
+		return true;
+
+	const unsigned long long int length = this->getFileSizeInBytes();
+	if (length == 0)
+		return false;
+
+	// populate all pages up front so that the first requests don't fault them in one by one
+	void * mapped =
+		mmap(NULL, length, PROT_READ, MAP_SHARED | MAP_POPULATE, this->getFileDescriptor(), 0);
+	if (mapped == MAP_FAILED)
+	{
+		tissuestack::logging::TissueStackLogger::instance()->error(
+			"Failed to map data set %s into memory: %s\n", this->getFileName().c_str(), strerror(errno));
+		return false;
+	}
+
+	// locking may exceed RLIMIT_MEMLOCK: we keep the populated mapping regardless
+	this->_is_locked_in_memory = (mlock(mapped, length) == 0);
+	if (!this->_is_locked_in_memory)
+		tissuestack::logging::TissueStackLogger::instance()->error(
+			"Could not lock data set %s in memory (%s), its pages may still be reclaimed!\n",
+			this->getFileName().c_str(), strerror(errno));
 
+	this->_pinned_data = static_cast<unsigned char *>(mapped);
+	this->_pinned_length = length;
+	this->_is_pinned = true;
+
+	// locked pages are ours for good: admission has to know about them
+	if (this->_is_locked_in_memory)
+		tissuestack::utils::MemoryAccounting::instance()->addPinnedBytes(length);
+
+	return true;
+}
+
+void tissuestack::imaging::TissueStackRawData::unpin()
+{
+	std::unique_lock<std::mutex> lock(this->_pin_mutex);
+
+	if (this->_pinned_data == nullptr)
+		return;
+
+	// no new reads from here on, the ones under way finish before the mapping goes
+	unsigned char * data = this->_pinned_data;
+	this->_pinned_data = nullptr;
+	this->_is_pinned = false;
+	this->_pinned_readers_done.wait(lock, [this] { return this->_pinned_readers == 0; });
+
+	if (this->_is_locked_in_memory)
+	{
+		munlock(data, this->_pinned_length);
+		tissuestack::utils::MemoryAccounting::instance()->removePinnedBytes(this->_pinned_length);
+	}
+	munmap(data, this->_pinned_length);
+
+	this->_pinned_length = 0;
+	this->_is_locked_in_memory = false;
+}
+
+const bool tissuestack::imaging::TissueStackRawData::isPinned() const
+{
+	return this->_is_pinned;
+}
+
+const bool tissuestack::imaging::TissueStackRawData::isLockedInMemory() const
+{
+	return this->_is_locked_in_memory;
+}
+
+const unsigned long long int tissuestack::imaging::TissueStackRawData::getPinnedBytes() const
+{
+	std::lock_guard<std::mutex> lock(this->_pin_mutex);
+
+	return this->_pinned_length;
+}
+
+const unsigned long long int tissuestack::imaging::TissueStackRawData::getResidentBytes() const
+{
+	std::lock_guard<std::mutex> lock(this->_pin_mutex);
+
+	if (this->_pinned_data == nullptr)
+		return 0;
+
+	const unsigned long long int pageSize = static_cast<unsigned long long int>(sysconf(_SC_PAGESIZE));
+	const unsigned long long int numberOfPages = (this->_pinned_length + pageSize - 1) / pageSize;
+	std::vector<unsigned char> residency(numberOfPages, 0);
+	if (mincore(this->_pinned_data, this->_pinned_length, residency.data()) != 0)
+		return 0;
+
+	unsigned long long int residentPages = 0;
+	for (auto page : residency)
+		if (page & 1)
+			residentPages++;
+
+	return std::min(residentPages * pageSize, this->_pinned_length);
+}
+
+const bool tissuestack::imaging::TissueStackRawData::readPinnedData(
+	unsigned char * buffer,
+	const unsigned long long int offset,
+	const unsigned long long int length) const
+{
+	const unsigned char * data = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(this->_pin_mutex);
+
+		if (this->_pinned_data == nullptr || buffer == nullptr || offset + length > this->_pinned_length)
+			return false;
+
+		// registered as a reader the copy itself needs no lock: reads of a pinned data set run side by side
+		data = this->_pinned_data;
+		this->_pinned_readers++;
+	}
+
+	memcpy(buffer, data + offset, length);
+
+	std::lock_guard<std::mutex> lock(this->_pin_mutex);
+	if (--this->_pinned_readers == 0)
+		this->_pinned_readers_done.notify_all();
+
+	return true;
 }
 
 const bool tissuestack::imaging::TissueStackRawData::isRaw() const
@@ -38,7 +174,8 @@ const tissuestack::imaging::RAW_FILE_VERSION tissuestack::imaging::TissueStackRa
 }
 
 tissuestack::imaging::TissueStackRawData::TissueStackRawData(const std::string & filename) :
-		tissuestack::imaging::TissueStackImageData(filename, tissuestack::imaging::FORMAT::MINC)
+		tissuestack::imaging::TissueStackImageData(filename, tissuestack::imaging::FORMAT::MINC),
+		_is_pinned(false), _is_locked_in_memory(false)
 {
 	char header[20];
 	memset(header, '\0', 20);
@@ -112,6 +249,358 @@ tissuestack::imaging::TissueStackRawData::TissueStackRawData(const std::string &
 
 	// delegate parsing
 	this->parseHeader(fullHeader);
+	if (this->_raw_version >= tissuestack::imaging::RAW_FILE_VERSION::V3)
+		this->loadBrickIndex();
+
+	// downsampled levels for zoomed out views are optional
+	this->_pyramid = tissuestack::imaging::TissueStackRawPyramid::fromRawData(this);
+	// so are the per slice statistics
+	this->_statistics = tissuestack::imaging::TissueStackRawStatistics::fromRawData(this);
+}
+
+const tissuestack::imaging::TissueStackRawPyramid * tissuestack::imaging::TissueStackRawData::getPyramid() const
+{
+	return this->_pyramid;
+}
+
+const tissuestack::imaging::TissueStackRawStatistics * tissuestack::imaging::TissueStackRawData::getStatistics() const
+{
+	return this->_statistics;
+}
+
+const std::shared_ptr<const tissuestack::imaging::TissueStackLabelSpatialIndex>
+	tissuestack::imaging::TissueStackRawData::getLabelSpatialIndex() const
+{
+	const tissuestack::imaging::TissueStackLabelLookup * lookup = this->getLookup();
+	if (lookup == nullptr)
+		return nullptr;
+
+	// concurrent first requests build it once, a reloaded lookup has it built again
+	std::lock_guard<std::mutex> lock(this->_label_index_mutex);
+	if (!this->_label_index || !this->_label_index->isUpToDate(lookup))
+		this->_label_index.reset(tissuestack::imaging::TissueStackLabelSpatialIndex::build(this, lookup));
+
+	return this->_label_index;
+}
+
+const bool tissuestack::imaging::TissueStackRawData::isBricked() const
+{
+	return this->_brick_edge != 0;
+}
+
+void tissuestack::imaging::TissueStackRawData::loadBrickIndex()
+{
+	if (this->_brick_edge == 0 || this->get2DDimension() != nullptr ||
+			this->getDimension('x') == nullptr || this->getDimension('y') == nullptr || this->getDimension('z') == nullptr)
+		THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
+			"A V3/V4 Tissue Stack RAW file needs a brick edge and x, y and z!");
+
+	this->_volume[0] = this->getDimension('x')->getNumberOfSlices();
+	this->_volume[1] = this->getDimension('y')->getNumberOfSlices();
+	this->_volume[2] = this->getDimension('z')->getNumberOfSlices();
+
+	const unsigned long long int edge = this->_brick_edge;
+	const unsigned long long int numberOfBricks =
+		((this->_volume[0] + edge - 1) / edge) *
+		((this->_volume[1] + edge - 1) / edge) *
+		((this->_volume[2] + edge - 1) / edge);
+
+	// compressed bricks come with their length
+	const unsigned short entriesPerBrick = this->_codec == tissuestack::imaging::RAW_CODEC::UNCOMPRESSED ? 1 : 2;
+	std::vector<unsigned long long int> index(numberOfBricks * entriesPerBrick);
+	const ssize_t length = static_cast<ssize_t>(index.size() * sizeof(unsigned long long int));
+	if (pread(this->getFileDescriptor(), index.data(), length, this->_totalHeaderLength) != length)
+		THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
+			"Could not read brick index of RAW file!");
+
+	this->_brick_index.resize(numberOfBricks);
+	if (entriesPerBrick == 2)
+		this->_brick_lengths.resize(numberOfBricks);
+	const unsigned long long int fileSize = this->getFileSizeInBytes();
+	for (unsigned long long int b=0;b<numberOfBricks;b++)
+	{
+		this->_brick_index[b] = index[b * entriesPerBrick];
+		if (entriesPerBrick == 2)
+			this->_brick_lengths[b] = index[b * entriesPerBrick + 1];
+		if (this->_brick_index[b] >= fileSize ||
+				(entriesPerBrick == 2 && this->_brick_index[b] + this->_brick_lengths[b] > fileSize))
+			THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
+				"Brick index of RAW file points beyond its end!");
+	}
+}
+
+const tissuestack::imaging::RAW_CODEC tissuestack::imaging::TissueStackRawData::getCodec() const
+{
+	return this->_codec;
+}
+
+const bool tissuestack::imaging::TissueStackRawData::compressBrick(
+	const tissuestack::imaging::RAW_CODEC codec,
+	const unsigned char * in,
+	const unsigned long long int in_length,
+	std::vector<unsigned char> & out)
+{
+	if (codec == tissuestack::imaging::RAW_CODEC::ZLIB)
+	{
+		// speed over ratio: bricks are decompressed for every tile that misses the cache
+		uLongf length = compressBound(in_length);
+		out.resize(length);
+		if (compress2(out.data(), &length, in, in_length, Z_BEST_SPEED) != Z_OK || length >= in_length)
+			return false;
+		out.resize(length);
+		return true;
+	}
+#ifdef USE_LZ4
+	if (codec == tissuestack::imaging::RAW_CODEC::LZ4)
+	{
+		out.resize(LZ4_compressBound(static_cast<int>(in_length)));
+		const int length =
+			LZ4_compress_default(
+				reinterpret_cast<const char *>(in),
+				reinterpret_cast<char *>(out.data()),
+				static_cast<int>(in_length),
+				static_cast<int>(out.size()));
+		if (length <= 0 || static_cast<unsigned long long int>(length) >= in_length)
+			return false;
+		out.resize(length);
+		return true;
+	}
+#endif
+
+	return false;
+}
+
+const bool tissuestack::imaging::TissueStackRawData::decompressBrick(
+	const tissuestack::imaging::RAW_CODEC codec,
+	const unsigned char * in,
+	const unsigned long long int in_length,
+	unsigned char * out,
+	const unsigned long long int out_length)
+{
+	if (codec == tissuestack::imaging::RAW_CODEC::ZLIB)
+	{
+		uLongf length = out_length;
+		return uncompress(out, &length, in, in_length) == Z_OK && length == out_length;
+	}
+#ifdef USE_LZ4
+	if (codec == tissuestack::imaging::RAW_CODEC::LZ4)
+		return LZ4_decompress_safe(
+			reinterpret_cast<const char *>(in),
+			reinterpret_cast<char *>(out),
+			static_cast<int>(in_length),
+			static_cast<int>(out_length)) == static_cast<int>(out_length);
+#endif
+
+	return false;
+}
+
+inline const bool tissuestack::imaging::TissueStackRawData::readBytes(
+	unsigned char * buffer,
+	const unsigned long long int offset,
+	const unsigned long long int length) const
+{
+	if (this->isPinned() && this->readPinnedData(buffer, offset, length))
+		return true;
+
+	return pread(
+		const_cast<tissuestack::imaging::TissueStackRawData *>(this)->getFileDescriptor(),
+		buffer, length, offset) == static_cast<ssize_t>(length);
+}
+
+inline const std::shared_ptr<const std::vector<unsigned char> > tissuestack::imaging::TissueStackRawData::findInflatedBrick(
+	const unsigned long long int brick_number,
+	const unsigned long long int length) const
+{
+	{
+		std::lock_guard<std::mutex> lock(this->_inflated_bricks_mutex);
+		const auto hit = this->_inflated_bricks.find(brick_number);
+		if (hit != this->_inflated_bricks.end())
+		{
+			this->_inflated_brick_usage.splice(this->_inflated_brick_usage.end(), this->_inflated_brick_usage, hit->second.second);
+			return hit->second.first;
+		}
+	}
+
+	// inflated outside of the lock, concurrent misses for the same brick keep the first one added
+	std::vector<unsigned char> compressed(this->_brick_lengths[brick_number]);
+	std::shared_ptr<std::vector<unsigned char> > brick(new std::vector<unsigned char>(length));
+	if (!this->readBytes(compressed.data(), this->_brick_index[brick_number], compressed.size()) ||
+			!tissuestack::imaging::TissueStackRawData::decompressBrick(
+				this->_codec, compressed.data(), compressed.size(), brick->data(), length))
+		return nullptr;
+
+	tissuestack::utils::MemoryAccounting * accounting = tissuestack::utils::MemoryAccounting::instance();
+	if (!accounting->canAccommodate(length, tissuestack::imaging::TissueStackSliceCache::MINIMUM_FREE_RAM_IN_BYTES))
+		return brick;
+
+	std::lock_guard<std::mutex> lock(this->_inflated_bricks_mutex);
+	if (this->_inflated_bricks.find(brick_number) != this->_inflated_bricks.end())
+		return brick;
+
+	while (!this->_inflated_brick_usage.empty() &&
+			this->_inflated_bricks_size + length >
+				tissuestack::imaging::TissueStackRawData::MAXIMUM_INFLATED_BRICK_CACHE_SIZE_IN_BYTES)
+	{
+		const auto oldest = this->_inflated_bricks.find(this->_inflated_brick_usage.front());
+		this->_inflated_bricks_size -= oldest->second.first->size();
+		accounting->removeCacheBytes(oldest->second.first->size());
+		this->_inflated_bricks.erase(oldest);
+		this->_inflated_brick_usage.pop_front();
+	}
+	this->_inflated_bricks[brick_number] =
+		std::make_pair(brick, this->_inflated_brick_usage.insert(this->_inflated_brick_usage.end(), brick_number));
+	this->_inflated_bricks_size += length;
+	accounting->addCacheBytes(length);
+
+	return brick;
+}
+
+const bool tissuestack::imaging::TissueStackRawData::readSliceRegion(
+	const tissuestack::imaging::TissueStackDataDimension * dimension,
+	const unsigned int slice_number,
+	const unsigned int x,
+	const unsigned int y,
+	const unsigned int width,
+	const unsigned int height,
+	unsigned char * out,
+	const unsigned long long int out_row_length) const
+{
+	if (this->isBricked())
+		return this->readBrickedSlice(dimension, slice_number, x, y, width, height, out, out_row_length);
+
+	if ((this->_raw_version == tissuestack::imaging::RAW_FILE_VERSION::LEGACY &&
+			this->getFormat() != tissuestack::imaging::FORMAT::RAW) ||
+			dimension == nullptr || out == nullptr || width == 0 || height == 0 ||
+			slice_number >= dimension->getNumberOfSlices() ||
+			x + width > dimension->getWidth() || y + height > dimension->getHeight())
+		return false;
+
+	const unsigned long long int channels = this->getType() == tissuestack::imaging::RAW_TYPE::UCHAR_8_BIT ? 1 : 3;
+	const unsigned long long int rowLength = dimension->getWidth() * channels;
+	const unsigned long long int sliceOffset =
+		dimension->getOffset() + static_cast<unsigned long long int>(slice_number) * dimension->getSliceSize() * channels;
+
+	// full rows packed the same way as in the file are contiguous: one read
+	if (x == 0 && width == dimension->getWidth() && out_row_length == rowLength)
+		return this->readBytes(out, sliceOffset + y * rowLength, height * rowLength);
+
+	// otherwise one read per row
+	for (unsigned int r=0;r<height;r++)
+		if (!this->readBytes(
+				out + r * out_row_length,
+				sliceOffset + (y + r) * rowLength + x * channels,
+				width * channels))
+			return false;
+
+	return true;
+}
+
+const bool tissuestack::imaging::TissueStackRawData::readBrickedSlice(
+	const tissuestack::imaging::TissueStackDataDimension * dimension,
+	const unsigned int slice_number,
+	const unsigned int x,
+	const unsigned int y,
+	const unsigned int width,
+	const unsigned int height,
+	unsigned char * out,
+	const unsigned long long int out_row_length) const
+{
+	if (!this->isBricked() || dimension == nullptr || out == nullptr || width == 0 || height == 0 ||
+			slice_number >= dimension->getNumberOfSlices() ||
+			x + width > dimension->getWidth() || y + height > dimension->getHeight())
+		return false;
+
+	const char plane = dimension->getName().at(0);
+	const bool flipColumns = (plane == 'x' && this->_brick_flips[1] == '1') || (plane == 'y' && this->_brick_flips[4] == '1');
+	const bool flipRows = (plane == 'x' && this->_brick_flips[2] == '1') || (plane == 'y' && this->_brick_flips[5] == '1');
+	const unsigned long long int channels = this->getType() == tissuestack::imaging::RAW_TYPE::UCHAR_8_BIT ? 1 : 3;
+
+	// the volume axes behind the columns and rows of the plane
+	const unsigned short columnAxis = plane == 'x' ? 1 : 0;
+	const unsigned short rowAxis = plane == 'z' ? 1 : 2;
+	const unsigned short sliceAxis = plane == 'x' ? 0 : (plane == 'y' ? 1 : 2);
+
+	// the voxel box the region covers
+	std::array<unsigned long long int, 3> from;
+	std::array<unsigned long long int, 3> to;
+	from[sliceAxis] = to[sliceAxis] = slice_number;
+	from[columnAxis] = flipColumns ? this->_volume[columnAxis] - (x + width) : x;
+	to[columnAxis] = from[columnAxis] + width - 1;
+	from[rowAxis] = flipRows ? this->_volume[rowAxis] - (y + height) : y;
+	to[rowAxis] = from[rowAxis] + height - 1;
+
+	const unsigned long long int edge = this->_brick_edge;
+	const unsigned long long int bricksX = (this->_volume[0] + edge - 1) / edge;
+	const unsigned long long int bricksY = (this->_volume[1] + edge - 1) / edge;
+	std::vector<unsigned char> brick(edge * edge * edge * channels);
+
+	for (unsigned long long int bz=from[2]/edge;bz<=to[2]/edge;bz++)
+		for (unsigned long long int by=from[1]/edge;by<=to[1]/edge;by++)
+			for (unsigned long long int bx=from[0]/edge;bx<=to[0]/edge;bx++)
+			{
+				const unsigned long long int bw = std::min(edge, this->_volume[0] - bx * edge);
+				const unsigned long long int bh = std::min(edge, this->_volume[1] - by * edge);
+				const unsigned long long int bd = std::min(edge, this->_volume[2] - bz * edge);
+				const unsigned long long int brickNumber = (bz * bricksY + by) * bricksX + bx;
+				const unsigned long long int offset = this->_brick_index[brickNumber];
+				const unsigned long long int rowSize = bw * channels;
+				const unsigned long long int layerSize = bh * rowSize;
+				const bool isCompressed =
+					offset != 0 && !this->_brick_lengths.empty() && this->_brick_lengths[brickNumber] != layerSize * bd;
+
+				// the part of the brick we need, relative to the brick
+				const unsigned long long int x0 = std::max(from[0], bx * edge) - bx * edge;
+				const unsigned long long int x1 = std::min(to[0], bx * edge + bw - 1) - bx * edge;
+				const unsigned long long int y0 = std::max(from[1], by * edge) - by * edge;
+				const unsigned long long int y1 = std::min(to[1], by * edge + bh - 1) - by * edge;
+				const unsigned long long int z0 = std::max(from[2], bz * edge) - bz * edge;
+				const unsigned long long int z1 = std::min(to[2], bz * edge + bd - 1) - bz * edge;
+
+				// uncompressed bricks are read layer by layer, from the first to the last voxel we need in it:
+				// a row for y planes, rows for z planes. x planes have a voxel in every row, so (almost) the whole layer.
+				// compressed ones are inflated in full and kept for the next tiles that need them
+				const unsigned char * base = brick.data();
+				unsigned long long int inLayerSize = layerSize;
+				std::shared_ptr<const std::vector<unsigned char> > inflated;
+				if (isCompressed)
+				{
+					inflated = this->findInflatedBrick(brickNumber, layerSize * bd);
+					if (!inflated)
+						return false;
+					base = inflated->data() + (z0 * bh + y0) * rowSize + x0 * channels;
+				} else
+				{
+					inLayerSize = (y1 - y0) * rowSize + (x1 - x0 + 1) * channels;
+					// bricks that are all 0 aren't stored
+					if (offset == 0)
+						memset(brick.data(), 0, inLayerSize * (z1 - z0 + 1));
+					else
+						for (unsigned long long int z=z0;z<=z1;z++)
+							if (!this->readBytes(
+									brick.data() + (z - z0) * inLayerSize,
+									offset + z * layerSize + y0 * rowSize + x0 * channels,
+									inLayerSize))
+								return false;
+				}
+
+				std::array<unsigned long long int, 3> voxel;
+				for (voxel[2]=z0 + bz * edge;voxel[2]<=z1 + bz * edge;voxel[2]++)
+					for (voxel[1]=y0 + by * edge;voxel[1]<=y1 + by * edge;voxel[1]++)
+					{
+						const unsigned char * in =
+							base + (voxel[2] - bz * edge - z0) * inLayerSize + (voxel[1] - by * edge - y0) * rowSize;
+						for (voxel[0]=x0 + bx * edge;voxel[0]<=x1 + bx * edge;voxel[0]++, in+=channels)
+						{
+							const unsigned long long int column =
+								flipColumns ? this->_volume[columnAxis] - 1 - voxel[columnAxis] : voxel[columnAxis];
+							const unsigned long long int row =
+								flipRows ? this->_volume[rowAxis] - 1 - voxel[rowAxis] : voxel[rowAxis];
+							memcpy(out + (row - y) * out_row_length + (column - x) * channels, in, channels);
+						}
+					}
+			}
+
+	return true;
 }
 
 void tissuestack::imaging::TissueStackRawData::parseHeader(const std::string & header)
@@ -123,6 +612,12 @@ void tissuestack::imaging::TissueStackRawData::parseHeader(const std::string & h
 		THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException, "A Legacy Tissue Stack RAW file will need at least 13 header bits!");
 	if (this->_raw_version == tissuestack::imaging::RAW_FILE_VERSION::V1 && headerTokens.size() < 5)
 		THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException, "A V1 Tissue Stack RAW file will need at least 5 header bits!");
+	if (this->_raw_version == tissuestack::imaging::RAW_FILE_VERSION::V2 && headerTokens.size() < 6)
+		THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException, "A V2 Tissue Stack RAW file will need at least 6 header bits!");
+	if (this->_raw_version == tissuestack::imaging::RAW_FILE_VERSION::V3 && headerTokens.size() < 8)
+		THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException, "A V3 Tissue Stack RAW file will need at least 8 header bits!");
+	if (this->_raw_version == tissuestack::imaging::RAW_FILE_VERSION::V4 && headerTokens.size() < 9)
+		THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException, "A V4 Tissue Stack RAW file will need at least 9 header bits!");
 
 	// for V1 and up: we don't have a separate dimension number token at the beginning
 	unsigned short count =
@@ -181,15 +676,51 @@ void tissuestack::imaging::TissueStackRawData::parseHeader(const std::string & h
 				{
 					this->setFormat(atoi(t.c_str()));
 					//count=6; // fast forward to 6 to stay compatible with switch logic
+				} else if (count == 6 && this->_raw_version >= tissuestack::imaging::RAW_FILE_VERSION::V2)
+				{
+					// for a V2 and up: the number of channels
+					if (atoi(t.c_str()) == 1)
+						this->setRawType(tissuestack::imaging::RAW_TYPE::UCHAR_8_BIT);
+					else if (atoi(t.c_str()) == 3)
+						this->setRawType(tissuestack::imaging::RAW_TYPE::RGB_24BIT);
+					else
+						THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException, "A V2 and up Tissue Stack RAW file has either 1 or 3 channels!");
 				}
 				break;
 			case 7:
 				// LEGACY RAW: redundant short dim names which we skip
 				if (this->_raw_version == tissuestack::imaging::RAW_FILE_VERSION::LEGACY)
 					break;
+				// V3 and up: the edge length of the bricks
+				if (this->_raw_version >= tissuestack::imaging::RAW_FILE_VERSION::V3)
+					this->_brick_edge = static_cast<unsigned short>(atoi(t.c_str()));
 				break;
 			case 8: // LEGACY RAW: dimension short names (redundant and unused)
+				// V3 and up: the orientation of the x and y planes with respect to the volume
+				if (this->_raw_version >= tissuestack::imaging::RAW_FILE_VERSION::V3)
+				{
+					if (t.length() != 6 || t[0] != 'x' || t[3] != 'y')
+						THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException, "A V3 Tissue Stack RAW file has invalid flips!");
+					this->_brick_flips = t;
+					break;
+				}
 			case 9:
+				// V4: the codec the bricks were compressed with
+				if (this->_raw_version == tissuestack::imaging::RAW_FILE_VERSION::V4)
+				{
+					const int codec = atoi(t.c_str());
+					if (codec == tissuestack::imaging::RAW_CODEC::ZLIB)
+						this->_codec = tissuestack::imaging::RAW_CODEC::ZLIB;
+					else if (codec == tissuestack::imaging::RAW_CODEC::LZ4)
+						this->_codec = tissuestack::imaging::RAW_CODEC::LZ4;
+					else
+						THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException, "A V4 Tissue Stack RAW file has an unknown codec!");
+#ifndef USE_LZ4
+					if (this->_codec == tissuestack::imaging::RAW_CODEC::LZ4)
+						THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException, "LZ4 compressed RAW files need a build with USE_LZ4!");
+#endif
+					break;
+				}
 				if (this->_raw_version == tissuestack::imaging::RAW_FILE_VERSION::LEGACY && numOfDims == 2 && count == 8)
 					count++;
 				break;
@@ -295,6 +826,15 @@ void tissuestack::imaging::TissueStackRawData::setRawVersion(int version)
 		case tissuestack::imaging::RAW_FILE_VERSION::V1:
 			this->_raw_version = tissuestack::imaging::RAW_FILE_VERSION::V1;
 			break;
+		case tissuestack::imaging::RAW_FILE_VERSION::V2:
+			this->_raw_version = tissuestack::imaging::RAW_FILE_VERSION::V2;
+			break;
+		case tissuestack::imaging::RAW_FILE_VERSION::V3:
+			this->_raw_version = tissuestack::imaging::RAW_FILE_VERSION::V3;
+			break;
+		case tissuestack::imaging::RAW_FILE_VERSION::V4:
+			this->_raw_version = tissuestack::imaging::RAW_FILE_VERSION::V4;
+			break;
 		default:
 			THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException, "Incompatible Raw File Version Enum!");
 			break;
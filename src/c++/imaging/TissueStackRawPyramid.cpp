@@ -0,0 +1,417 @@
+/*
+ * This file is part of TissueStack.
+ *
+ * TissueStack is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TissueStack is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TissueStack.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "networking.h"
+#include "imaging.h"
+
+const std::string tissuestack::imaging::TissueStackRawPyramid::getSidecarFileName(const std::string & raw_file_name)
+{
+	return raw_file_name + ".pyramid";
+}
+
+tissuestack::imaging::TissueStackRawPyramid * tissuestack::imaging::TissueStackRawPyramid::fromRawData(
+	const tissuestack::imaging::TissueStackRawData * raw)
+{
+	if (raw == nullptr)
+		return nullptr;
+
+	const std::string sidecar =
+		tissuestack::imaging::TissueStackRawPyramid::getSidecarFileName(raw->getFileName());
+	if (!tissuestack::utils::System::fileExists(sidecar))
+		return nullptr;
+
+	// a raw that was converted again leaves us with a stale pyramid
+	if (tissuestack::utils::System::getLastModifiedTime(sidecar) <
+			tissuestack::utils::System::getLastModifiedTime(raw->getFileName()))
+	{
+		tissuestack::logging::TissueStackLogger::instance()->error(
+			"Pyramid %s is older than its raw file and will be ignored!\n", sidecar.c_str());
+		return nullptr;
+	}
+
+	std::unordered_map<char, unsigned long long int> numberOfSlices;
+	for (auto dim : raw->getDimensionOrder())
+		numberOfSlices[dim.at(0)] = raw->getDimensionByLongName(dim)->getNumberOfSlices();
+
+	try
+	{
+		tissuestack::imaging::TissueStackRawPyramid * pyramid =
+			new tissuestack::imaging::TissueStackRawPyramid(
+				sidecar,
+				raw->getType() == tissuestack::imaging::RAW_TYPE::UCHAR_8_BIT ? 1 : 3,
+				numberOfSlices);
+
+		// the raw size is recorded at build time
+		if (pyramid->_raw_file_size != raw->getFileSizeInBytes())
+		{
+			delete pyramid;
+			tissuestack::logging::TissueStackLogger::instance()->error(
+				"Pyramid %s does not match the size of its raw file and will be ignored!\n", sidecar.c_str());
+			return nullptr;
+		}
+
+		return pyramid;
+	} catch (const std::exception & bad)
+	{
+		tissuestack::logging::TissueStackLogger::instance()->error(
+			"Failed to load pyramid %s: %s\n", sidecar.c_str(), bad.what());
+	}
+
+	return nullptr;
+}
+
+tissuestack::imaging::TissueStackRawPyramid::TissueStackRawPyramid(
+	const std::string & sidecar,
+	const unsigned short channels,
+	const std::unordered_map<char, unsigned long long int> & number_of_slices) :
+		_channels(channels), _number_of_slices(number_of_slices)
+{
+	const int fd = open(sidecar.c_str(), O_RDONLY);
+	if (fd < 0)
+		THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
+			"Pyramid file could not be opened!");
+
+	char prefix[32];
+	memset(prefix, '\0', 32);
+	if (pread(fd, prefix, 31, 0) <= 0 || strncmp(prefix, "@IaMpYramiD@V1|", 15) != 0)
+	{
+		close(fd);
+		THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
+			"Pyramid file does not start with expected header!");
+	}
+
+	const char * pipe = strchr(prefix + 15, '|');
+	const unsigned long long int headerLength = strtoull(prefix + 15, NULL, 10);
+	if (pipe == nullptr || headerLength == 0)
+	{
+		close(fd);
+		THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
+			"Could not read header length of pyramid file!");
+	}
+	const unsigned long long int dataStart = static_cast<unsigned long long int>(pipe - prefix + 1) + headerLength;
+
+	std::string header(headerLength, '\0');
+	if (pread(fd, &header[0], headerLength, pipe - prefix + 1) != static_cast<ssize_t>(headerLength))
+	{
+		close(fd);
+		THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
+			"Could not read header content of pyramid file!");
+	}
+
+	// raw size, filter and then the levels of each dimension
+	const std::vector<std::string> tokens = tissuestack::utils::Misc::tokenizeString(header, '|');
+	if (tokens.size() < 2)
+	{
+		close(fd);
+		THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
+			"Pyramid file header is incomplete!");
+	}
+	this->_raw_file_size = strtoull(tokens[0].c_str(), NULL, 10);
+	this->_is_averaged = tokens[1].compare("nearest") != 0;
+
+	unsigned long long int end = dataStart;
+	for (unsigned int i=2;i<tokens.size();i++)
+	{
+		const std::vector<std::string> level = tissuestack::utils::Misc::tokenizeString(tokens[i], ':');
+		if (level.empty() || level[0].empty() || (level.size() - 1) % 3 != 0 ||
+				this->_number_of_slices.find(level[0].at(0)) == this->_number_of_slices.end())
+		{
+			close(fd);
+			THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
+				"Pyramid file has an invalid level description!");
+		}
+
+		std::vector<std::array<unsigned long long int, 3> > levels;
+		for (unsigned int j=1;j+2<level.size();j+=3)
+		{
+			const std::array<unsigned long long int, 3> info =
+			{
+				strtoull(level[j].c_str(), NULL, 10),
+				strtoull(level[j+1].c_str(), NULL, 10),
+				dataStart + strtoull(level[j+2].c_str(), NULL, 10)
+			};
+			levels.push_back(info);
+			end = std::max(end,
+				info[2] + info[0] * info[1] * this->_channels * this->_number_of_slices[level[0].at(0)]);
+		}
+		this->_levels[level[0].at(0)] = levels;
+	}
+
+	this->_length = tissuestack::utils::System::getFileSizeInBytes(sidecar);
+	if (this->_length < end)
+	{
+		close(fd);
+		THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
+			"Pyramid file is truncated!");
+	}
+
+	// slices are handed out straight from the mapping, the page cache does the rest
+	void * mapped = mmap(NULL, this->_length, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (mapped == MAP_FAILED)
+		THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
+			"Pyramid file could not be mapped into memory!");
+	this->_data = static_cast<unsigned char *>(mapped);
+}
+
+tissuestack::imaging::TissueStackRawPyramid::~TissueStackRawPyramid()
+{
+	if (this->_data)
+		munmap(this->_data, this->_length);
+}
+
+inline const std::array<unsigned long long int, 3> * tissuestack::imaging::TissueStackRawPyramid::findLevelInfo(
+	const std::string & dimension_name,
+	const unsigned short level) const
+{
+	if (dimension_name.empty() || level == 0)
+		return nullptr;
+
+	const auto levels = this->_levels.find(dimension_name.at(0));
+	if (levels == this->_levels.end() || level > levels->second.size())
+		return nullptr;
+
+	return &levels->second[level-1];
+}
+
+const bool tissuestack::imaging::TissueStackRawPyramid::isAveraged() const
+{
+	return this->_is_averaged;
+}
+
+const unsigned short tissuestack::imaging::TissueStackRawPyramid::findLevel(
+	const std::string & dimension_name,
+	const unsigned int minimum_width,
+	const unsigned int minimum_height) const
+{
+	if (dimension_name.empty())
+		return 0;
+
+	const auto levels = this->_levels.find(dimension_name.at(0));
+	if (levels == this->_levels.end())
+		return 0;
+
+	unsigned short level = 0;
+	for (unsigned short i=0;i<levels->second.size();i++)
+	{
+		if (levels->second[i][0] < minimum_width || levels->second[i][1] < minimum_height)
+			break;
+		level = i + 1;
+	}
+
+	return level;
+}
+
+const unsigned int tissuestack::imaging::TissueStackRawPyramid::getWidth(
+	const std::string & dimension_name, const unsigned short level) const
+{
+	const std::array<unsigned long long int, 3> * info = this->findLevelInfo(dimension_name, level);
+
+	return info == nullptr ? 0 : static_cast<unsigned int>((*info)[0]);
+}
+
+const unsigned int tissuestack::imaging::TissueStackRawPyramid::getHeight(
+	const std::string & dimension_name, const unsigned short level) const
+{
+	const std::array<unsigned long long int, 3> * info = this->findLevelInfo(dimension_name, level);
+
+	return info == nullptr ? 0 : static_cast<unsigned int>((*info)[1]);
+}
+
+const unsigned char * tissuestack::imaging::TissueStackRawPyramid::getSlice(
+	const std::string & dimension_name,
+	const unsigned short level,
+	const unsigned int slice_number) const
+{
+	const std::array<unsigned long long int, 3> * info = this->findLevelInfo(dimension_name, level);
+	if (info == nullptr)
+		return nullptr;
+
+	const auto numberOfSlices = this->_number_of_slices.find(dimension_name.at(0));
+	if (numberOfSlices == this->_number_of_slices.end() || slice_number >= numberOfSlices->second)
+		return nullptr;
+
+	return this->_data + (*info)[2] + (*info)[0] * (*info)[1] * this->_channels * slice_number;
+}
+
+void tissuestack::imaging::TissueStackRawPyramid::downsample(
+	const unsigned char * in,
+	const unsigned int width,
+	const unsigned int height,
+	const unsigned short channels,
+	unsigned char * out,
+	const bool average)
+{
+	const unsigned int outWidth = (width + 1) / 2;
+	const unsigned int outHeight = (height + 1) / 2;
+	const unsigned long long int rowLength = static_cast<unsigned long long int>(width) * channels;
+
+	for (unsigned int y=0;y<outHeight;y++)
+	{
+		const unsigned char * top = in + static_cast<unsigned long long int>(y * 2) * rowLength;
+		// odd sizes: the last row/column is paired with itself
+		const unsigned char * bottom = (y * 2 + 1 < height) ? top + rowLength : top;
+		unsigned char * row = out + static_cast<unsigned long long int>(y) * outWidth * channels;
+
+		for (unsigned int x=0;x<outWidth;x++)
+		{
+			const unsigned long long int left = static_cast<unsigned long long int>(x * 2) * channels;
+			const unsigned long long int right = (x * 2 + 1 < width) ? left + channels : left;
+			for (unsigned short c=0;c<channels;c++)
+			{
+				// label data must not be blended: take the top left sample instead
+				if (!average)
+					row[x * channels + c] = top[left + c];
+				else
+					row[x * channels + c] =
+						static_cast<unsigned char>(
+							(static_cast<unsigned int>(top[left + c]) + top[right + c] +
+								bottom[left + c] + bottom[right + c] + 2) / 4);
+			}
+		}
+	}
+}
+
+void tissuestack::imaging::TissueStackRawPyramid::build(
+	const tissuestack::imaging::TissueStackRawData * raw,
+	const bool average)
+{
+	if (raw == nullptr)
+		THROW_TS_EXCEPTION(tissuestack::common::TissueStackNullPointerException,
+			"Pyramid needs a raw file to be built from!");
+
+	const unsigned short channels =
+		raw->getType() == tissuestack::imaging::RAW_TYPE::UCHAR_8_BIT ? 1 : 3;
+
+	// lay out the levels first: each level is half of the one before until it gets to tile size
+	std::ostringstream header;
+	header << raw->getFileSizeInBytes() << "|" << (average ? "avg" : "nearest");
+	std::vector<std::vector<std::array<unsigned long long int, 3> > > plan;
+	unsigned long long int size = 0;
+	for (auto dim : raw->getDimensionOrder())
+	{
+		const tissuestack::imaging::TissueStackDataDimension * dimension =
+			raw->getDimensionByLongName(dim);
+		unsigned long long int width = dimension->getWidth();
+		unsigned long long int height = dimension->getHeight();
+
+		std::vector<std::array<unsigned long long int, 3> > levels;
+		header << "|" << dim.at(0);
+		while (levels.size() < tissuestack::imaging::TissueStackRawPyramid::MAXIMUM_NUMBER_OF_LEVELS &&
+				std::max(width, height) > tissuestack::imaging::TissueStackRawPyramid::MINIMUM_LEVEL_LENGTH)
+		{
+			width = (width + 1) / 2;
+			height = (height + 1) / 2;
+			levels.push_back({ width, height, size });
+			header << ":" << width << ":" << height << ":" << size;
+			size += width * height * channels * dimension->getNumberOfSlices();
+		}
+		plan.push_back(levels);
+	}
+
+	if (size == 0)
+	{
+		tissuestack::logging::TissueStackLogger::instance()->info(
+			"Pyramid: %s is small enough as is, no levels built.\n", raw->getFileName().c_str());
+		return;
+	}
+
+	const std::string content = header.str();
+	const std::string prefix = "@IaMpYramiD@V1|" + std::to_string(content.length()) + "|";
+	const unsigned long long int dataStart = prefix.length() + content.length();
+
+	// we build into a temporary file so that a running server never maps a half written pyramid
+	const std::string sidecar =
+		tissuestack::imaging::TissueStackRawPyramid::getSidecarFileName(raw->getFileName());
+	const std::string tmpFile = sidecar + ".tmp";
+	const int fd = open(tmpFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
+			"Pyramid: Could not create file!");
+
+	const std::string fullHeader = prefix + content;
+	if (ftruncate(fd, dataStart + size) != 0 ||
+			pwrite(fd, fullHeader.c_str(), fullHeader.length(), 0) != static_cast<ssize_t>(fullHeader.length()))
+	{
+		close(fd);
+		unlink(tmpFile.c_str());
+		THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
+			"Pyramid: Could not write header!");
+	}
+
+	const tissuestack::imaging::UncachedImageExtraction extraction;
+	const std::vector<std::string> dimensions = raw->getDimensionOrder();
+	try
+	{
+		for (unsigned short d=0;d<dimensions.size();d++)
+		{
+			if (plan[d].empty())
+				continue;
+
+			const tissuestack::imaging::TissueStackDataDimension * dimension =
+				raw->getDimensionByLongName(dimensions[d]);
+			std::vector<unsigned char> previous;
+			std::vector<unsigned char> current;
+
+			for (unsigned int s=0;s<dimension->getNumberOfSlices();s++)
+			{
+				// each level is made from the one before
+				std::unique_ptr<const unsigned char[]> slice(
+					extraction.extractSliceOnly(raw, dimension, s));
+				if (!slice)
+					THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
+						"Pyramid: Could not read slice from raw file!");
+
+				const unsigned char * in = slice.get();
+				unsigned int width = dimension->getWidth();
+				unsigned int height = dimension->getHeight();
+				for (auto level : plan[d])
+				{
+					const unsigned long long int levelSliceSize = level[0] * level[1] * channels;
+					current.resize(levelSliceSize);
+					tissuestack::imaging::TissueStackRawPyramid::downsample(
+						in, width, height, channels, current.data(), average);
+
+					if (pwrite(fd, current.data(), levelSliceSize, dataStart + level[2] + levelSliceSize * s) !=
+							static_cast<ssize_t>(levelSliceSize))
+						THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
+							"Pyramid: Could not write level slice!");
+
+					current.swap(previous);
+					in = previous.data();
+					width = static_cast<unsigned int>(level[0]);
+					height = static_cast<unsigned int>(level[1]);
+				}
+			}
+		}
+	} catch (...)
+	{
+		close(fd);
+		unlink(tmpFile.c_str());
+		throw;
+	}
+
+	close(fd);
+	if (rename(tmpFile.c_str(), sidecar.c_str()) != 0)
+	{
+		unlink(tmpFile.c_str());
+		THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
+			"Pyramid: Could not move finished file into place!");
+	}
+
+	tissuestack::logging::TissueStackLogger::instance()->info(
+		"Pyramid: built %s (%llu bytes)\n", sidecar.c_str(), dataStart + size);
+}
@@ -0,0 +1,386 @@
+/*
+ * This file is part of TissueStack.
+ *
+ * TissueStack is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TissueStack is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TissueStack.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "networking.h"
+#include "imaging.h"
+
+const std::string tissuestack::imaging::TissueStackRawStatistics::getSidecarFileName(const std::string & raw_file_name)
+{
+	return raw_file_name + ".stats";
+}
+
+tissuestack::imaging::TissueStackRawStatistics * tissuestack::imaging::TissueStackRawStatistics::fromRawData(
+	const tissuestack::imaging::TissueStackRawData * raw)
+{
+	if (raw == nullptr)
+		return nullptr;
+
+	const std::string sidecar =
+		tissuestack::imaging::TissueStackRawStatistics::getSidecarFileName(raw->getFileName());
+	if (!tissuestack::utils::System::fileExists(sidecar))
+		return nullptr;
+
+	// a raw that was converted again leaves us with stale statistics
+	if (tissuestack::utils::System::getLastModifiedTime(sidecar) <
+			tissuestack::utils::System::getLastModifiedTime(raw->getFileName()))
+	{
+		tissuestack::logging::TissueStackLogger::instance()->error(
+			"Statistics %s are older than their raw file and will be ignored!\n", sidecar.c_str());
+		return nullptr;
+	}
+
+	std::unordered_map<char, unsigned long long int> numberOfSlices;
+	for (auto dim : raw->getDimensionOrder())
+		numberOfSlices[dim.at(0)] = raw->getDimensionByLongName(dim)->getNumberOfSlices();
+
+	try
+	{
+		tissuestack::imaging::TissueStackRawStatistics * statistics =
+			new tissuestack::imaging::TissueStackRawStatistics(
+				sidecar,
+				raw->getType() == tissuestack::imaging::RAW_TYPE::UCHAR_8_BIT ? 1 : 3,
+				numberOfSlices);
+
+		// the raw size is recorded at build time
+		if (statistics->_raw_file_size != raw->getFileSizeInBytes())
+		{
+			delete statistics;
+			tissuestack::logging::TissueStackLogger::instance()->error(
+				"Statistics %s do not match the size of their raw file and will be ignored!\n", sidecar.c_str());
+			return nullptr;
+		}
+
+		return statistics;
+	} catch (const std::exception & bad)
+	{
+		tissuestack::logging::TissueStackLogger::instance()->error(
+			"Failed to load statistics %s: %s\n", sidecar.c_str(), bad.what());
+	}
+
+	return nullptr;
+}
+
+tissuestack::imaging::TissueStackRawStatistics::TissueStackRawStatistics(
+	const std::string & sidecar,
+	const unsigned short channels,
+	const std::unordered_map<char, unsigned long long int> & number_of_slices) :
+		_channels(channels), _number_of_slices(number_of_slices)
+{
+	const int fd = open(sidecar.c_str(), O_RDONLY);
+	if (fd < 0)
+		THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
+			"Statistics file could not be opened!");
+
+	char prefix[32];
+	memset(prefix, '\0', 32);
+	if (pread(fd, prefix, 31, 0) <= 0 || strncmp(prefix, "@IaMsTatS@V1|", 13) != 0)
+	{
+		close(fd);
+		THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
+			"Statistics file does not start with expected header!");
+	}
+
+	const char * pipe = strchr(prefix + 13, '|');
+	const unsigned long long int headerLength = strtoull(prefix + 13, NULL, 10);
+	if (pipe == nullptr || headerLength == 0)
+	{
+		close(fd);
+		THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
+			"Could not read header length of statistics file!");
+	}
+	const unsigned long long int dataStart = static_cast<unsigned long long int>(pipe - prefix + 1) + headerLength;
+
+	std::string header(headerLength, '\0');
+	if (pread(fd, &header[0], headerLength, pipe - prefix + 1) != static_cast<ssize_t>(headerLength))
+	{
+		close(fd);
+		THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
+			"Could not read header content of statistics file!");
+	}
+
+	// raw size, channels and then the slices of each dimension
+	const std::vector<std::string> tokens = tissuestack::utils::Misc::tokenizeString(header, '|');
+	if (tokens.size() < 2 || strtoul(tokens[1].c_str(), NULL, 10) != channels)
+	{
+		close(fd);
+		THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
+			"Statistics file header is incomplete or has the wrong number of channels!");
+	}
+	this->_raw_file_size = strtoull(tokens[0].c_str(), NULL, 10);
+
+	const unsigned long long int recordLength = (channels * 256 + 4) * sizeof(unsigned int);
+	unsigned long long int end = dataStart;
+	for (unsigned int i=2;i<tokens.size();i++)
+	{
+		const std::vector<std::string> dimension = tissuestack::utils::Misc::tokenizeString(tokens[i], ':');
+		if (dimension.size() != 3 || dimension[0].empty() ||
+				this->_number_of_slices.find(dimension[0].at(0)) == this->_number_of_slices.end() ||
+				strtoull(dimension[1].c_str(), NULL, 10) != this->_number_of_slices[dimension[0].at(0)])
+		{
+			close(fd);
+			THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
+				"Statistics file has an invalid dimension description!");
+		}
+
+		const unsigned long long int offset = dataStart + strtoull(dimension[2].c_str(), NULL, 10);
+		this->_offsets[dimension[0].at(0)] = offset;
+		end = std::max(end, offset + recordLength * this->_number_of_slices[dimension[0].at(0)]);
+	}
+
+	this->_length = tissuestack::utils::System::getFileSizeInBytes(sidecar);
+	if (this->_length < end)
+	{
+		close(fd);
+		THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
+			"Statistics file is truncated!");
+	}
+
+	// records are handed out straight from the mapping
+	void * mapped = mmap(NULL, this->_length, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (mapped == MAP_FAILED)
+		THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
+			"Statistics file could not be mapped into memory!");
+	this->_data = static_cast<unsigned char *>(mapped);
+}
+
+tissuestack::imaging::TissueStackRawStatistics::~TissueStackRawStatistics()
+{
+	if (this->_data)
+		munmap(this->_data, this->_length);
+}
+
+const unsigned short tissuestack::imaging::TissueStackRawStatistics::getNumberOfChannels() const
+{
+	return this->_channels;
+}
+
+inline const unsigned char * tissuestack::imaging::TissueStackRawStatistics::findRecord(
+	const std::string & dimension_name,
+	const unsigned int slice_number) const
+{
+	if (dimension_name.empty())
+		return nullptr;
+
+	const auto offset = this->_offsets.find(dimension_name.at(0));
+	const auto numberOfSlices = this->_number_of_slices.find(dimension_name.at(0));
+	if (offset == this->_offsets.end() || numberOfSlices == this->_number_of_slices.end() ||
+			slice_number >= numberOfSlices->second)
+		return nullptr;
+
+	return this->_data + offset->second + (this->_channels * 256 + 4) * sizeof(unsigned int) * slice_number;
+}
+
+const bool tissuestack::imaging::TissueStackRawStatistics::addHistograms(
+	const std::string & dimension_name,
+	const unsigned int slice_number,
+	unsigned long long int * histograms) const
+{
+	const unsigned char * record = this->findRecord(dimension_name, slice_number);
+	if (record == nullptr)
+		return false;
+
+	// the header is text of any length: records are copied out rather than accessed in place
+	unsigned int counts[3 * 256];
+	memcpy(counts, record, this->_channels * 256 * sizeof(unsigned int));
+	for (unsigned short i=0;i<this->_channels * 256;i++)
+		histograms[i] += counts[i];
+
+	return true;
+}
+
+const bool tissuestack::imaging::TissueStackRawStatistics::getNonZeroBounds(
+	const std::string & dimension_name,
+	const unsigned int slice_number,
+	std::array<unsigned int, 4> & bounds) const
+{
+	const unsigned char * record = this->findRecord(dimension_name, slice_number);
+	if (record == nullptr)
+		return false;
+
+	memcpy(bounds.data(), record + this->_channels * 256 * sizeof(unsigned int), 4 * sizeof(unsigned int));
+
+	return true;
+}
+
+void tissuestack::imaging::TissueStackRawStatistics::computeSliceRange(
+	const tissuestack::imaging::TissueStackRawData * raw,
+	const tissuestack::imaging::TissueStackDataDimension * dimension,
+	const unsigned int first_slice,
+	const unsigned int last_slice,
+	unsigned int * records,
+	bool & succeeded)
+{
+	const unsigned short channels =
+		raw->getType() == tissuestack::imaging::RAW_TYPE::UCHAR_8_BIT ? 1 : 3;
+	const unsigned int width = dimension->getWidth();
+	const unsigned int height = dimension->getHeight();
+	const unsigned long long int rowLength = static_cast<unsigned long long int>(width) * channels;
+	std::vector<unsigned char> slice(rowLength * height);
+
+	for (unsigned int s=first_slice;s<=last_slice;s++)
+	{
+		if (!raw->readSliceRegion(dimension, s, 0, 0, width, height, slice.data(), rowLength))
+		{
+			succeeded = false;
+			return;
+		}
+
+		unsigned int * record = records + static_cast<unsigned long long int>(s) * (channels * 256 + 4);
+		unsigned int * bounds = record + channels * 256;
+		unsigned int left = width, top = height, right = 0, bottom = 0;
+		for (unsigned int y=0;y<height;y++)
+		{
+			const unsigned char * row = slice.data() + y * rowLength;
+			tissuestack::imaging::PixelKernels::countValues(row, channels, width, record);
+
+			// the first and last non zero byte of the row give its columns
+			unsigned long long int first = 0;
+			while (first < rowLength && row[first] == 0)
+				first++;
+			if (first == rowLength)
+				continue;
+			unsigned long long int last = rowLength - 1;
+			while (row[last] == 0)
+				last--;
+
+			left = std::min(left, static_cast<unsigned int>(first / channels));
+			right = std::max(right, static_cast<unsigned int>(last / channels + 1));
+			top = std::min(top, y);
+			bottom = y + 1;
+		}
+
+		if (right > 0)
+		{
+			bounds[0] = left;
+			bounds[1] = top;
+			bounds[2] = right;
+			bounds[3] = bottom;
+		}
+	}
+}
+
+void tissuestack::imaging::TissueStackRawStatistics::build(const tissuestack::imaging::TissueStackRawData * raw)
+{
+	if (raw == nullptr)
+		THROW_TS_EXCEPTION(tissuestack::common::TissueStackNullPointerException,
+			"Statistics need a raw file to be computed from!");
+
+	const unsigned short channels =
+		raw->getType() == tissuestack::imaging::RAW_TYPE::UCHAR_8_BIT ? 1 : 3;
+	const unsigned long long int recordLength = channels * 256 + 4;
+
+	std::ostringstream header;
+	header << raw->getFileSizeInBytes() << "|" << channels;
+	unsigned long long int size = 0;
+	for (auto dim : raw->getDimensionOrder())
+	{
+		const unsigned long long int numberOfSlices = raw->getDimensionByLongName(dim)->getNumberOfSlices();
+		header << "|" << dim.at(0) << ":" << numberOfSlices << ":" << size;
+		size += numberOfSlices * recordLength * sizeof(unsigned int);
+	}
+
+	const std::string content = header.str();
+	const std::string fullHeader = "@IaMsTatS@V1|" + std::to_string(content.length()) + "|" + content;
+
+	// we build into a temporary file so that a running server never maps half written statistics
+	const std::string sidecar =
+		tissuestack::imaging::TissueStackRawStatistics::getSidecarFileName(raw->getFileName());
+	const std::string tmpFile = sidecar + ".tmp";
+	const int fd = open(tmpFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
+			"Statistics: Could not create file!");
+
+	if (pwrite(fd, fullHeader.c_str(), fullHeader.length(), 0) != static_cast<ssize_t>(fullHeader.length()))
+	{
+		close(fd);
+		unlink(tmpFile.c_str());
+		THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
+			"Statistics: Could not write header!");
+	}
+
+	unsigned long long int position = fullHeader.length();
+	for (auto dim : raw->getDimensionOrder())
+	{
+		const tissuestack::imaging::TissueStackDataDimension * dimension = raw->getDimensionByLongName(dim);
+		const unsigned int numberOfSlices = static_cast<unsigned int>(dimension->getNumberOfSlices());
+		std::vector<unsigned int> records(numberOfSlices * recordLength, 0);
+
+		// every thread takes a band of slices
+		const unsigned int numberOfThreads =
+			std::max(1u,
+				std::min(
+					std::min(
+						tissuestack::utils::System::getNumberOfCores(),
+						static_cast<unsigned int>(tissuestack::imaging::TissueStackRawStatistics::MAXIMUM_NUMBER_OF_THREADS)),
+					numberOfSlices));
+		const unsigned int slicesPerThread = (numberOfSlices + numberOfThreads - 1) / numberOfThreads;
+		std::unique_ptr<bool[]> succeeded(new bool[numberOfThreads]);
+		try
+		{
+			tissuestack::utils::WorkerThreads threads;
+			for (unsigned int t=0;t<numberOfThreads;t++)
+			{
+				succeeded[t] = true;
+				if (t * slicesPerThread >= numberOfSlices)
+					continue;
+				threads.start(
+					std::bind(
+						&tissuestack::imaging::TissueStackRawStatistics::computeSliceRange,
+						raw,
+						dimension,
+						t * slicesPerThread,
+						std::min(numberOfSlices - 1, (t + 1) * slicesPerThread - 1),
+						records.data(),
+						std::ref(succeeded[t])));
+			}
+			threads.join();
+		} catch (...)
+		{
+			// all bands have been joined by now, don't leave the temporary file behind
+			close(fd);
+			unlink(tmpFile.c_str());
+			throw;
+		}
+
+		bool allSucceeded = true;
+		for (unsigned int t=0;t<numberOfThreads;t++)
+			allSucceeded = allSucceeded && succeeded[t];
+
+		const unsigned long long int length = records.size() * sizeof(unsigned int);
+		if (!allSucceeded ||
+				pwrite(fd, records.data(), length, position) != static_cast<ssize_t>(length))
+		{
+			close(fd);
+			unlink(tmpFile.c_str());
+			THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
+				"Statistics: Could not compute or write the slice statistics!");
+		}
+		position += length;
+	}
+
+	close(fd);
+	if (rename(tmpFile.c_str(), sidecar.c_str()) != 0)
+	{
+		unlink(tmpFile.c_str());
+		THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
+			"Statistics: Could not move finished file into place!");
+	}
+
+	tissuestack::logging::TissueStackLogger::instance()->info(
+		"Statistics: built %s (%llu bytes)\n", sidecar.c_str(), position);
+}
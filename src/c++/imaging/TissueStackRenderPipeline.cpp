@@ -0,0 +1,499 @@
+/*
+ * This file is part of TissueStack.
+ *
+ * TissueStack is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TissueStack is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TissueStack.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "networking.h"
+#include "imaging.h"
+
+tissuestack::imaging::TissueStackRenderPipeline::TissueStackRenderPipeline(
+	const tissuestack::imaging::TissueStackRawData * image,
+	const tissuestack::imaging::TissueStackDataDimension * actualDimension,
+	const tissuestack::networking::TissueStackImageRequest * request,
+	const bool flip_vertically,
+	const unsigned int source_width,
+	const unsigned int source_height,
+	const unsigned short layer) :
+		_request(request),
+		_raw_width(source_width == 0 ? actualDimension->getWidth() : source_width),
+		_source_channels((image->getType() == tissuestack::imaging::RAW_TYPE::UCHAR_8_BIT) ? 1 : 3)
+{
+	std::array<unsigned int, 2> scaled;
+	std::array<unsigned int, 2> reduced;
+	std::array<unsigned int, 2> offset;
+	std::array<unsigned int, 2> size;
+	tissuestack::imaging::TissueStackRenderPipeline::measureTile(actualDimension, request, scaled, reduced, offset, size);
+	this->_width = size[0];
+	this->_height = size[1];
+
+	// collapse all nearest neighbor stages into one mapping per axis
+	std::vector<unsigned int> columns(this->_width);
+	this->mapToSource(
+		columns,
+		offset[0],
+		this->_raw_width,
+		actualDimension->getAnisotropicWidth(),
+		scaled[0],
+		reduced[0],
+		false);
+	this->_column_offsets.resize(this->_width);
+	for (unsigned int x=0;x<this->_width;x++)
+		this->_column_offsets[x] = static_cast<unsigned long long int>(columns[x]) * this->_source_channels;
+
+	this->_source_rows.resize(this->_height);
+	this->mapToSource(
+		this->_source_rows,
+		offset[1],
+		source_height == 0 ? actualDimension->getHeight() : source_height,
+		actualDimension->getAnisotropicHeight(),
+		scaled[1],
+		reduced[1],
+		flip_vertically);
+
+	const auto sourceColumns = std::minmax_element(columns.begin(), columns.end());
+	const auto sourceRows = std::minmax_element(this->_source_rows.begin(), this->_source_rows.end());
+	this->_source_region = {{
+		*sourceColumns.first,
+		*sourceRows.first,
+		*sourceColumns.second - *sourceColumns.first + 1,
+		*sourceRows.second - *sourceRows.first + 1 }};
+
+	this->findLookupTable(image, layer);
+	this->findLabelSelection(image);
+
+	// outlines compare the border voxels of the region with their neighbors: they have to be read as well
+	if (this->_draws_label_outlines)
+	{
+		const unsigned int rawHeight = source_height == 0 ? actualDimension->getHeight() : source_height;
+		const unsigned int left = this->_source_region[0] > 0 ? this->_source_region[0] - 1 : 0;
+		const unsigned int top = this->_source_region[1] > 0 ? this->_source_region[1] - 1 : 0;
+		const unsigned int right = std::min(this->_source_region[0] + this->_source_region[2] + 1, this->_raw_width);
+		const unsigned int bottom = std::min(this->_source_region[1] + this->_source_region[3] + 1, rawHeight);
+		this->_source_region = {{ left, top, right - left, bottom - top }};
+	}
+}
+
+tissuestack::imaging::TissueStackRenderPipeline::TissueStackRenderPipeline(
+	const tissuestack::imaging::TissueStackRawData * image,
+	const tissuestack::networking::TissueStackImageRequest * request,
+	const unsigned int width,
+	const unsigned int height) :
+		_request(request),
+		_raw_width(width),
+		_source_channels((image->getType() == tissuestack::imaging::RAW_TYPE::UCHAR_8_BIT) ? 1 : 3),
+		_width(width),
+		_height(height)
+{
+	// one to one
+	this->_column_offsets.resize(this->_width);
+	for (unsigned int x=0;x<this->_width;x++)
+		this->_column_offsets[x] = static_cast<unsigned long long int>(x) * this->_source_channels;
+	this->_source_rows.resize(this->_height);
+	for (unsigned int y=0;y<this->_height;y++)
+		this->_source_rows[y] = y;
+	this->_source_region = {{ 0, 0, width, height }};
+
+	this->findLookupTable(image, 0);
+}
+
+const std::array<unsigned int, 4> tissuestack::imaging::TissueStackRenderPipeline::findSourceRegion(
+	const tissuestack::imaging::TissueStackRawData * image,
+	const tissuestack::imaging::TissueStackDataDimension * actualDimension,
+	const tissuestack::networking::TissueStackImageRequest * request,
+	const bool flip_vertically,
+	unsigned int & width,
+	unsigned int & height)
+{
+	std::array<unsigned int, 2> scaled;
+	std::array<unsigned int, 2> reduced;
+	std::array<unsigned int, 2> offset;
+	std::array<unsigned int, 2> size;
+	tissuestack::imaging::TissueStackRenderPipeline::measureTile(actualDimension, request, scaled, reduced, offset, size);
+	width = size[0];
+	height = size[1];
+
+	// every stage of the mapping is monotone: the tile's first and last pixels give the region's edges
+	const unsigned int left =
+		tissuestack::imaging::TissueStackRenderPipeline::mapToSource(
+			offset[0],
+			actualDimension->getWidth(),
+			actualDimension->getAnisotropicWidth(),
+			scaled[0],
+			reduced[0],
+			false);
+	const unsigned int right =
+		tissuestack::imaging::TissueStackRenderPipeline::mapToSource(
+			offset[0] + size[0] - 1,
+			actualDimension->getWidth(),
+			actualDimension->getAnisotropicWidth(),
+			scaled[0],
+			reduced[0],
+			false);
+	const unsigned int firstRow =
+		tissuestack::imaging::TissueStackRenderPipeline::mapToSource(
+			offset[1],
+			actualDimension->getHeight(),
+			actualDimension->getAnisotropicHeight(),
+			scaled[1],
+			reduced[1],
+			flip_vertically);
+	const unsigned int lastRow =
+		tissuestack::imaging::TissueStackRenderPipeline::mapToSource(
+			offset[1] + size[1] - 1,
+			actualDimension->getHeight(),
+			actualDimension->getAnisotropicHeight(),
+			scaled[1],
+			reduced[1],
+			flip_vertically);
+	const unsigned int top = std::min(firstRow, lastRow);
+	const unsigned int bottom = std::max(firstRow, lastRow);
+
+	// the margin the constructor adds for outlines
+	if (request->getLabelMode() == tissuestack::networking::TissueStackImageRequest::LabelMode::OUTLINE &&
+			image->getLookup() != nullptr)
+	{
+		const unsigned int outerLeft = left > 0 ? left - 1 : 0;
+		const unsigned int outerTop = top > 0 ? top - 1 : 0;
+		const unsigned int outerRight = std::min(right + 2, actualDimension->getWidth());
+		const unsigned int outerBottom = std::min(bottom + 2, actualDimension->getHeight());
+		return {{ outerLeft, outerTop, outerRight - outerLeft, outerBottom - outerTop }};
+	}
+
+	return {{ left, top, right - left + 1, bottom - top + 1 }};
+}
+
+inline void tissuestack::imaging::TissueStackRenderPipeline::measureTile(
+	const tissuestack::imaging::TissueStackDataDimension * actualDimension,
+	const tissuestack::networking::TissueStackImageRequest * request,
+	std::array<unsigned int, 2> & scaled,
+	std::array<unsigned int, 2> & reduced,
+	std::array<unsigned int, 2> & offset,
+	std::array<unsigned int, 2> & size)
+{
+	// the geometry of the intermediate images we no longer create
+	scaled = {{ actualDimension->getAnisotropicWidth(), actualDimension->getAnisotropicHeight() }};
+	if (request->getScaleFactor() != static_cast<const float>(1.0))
+	{
+		const float scaledWith =
+			static_cast<const float>(actualDimension->getAnisotropicWidth()) * request->getScaleFactor();
+		const float scaledHeigth =
+			static_cast<const float>(actualDimension->getAnisotropicHeight()) * request->getScaleFactor();
+		scaled[0] = scaledWith < 1 ? 1 : static_cast<const unsigned int>(scaledWith);
+		scaled[1] = scaledHeigth < 1 ? 1 : static_cast<const unsigned int>(scaledHeigth);
+	}
+
+	reduced = scaled;
+	if (request->getQualityFactor() < static_cast<const float>(1.0))
+	{
+		const float width = static_cast<const float>(scaled[0]) * request->getQualityFactor();
+		const float height = static_cast<const float>(scaled[1]) * request->getQualityFactor();
+		reduced[0] = width < 1 ? 1 : static_cast<const unsigned int>(width);
+		reduced[1] = height < 1 ? 1 : static_cast<const unsigned int>(height);
+	}
+
+	// previews are only cropped if they don't fit the viewing window
+	offset = {{ 0, 0 }};
+	size = scaled;
+	if (!request->isPreview() || request->showOnlyPortionOfImage())
+	{
+		const unsigned int width = request->isPreview() ? request->getWidth() : request->getLengthOfSquare();
+		const unsigned int height = request->isPreview() ? request->getHeight() : request->getLengthOfSquare();
+		offset[0] = request->isPreview() ? request->getXCoordinate() : request->getXCoordinate() * width;
+		offset[1] = request->isPreview() ? request->getYCoordinate() : request->getYCoordinate() * height;
+
+		// check if we don't exceed bounds
+		if (offset[0] > scaled[0] || offset[1] > scaled[1])
+			THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
+				"Image Extraction: tile number(x/y) exceeds the width/height of the image (given the square length)");
+		if (offset[0] >= scaled[0] || offset[1] >= scaled[1] || width == 0 || height == 0)
+			THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
+				"Image Extraction: Failed to crop image to get tile!");
+
+		// tiles at the border are cut off
+		size[0] = offset[0] + width > scaled[0] ? scaled[0] - offset[0] : width;
+		size[1] = offset[1] + height > scaled[1] ? scaled[1] - offset[1] : height;
+	}
+}
+
+inline void tissuestack::imaging::TissueStackRenderPipeline::findLookupTable(
+	const tissuestack::imaging::TissueStackRawData * image,
+	const unsigned short layer)
+{
+	this->_lookup_table =
+		tissuestack::imaging::TissueStackLookupTableStore::instance()->findLookupTable(
+			this->_request->getLayerContrastMinimum(layer),
+			this->_request->getLayerContrastMaximum(layer),
+			image->getImageDataMinumum(),
+			image->getImageDataMaximum(),
+			this->_request->getLayerColorMapName(layer));
+	this->_opacity_weight =
+		static_cast<unsigned short>(lround(this->_request->getLayerOpacity(layer) * 256));
+}
+
+inline void tissuestack::imaging::TissueStackRenderPipeline::findLabelSelection(
+	const tissuestack::imaging::TissueStackRawData * image)
+{
+	if (this->_request->getLabelMode() == tissuestack::networking::TissueStackImageRequest::LabelMode::NONE ||
+			image->getLookup() == nullptr)
+		return;
+
+	this->_label_lookup = image->getLookup();
+	this->_draws_label_outlines =
+		this->_request->getLabelMode() == tissuestack::networking::TissueStackImageRequest::LabelMode::OUTLINE;
+	if (this->_request->getSelectedLabel().empty())
+		return;
+
+	this->_selected_label = this->_label_lookup->findLabelIndex(this->_request->getSelectedLabel());
+	if (this->_selected_label == 0)
+		THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
+			"Label could not be found in the data set's label lookup!");
+}
+
+inline const std::vector<unsigned char> tissuestack::imaging::TissueStackRenderPipeline::findLabelMask(
+	const unsigned char * data) const
+{
+	// the labels of the source region, resolved a row at a time
+	const unsigned long long int sourceRowLength =
+		static_cast<unsigned long long int>(this->_raw_width) * this->_source_channels;
+	const unsigned int regionWidth = this->_source_region[2];
+	const unsigned int regionHeight = this->_source_region[3];
+	std::vector<unsigned short> labels(static_cast<unsigned long long int>(regionWidth) * regionHeight);
+	for (unsigned int y=0;y<regionHeight;y++)
+		this->_label_lookup->findLabelIndices(
+			data + (this->_source_region[1] + y) * sourceRowLength + this->_source_region[0] * this->_source_channels,
+			this->_source_channels,
+			regionWidth,
+			labels.data() + static_cast<unsigned long long int>(y) * regionWidth);
+
+	std::vector<unsigned char> boundaries;
+	if (this->_draws_label_outlines)
+	{
+		boundaries.resize(labels.size());
+		tissuestack::imaging::PixelKernels::markLabelBoundaries(labels.data(), regionWidth, regionHeight, boundaries.data());
+	}
+
+	// then sampled like the pixels are
+	std::vector<unsigned char> mask(static_cast<unsigned long long int>(this->_width) * this->_height);
+	for (unsigned int y=0;y<this->_height;y++)
+	{
+		const unsigned long long int row =
+			static_cast<unsigned long long int>(this->_source_rows[y] - this->_source_region[1]) * regionWidth;
+		for (unsigned int x=0;x<this->_width;x++)
+		{
+			const unsigned long long int i =
+				row + this->_column_offsets[x] / this->_source_channels - this->_source_region[0];
+			const bool isSelected = this->_selected_label == 0 || labels[i] == this->_selected_label;
+			mask[static_cast<unsigned long long int>(y) * this->_width + x] =
+				(isSelected && (this->_draws_label_outlines ? boundaries[i] != 0 : labels[i] != 0)) ? 1 : 0;
+		}
+	}
+
+	return mask;
+}
+
+inline void tissuestack::imaging::TissueStackRenderPipeline::mapToSource(
+	std::vector<unsigned int> & positions,
+	const unsigned int offset,
+	const unsigned int raw_length,
+	const unsigned int anisotropic_length,
+	const unsigned int scaled_length,
+	const unsigned int reduced_length,
+	const bool flip) const
+{
+	for (unsigned int i=0;i<positions.size();i++)
+		positions[i] =
+			tissuestack::imaging::TissueStackRenderPipeline::mapToSource(
+				i + offset, raw_length, anisotropic_length, scaled_length, reduced_length, flip);
+}
+
+inline const unsigned int tissuestack::imaging::TissueStackRenderPipeline::mapToSource(
+	const unsigned int position,
+	const unsigned int raw_length,
+	const unsigned int anisotropic_length,
+	const unsigned int scaled_length,
+	const unsigned int reduced_length,
+	const bool flip)
+{
+	// walk back: crop, quality (up and down), scale, orientation, anisotropy
+	unsigned int sourcePosition =
+		tissuestack::imaging::PixelKernels::getNearestSampleOffset(position, reduced_length, scaled_length);
+	sourcePosition =
+		tissuestack::imaging::PixelKernels::getNearestSampleOffset(sourcePosition, scaled_length, reduced_length);
+	sourcePosition =
+		tissuestack::imaging::PixelKernels::getNearestSampleOffset(sourcePosition, anisotropic_length, scaled_length);
+	if (flip)
+		sourcePosition = anisotropic_length - 1 - sourcePosition;
+	return tissuestack::imaging::PixelKernels::getNearestSampleOffset(sourcePosition, raw_length, anisotropic_length);
+}
+
+const unsigned int tissuestack::imaging::TissueStackRenderPipeline::getWidth() const
+{
+	return this->_width;
+}
+
+const unsigned int tissuestack::imaging::TissueStackRenderPipeline::getHeight() const
+{
+	return this->_height;
+}
+
+const unsigned short tissuestack::imaging::TissueStackRenderPipeline::getChannels() const
+{
+	return this->_lookup_table->isColored() ? 3 : this->_source_channels;
+}
+
+const unsigned char * tissuestack::imaging::TissueStackRenderPipeline::getPalette() const
+{
+	// the pixels label rendering drops are black, which need not be in the palette
+	if (this->_label_lookup != nullptr)
+		return nullptr;
+
+	return this->_lookup_table->getPalette();
+}
+
+const std::array<unsigned int, 4> tissuestack::imaging::TissueStackRenderPipeline::getSourceRegion() const
+{
+	return this->_source_region;
+}
+
+void tissuestack::imaging::TissueStackRenderPipeline::cropToSourceRegion()
+{
+	for (unsigned int y=0;y<this->_height;y++)
+		this->_source_rows[y] -= this->_source_region[1];
+	for (unsigned int x=0;x<this->_width;x++)
+		this->_column_offsets[x] -= static_cast<unsigned long long int>(this->_source_region[0]) * this->_source_channels;
+	this->_raw_width = this->_source_region[2];
+	this->_source_region = {{ 0, 0, this->_source_region[2], this->_source_region[3] }};
+}
+
+void tissuestack::imaging::TissueStackRenderPipeline::render(
+	const unsigned char * data,
+	const std::function<void (const unsigned int row, const unsigned char * pixels)> & row_callback,
+	const bool palette_indices) const
+{
+	if (data == nullptr)
+		THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
+			"Data is null!");
+	if (palette_indices && this->getPalette() == nullptr)
+		THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
+			"Render Pipeline: Palette indices require a color map!");
+
+	const unsigned long long int sourceRowLength =
+		static_cast<unsigned long long int>(this->_raw_width) * this->_source_channels;
+
+	// one output row is all we need, repeated source rows are reused as is
+	std::vector<unsigned char> row(
+		static_cast<unsigned long long int>(this->_width) * (palette_indices ? 1 : this->getChannels()));
+	const unsigned short channels = palette_indices ? 1 : this->getChannels();
+	const std::vector<unsigned char> labelMask =
+		this->_label_lookup != nullptr ? this->findLabelMask(data) : std::vector<unsigned char>();
+	for (unsigned int y=0;y<this->_height;y++)
+	{
+		// timeout/shutdown check
+		if ((y & 63) == 0 && this->_request->hasExpired())
+			THROW_TS_EXCEPTION(tissuestack::common::TissueStackObsoleteRequestException,
+				"Old Image Request!");
+
+		if (y > 0 && this->_source_rows[y] == this->_source_rows[y-1])
+		{
+			row_callback(y, row.data());
+			continue;
+		}
+
+		// palette indices are the (red) source values themselves
+		if (palette_indices)
+		{
+			const unsigned char * sourceRow = data + this->_source_rows[y] * sourceRowLength;
+			for (unsigned int x=0;x<this->_width;x++)
+				row[x] = sourceRow[this->_column_offsets[x]];
+		} else
+			this->_lookup_table->applyToRow(
+				data + this->_source_rows[y] * sourceRowLength,
+				this->_source_channels,
+				this->_column_offsets.data(),
+				this->_width,
+				row.data());
+
+		if (!labelMask.empty())
+		{
+			const unsigned char * keep = labelMask.data() + static_cast<unsigned long long int>(y) * this->_width;
+			for (unsigned int x=0;x<this->_width;x++)
+				if (keep[x] == 0)
+					memset(row.data() + x * channels, 0, channels);
+		}
+
+		row_callback(y, row.data());
+	}
+}
+
+void tissuestack::imaging::TissueStackRenderPipeline::renderOnto(
+	const unsigned char * data,
+	unsigned char * rgb_image) const
+{
+	if (data == nullptr || rgb_image == nullptr)
+		THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
+			"Data is null!");
+
+	const unsigned long long int sourceRowLength =
+		static_cast<unsigned long long int>(this->_raw_width) * this->_source_channels;
+	const unsigned long long int rgbRowLength = static_cast<unsigned long long int>(this->_width) * 3;
+
+	// label rendering: the dropped pixels are handed over as 0, which leaves the layers underneath as they are
+	const std::vector<unsigned char> labelMask =
+		this->_label_lookup != nullptr ? this->findLabelMask(data) : std::vector<unsigned char>();
+	std::vector<unsigned char> keptPixels;
+	std::vector<unsigned long long int> keptOffsets;
+	if (!labelMask.empty())
+	{
+		keptPixels.resize(static_cast<unsigned long long int>(this->_width) * this->_source_channels);
+		keptOffsets.resize(this->_width);
+		for (unsigned int x=0;x<this->_width;x++)
+			keptOffsets[x] = static_cast<unsigned long long int>(x) * this->_source_channels;
+	}
+
+	for (unsigned int y=0;y<this->_height;y++)
+	{
+		// timeout/shutdown check
+		if ((y & 63) == 0 && this->_request->hasExpired())
+			THROW_TS_EXCEPTION(tissuestack::common::TissueStackObsoleteRequestException,
+				"Old Image Request!");
+
+		if (!labelMask.empty())
+		{
+			const unsigned char * sourceRow = data + this->_source_rows[y] * sourceRowLength;
+			const unsigned char * keep = labelMask.data() + static_cast<unsigned long long int>(y) * this->_width;
+			for (unsigned int x=0;x<this->_width;x++)
+				if (keep[x] == 0)
+					memset(keptPixels.data() + keptOffsets[x], 0, this->_source_channels);
+				else
+					memcpy(keptPixels.data() + keptOffsets[x], sourceRow + this->_column_offsets[x], this->_source_channels);
+
+			this->_lookup_table->blendRowOnto(
+				keptPixels.data(),
+				this->_source_channels,
+				keptOffsets.data(),
+				this->_width,
+				this->_opacity_weight,
+				rgb_image + y * rgbRowLength);
+			continue;
+		}
+
+		this->_lookup_table->blendRowOnto(
+			data + this->_source_rows[y] * sourceRowLength,
+			this->_source_channels,
+			this->_column_offsets.data(),
+			this->_width,
+			this->_opacity_weight,
+			rgb_image + y * rgbRowLength);
+	}
+}
@@ -16,8 +16,10 @@
  */
 #include "networking.h"
 #include "imaging.h"
+#include "database.h"
 
 const unsigned long long int tissuestack::imaging::TissueStackSliceCache::MINIMUM_FREE_RAM_IN_BYTES = 500 * 1000 * 1024;
+const unsigned int tissuestack::imaging::TissueStackSliceCache::HOT_SET_SNAPSHOT_SIZE = 500;
 const unsigned long long int tissuestack::imaging::TissueStackSliceCache::SECOND_IN_MILLIS = 1000;
 const unsigned long long int tissuestack::imaging::TissueStackSliceCache::MINUTE_IN_MILLIS =
 	tissuestack::imaging::TissueStackSliceCache::SECOND_IN_MILLIS * 60;
@@ -50,13 +52,25 @@ tissuestack::imaging::TissueStackSliceCache::TissueStackSliceCache() : _is_being
 
 	this->_is_being_cleaned = true;
 
+	// data sets whose slices are kept compressed: comma separated, '*' for all of them
+	const std::string compressedDataSets =
+		tissuestack::database::ConfigurationDataProvider::findSpecificApplicationDirectory("slice_cache_compression");
+	for (auto entry : tissuestack::utils::Misc::tokenizeString(compressedDataSets, ','))
+	{
+		const std::string trimmed = tissuestack::utils::Misc::eraseCharacterFromString(entry, ' ');
+		if (!trimmed.empty())
+			this->_compressed_data_sets.push_back(trimmed);
+	}
+
 	// we take the existing data sets and build up a cache structure
 	const std::vector<const tissuestack::imaging::TissueStackRawData * > dataSets =
 		tissuestack::imaging::TissueStackDataSetStore::instance()->getDataSetList();
 
 	// initialize cache
 	for (auto ds : dataSets)
-		this->_cache[ds->getFileName()] = new tissuestack::imaging::DataSetSliceCache(ds);
+		this->_cache[ds->getFileName()] =
+			new tissuestack::imaging::DataSetSliceCache(
+				ds, this->isCompressionConfiguredForDataSet(ds->getFileName()));
 
 	this->_is_being_cleaned = false;
 }
@@ -80,13 +94,35 @@ void tissuestack::imaging::TissueStackSliceCache::purgeInstance()
 	tissuestack::imaging::TissueStackSliceCache::_instance = nullptr;
 }
 
+void tissuestack::imaging::TissueStackSliceCache::reserveInFlightBytes(const unsigned long long int bytes)
+{
+	tissuestack::utils::MemoryAccounting * accounting = tissuestack::utils::MemoryAccounting::instance();
+	// the reads that are under way right now are not yet reflected in the usage figures
+	const unsigned long long int reserve =
+		accounting->getInFlightBytes() + tissuestack::imaging::TissueStackSliceCache::MINIMUM_FREE_RAM_IN_BYTES / 2;
+
+	if (!accounting->canAccommodate(bytes, reserve))
+	{
+		// give the cache a chance to make room before we turn the request away
+		tissuestack::imaging::TissueStackSliceCache::instance()->cleanUpCache();
+		if (!accounting->canAccommodate(bytes, reserve))
+			THROW_TS_EXCEPTION(tissuestack::common::TissueStackServiceUnavailableException,
+				"Insufficient memory to serve request right now, please try again later!");
+	}
+
+	accounting->addInFlightBytes(bytes);
+}
+
 const bool tissuestack::imaging::TissueStackSliceCache::addCacheEntry(
-	const std::string dataset, const unsigned long int slice, const unsigned char * data)
+	const std::string dataset,
+	const unsigned long int slice,
+	const unsigned char * data,
+	const unsigned long long int access_count)
 {
 	if (this->isBeingCleanedUp() || dataset.empty() || data == nullptr)
 			return false;
 
-	if (tissuestack::utils::System::getFreeRam() < tissuestack::imaging::TissueStackSliceCache::MINIMUM_FREE_RAM_IN_BYTES)
+	if (tissuestack::utils::MemoryAccounting::instance()->getAvailableMemory() < tissuestack::imaging::TissueStackSliceCache::MINIMUM_FREE_RAM_IN_BYTES)
 		return false;
 
 	std::lock_guard<std::mutex> lock(this->_cache_mutex);
@@ -98,7 +134,13 @@ const bool tissuestack::imaging::TissueStackSliceCache::addCacheEntry(
 		this->_is_empty = false;
 		tissuestack::imaging::DataSetSliceCache * cache = this->_cache.at(dataset);
 		cache->setMostRecentCacheFailure(-1);
-		return cache->setSlice(slice, new tissuestack::imaging::SliceCacheEntry(data));
+		tissuestack::imaging::SliceCacheEntry * entry = cache->createSliceCacheEntry(slice, data, access_count);
+		if (entry == nullptr)
+		{
+			this->_is_empty = oldStatus;
+			return false;
+		}
+		return cache->setSlice(slice, entry);
 	} catch (std::out_of_range & not_found) {
 		// we did not have this data set before => add it to cache structure
 		try
@@ -107,10 +149,18 @@ const bool tissuestack::imaging::TissueStackSliceCache::addCacheEntry(
 				tissuestack::imaging::TissueStackDataSetStore::instance()->findDataSet(dataset);
 			if (ds == nullptr || ds->getImageData() == nullptr || !ds->getImageData()->isRaw()) return false;
 
-			this->_cache[ds->getDataSetId()] =
+			tissuestack::imaging::DataSetSliceCache * cache =
 				new tissuestack::imaging::DataSetSliceCache(
-					static_cast<const tissuestack::imaging::TissueStackRawData *>(ds->getImageData()));
-			return this->_cache[ds->getDataSetId()]->setSlice(slice, new tissuestack::imaging::SliceCacheEntry(data));
+					static_cast<const tissuestack::imaging::TissueStackRawData *>(ds->getImageData()),
+					this->isCompressionConfiguredForDataSet(ds->getDataSetId()));
+			this->_cache[ds->getDataSetId()] = cache;
+			tissuestack::imaging::SliceCacheEntry * entry = cache->createSliceCacheEntry(slice, data, access_count);
+			if (entry == nullptr)
+			{
+				this->_is_empty = oldStatus;
+				return false;
+			}
+			return cache->setSlice(slice, entry);
 		} catch (std::exception & ex) {
 			this->_is_empty = oldStatus;
 			tissuestack::logging::TissueStackLogger::instance()->error(
@@ -123,9 +173,27 @@ const bool tissuestack::imaging::TissueStackSliceCache::addCacheEntry(
 	return false;
 }
 
+void tissuestack::imaging::TissueStackSliceCache::eraseDataSet(const std::string dataset)
+{
+	if (this->isBeingCleanedUp() || dataset.empty())
+		return;
+
+	std::lock_guard<std::mutex> lock(this->_cache_mutex);
+
+	try
+	{
+		tissuestack::imaging::DataSetSliceCache * cache = this->_cache.at(dataset);
+		for (unsigned long int x=0;x<cache->getNumberOfCachedSlices();x++)
+			cache->eraseSlice(x);
+	} catch (std::out_of_range & not_found) {
+		// nothing cached
+	}
+}
+
 const unsigned char *  tissuestack::imaging::TissueStackSliceCache::findCacheEntry(
-	const std::string dataset, const unsigned long int slice)
+	const std::string dataset, const unsigned long int slice, bool & is_copy, const bool is_peek)
 {
+	is_copy = false;
 	if (this->isBeingCleanedUp() || dataset.empty() || this->_is_empty)
 		return nullptr;
 
@@ -133,7 +201,7 @@ const unsigned char *  tissuestack::imaging::TissueStackSliceCache::findCacheEnt
 	{
 		tissuestack::imaging::DataSetSliceCache * cache = this->_cache.at(dataset);
 
-		int waitLimit = 10000000;
+		int waitLimit = is_peek ? 0 : 10000000;
 		while (waitLimit > 0 && cache->getMostRecentCacheFailure() == static_cast<long int>(slice))
 		{
 			usleep(100000); // 100,000 micro seconds /100 milli seconds
@@ -143,22 +211,50 @@ const unsigned char *  tissuestack::imaging::TissueStackSliceCache::findCacheEnt
 		return nullptr;
 	}
 
-	std::lock_guard<std::mutex> lock(this->_cache_mutex);
-
-	try
+	std::unique_ptr<unsigned char[]> compressed;
+	unsigned long long int compressedLength = 0;
+	unsigned long long int uncompressedLength = 0;
 	{
-		// look up data set
-		tissuestack::imaging::DataSetSliceCache * cache = this->_cache.at(dataset);
-		tissuestack::imaging::SliceCacheEntry * cached_slice = cache->getSlice(slice);
-		if (cached_slice == nullptr)
+		std::lock_guard<std::mutex> lock(this->_cache_mutex);
+
+		try
 		{
-			cache->setMostRecentCacheFailure(slice);
+			// look up data set
+			tissuestack::imaging::DataSetSliceCache * cache = this->_cache.at(dataset);
+			tissuestack::imaging::SliceCacheEntry * cached_slice = cache->getSlice(slice);
+			if (cached_slice == nullptr)
+			{
+				if (!is_peek)
+					cache->setMostRecentCacheFailure(slice);
+				return nullptr;
+			}
+			if (!cached_slice->isCompressed())
+				return cached_slice->getCacheData();
+
+			// only the copy is made under the lock, other hits need not wait for us to inflate it
+			compressed.reset(cached_slice->copyCacheData());
+			compressedLength = cached_slice->getSizeInBytes();
+			uncompressedLength = cached_slice->getUncompressedSizeInBytes();
+		} catch (std::out_of_range & not_found) {
 			return nullptr;
 		}
-		return cached_slice->getCacheData();
-	} catch (std::out_of_range & not_found) {
-		return nullptr;
 	}
+
+	if (!compressed)
+		return nullptr;
+
+	// a compressed entry hands out a decompressed copy which is the caller's to delete
+	std::unique_ptr<unsigned char[]> uncompressed(new unsigned char[uncompressedLength]);
+	if (!tissuestack::imaging::TissueStackRawData::decompressBrick(
+			tissuestack::imaging::DataSetSliceCache::SLICE_CODEC,
+			compressed.get(),
+			compressedLength,
+			uncompressed.get(),
+			uncompressedLength))
+		return nullptr;
+
+	is_copy = true;
+	return uncompressed.release();
 }
 
 void tissuestack::imaging::TissueStackSliceCache::cleanUpCache()
@@ -198,7 +294,7 @@ void tissuestack::imaging::TissueStackSliceCache::cleanUpCache()
 				}
 		}
 
-		if (tissuestack::utils::System::getFreeRam() > tissuestack::imaging::TissueStackSliceCache::MINIMUM_FREE_RAM_IN_BYTES)
+		if (tissuestack::utils::MemoryAccounting::instance()->getAvailableMemory() > tissuestack::imaging::TissueStackSliceCache::MINIMUM_FREE_RAM_IN_BYTES)
 		{
 			if (count > 0)
 				tissuestack::logging::TissueStackLogger::instance()->info("Freed %lu cache entries.", count);
@@ -248,7 +344,7 @@ void tissuestack::imaging::TissueStackSliceCache::cleanUpCache()
 		}
 
 		// we've free enough, let's leave ...
-		if (tissuestack::utils::System::getFreeRam() > tissuestack::imaging::TissueStackSliceCache::MINIMUM_FREE_RAM_IN_BYTES)
+		if (tissuestack::utils::MemoryAccounting::instance()->getAvailableMemory() > tissuestack::imaging::TissueStackSliceCache::MINIMUM_FREE_RAM_IN_BYTES)
 		{
 			if (count > 0)
 				tissuestack::logging::TissueStackLogger::instance()->info("Freed %lu cache entries.", count);
@@ -277,6 +373,239 @@ void tissuestack::imaging::TissueStackSliceCache::cleanUpCache()
 	this->_is_being_cleaned = false;
 }
 
+inline const bool tissuestack::imaging::TissueStackSliceCache::isCompressionConfiguredForDataSet(const std::string & dataset) const
+{
+	for (auto entry : this->_compressed_data_sets)
+	{
+		if (entry.compare("*") == 0 || entry.compare(dataset) == 0)
+			return true;
+
+		// the file name without its path will do as well
+		const size_t lastSlash = dataset.find_last_of('/');
+		if (lastSlash != std::string::npos && entry.compare(dataset.substr(lastSlash+1)) == 0)
+			return true;
+	}
+
+	return false;
+}
+
+void tissuestack::imaging::TissueStackSliceCache::dumpCacheStatisticsIntoLog()
+{
+	if (this->isBeingCleanedUp())
+		return;
+
+	std::lock_guard<std::mutex> lock(this->_cache_mutex);
+
+	unsigned long long int totalResident = 0;
+	unsigned long long int totalUncompressed = 0;
+	for (auto cached_dataset : this->_cache)
+	{
+		const tissuestack::imaging::DataSetSliceCache * cache = cached_dataset.second;
+		if (cache == nullptr || cache->getResidentBytes() == 0)
+			continue;
+
+		totalResident += cache->getResidentBytes();
+		totalUncompressed += cache->getUncompressedBytes();
+
+		if (!cache->isCompressionEnabled())
+			continue;
+
+		tissuestack::logging::TissueStackLogger::instance()->info(
+			"Slice Cache [%s]: %llu bytes resident for %llu bytes of slices (compression ratio %.2f)\n",
+			cached_dataset.first.c_str(),
+			cache->getResidentBytes(),
+			cache->getUncompressedBytes(),
+			static_cast<double>(cache->getUncompressedBytes()) / static_cast<double>(cache->getResidentBytes()));
+	}
+
+	if (totalResident == 0)
+		return;
+
+	tissuestack::logging::TissueStackLogger::instance()->info(
+		"Slice Cache: %llu bytes resident for %llu bytes of slices (effective ratio %.2f)\n",
+		totalResident,
+		totalUncompressed,
+		static_cast<double>(totalUncompressed) / static_cast<double>(totalResident));
+}
+
+const std::string tissuestack::imaging::TissueStackSliceCache::getHotSetSnapshotFile()
+{
+	std::string dir =
+		tissuestack::database::ConfigurationDataProvider::findSpecificApplicationDirectory("tasks_directory");
+	if (dir.empty())
+		dir = TASKS_PATH;
+
+	return dir + "/slice_cache.hotset";
+}
+
+const bool tissuestack::imaging::TissueStackSliceCache::persistHotSetSnapshot()
+{
+	if (this->isBeingCleanedUp() || !tissuestack::imaging::TissueStackDataSetStore::doesInstanceExist())
+		return false;
+
+	// collect: access count, data set and slice index within the data set cache
+	std::vector<std::pair<unsigned long long int, std::pair<std::string, unsigned long int> > > hotSet;
+	{
+		std::lock_guard<std::mutex> lock(this->_cache_mutex);
+
+		for (auto cached_dataset : this->_cache)
+		{
+			tissuestack::imaging::DataSetSliceCache * cache = cached_dataset.second;
+			for (unsigned long int x=0;x<cache->getNumberOfCachedSlices();x++)
+				if (cache->isSliceCached(x))
+					hotSet.push_back(
+						std::make_pair(
+							cache->getSlice(x)->getAccessCount(),
+							std::make_pair(cached_dataset.first, x)));
+		}
+	}
+
+	// hottest first
+	std::sort(hotSet.begin(), hotSet.end(),
+		[] (const std::pair<unsigned long long int, std::pair<std::string, unsigned long int> > & a,
+			const std::pair<unsigned long long int, std::pair<std::string, unsigned long int> > & b) {
+			return a.first > b.first;
+	});
+	if (hotSet.size() > tissuestack::imaging::TissueStackSliceCache::HOT_SET_SNAPSHOT_SIZE)
+		hotSet.resize(tissuestack::imaging::TissueStackSliceCache::HOT_SET_SNAPSHOT_SIZE);
+
+	const std::string snapshotFile = tissuestack::imaging::TissueStackSliceCache::getHotSetSnapshotFile();
+	const std::string tmpFile = snapshotFile + ".tmp";
+
+	std::ofstream snapshot(tmpFile, std::ios::out | std::ios::trunc);
+	if (!snapshot.good())
+		return false;
+
+	// translate the cache slice index back into dimension and slice number
+	for (auto entry : hotSet)
+	{
+		const tissuestack::imaging::TissueStackDataSet * ds =
+			tissuestack::imaging::TissueStackDataSetStore::instance()->findDataSet(entry.second.first);
+		if (ds == nullptr || ds->getImageData() == nullptr)
+			continue;
+
+		unsigned long int slice = entry.second.second;
+		for (auto dim : ds->getImageData()->getDimensionOrder())
+		{
+			const unsigned long int numberOfSlices =
+				ds->getImageData()->getDimensionByLongName(dim)->getNumberOfSlices();
+			if (slice < numberOfSlices)
+			{
+				snapshot << entry.second.first << "\t" << dim << "\t" << slice << "\t" << entry.first << "\n";
+				break;
+			}
+			slice -= numberOfSlices;
+		}
+	}
+	snapshot.close();
+
+	// replace the previous snapshot in one go
+	if (snapshot.fail() || rename(tmpFile.c_str(), snapshotFile.c_str()) != 0)
+	{
+		unlink(tmpFile.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+inline const bool tissuestack::imaging::TissueStackSliceCache::isCached(
+	const std::string & dataset, const unsigned long int slice)
+{
+	std::lock_guard<std::mutex> lock(this->_cache_mutex);
+
+	auto cache = this->_cache.find(dataset);
+	if (cache == this->_cache.end())
+		return false;
+
+	return cache->second->isSliceCached(slice);
+}
+
+void tissuestack::imaging::TissueStackSliceCache::warmUpFromHotSetSnapshot(
+	const tissuestack::common::ProcessingStrategy * processing_strategy)
+{
+	const std::vector<std::string> lines =
+		tissuestack::utils::System::readTextFileLineByLine(
+			tissuestack::imaging::TissueStackSliceCache::getHotSetSnapshotFile());
+	if (lines.empty() || !tissuestack::imaging::TissueStackDataSetStore::doesInstanceExist())
+		return;
+
+	tissuestack::logging::TissueStackLogger::instance()->info(
+		"Warming up Slice Cache with %lu snapshot entries\n", lines.size());
+
+	const tissuestack::imaging::UncachedImageExtraction extractor;
+	unsigned long int count = 0;
+
+	for (auto line : lines)
+	{
+		if (processing_strategy == nullptr || processing_strategy->isStopFlagRaised())
+			break;
+
+		const std::vector<std::string> tokens = tissuestack::utils::Misc::tokenizeString(line, '\t');
+		if (tokens.size() != 4 ||
+			!tissuestack::utils::Misc::isNumber(tokens[2]) || !tissuestack::utils::Misc::isNumber(tokens[3]))
+			continue;
+
+		// no point in continuing if we are running out of memory
+		if (tissuestack::utils::MemoryAccounting::instance()->getAvailableMemory() < tissuestack::imaging::TissueStackSliceCache::MINIMUM_FREE_RAM_IN_BYTES)
+			break;
+
+		const tissuestack::imaging::TissueStackDataSet * ds =
+			tissuestack::imaging::TissueStackDataSetStore::instance()->findDataSet(tokens[0]);
+		if (ds == nullptr || ds->getImageData() == nullptr || !ds->getImageData()->isRaw())
+			continue;
+
+		const tissuestack::imaging::TissueStackRawData * image =
+			static_cast<const tissuestack::imaging::TissueStackRawData *>(ds->getImageData());
+		if (image->isPinned())
+			continue;
+		const tissuestack::imaging::TissueStackDataDimension * actualDimension =
+			image->getDimensionByLongName(tokens[1]);
+		if (actualDimension == nullptr)
+			continue;
+
+		const unsigned int sliceNumber = static_cast<unsigned int>(strtoul(tokens[2].c_str(), NULL, 10));
+		if (sliceNumber >= actualDimension->getNumberOfSlices())
+			continue;
+
+		unsigned long int slice = 0;
+		for (auto dim : image->getDimensionOrder())
+		{
+			if (dim.compare(tokens[1]) == 0)
+				break;
+			slice += image->getDimensionByLongName(dim)->getNumberOfSlices();
+		}
+		slice += sliceNumber;
+
+		// requests might have been faster
+		if (this->isCached(image->getFileName(), slice))
+			continue;
+
+		try
+		{
+			const unsigned char * data =
+				extractor.extractSliceOnly(image, actualDimension, sliceNumber);
+			if (data == nullptr)
+				continue;
+
+			if (this->addCacheEntry(image->getFileName(), slice, data, strtoull(tokens[3].c_str(), NULL, 10)))
+				count++;
+			else
+				delete [] data;
+		} catch (std::exception & bad)
+		{
+			tissuestack::logging::TissueStackLogger::instance()->error(
+				"Failed to warm up slice %s of %s: %s\n", tokens[2].c_str(), tokens[0].c_str(), bad.what());
+		}
+
+		// we are low priority: give the request threads a chance to get at the disk
+		usleep(10000); // 10,000 micro seconds / 10 milli seconds
+	}
+
+	tissuestack::logging::TissueStackLogger::instance()->info(
+		"Finished warming up Slice Cache: %lu slices loaded\n", count);
+}
+
 const bool tissuestack::imaging::TissueStackSliceCache::isBeingCleanedUp() const
 {
 	return this->_is_being_cleaned;
@@ -0,0 +1,458 @@
+/*
+ * This file is part of TissueStack.
+ *
+ * TissueStack is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TissueStack is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TissueStack.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "networking.h"
+#include "imaging.h"
+#include "database.h"
+
+const unsigned long long int tissuestack::imaging::TissueStackTileDiskCache::DEFAULT_MAXIMUM_SIZE_IN_BYTES =
+	static_cast<unsigned long long int>(1024) * 1024 * 1024;
+const std::string tissuestack::imaging::TissueStackTileDiskCache::CACHE_FILE_MAGIC = "@TsTiLe@";
+const std::string tissuestack::imaging::TissueStackTileDiskCache::CACHE_FILE_EXTENSION = ".tile";
+const std::string tissuestack::imaging::TissueStackTileDiskCache::CACHE_TEMP_FILE_EXTENSION = ".tmp";
+
+tissuestack::imaging::TissueStackTileDiskCache::~TissueStackTileDiskCache()
+{
+	std::lock_guard<std::mutex> lock(this->_cache_mutex);
+
+	// the files stay on disk, that's the whole point
+	this->_index.clear();
+	this->_lru.clear();
+}
+
+tissuestack::imaging::TissueStackTileDiskCache::TissueStackTileDiskCache() :
+		_maximum_size_in_bytes(tissuestack::imaging::TissueStackTileDiskCache::DEFAULT_MAXIMUM_SIZE_IN_BYTES)
+{
+	const std::string maxSize =
+		tissuestack::database::ConfigurationDataProvider::findSpecificApplicationDirectory("tile_disk_cache_size");
+	if (!maxSize.empty() && tissuestack::utils::Misc::isNumber(maxSize))
+		this->_maximum_size_in_bytes = strtoull(maxSize.c_str(), NULL, 10);
+
+	// a size of 0 means: switched off
+	if (this->_maximum_size_in_bytes == 0)
+	{
+		tissuestack::logging::TissueStackLogger::instance()->info("Tile Disk Cache is disabled\n");
+		return;
+	}
+
+	this->_cache_directory = tissuestack::imaging::TissueStackTileDiskCache::getTileDiskCacheDirectory();
+	if (!tissuestack::utils::System::directoryExists(this->_cache_directory) &&
+		!tissuestack::utils::System::createDirectory(this->_cache_directory, 0755))
+	{
+		tissuestack::logging::TissueStackLogger::instance()->error(
+			"Could not create tile disk cache directory %s! Tile Disk Cache will be disabled!\n",
+			this->_cache_directory.c_str());
+		return;
+	}
+
+	this->recoverCacheFromDisk();
+	this->_is_enabled = true;
+
+	tissuestack::logging::TissueStackLogger::instance()->info(
+		"Tile Disk Cache in %s holds %llu entries (%llu of %llu bytes)\n",
+		this->_cache_directory.c_str(),
+		this->getNumberOfEntries(),
+		this->_size_in_bytes,
+		this->_maximum_size_in_bytes);
+}
+
+tissuestack::imaging::TissueStackTileDiskCache * tissuestack::imaging::TissueStackTileDiskCache::instance()
+{
+	if (tissuestack::imaging::TissueStackTileDiskCache::_instance == nullptr)
+		tissuestack::imaging::TissueStackTileDiskCache::_instance = new tissuestack::imaging::TissueStackTileDiskCache();
+
+	return tissuestack::imaging::TissueStackTileDiskCache::_instance;
+}
+
+const bool tissuestack::imaging::TissueStackTileDiskCache::doesInstanceExist()
+{
+	return (tissuestack::imaging::TissueStackTileDiskCache::_instance != nullptr);
+}
+
+void tissuestack::imaging::TissueStackTileDiskCache::purgeInstance()
+{
+	delete tissuestack::imaging::TissueStackTileDiskCache::_instance;
+	tissuestack::imaging::TissueStackTileDiskCache::_instance = nullptr;
+}
+
+const std::string tissuestack::imaging::TissueStackTileDiskCache::getTileDiskCacheDirectory()
+{
+	std::string dir =
+		tissuestack::database::ConfigurationDataProvider::findSpecificApplicationDirectory("tile_disk_cache_directory");
+	if (dir.empty())
+		dir = TILE_DISK_CACHE_PATH;
+
+	return dir;
+}
+
+const std::string tissuestack::imaging::TissueStackTileDiskCache::generateCacheKey(
+	const tissuestack::imaging::TissueStackRawData * image,
+	const tissuestack::networking::TissueStackImageRequest * request)
+{
+	if (image == nullptr || request == nullptr)
+		return "";
+
+	// a changed color map or a replaced raw file must not give us stale tiles
+	time_t colorMapModified = 0;
+	const tissuestack::imaging::TissueStackColorMap * colorMap =
+		tissuestack::imaging::TissueStackColorMapStore::instance()->findColorMap(request->getColorMapName());
+	if (colorMap)
+		colorMapModified = colorMap->getLastModified();
+
+	std::ostringstream key;
+	key << image->getFileName() << "|"
+		<< tissuestack::utils::System::getLastModifiedTime(image->getFileName()) << "|"
+		<< request->getDimensionName() << "|"
+		<< request->getSliceNumber() << "|"
+		<< (request->isPreview() ? "P" : "T") << "|"
+		<< request->getXCoordinate() << "|"
+		<< request->getYCoordinate() << "|"
+		<< request->getLengthOfSquare() << "|"
+		<< request->getWidth() << "|"
+		<< request->getHeight() << "|"
+		<< request->getScaleFactor() << "|"
+		<< request->getQualityFactor() << "|"
+		<< request->getColorMapName() << "|"
+		<< colorMapModified << "|"
+		<< request->getContrastMinimum() << "|"
+		<< request->getContrastMaximum() << "|"
+		<< request->getOutputImageFormat();
+	if (request->getLabelMode() != tissuestack::networking::TissueStackImageRequest::LabelMode::NONE)
+		key << "|" << request->getLabelModeName() << "|" << request->getSelectedLabel();
+
+	// overlays: the layers on top of the first data set
+	const std::vector<std::string> dataSets = request->getDataSetLocations();
+	for (unsigned short layer=1;layer<dataSets.size();layer++)
+	{
+		colorMapModified = 0;
+		colorMap =
+			tissuestack::imaging::TissueStackColorMapStore::instance()->findColorMap(request->getLayerColorMapName(layer));
+		if (colorMap)
+			colorMapModified = colorMap->getLastModified();
+
+		key << "|" << dataSets[layer] << "|"
+			<< tissuestack::utils::System::getLastModifiedTime(dataSets[layer]) << "|"
+			<< request->getLayerColorMapName(layer) << "|"
+			<< colorMapModified << "|"
+			<< request->getLayerContrastMinimum(layer) << "|"
+			<< request->getLayerContrastMaximum(layer) << "|"
+			<< request->getLayerOpacity(layer);
+	}
+	if (dataSets.size() > 1)
+		key << "|" << request->getLayerOpacity(0);
+
+	return key.str();
+}
+
+const bool tissuestack::imaging::TissueStackTileDiskCache::isEnabled() const
+{
+	return this->_is_enabled;
+}
+
+const unsigned long long int tissuestack::imaging::TissueStackTileDiskCache::getSizeInBytes() const
+{
+	return this->_size_in_bytes;
+}
+
+const unsigned long long int tissuestack::imaging::TissueStackTileDiskCache::getNumberOfEntries() const
+{
+	return static_cast<unsigned long long int>(this->_index.size());
+}
+
+inline const std::string tissuestack::imaging::TissueStackTileDiskCache::getFileNameForKey(const std::string & key) const
+{
+	// content addressed: the (full) key is stored within the file to rule out hash collisions
+	char hash[17];
+	snprintf(hash, sizeof(hash), "%016llx",
+		static_cast<unsigned long long int>(std::hash<std::string>()(key)));
+
+	return this->_cache_directory + "/" + std::string(hash) +
+		tissuestack::imaging::TissueStackTileDiskCache::CACHE_FILE_EXTENSION;
+}
+
+void tissuestack::imaging::TissueStackTileDiskCache::recoverCacheFromDisk()
+{
+	std::vector<std::pair<time_t, std::string> > cacheFiles;
+	std::vector<unsigned long long int> cacheFileSizes;
+
+	DIR * dir = opendir(this->_cache_directory.c_str());
+	if (dir == NULL)
+		return;
+
+	struct dirent * dir_entry = NULL;
+	while ((dir_entry = readdir(dir)))
+	{
+		const std::string name = dir_entry->d_name;
+		if (name.compare(".") == 0 || name.compare("..") == 0)
+			continue;
+
+		const std::string file = this->_cache_directory + "/" + name;
+
+		// left overs from writes that never finished (crash, kill -9)
+		if (name.length() > tissuestack::imaging::TissueStackTileDiskCache::CACHE_TEMP_FILE_EXTENSION.length() &&
+			name.compare(
+				name.length() - tissuestack::imaging::TissueStackTileDiskCache::CACHE_TEMP_FILE_EXTENSION.length(),
+				std::string::npos,
+				tissuestack::imaging::TissueStackTileDiskCache::CACHE_TEMP_FILE_EXTENSION) == 0)
+		{
+			unlink(file.c_str());
+			continue;
+		}
+
+		if (name.length() <= tissuestack::imaging::TissueStackTileDiskCache::CACHE_FILE_EXTENSION.length() ||
+			name.compare(
+				name.length() - tissuestack::imaging::TissueStackTileDiskCache::CACHE_FILE_EXTENSION.length(),
+				std::string::npos,
+				tissuestack::imaging::TissueStackTileDiskCache::CACHE_FILE_EXTENSION) != 0)
+			continue;
+
+		struct stat buf;
+		if (stat(file.c_str(), &buf) != 0 || !S_ISREG(buf.st_mode))
+			continue;
+
+		// too small to be anything but a corrupted file
+		if (static_cast<unsigned long long int>(buf.st_size) <=
+				tissuestack::imaging::TissueStackTileDiskCache::CACHE_FILE_MAGIC.length() + sizeof(unsigned int))
+		{
+			unlink(file.c_str());
+			continue;
+		}
+
+		cacheFiles.push_back(std::make_pair(buf.st_mtime, file));
+		cacheFileSizes.push_back(static_cast<unsigned long long int>(buf.st_size));
+	}
+	closedir(dir);
+
+	// oldest first, the modification time is bumped on every hit => we can restore lru order
+	std::vector<unsigned int> order(cacheFiles.size());
+	for (unsigned int i=0;i<order.size();i++)
+		order[i] = i;
+	std::sort(order.begin(), order.end(),
+		[&cacheFiles] (const unsigned int a, const unsigned int b) {
+			return cacheFiles[a].first < cacheFiles[b].first;
+	});
+
+	std::lock_guard<std::mutex> lock(this->_cache_mutex);
+	for (auto i : order)
+		this->registerCacheFile(cacheFiles[i].second, cacheFileSizes[i]);
+
+	// the configured budget might have been lowered in the meantime
+	this->evictLeastRecentlyUsedEntries(0);
+}
+
+inline void tissuestack::imaging::TissueStackTileDiskCache::registerCacheFile(
+	const std::string & file, const unsigned long long int size)
+{
+	auto existing = this->_index.find(file);
+	if (existing != this->_index.end())
+	{
+		this->_size_in_bytes -= existing->second.second;
+		this->_lru.erase(existing->second.first);
+		this->_index.erase(existing);
+	}
+
+	this->_lru.push_front(file);
+	this->_index[file] = std::make_pair(this->_lru.begin(), size);
+	this->_size_in_bytes += size;
+}
+
+inline void tissuestack::imaging::TissueStackTileDiskCache::eraseCacheFile(const std::string & file)
+{
+	auto existing = this->_index.find(file);
+	if (existing == this->_index.end())
+		return;
+
+	this->_size_in_bytes -= existing->second.second;
+	this->_lru.erase(existing->second.first);
+	this->_index.erase(existing);
+	unlink(file.c_str());
+}
+
+inline void tissuestack::imaging::TissueStackTileDiskCache::eraseCacheFileIfUnchanged(
+	const std::string & file, const struct stat & found)
+{
+	// addCacheEntry may have renamed a new file into place after we looked: that one stays
+	struct stat buf;
+	if (stat(file.c_str(), &buf) == 0 && (buf.st_dev != found.st_dev || buf.st_ino != found.st_ino))
+		return;
+
+	this->eraseCacheFile(file);
+}
+
+inline void tissuestack::imaging::TissueStackTileDiskCache::evictLeastRecentlyUsedEntries(
+	const unsigned long long int bytes_needed)
+{
+	while (!this->_lru.empty() &&
+			this->_size_in_bytes + bytes_needed > this->_maximum_size_in_bytes)
+	{
+		const std::string victim = this->_lru.back();
+		this->eraseCacheFile(victim);
+	}
+}
+
+const bool tissuestack::imaging::TissueStackTileDiskCache::addCacheEntry(
+	const std::string & key, const unsigned char * data, const unsigned long long int length)
+{
+	if (!this->_is_enabled || key.empty() || data == nullptr || length == 0)
+		return false;
+
+	const unsigned int keyLength = static_cast<unsigned int>(key.length());
+	const unsigned long long int totalLength =
+		tissuestack::imaging::TissueStackTileDiskCache::CACHE_FILE_MAGIC.length() +
+		sizeof(keyLength) + keyLength + length;
+	if (totalLength > this->_maximum_size_in_bytes)
+		return false;
+
+	const std::string file = this->getFileNameForKey(key);
+
+	// we write into a temporary file first and rename it after,
+	// that way a crash can never leave us with half written cache entries
+	std::ostringstream tmpFile;
+	tmpFile << file << "." << std::hash<std::thread::id>()(std::this_thread::get_id()) <<
+		tissuestack::imaging::TissueStackTileDiskCache::CACHE_TEMP_FILE_EXTENSION;
+
+	const int fd = open(tmpFile.str().c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		return false;
+
+	bool success =
+		write(fd,
+			tissuestack::imaging::TissueStackTileDiskCache::CACHE_FILE_MAGIC.c_str(),
+			tissuestack::imaging::TissueStackTileDiskCache::CACHE_FILE_MAGIC.length()) ==
+				static_cast<ssize_t>(tissuestack::imaging::TissueStackTileDiskCache::CACHE_FILE_MAGIC.length()) &&
+		write(fd, &keyLength, sizeof(keyLength)) == static_cast<ssize_t>(sizeof(keyLength)) &&
+		write(fd, key.c_str(), keyLength) == static_cast<ssize_t>(keyLength);
+
+	unsigned long long int written = 0;
+	while (success && written < length)
+	{
+		const ssize_t ret = write(fd, data + written, length - written);
+		if (ret <= 0)
+			success = false;
+		else
+			written += ret;
+	}
+	close(fd);
+
+	if (!success || rename(tmpFile.str().c_str(), file.c_str()) != 0)
+	{
+		unlink(tmpFile.str().c_str());
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(this->_cache_mutex);
+	// we account for the new entry before making room so that a replaced file is not counted twice
+	this->registerCacheFile(file, totalLength);
+	this->evictLeastRecentlyUsedEntries(0);
+
+	return true;
+}
+
+unsigned char * tissuestack::imaging::TissueStackTileDiskCache::findCacheEntry(
+	const std::string & key, unsigned long long int & length)
+{
+	length = 0;
+	if (!this->_is_enabled || key.empty())
+		return nullptr;
+
+	const std::string file = this->getFileNameForKey(key);
+
+	{
+		std::lock_guard<std::mutex> lock(this->_cache_mutex);
+
+		auto hit = this->_index.find(file);
+		if (hit == this->_index.end())
+			return nullptr;
+
+		// move to the front
+		this->_lru.splice(this->_lru.begin(), this->_lru, hit->second.first);
+	}
+
+	// entries are renamed into place whole: what we opened is consistent in itself,
+	// its size is taken from the descriptor, not from the index which a rewrite may have changed by now
+	struct stat found;
+	memset(&found, 0, sizeof(found));
+	const int fd = open(file.c_str(), O_RDONLY);
+	if (fd < 0 || fstat(fd, &found) != 0)
+	{
+		if (fd >= 0)
+			close(fd);
+		memset(&found, 0, sizeof(found));
+		std::lock_guard<std::mutex> lock(this->_cache_mutex);
+		this->eraseCacheFileIfUnchanged(file, found);
+		return nullptr;
+	}
+	const unsigned long long int fileSize = static_cast<unsigned long long int>(found.st_size);
+
+	const unsigned int magicLength = tissuestack::imaging::TissueStackTileDiskCache::CACHE_FILE_MAGIC.length();
+	std::string magic(magicLength, '\0');
+	unsigned int keyLength = 0;
+	bool valid =
+		read(fd, &magic[0], magicLength) == static_cast<ssize_t>(magicLength) &&
+		tissuestack::imaging::TissueStackTileDiskCache::CACHE_FILE_MAGIC.compare(magic) == 0 &&
+		read(fd, &keyLength, sizeof(keyLength)) == static_cast<ssize_t>(sizeof(keyLength)) &&
+		magicLength + sizeof(keyLength) + keyLength < fileSize;
+
+	if (valid)
+	{
+		std::string storedKey(keyLength, '\0');
+		valid = read(fd, &storedKey[0], keyLength) == static_cast<ssize_t>(keyLength);
+
+		// a hash collision is not an error, we simply don't have it
+		if (valid && storedKey.compare(key) != 0)
+		{
+			close(fd);
+			return nullptr;
+		}
+	}
+
+	unsigned char * data = nullptr;
+	if (valid)
+	{
+		length = fileSize - magicLength - sizeof(keyLength) - keyLength;
+		data = new unsigned char[length];
+
+		unsigned long long int bytesRead = 0;
+		while (valid && bytesRead < length)
+		{
+			const ssize_t ret = read(fd, data + bytesRead, length - bytesRead);
+			if (ret <= 0)
+				valid = false;
+			else
+				bytesRead += ret;
+		}
+	}
+
+	// touch file to preserve the lru order for a restart
+	if (valid)
+		futimens(fd, NULL);
+	close(fd);
+
+	if (!valid)
+	{
+		if (data)
+			delete [] data;
+		length = 0;
+
+		std::lock_guard<std::mutex> lock(this->_cache_mutex);
+		this->eraseCacheFileIfUnchanged(file, found);
+		return nullptr;
+	}
+
+	return data;
+}
+
+tissuestack::imaging::TissueStackTileDiskCache * tissuestack::imaging::TissueStackTileDiskCache::_instance = nullptr;
@@ -16,6 +16,7 @@
  */
 #include "networking.h"
 #include "imaging.h"
+#include <thread>
 
 tissuestack::imaging::UncachedImageExtraction::UncachedImageExtraction()
 {
@@ -37,23 +38,49 @@ inline unsigned char * tissuestack::imaging::UncachedImageExtraction::readRawSli
 			actualDimension->getOffset() +
 				static_cast<unsigned long long int>(sliceNumber) * static_cast<unsigned long long int>(dataLength);
 
-	// read the actual raw data to write out images later on
 	unsigned char * data = new unsigned char[dataLength];
+
+	// bricked raws have no slices on disk, they are assembled
+	if (image->isBricked())
+	{
+		if (!image->readBrickedSlice(
+				actualDimension,
+				sliceNumber,
+				0,
+				0,
+				actualDimension->getWidth(),
+				actualDimension->getHeight(),
+				data,
+				actualDimension->getWidth() * multiplier))
+		{
+			delete [] data;
+			THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
+					"Failed to read entire slice from RAW file!");
+		}
+		return data;
+	}
+
+	// pinned data sets are served straight from their locked mapping
+	if (image->isPinned() && image->readPinnedData(data, actualOffset, dataLength))
+		return data;
+
+	// read the actual raw data to write out images later on
+	// (positional read: the descriptor is shared among request threads and the cache warm up)
 	const int fd =
 		const_cast<tissuestack::imaging::TissueStackRawData *>(image)->getFileDescriptor();
-	lseek(
-		fd,
-		actualOffset,
-		SEEK_SET);
 	ssize_t bRead =
-		read(
+		pread(
 			fd,
 			static_cast<void *>(data),
-			dataLength);
+			dataLength,
+			actualOffset);
 
 	if (bRead != dataLength)
+	{
+		delete [] data;
 		THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
 				"Failed to read entire slice from RAW file!");
+	}
 
 	return data;
 }
@@ -79,7 +106,19 @@ const unsigned char * tissuestack::imaging::UncachedImageExtraction::extractImag
 	return data;
 }
 
-Image * tissuestack::imaging::UncachedImageExtraction::extractImageForPreTiling(
+const unsigned char * tissuestack::imaging::UncachedImageExtraction::extractSliceOnly(
+		const tissuestack::imaging::TissueStackRawData * image,
+		const tissuestack::imaging::TissueStackDataDimension * actualDimension,
+		const unsigned int sliceNumber) const
+{
+	if (image == nullptr || actualDimension == nullptr ||
+			sliceNumber >= actualDimension->getNumberOfSlices())
+		return nullptr;
+
+	return this->readRawSlice(image, actualDimension, sliceNumber);
+}
+
+tissuestack::imaging::PixelBuffer * tissuestack::imaging::UncachedImageExtraction::extractImageForPreTiling(
 		const tissuestack::imaging::TissueStackRawData * image,
 		const tissuestack::imaging::TissueStackDataDimension * actualDimension,
 		const unsigned int sliceNumber) const
@@ -91,36 +130,31 @@ Image * tissuestack::imaging::UncachedImageExtraction::extractImageForPreTiling(
 				sliceNumber));
 
 	return
-		this->createImageFromDataRead0(
+		this->createPixelBufferFromDataRead(
 			image,
 			actualDimension,
 			data.get());
 }
 
-Image * tissuestack::imaging::UncachedImageExtraction::applyPreTilingProcessing(
-	Image * img,
+tissuestack::imaging::PixelBuffer * tissuestack::imaging::UncachedImageExtraction::applyPreTilingProcessing(
+	tissuestack::imaging::PixelBuffer * buffer,
 	const std::string color_map_name,
 	unsigned long int & width,
 	unsigned long int & height,
 	const float scaleFactor) const
 {
-	if (img == nullptr)
+	if (buffer == nullptr)
 		return nullptr;
 
+	std::unique_ptr<tissuestack::imaging::PixelBuffer> processed(buffer);
+
 	// perform color mapping if requested
 	if (color_map_name.compare("gray") != 0 &&
 		color_map_name.compare("grey") != 0)
-	{
-		img = this->convertAnythingToRgbImage(img);
-		this->applyColorMap(
-				img,
-				color_map_name,
-				width,
-				height);
-	}
+		processed.reset(this->applyLookupTable(processed.get(), 0, 255, 0, 0, color_map_name));
 
 	// adjust scale (if requested)
-	if (img && scaleFactor != static_cast<const float>(1.0))
+	if (scaleFactor != static_cast<const float>(1.0))
 	{
 		width =
 			static_cast<unsigned int>(
@@ -136,106 +170,901 @@ Image * tissuestack::imaging::UncachedImageExtraction::applyPreTilingProcessing(
 		if (height < 1)
 			height = 1;
 
-		img =
-			this->scaleImage(
-				img,
+		processed.reset(
+			this->scalePixelBuffer(
+				processed.get(),
 				width,
-				height);
+				height));
 	}
 
-	return img;
+	return processed.release();
 }
 
+const unsigned char * tissuestack::imaging::UncachedImageExtraction::encodeImage(
+		const tissuestack::imaging::TissueStackRawData * image,
+		const tissuestack::networking::TissueStackImageRequest * request,
+		const unsigned char * data,
+		unsigned long long int & length) const
+{
+	return this->encodeImage0(image, request, data, 0, 0, length);
+}
 
-Image * tissuestack::imaging::UncachedImageExtraction::applyPostExtractionTasks(
-		Image * img,
+const unsigned char * tissuestack::imaging::UncachedImageExtraction::encodeImageFromPyramid(
+		const tissuestack::imaging::TissueStackRawData * image,
+		const tissuestack::networking::TissueStackImageRequest * request,
+		unsigned long long int & length) const
+{
+	// averaged levels blend neighboring label ids into ids and colors that exist nowhere in the data,
+	// whatever the label mode: data sets with a lookup only use nearest neighbor levels
+	const tissuestack::imaging::TissueStackRawPyramid * pyramid = image->getPyramid();
+	if (pyramid == nullptr || (image->getLookup() != nullptr && pyramid->isAveraged()))
+		return nullptr;
+
+	const tissuestack::imaging::TissueStackDataDimension * actualDimension =
+			image->getDimensionByLongName(request->getDimensionName());
+	if (actualDimension == nullptr)
+		return nullptr;
+
+	// the resolution the render pipeline ends up sampling the whole slice at
+	float width = static_cast<const float>(actualDimension->getAnisotropicWidth()) * request->getScaleFactor();
+	float height = static_cast<const float>(actualDimension->getAnisotropicHeight()) * request->getScaleFactor();
+	width = width < 1 ? 1 : static_cast<float>(static_cast<unsigned int>(width));
+	height = height < 1 ? 1 : static_cast<float>(static_cast<unsigned int>(height));
+	if (request->getQualityFactor() < static_cast<const float>(1.0))
+	{
+		width *= request->getQualityFactor();
+		height *= request->getQualityFactor();
+	}
+
+	// the smallest level at or above that resolution will do
+	const unsigned short level =
+		pyramid->findLevel(
+			actualDimension->getName(),
+			static_cast<unsigned int>(ceil(width)),
+			static_cast<unsigned int>(ceil(height)));
+	if (level == 0)
+		return nullptr;
+
+	const unsigned char * data =
+		pyramid->getSlice(actualDimension->getName(), level, request->getSliceNumber());
+	if (data == nullptr)
+		return nullptr;
+
+	return this->encodeImage0(
+		image,
+		request,
+		data,
+		pyramid->getWidth(actualDimension->getName(), level),
+		pyramid->getHeight(actualDimension->getName(), level),
+		length);
+}
+
+const unsigned char * tissuestack::imaging::UncachedImageExtraction::encodeImageFromBricks(
+		const tissuestack::imaging::TissueStackRawData * image,
+		const tissuestack::networking::TissueStackImageRequest * request,
+		unsigned long long int & length) const
+{
+	if (!image->isBricked())
+		return nullptr;
+
+	const tissuestack::imaging::TissueStackDataDimension * actualDimension =
+			image->getDimensionByLongName(request->getDimensionName());
+	if (actualDimension == nullptr || request->getSliceNumber() >= actualDimension->getNumberOfSlices())
+		THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
+			"Image Extraction: slice number exceeds the number of slices!");
+
+	tissuestack::imaging::TissueStackRenderPipeline pipeline(
+		image,
+		actualDimension,
+		request,
+		this->isFlippedVertically(image, actualDimension));
+
+	// the pipeline only ever looks at its source region: that's all we read
+	const unsigned long long int multiplier =
+		image->getType() != tissuestack::imaging::RAW_TYPE::UCHAR_8_BIT ? 3 : 1;
+	const std::array<unsigned int, 4> region = pipeline.getSourceRegion();
+	pipeline.cropToSourceRegion();
+	const unsigned long long int rowLength = region[2] * multiplier;
+	const unsigned long long int regionBytes = rowLength * region[3];
+
+	tissuestack::imaging::TissueStackSliceCache::reserveInFlightBytes(regionBytes);
+	tissuestack::utils::MemoryAccounting * accounting = tissuestack::utils::MemoryAccounting::instance();
+
+	const unsigned char * encoded = nullptr;
+	try
+	{
+		const std::unique_ptr<unsigned char[]> data(new unsigned char[regionBytes]);
+		if (!image->readBrickedSlice(
+				actualDimension,
+				request->getSliceNumber(),
+				region[0],
+				region[1],
+				region[2],
+				region[3],
+				data.get(),
+				rowLength))
+			THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
+				"Failed to read bricks from RAW file!");
+
+		if (request->hasExpired())
+			THROW_TS_EXCEPTION(tissuestack::common::TissueStackObsoleteRequestException,
+				"Old Image Request!");
+
+		encoded = this->encodeRendered(pipeline, request, data.get(), length);
+	} catch (...)
+	{
+		accounting->removeInFlightBytes(regionBytes);
+		throw;
+	}
+	accounting->removeInFlightBytes(regionBytes);
+
+	return encoded;
+}
+
+const std::shared_ptr<const std::vector<unsigned char> > tissuestack::imaging::UncachedImageExtraction::findBlankTile(
 		const tissuestack::imaging::TissueStackRawData * image,
 		const tissuestack::networking::TissueStackImageRequest * request) const
 {
-	if (img == NULL) return NULL;
+	const tissuestack::imaging::TissueStackRawStatistics * statistics = image->getStatistics();
+	if (statistics == nullptr)
+		return nullptr;
 
 	const tissuestack::imaging::TissueStackDataDimension * actualDimension =
 			image->getDimensionByLongName(request->getDimensionName());
+	std::array<unsigned int, 4> bounds;
+	if (actualDimension == nullptr ||
+			!statistics->getNonZeroBounds(actualDimension->getName(), request->getSliceNumber(), bounds))
+		return nullptr;
+
+	// every sampled voxel lies within the source region: if that misses the non zero ones the tile is all 0.
+	// most tiles don't, they are turned away before any pipeline is built
+	const bool flip = this->isFlippedVertically(image, actualDimension);
+	unsigned int width = 0;
+	unsigned int height = 0;
+	const std::array<unsigned int, 4> region =
+		tissuestack::imaging::TissueStackRenderPipeline::findSourceRegion(
+			image, actualDimension, request, flip, width, height);
+	if (bounds[2] > bounds[0] &&
+			region[0] < bounds[2] && region[0] + region[2] > bounds[0] &&
+			region[1] < bounds[3] && region[1] + region[3] > bounds[1])
+		return nullptr;
+
+	std::ostringstream key;
+	key << request->getLayerColorMapName(0) << "|"
+		<< request->getLayerContrastMinimum(0) << "|"
+		<< request->getLayerContrastMaximum(0) << "|"
+		<< image->getImageDataMinumum() << "|"
+		<< image->getImageDataMaximum() << "|"
+		<< static_cast<int>(image->getType()) << "|"
+		<< request->getOutputImageFormat() << "|"
+		<< request->getQualityFactor() << "|"
+		<< request->getLabelModeName() << "|"
+		<< request->getSelectedLabel() << "|"
+		<< width << "x" << height;
 
-	// apply possible contrast settings
-	if (!(request->getContrastMinimum() == 0 && request->getContrastMaximum() == 255))
 	{
-		img = this->convertAnythingToRgbImage(img);
-		this->changeContrast(
-				img,
-				request->getContrastMinimum(),
-				request->getContrastMaximum(),
-				image->getImageDataMinumum(),
-				image->getImageDataMaximum(),
-				actualDimension->getAnisotropicWidth(),
-				actualDimension->getAnisotropicHeight());
+		std::lock_guard<std::mutex> lock(this->_blank_tiles_mutex);
+		const auto hit = this->_blank_tiles.find(key.str());
+		if (hit != this->_blank_tiles.end())
+		{
+			this->_blank_tile_usage.splice(this->_blank_tile_usage.end(), this->_blank_tile_usage, hit->second.second);
+			return hit->second.first;
+		}
 	}
 
-	// timeout/shutdown check
-	if (request->hasExpired())
+	// render zeros through the usual pipeline, only the rows up to the source region's bottom are looked at
+	const tissuestack::imaging::TissueStackRenderPipeline pipeline(image, actualDimension, request, flip);
+	const unsigned long long int multiplier =
+		image->getType() != tissuestack::imaging::RAW_TYPE::UCHAR_8_BIT ? 3 : 1;
+	const std::vector<unsigned char> zeros(
+		static_cast<unsigned long long int>(region[1] + region[3]) * actualDimension->getWidth() * multiplier, 0);
+	unsigned long long int length = 0;
+	const unsigned char * encoded = this->encodeRendered(pipeline, request, zeros.data(), length);
+	if (encoded == nullptr || length == 0)
+		return nullptr;
+
+	const std::shared_ptr<const std::vector<unsigned char> > blankTile(
+		new std::vector<unsigned char>(encoded, encoded + length));
+
+	std::lock_guard<std::mutex> lock(this->_blank_tiles_mutex);
+
+	// another thread may have been quicker
+	const auto hit = this->_blank_tiles.find(key.str());
+	if (hit != this->_blank_tiles.end())
+		return hit->second.first;
+
+	// once full the least recently used tile makes room, tiles still being streamed hold on to theirs
+	if (this->_blank_tiles.size() >= tissuestack::imaging::UncachedImageExtraction::MAXIMUM_NUMBER_OF_BLANK_TILES)
 	{
-		if (img) DestroyImage(img);
+		this->_blank_tiles.erase(this->_blank_tile_usage.front());
+		this->_blank_tile_usage.pop_front();
+	}
+	this->_blank_tiles[key.str()] =
+		std::make_pair(blankTile, this->_blank_tile_usage.insert(this->_blank_tile_usage.end(), key.str()));
+
+	return blankTile;
+}
+
+const unsigned char * tissuestack::imaging::UncachedImageExtraction::encodeObliqueImage(
+		const tissuestack::imaging::TissueStackRawData * image,
+		const tissuestack::networking::TissueStackObliqueRequest * request,
+		unsigned long long int & length) const
+{
+	tissuestack::imaging::TissueStackObliqueReslicer reslicer(image, request);
+	const std::unique_ptr<const unsigned char[]> data(reslicer.reslice());
+
+	if (request->hasExpired())
 		THROW_TS_EXCEPTION(tissuestack::common::TissueStackObsoleteRequestException,
 			"Old Image Request!");
+
+	// the sampled plane goes through the usual contrast, color map and encoding
+	const tissuestack::imaging::TissueStackRenderPipeline pipeline(
+		image,
+		request,
+		request->getPlaneWidth(),
+		request->getPlaneHeight());
+
+	return this->encodeRendered(pipeline, request, data.get(), length);
+}
+
+unsigned char * tissuestack::imaging::UncachedImageExtraction::projectSlices(
+		const tissuestack::imaging::TissueStackRawData * image,
+		const tissuestack::networking::TissueStackProjectionRequest * request) const
+{
+	const tissuestack::imaging::TissueStackDataDimension * actualDimension =
+			image->getDimensionByLongName(request->getDimensionName());
+	if (actualDimension == nullptr)
+		THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
+				"Image Dimension could not be found!");
+
+	const unsigned int firstSlice = request->getSliceNumber();
+	const unsigned int lastSlice =
+		std::min(request->getLastSliceNumber(), static_cast<unsigned int>(actualDimension->getNumberOfSlices() - 1));
+	if (firstSlice > lastSlice)
+		THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
+				"Slice number requested is out of bounds!");
+
+	const unsigned long long int length =
+		actualDimension->getSliceSize() * (image->getType() == tissuestack::imaging::RAW_TYPE::UCHAR_8_BIT ? 1 : 3);
+	const bool isMean =
+		request->getProjection() == tissuestack::networking::TissueStackProjectionRequest::Projection::MEAN;
+	const unsigned char start =
+		request->getProjection() == tissuestack::networking::TissueStackProjectionRequest::Projection::MINIMUM ? 255 : 0;
+
+	// every thread reduces a band of slices into an accumulator of its own, they are merged at the end
+	const unsigned int numberOfSlices = lastSlice - firstSlice + 1;
+	const unsigned int numberOfThreads =
+		std::max(1u,
+			std::min(
+				std::min(
+					tissuestack::utils::System::getNumberOfCores(),
+					static_cast<unsigned int>(tissuestack::imaging::UncachedImageExtraction::MAXIMUM_NUMBER_OF_PROJECTION_THREADS)),
+				numberOfSlices / 8));
+	const unsigned int slicesPerThread = (numberOfSlices + numberOfThreads - 1) / numberOfThreads;
+
+	// the accumulators and the slice buffer of every thread are not in the usage figures,
+	// they are reserved up front like any other read and released once merged
+	const unsigned long long int workingBytes =
+		static_cast<unsigned long long int>(numberOfThreads) * length * (1 + (isMean ? sizeof(unsigned int) : 1));
+	tissuestack::imaging::TissueStackSliceCache::reserveInFlightBytes(workingBytes);
+	tissuestack::utils::MemoryAccounting * accounting = tissuestack::utils::MemoryAccounting::instance();
+
+	unsigned char * projection = nullptr;
+	try
+	{
+		std::vector<std::vector<unsigned char> > extremes(numberOfThreads);
+		std::vector<std::vector<unsigned int> > sums(numberOfThreads);
+		std::unique_ptr<bool[]> succeeded(new bool[numberOfThreads]);
+		// declared after the accumulators: the bands are joined before those can go away
+		tissuestack::utils::WorkerThreads threads;
+		for (unsigned int t=0;t<numberOfThreads;t++)
+		{
+			if (isMean)
+				sums[t].assign(length, 0);
+			else
+				extremes[t].assign(length, start);
+			succeeded[t] = true;
+
+			// the calling thread takes the first band
+			if (t == 0)
+				continue;
+			const unsigned int bandStart = firstSlice + t * slicesPerThread;
+			if (bandStart > lastSlice)
+				break;
+			threads.start(
+				std::bind(
+					&tissuestack::imaging::UncachedImageExtraction::projectSliceRange,
+					this,
+					image,
+					actualDimension,
+					request,
+					bandStart,
+					std::min(lastSlice, bandStart + slicesPerThread - 1),
+					isMean ? nullptr : extremes[t].data(),
+					isMean ? sums[t].data() : nullptr,
+					std::ref(succeeded[t])));
+		}
+		this->projectSliceRange(
+			image,
+			actualDimension,
+			request,
+			firstSlice,
+			std::min(lastSlice, firstSlice + slicesPerThread - 1),
+			isMean ? nullptr : extremes[0].data(),
+			isMean ? sums[0].data() : nullptr,
+			succeeded[0]);
+		threads.join();
+
+		// timeout/shutdown check
+		if (request->hasExpired())
+			THROW_TS_EXCEPTION(tissuestack::common::TissueStackObsoleteRequestException,
+				"Old Image Request!");
+		for (unsigned int t=0;t<numberOfThreads;t++)
+			if (!succeeded[t])
+				THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
+					"Failed to read slices for projection from RAW file!");
+
+		projection = new unsigned char[length];
+		if (isMean)
+		{
+			for (unsigned int t=1;t<numberOfThreads;t++)
+				for (unsigned long long int i=0;i<length;i++)
+					sums[0][i] += sums[t][i];
+			for (unsigned long long int i=0;i<length;i++)
+				projection[i] = static_cast<unsigned char>((sums[0][i] + numberOfSlices / 2) / numberOfSlices);
+		} else
+		{
+			for (unsigned int t=1;t<numberOfThreads;t++)
+				if (start == 0)
+					tissuestack::imaging::PixelKernels::maximumRows(extremes[t].data(), extremes[0].data(), length);
+				else
+					tissuestack::imaging::PixelKernels::minimumRows(extremes[t].data(), extremes[0].data(), length);
+			memcpy(projection, extremes[0].data(), length);
+		}
+	} catch (...)
+	{
+		accounting->removeInFlightBytes(workingBytes);
+		throw;
 	}
+	accounting->removeInFlightBytes(workingBytes);
 
-	// perform color mapping if requested
-	if (request->getColorMapName().compare("gray") != 0 &&
-		request->getColorMapName().compare("grey") != 0)
+	return projection;
+}
+
+void tissuestack::imaging::UncachedImageExtraction::projectSliceRange(
+		const tissuestack::imaging::TissueStackRawData * image,
+		const tissuestack::imaging::TissueStackDataDimension * actualDimension,
+		const tissuestack::networking::TissueStackProjectionRequest * request,
+		const unsigned int first_slice,
+		const unsigned int last_slice,
+		unsigned char * extremes,
+		unsigned int * sums,
+		bool & succeeded) const
+{
+	const unsigned long long int channels = image->getType() == tissuestack::imaging::RAW_TYPE::UCHAR_8_BIT ? 1 : 3;
+	const unsigned long long int length = actualDimension->getSliceSize() * channels;
+	std::vector<unsigned char> slice(length);
+
+	for (unsigned int s=first_slice;s<=last_slice;s++)
 	{
-		img = this->convertAnythingToRgbImage(img);
-		this->applyColorMap(
-				img,
-				request->getColorMapName(),
-				actualDimension->getAnisotropicWidth(),
-				actualDimension->getAnisotropicHeight());
+		// the caller checks for expiry once we are all done
+		if (request->hasExpired())
+			return;
+
+		if (!image->readSliceRegion(
+				actualDimension,
+				s,
+				0,
+				0,
+				actualDimension->getWidth(),
+				actualDimension->getHeight(),
+				slice.data(),
+				actualDimension->getWidth() * channels))
+		{
+			succeeded = false;
+			return;
+		}
+
+		if (sums != nullptr)
+			tissuestack::imaging::PixelKernels::accumulateRows(slice.data(), sums, length);
+		else if (request->getProjection() == tissuestack::networking::TissueStackProjectionRequest::Projection::MINIMUM)
+			tissuestack::imaging::PixelKernels::minimumRows(slice.data(), extremes, length);
+		else
+			tissuestack::imaging::PixelKernels::maximumRows(slice.data(), extremes, length);
 	}
+}
 
-	// timeout/shutdown check
-	if (request->hasExpired())
+const std::vector<unsigned long long int> tissuestack::imaging::UncachedImageExtraction::computeHistograms(
+		const tissuestack::imaging::TissueStackRawData * image,
+		const tissuestack::networking::TissueStackStatisticsRequest * request,
+		const std::function<const unsigned char * (const unsigned int slice_number, bool & is_copy)> & find_cached_slice) const
+{
+	const tissuestack::imaging::TissueStackDataDimension * actualDimension =
+			image->getDimensionByLongName(request->getDimensionName());
+	if (actualDimension == nullptr)
+		THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
+				"Image Dimension could not be found!");
+
+	const unsigned int firstSlice = request->getSliceNumber();
+	const unsigned int lastSlice =
+		std::min(request->getLastSliceNumber(), static_cast<unsigned int>(actualDimension->getNumberOfSlices() - 1));
+	if (firstSlice > lastSlice)
+		THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
+				"Slice number requested is out of bounds!");
+
+	const unsigned short channels = image->getType() == tissuestack::imaging::RAW_TYPE::UCHAR_8_BIT ? 1 : 3;
+	std::vector<unsigned long long int> histograms(channels * 256, 0);
+
+	// whole slices were counted at conversion time if there is a statistics sidecar
+	if (request->getPolygon().empty() && image->getStatistics() != nullptr)
 	{
-		if (img) DestroyImage(img);
-		THROW_TS_EXCEPTION(tissuestack::common::TissueStackObsoleteRequestException,
-			"Old Image Request!");
+		bool isComplete = true;
+		for (unsigned int s=firstSlice;s<=lastSlice && isComplete;s++)
+			isComplete = image->getStatistics()->addHistograms(actualDimension->getName(), s, histograms.data());
+		if (isComplete)
+			return histograms;
+		std::fill(histograms.begin(), histograms.end(), 0);
 	}
 
-	const float scaledWith =
-		static_cast<const float>(actualDimension->getAnisotropicWidth()) * request->getScaleFactor();
-	const float scaledHeight =
-		static_cast<const float>(actualDimension->getAnisotropicHeight()) * request->getScaleFactor();
+	// the bounding box of the region within the slice: that is all we read
+	const std::vector<std::vector<std::pair<unsigned int, unsigned int> > > spans =
+		tissuestack::imaging::UncachedImageExtraction::findRegionSpans(
+			request->getPolygon(), actualDimension->getWidth(), actualDimension->getHeight());
+	unsigned int top = UINT_MAX, bottom = 0, left = UINT_MAX, right = 0;
+	for (unsigned int r=0;r<spans.size();r++)
+	{
+		if (spans[r].empty())
+			continue;
+		top = std::min(top, r);
+		bottom = r + 1;
+		left = std::min(left, spans[r].front().first);
+		right = std::max(right, spans[r].back().second);
+	}
+	if (top >= bottom)
+		return histograms;
+
+	// several slices are shared out among the threads, a single one is shared out by rows
+	const unsigned int numberOfSlices = lastSlice - firstSlice + 1;
+	const unsigned int numberOfUnits = numberOfSlices > 1 ? numberOfSlices : (bottom - top + 63) / 64;
+	const unsigned int numberOfThreads =
+		std::max(1u,
+			std::min(
+				std::min(
+					tissuestack::utils::System::getNumberOfCores(),
+					static_cast<unsigned int>(tissuestack::imaging::UncachedImageExtraction::MAXIMUM_NUMBER_OF_STATISTICS_THREADS)),
+				numberOfUnits));
+	const unsigned int unitsPerThread = (numberOfUnits + numberOfThreads - 1) / numberOfThreads;
+
+	// a single slice is looked up once for all threads
+	std::function<const unsigned char * (const unsigned int slice_number, bool & is_copy)> findSlice = find_cached_slice;
+	std::unique_ptr<const unsigned char[]> sliceCopy;
+	if (numberOfSlices == 1 && find_cached_slice)
+	{
+		bool isCopy = false;
+		const unsigned char * data = find_cached_slice(firstSlice, isCopy);
+		if (isCopy)
+			sliceCopy.reset(data);
+		findSlice =
+			[data] (const unsigned int slice_number, bool & is_copy) -> const unsigned char *
+			{
+				is_copy = false;
+				return data;
+			};
+	}
 
-	// adjust scale (if requested)
-	if (request->getScaleFactor() != static_cast<const float>(1.0))
-		img =
-			this->scaleImage(
-				img,
-				scaledWith < 0 ? 1 : static_cast<const unsigned int>(scaledWith),
-				scaledHeight < 0 ? 1 : static_cast<const unsigned int>(scaledHeight));
+	std::vector<std::vector<unsigned long long int> > counts(numberOfThreads);
+	std::unique_ptr<bool[]> succeeded(new bool[numberOfThreads]);
+	// declared after the counts and the slice lookup: the shares are joined before those can go away
+	tissuestack::utils::WorkerThreads threads;
+	for (unsigned int t=0;t<numberOfThreads;t++)
+	{
+		counts[t].assign(channels * 256, 0);
+		succeeded[t] = true;
+
+		const unsigned int unitStart = t * unitsPerThread;
+		if (unitStart >= numberOfUnits)
+			break;
+		const unsigned int unitEnd = std::min(numberOfUnits, unitStart + unitsPerThread);
+
+		const unsigned int fromSlice = numberOfSlices > 1 ? firstSlice + unitStart : firstSlice;
+		const unsigned int toSlice = numberOfSlices > 1 ? firstSlice + unitEnd - 1 : firstSlice;
+		const unsigned int fromRow = numberOfSlices > 1 ? top : top + unitStart * 64;
+		const unsigned int toRow = numberOfSlices > 1 ? bottom : std::min(bottom, top + unitEnd * 64);
+
+		// the calling thread takes the first share
+		if (t == 0)
+			continue;
+		threads.start(
+			std::bind(
+				&tissuestack::imaging::UncachedImageExtraction::countRegionValues,
+				this,
+				image,
+				actualDimension,
+				request,
+				std::cref(spans),
+				fromSlice,
+				toSlice,
+				fromRow,
+				toRow,
+				left,
+				right,
+				std::cref(findSlice),
+				counts[t].data(),
+				std::ref(succeeded[t])));
+	}
+	this->countRegionValues(
+		image,
+		actualDimension,
+		request,
+		spans,
+		firstSlice,
+		numberOfSlices > 1 ? std::min(lastSlice, firstSlice + unitsPerThread - 1) : firstSlice,
+		top,
+		numberOfSlices > 1 ? bottom : std::min(bottom, top + unitsPerThread * 64),
+		left,
+		right,
+		findSlice,
+		counts[0].data(),
+		succeeded[0]);
+	threads.join();
 
 	// timeout/shutdown check
 	if (request->hasExpired())
-	{
-		if (img) DestroyImage(img);
 		THROW_TS_EXCEPTION(tissuestack::common::TissueStackObsoleteRequestException,
-			"Old Image Request!");
+			"Old Statistics Request!");
+	for (unsigned int t=0;t<numberOfThreads;t++)
+		if (!succeeded[t])
+			THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
+				"Failed to read slices for statistics from RAW file!");
+
+	for (unsigned int t=0;t<numberOfThreads;t++)
+		for (unsigned int i=0;i<histograms.size();i++)
+			histograms[i] += counts[t][i];
+
+	return histograms;
+}
+
+void tissuestack::imaging::UncachedImageExtraction::countRegionValues(
+		const tissuestack::imaging::TissueStackRawData * image,
+		const tissuestack::imaging::TissueStackDataDimension * actualDimension,
+		const tissuestack::networking::TissueStackStatisticsRequest * request,
+		const std::vector<std::vector<std::pair<unsigned int, unsigned int> > > & spans,
+		const unsigned int first_slice,
+		const unsigned int last_slice,
+		const unsigned int first_row,
+		const unsigned int last_row,
+		const unsigned int left,
+		const unsigned int right,
+		const std::function<const unsigned char * (const unsigned int slice_number, bool & is_copy)> & find_cached_slice,
+		unsigned long long int * counts,
+		bool & succeeded) const
+{
+	if (first_row >= last_row)
+		return;
+
+	const unsigned short channels = image->getType() == tissuestack::imaging::RAW_TYPE::UCHAR_8_BIT ? 1 : 3;
+	// a slice's counts fit 32 bits, a slab's need not
+	std::vector<unsigned int> sliceCounts(channels * 256);
+	std::vector<unsigned char> region;
+
+	for (unsigned int s=first_slice;s<=last_slice;s++)
+	{
+		// the caller checks for expiry once we are all done
+		if (request->hasExpired())
+			return;
+
+		bool isCopy = false;
+		const unsigned char * data = find_cached_slice ? find_cached_slice(s, isCopy) : nullptr;
+		const std::unique_ptr<const unsigned char[]> copy(isCopy ? data : nullptr);
+
+		const unsigned char * rows = nullptr;
+		unsigned long long int stride = 0;
+		unsigned int column = 0;
+		if (data != nullptr)
+		{
+			stride = static_cast<unsigned long long int>(actualDimension->getWidth()) * channels;
+			rows = data + first_row * stride;
+		} else
+		{
+			stride = static_cast<unsigned long long int>(right - left) * channels;
+			region.resize(stride * (last_row - first_row));
+			if (!image->readSliceRegion(
+					actualDimension, s, left, first_row, right - left, last_row - first_row, region.data(), stride))
+			{
+				succeeded = false;
+				return;
+			}
+			rows = region.data();
+			column = left;
+		}
+
+		std::fill(sliceCounts.begin(), sliceCounts.end(), 0);
+		for (unsigned int r=first_row;r<last_row;r++)
+			for (auto & span : spans[r])
+				tissuestack::imaging::PixelKernels::countValues(
+					rows + (r - first_row) * stride + (span.first - column) * channels,
+					channels,
+					span.second - span.first,
+					sliceCounts.data());
+
+		for (unsigned int i=0;i<sliceCounts.size();i++)
+			counts[i] += sliceCounts[i];
+	}
+}
+
+const std::vector<std::vector<std::pair<unsigned int, unsigned int> > >
+	tissuestack::imaging::UncachedImageExtraction::findRegionSpans(
+		const std::vector<std::array<unsigned int, 2> > & polygon,
+		const unsigned int width,
+		const unsigned int height)
+{
+	std::vector<std::vector<std::pair<unsigned int, unsigned int> > > spans(height);
+	if (polygon.empty())
+	{
+		for (auto & row : spans)
+			row.push_back(std::make_pair(0u, width));
+		return spans;
 	}
 
-	// adjust quality (if requested)
-	if (request->getQualityFactor() < static_cast<const float>(1.0))
-		img =
-			this->degradeImage0(
-				img,
-				scaledWith < 0 ? 1 : static_cast<const unsigned int>(scaledWith),
-				scaledHeight < 0 ? 1 : static_cast<const unsigned int>(scaledHeight),
-				request->getQualityFactor());
-
-	// we don't have a preview => chop up into tiles
-	if (!request->isPreview())
-		img = this->getImageTile(img, request);
-	else if (request->showOnlyPortionOfImage())
-		img = this->getImageTile(img, request);
+	// scan lines through the voxel centers, the crossings pair up (even odd rule)
+	std::vector<double> crossings;
+	for (unsigned int r=0;r<height;r++)
+	{
+		const double y = r + 0.5;
+		crossings.clear();
+		for (unsigned int v=0;v<polygon.size();v++)
+		{
+			const std::array<unsigned int, 2> & from = polygon[v];
+			const std::array<unsigned int, 2> & to = polygon[(v + 1) % polygon.size()];
+			if ((y < from[1]) == (y < to[1]))
+				continue;
+			crossings.push_back(
+				from[0] + (y - from[1]) * (static_cast<double>(to[0]) - from[0]) / (static_cast<double>(to[1]) - from[1]));
+		}
+		std::sort(crossings.begin(), crossings.end());
 
-	return img;
+		// the voxels whose centers lie in between a pair
+		for (unsigned int c=0;c+1<crossings.size();c+=2)
+		{
+			const double first = std::max(0.0, std::ceil(crossings[c] - 0.5));
+			const double last = std::min(static_cast<double>(width), std::ceil(crossings[c+1] - 0.5));
+			if (first < last)
+				spans[r].push_back(
+					std::make_pair(static_cast<unsigned int>(first), static_cast<unsigned int>(last)));
+		}
+	}
+
+	return spans;
+}
+
+const unsigned char * tissuestack::imaging::UncachedImageExtraction::encodeProjectionImage(
+		const tissuestack::imaging::TissueStackRawData * image,
+		const tissuestack::networking::TissueStackProjectionRequest * request,
+		unsigned long long int & length) const
+{
+	const std::unique_ptr<const unsigned char[]> data(this->projectSlices(image, request));
+
+	// the projection renders like any other slice of its dimension
+	return this->encodeImage(image, request, data.get(), length);
+}
+
+const unsigned char * tissuestack::imaging::UncachedImageExtraction::encodeCompositeImage(
+		const std::vector<const tissuestack::imaging::TissueStackRawData *> & images,
+		const tissuestack::networking::TissueStackImageRequest * request,
+		const std::vector<const unsigned char *> & data,
+		unsigned long long int & length) const
+{
+	if (images.empty() || images.size() != data.size())
+		THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
+			"Composite Image: Every layer needs its slice data!");
+
+	// the layers are drawn one after the other onto a black rgb image
+	std::vector<unsigned char> composite;
+	unsigned int width = 0;
+	unsigned int height = 0;
+	for (unsigned short layer=0;layer<images.size();layer++)
+	{
+		const tissuestack::imaging::TissueStackDataDimension * actualDimension =
+				images[layer]->getDimensionByLongName(request->getDimensionName());
+		const tissuestack::imaging::TissueStackRenderPipeline pipeline(
+			images[layer],
+			actualDimension,
+			request,
+			this->isFlippedVertically(images[layer], actualDimension),
+			0,
+			0,
+			layer);
+
+		if (layer == 0)
+		{
+			width = pipeline.getWidth();
+			height = pipeline.getHeight();
+			composite.assign(static_cast<unsigned long long int>(width) * height * 3, 0);
+		} else if (pipeline.getWidth() != width || pipeline.getHeight() != height)
+			THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
+				"Composite Image: Data sets to be overlaid need the same geometry!");
+
+		pipeline.renderOnto(data[layer], composite.data());
+	}
+
+	tissuestack::imaging::TissueStackImageEncoder encoder(
+		request->getOutputImageFormat(),
+		width,
+		height,
+		3,
+		request->getQualityFactor());
+	for (unsigned int y=0;y<height;y++)
+		encoder.writeRow(composite.data() + static_cast<unsigned long long int>(y) * width * 3);
+
+	return encoder.finish(length);
+}
+
+inline const unsigned char * tissuestack::imaging::UncachedImageExtraction::encodeImage0(
+		const tissuestack::imaging::TissueStackRawData * image,
+		const tissuestack::networking::TissueStackImageRequest * request,
+		const unsigned char * data,
+		const unsigned int source_width,
+		const unsigned int source_height,
+		unsigned long long int & length) const
+{
+	const tissuestack::imaging::TissueStackDataDimension * actualDimension =
+			image->getDimensionByLongName(request->getDimensionName());
+
+	const tissuestack::imaging::TissueStackRenderPipeline pipeline(
+		image,
+		actualDimension,
+		request,
+		this->isFlippedVertically(image, actualDimension),
+		source_width,
+		source_height);
+
+	return this->encodeRendered(pipeline, request, data, length);
+}
+
+inline const unsigned char * tissuestack::imaging::UncachedImageExtraction::encodeRendered(
+		const tissuestack::imaging::TissueStackRenderPipeline & pipeline,
+		const tissuestack::networking::TissueStackImageRequest * request,
+		const unsigned char * data,
+		unsigned long long int & length) const
+{
+	// color mapped tiles can be indexed, gray ones are single channel already, rgb is the last resort
+	if (pipeline.getPalette() != nullptr &&
+			tissuestack::imaging::TissueStackImageEncoder::isPaletteSupported(request->getOutputImageFormat()))
+		return this->encodeWithPalette(pipeline, request, data, length);
+
+	// rendered rows go straight into the encoder
+	tissuestack::imaging::TissueStackImageEncoder encoder(
+		request->getOutputImageFormat(),
+		pipeline.getWidth(),
+		pipeline.getHeight(),
+		pipeline.getChannels(),
+		request->getQualityFactor());
+	pipeline.render(
+		data,
+		[&encoder] (const unsigned int /* row */, const unsigned char * pixels)
+		{
+			encoder.writeRow(pixels);
+		});
+
+	return encoder.finish(length);
+}
+
+const std::vector<unsigned char> tissuestack::imaging::UncachedImageExtraction::performBatchQuery(
+	const tissuestack::common::ProcessingStrategy * processing_strategy,
+	const tissuestack::imaging::TissueStackRawData * image,
+	const tissuestack::networking::TissueStackBatchQueryRequest * request) const
+{
+	const tissuestack::imaging::TissueStackDataDimension * actualDimension =
+			image->getDimensionByLongName(request->getDimensionName());
+	const std::vector<std::array<unsigned int, 3> > & points = request->getPoints();
+	const unsigned short channels = image->getType() == tissuestack::imaging::RAW_TYPE::UCHAR_8_BIT ? 1 : 3;
+
+	std::vector<unsigned char> values(points.size() * channels, 0);
+	const std::vector<unsigned int> order =
+		tissuestack::imaging::UncachedImageExtraction::sortPointsBySlice(points);
+	for (unsigned int first=0, last=0;first<order.size();first=last)
+	{
+		while (last < order.size() && points[order[last]][2] == points[order[first]][2])
+			last++;
+
+		if (request->hasExpired())
+			THROW_TS_EXCEPTION(tissuestack::common::TissueStackObsoleteRequestException,
+				"Old Batch Query Request!");
+
+		this->queryPointsOfSlice(
+			image, actualDimension, points, order.data() + first, last - first, nullptr, values.data());
+	}
+
+	return values;
+}
+
+const std::vector<unsigned int> tissuestack::imaging::UncachedImageExtraction::sortPointsBySlice(
+	const std::vector<std::array<unsigned int, 3> > & points)
+{
+	std::vector<unsigned int> order(points.size());
+	for (unsigned int i=0;i<order.size();i++)
+		order[i] = i;
+
+	std::sort(order.begin(), order.end(),
+		[&points] (const unsigned int a, const unsigned int b)
+		{
+			if (points[a][2] != points[b][2])
+				return points[a][2] < points[b][2];
+			if (points[a][1] != points[b][1])
+				return points[a][1] < points[b][1];
+			return points[a][0] < points[b][0];
+		});
+
+	return order;
+}
+
+void tissuestack::imaging::UncachedImageExtraction::queryPointsOfSlice(
+	const tissuestack::imaging::TissueStackRawData * image,
+	const tissuestack::imaging::TissueStackDataDimension * actualDimension,
+	const std::vector<std::array<unsigned int, 3> > & points,
+	const unsigned int * indices,
+	const unsigned int number_of_indices,
+	const unsigned char * slice_data,
+	unsigned char * values) const
+{
+	if (number_of_indices == 0)
+		return;
+
+	const unsigned int slice = points[indices[0]][2];
+	if (slice >= actualDimension->getNumberOfSlices())
+		THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
+			"Batch Query: Slice number requested is out of bounds!");
+
+	// the region the points span
+	unsigned int left = UINT_MAX, right = 0, top = UINT_MAX, bottom = 0;
+	for (unsigned int i=0;i<number_of_indices;i++)
+	{
+		const std::array<unsigned int, 3> & point = points[indices[i]];
+		if (point[0] >= actualDimension->getWidth() || point[1] >= actualDimension->getHeight())
+			THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
+				"Batch Query: Coordinate (x/y) exceeds the width/height of the image slice!");
+		left = std::min(left, point[0]);
+		right = std::max(right, point[0]);
+		top = std::min(top, point[1]);
+		bottom = std::max(bottom, point[1]);
+	}
+
+	const unsigned long long int channels = image->getType() == tissuestack::imaging::RAW_TYPE::UCHAR_8_BIT ? 1 : 3;
+	const unsigned int regionWidth = right - left + 1;
+	const unsigned int regionHeight = bottom - top + 1;
+
+	// no slice data: either the region in one go (bricks are decompressed once) or point by point
+	std::vector<unsigned char> region;
+	if (slice_data == nullptr &&
+			static_cast<unsigned long long int>(regionWidth) * regionHeight * channels <=
+				number_of_indices * tissuestack::imaging::UncachedImageExtraction::BYTES_READ_PER_QUERIED_POINT)
+	{
+		region.resize(static_cast<unsigned long long int>(regionWidth) * regionHeight * channels);
+		if (!image->readSliceRegion(
+				actualDimension, slice, left, top, regionWidth, regionHeight, region.data(), regionWidth * channels))
+			THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
+				"Failed to query slice within RAW file!");
+	}
+
+	for (unsigned int i=0;i<number_of_indices;i++)
+	{
+		const std::array<unsigned int, 3> & point = points[indices[i]];
+		unsigned char * value = values + indices[i] * channels;
+
+		if (slice_data != nullptr)
+			memcpy(
+				value,
+				slice_data + (static_cast<unsigned long long int>(point[1]) * actualDimension->getWidth() + point[0]) * channels,
+				channels);
+		else if (!region.empty())
+			memcpy(
+				value,
+				region.data() + (static_cast<unsigned long long int>(point[1] - top) * regionWidth + (point[0] - left)) * channels,
+				channels);
+		else if (!image->readSliceRegion(actualDimension, slice, point[0], point[1], 1, 1, value, channels))
+			THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
+				"Failed to query slice within RAW file!");
+	}
 }
 
 const std::array<unsigned long long int, 3> tissuestack::imaging::UncachedImageExtraction::performQuery(
@@ -252,9 +1081,35 @@ const std::array<unsigned long long int, 3> tissuestack::imaging::UncachedImageE
 			"Image Query: Coordinate (x/y) exceeds the width/height of the image slice!");
 
 	std::array<unsigned long long int, 3> pixel_value;
+	if (image->isBricked())
+	{
+		// the voxel's brick is all we touch
+		unsigned char data[3] = {'\0', '\0', '\0'};
+		if (!image->readBrickedSlice(
+				actualDimension,
+				request->getSliceNumber(),
+				request->getXCoordinate(),
+				request->getYCoordinate(),
+				1,
+				1,
+				data,
+				3))
+			THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
+					"Failed to query slice within RAW file!");
+
+		// single channel data is gray: all three are the same
+		if (image->getType() == tissuestack::imaging::RAW_TYPE::UCHAR_8_BIT)
+			data[1] = data[2] = data[0];
+		pixel_value[0] = static_cast<unsigned long long int>(data[0]);
+		pixel_value[1] = static_cast<unsigned long long int>(data[1]);
+		pixel_value[2] = static_cast<unsigned long long int>(data[2]);
+
+		return pixel_value;
+	}
+
 	if ((image->getRawVersion() == tissuestack::imaging::RAW_FILE_VERSION::LEGACY &&
 			image->getFormat() == tissuestack::imaging::FORMAT::RAW) ||
-			image->getRawVersion() == tissuestack::imaging::RAW_FILE_VERSION::V1)
+			image->getRawVersion() != tissuestack::imaging::RAW_FILE_VERSION::LEGACY)
 	{
 
 		unsigned long long int multiplier = 1;
@@ -284,18 +1139,22 @@ const std::array<unsigned long long int, 3> tissuestack::imaging::UncachedImageE
 			read(
 				fd,
 				static_cast<void *>(data),
-				3);
+				multiplier);
 
-		if (bRead != 3)
+		if (bRead != static_cast<ssize_t>(multiplier))
 		{
 			delete [] data;
 			THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
 					"Failed to query slice within RAW file!");
 		}
 
+		// single channel data is gray: all three are the same
+		if (multiplier == 1)
+			data[1] = data[2] = data[0];
 		pixel_value[0] = static_cast<unsigned long long int>(data[0]);
 		pixel_value[1] = static_cast<unsigned long long int>(data[1]);
 		pixel_value[2] = static_cast<unsigned long long int>(data[2]);
+		delete [] data;
 
 		return pixel_value;
 	}
@@ -401,7 +1260,7 @@ inline Image * tissuestack::imaging::UncachedImageExtraction::createImageFromDat
 	// TODO: check legacy code path for compatibility issues
 	if ((image->getRawVersion() == tissuestack::imaging::RAW_FILE_VERSION::LEGACY &&
 			image->getFormat() == tissuestack::imaging::FORMAT::RAW) ||
-			image->getRawVersion() == tissuestack::imaging::RAW_FILE_VERSION::V1 ||
+			image->getRawVersion() != tissuestack::imaging::RAW_FILE_VERSION::LEGACY ||
 			image->getNumberOfDimensions() < 3)
 		return img;
 
@@ -442,24 +1301,12 @@ inline Image * tissuestack::imaging::UncachedImageExtraction::createImageFromDat
 	return img;
 }
 
-Image * tissuestack::imaging::UncachedImageExtraction::degradeImage(
-		Image * img,
-		const unsigned int width,
-		const unsigned int height,
-		const float quality_factor) const
-{
-	return this->degradeImage0(img, width, height, quality_factor);
-}
-
-inline Image * tissuestack::imaging::UncachedImageExtraction::degradeImage0(
-		Image * img,
+tissuestack::imaging::PixelBuffer * tissuestack::imaging::UncachedImageExtraction::degradeImage(
+		const tissuestack::imaging::PixelBuffer * buffer,
 		const unsigned int width,
 		const unsigned int height,
 		const float quality_factor) const
 {
-	ExceptionInfo exception;
-	GetExceptionInfo(&exception);
-
 	float reducedWidth = static_cast<const float>(width) * quality_factor;
 	float reducedHeight = static_cast<const float>(height) * quality_factor;
 
@@ -469,38 +1316,33 @@ inline Image * tissuestack::imaging::UncachedImageExtraction::degradeImage0(
 		reducedHeight = reducedHeight < 1 ? 1 : reducedHeight;
 	}
 
-	Image * tmp = img;
-
-	img =
-		SampleImage(
-			img,
-			reducedWidth,
-			reducedHeight,
-			&exception);
-	DestroyImage(tmp);
-	if (img == NULL)
-	{
-		CatchException(&exception);
-		THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
-				"Image Extraction: Failed to adjust quality!");
-	}
+	std::unique_ptr<tissuestack::imaging::PixelBuffer> reduced(
+		this->scalePixelBuffer(
+			buffer,
+			static_cast<unsigned int>(reducedWidth),
+			static_cast<unsigned int>(reducedHeight)));
 
-	tmp = img;
-	img =
-		SampleImage(
-			img,
-			width < 1 ? 1 : width,
-			height < 1 ? 1 : height,
-			&exception);
-	DestroyImage(tmp);
-	if (img == NULL)
-	{
-		CatchException(&exception);
-		THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
-				"Image Extraction: Failed to adjust quality!");
-	}
+	return this->scalePixelBuffer(reduced.get(), width, height);
+}
 
-	return img;
+inline tissuestack::imaging::PixelBuffer * tissuestack::imaging::UncachedImageExtraction::scalePixelBuffer(
+		const tissuestack::imaging::PixelBuffer * buffer,
+		const unsigned int width,
+		const unsigned int height) const
+{
+	tissuestack::imaging::PixelBuffer * scaled =
+		new tissuestack::imaging::PixelBuffer(width, height, buffer->getChannels());
+
+	tissuestack::imaging::PixelKernels::resampleNearest(
+		buffer->getData(),
+		buffer->getWidth(),
+		buffer->getHeight(),
+		buffer->getChannels(),
+		scaled->getData(),
+		scaled->getWidth(),
+		scaled->getHeight());
+
+	return scaled;
 }
 
 inline Image * tissuestack::imaging::UncachedImageExtraction::scaleImage(
@@ -529,148 +1371,6 @@ inline Image * tissuestack::imaging::UncachedImageExtraction::scaleImage(
 	return img;
 }
 
-inline Image * tissuestack::imaging::UncachedImageExtraction::convertAnythingToRgbImage(Image * img) const
-{
-	if (img != NULL && img->is_grayscale)
-	{
-		ExceptionInfo exception;
-		GetExceptionInfo(&exception);
-		const PixelPacket * pixels = AcquireImagePixels(img, 0, 0, img->columns, img->rows, &exception);
-		if (pixels == NULL)
-		{
-			CatchException(&exception);
-			DestroyImage(img);
-			THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
-				"RGB conversion: Could not obtain pixels from image!");
-		}
-
-		ImageInfo * newImageInfo = CloneImageInfo((ImageInfo *)NULL);
-		if (newImageInfo == NULL)
-		{
-			CatchException(&exception);
-			DestroyImage(img);
-			THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
-				"RGB Conversion: Could not create new image info!");
-		}
-		newImageInfo->colorspace = ColorspaceType::RGBColorspace;
-
-		Image * newRGBImage = AllocateImage(newImageInfo);
-		if (newRGBImage == NULL)
-		{
-			CatchException(&exception);
-			DestroyImage(img);
-			DestroyImageInfo(newImageInfo);
-			THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
-				"RGB Conversion: Could not allocate new RGB image!");
-		}
-		newRGBImage->rows = img->rows;
-		newRGBImage->columns = img->columns;
-
-		// get pixels and copy over value
-		PixelPacket * rgbPixels =  SetImagePixelsEx(newRGBImage, 0, 0, newRGBImage->columns, newRGBImage->rows, &exception);
-		if (rgbPixels == NULL)
-		{
-			CatchException(&exception);
-			DestroyImage(img);
-			DestroyImage(newRGBImage);
-			DestroyImageInfo(newImageInfo);
-			THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
-				"RGB conversion: Could not obtain pixels from new RGB image!");
-		}
-		for (unsigned long int i=0;i<newRGBImage->columns*newRGBImage->rows;i++)
-		{
-			rgbPixels[i].red = pixels[i].red;
-			rgbPixels[i].green = pixels[i].green;
-			rgbPixels[i].blue = pixels[i].blue;
-		}
-
-		DestroyImage(img);
-		DestroyImageInfo(newImageInfo);
-		return newRGBImage;
-	}
-
-	return img;
-}
-
-void inline tissuestack::imaging::UncachedImageExtraction::changeContrast(
-					Image * img,
-					const unsigned short minimum,
-					const unsigned short maximum,
-					const unsigned short dataset_min,
-					const unsigned short dataset_max,
-					const unsigned long int width,
-					const unsigned long int height) const
-{
-	ExceptionInfo exception;
-	GetExceptionInfo(&exception);
-
-	PixelPacket * pixels = GetImagePixelsEx(img, 0, 0, width, height, &exception);
-	if (pixels == NULL)
-	{
-		CatchException(&exception);
-		DestroyImage(img);
-		THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
-			"Contrast Application: Could not obtain pixels from image!");
-	}
-
-	unsigned int i = 0;
-	unsigned int j = 0;
-	unsigned long long int pixel_values[3];
-
-	float contrast_min = static_cast<float>(minimum);
-	float contrast_max = static_cast<float>(maximum);
-
-	while (i < height)
-	{
-		j = 0;
-		while (j < width)
-		{
-			pixel_values[0] = static_cast<unsigned long long int>(pixels[(width * i) + j].red);
-			pixel_values[1] = static_cast<unsigned long long int>(pixels[(width * i) + j].green);
-			pixel_values[2] = static_cast<unsigned long long int>(pixels[(width * i) + j].blue);
-
-			for (int z=0;z<3;z++)
-			{
-				if (QuantumDepth != 8 && img->depth == QuantumDepth)
-					pixel_values[z] =
-						this->mapUnsignedValue(img->depth, 8, pixel_values[z]);
-
-				float val = static_cast<float>(pixel_values[z]);
-
-				if (val <= contrast_min)
-					pixel_values[z] = dataset_min;
-				else if (val >= contrast_max)
-					pixel_values[z] = dataset_max;
-				else
-					pixel_values[z] =
-						static_cast<unsigned long long int>(
-							lround(((val - contrast_min) / (contrast_max - contrast_min))
-								* static_cast<float>(dataset_max - dataset_min)));
-			}
-
-			// graphicmagick quantum depth mess which we have to react to at runtime
-			if (QuantumDepth == 16 && img->depth == QuantumDepth)
-			{
-				pixels[(width * i) + j].red = static_cast<unsigned short>(this->mapUnsignedValue(8, 16, pixel_values[0]));
-				pixels[(width * i) + j].green = static_cast<unsigned short>(this->mapUnsignedValue(8, 16, pixel_values[1]));
-				pixels[(width * i) + j].blue =	static_cast<unsigned short>(this->mapUnsignedValue(8, 16, pixel_values[2]));
-			} else if (QuantumDepth == 32 && img->depth == QuantumDepth)
-			{
-				pixels[(width * i) + j].red = static_cast<unsigned int>(this->mapUnsignedValue(8, 32, pixel_values[0]));
-				pixels[(width * i) + j].green = static_cast<unsigned int>(this->mapUnsignedValue(8, 32, pixel_values[1]));
-				pixels[(width * i) + j].blue = static_cast<unsigned int>(this->mapUnsignedValue(8, 32, pixel_values[2]));
-			} else
-			{
-				pixels[(width * i) + j].red = static_cast<unsigned char>(pixel_values[0]);
-				pixels[(width * i) + j].green = static_cast<unsigned char>(pixel_values[1]);
-				pixels[(width * i) + j].blue = static_cast<unsigned char>(pixel_values[2]);
-			}
-			j++;
-		}
-		i++;
-	}
-}
-
 unsigned long long tissuestack::imaging::UncachedImageExtraction::mapUnsignedValue(const unsigned char fromBitRange, const unsigned char toBitRange, const unsigned long long value) const
 {
 	return this->mapUnsignedValue0(fromBitRange, toBitRange, value);
@@ -688,184 +1388,220 @@ inline unsigned long long tissuestack::imaging::UncachedImageExtraction::mapUnsi
 	return static_cast<unsigned long long>(llround((static_cast<double>(value) / from) * static_cast<double>(to)));
 }
 
-void inline tissuestack::imaging::UncachedImageExtraction::applyColorMap(
-		Image * img,
-		const std::string color_map_name,
-		const unsigned long int width,
-		const unsigned long int height) const
+tissuestack::imaging::PixelBuffer * tissuestack::imaging::UncachedImageExtraction::createPixelBufferFromDataRead(
+		const tissuestack::imaging::TissueStackRawData * image,
+		const tissuestack::imaging::TissueStackDataDimension * actualDimension,
+		const unsigned char * data) const
 {
-	// retrieve color map
-	const tissuestack::imaging::TissueStackColorMap * colorMap =
-			tissuestack::imaging::TissueStackColorMapStore::instance()->findColorMap(color_map_name);
-	if (colorMap == nullptr)
-	{
-		if (img) DestroyImage(img);
+	if (data == nullptr)
 		THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
-			"Colormap Application: Could not find color map!");
-	}
+			"Data is null!");
 
-	ExceptionInfo exception;
-	GetExceptionInfo(&exception);
+	const unsigned short channels =
+		(image->getType() == tissuestack::imaging::RAW_TYPE::UCHAR_8_BIT) ? 1 : 3;
 
-	PixelPacket * pixels = GetImagePixelsEx(img, 0, 0, width, height, &exception);
-	if (pixels == NULL)
+	tissuestack::imaging::PixelBuffer * buffer = nullptr;
+
+	// adjust image size in the anisotropic case ...
+	if (actualDimension->getWidth() != actualDimension->getAnisotropicWidth() ||
+		actualDimension->getHeight() != actualDimension->getAnisotropicHeight())
 	{
-		CatchException(&exception);
-		if (img) DestroyImage(img);
-		THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
-			"Colormap Application: Could not obtain pixels from image!");
+		buffer = new tissuestack::imaging::PixelBuffer(
+			actualDimension->getAnisotropicWidth(), actualDimension->getAnisotropicHeight(), channels);
+		tissuestack::imaging::PixelKernels::resampleNearest(
+			data,
+			actualDimension->getWidth(),
+			actualDimension->getHeight(),
+			channels,
+			buffer->getData(),
+			buffer->getWidth(),
+			buffer->getHeight());
+	} else
+	{
+		buffer = new tissuestack::imaging::PixelBuffer(
+			actualDimension->getWidth(), actualDimension->getHeight(), channels);
+		memcpy(buffer->getData(), data, buffer->getSizeInBytes());
 	}
 
-	unsigned int i = 0;
-	unsigned int j = 0;
-	unsigned long long int pixel_value;
+	// same orientation rules as createImageFromDataRead0
+	if (this->isFlippedVertically(image, actualDimension))
+		tissuestack::imaging::PixelKernels::flipVertically(
+			buffer->getData(), buffer->getWidth(), buffer->getHeight(), buffer->getChannels());
 
-	while (i < height)
+	return buffer;
+}
+
+inline const unsigned char * tissuestack::imaging::UncachedImageExtraction::encodeWithPalette(
+		const tissuestack::imaging::TissueStackRenderPipeline & pipeline,
+		const tissuestack::networking::TissueStackImageRequest * request,
+		const unsigned char * data,
+		unsigned long long int & length) const
+{
+	// the indices of the tile are collected first to find the colors actually used
+	tissuestack::imaging::PixelBuffer indices(pipeline.getWidth(), pipeline.getHeight(), 1);
+	pipeline.render(
+		data,
+		[&indices] (const unsigned int row, const unsigned char * pixels)
+		{
+			memcpy(indices.getRow(row), pixels, indices.getRowLength());
+		},
+		true);
+
+	bool used[256] = { false };
+	const unsigned char * pixels = indices.getData();
+	const unsigned long long int numberOfPixels = indices.getSizeInBytes();
+	for (unsigned long long int i=0;i<numberOfPixels;i++)
+		used[pixels[i]] = true;
+
+	// compact the palette (identical colors are merged) so that small palettes pack into fewer bits
+	const unsigned char * colorTable = pipeline.getPalette();
+	unsigned char palette[256 * 3];
+	unsigned char remap[256] = { 0 };
+	unsigned short paletteSize = 0;
+	std::unordered_map<unsigned int, unsigned char> colors;
+	for (unsigned int i=0;i<256;i++)
 	{
-		j = 0;
-		while (j < width)
+		if (!used[i])
+			continue;
+
+		const unsigned int rgb =
+			(static_cast<unsigned int>(colorTable[i*3]) << 16) |
+			(static_cast<unsigned int>(colorTable[i*3+1]) << 8) |
+			static_cast<unsigned int>(colorTable[i*3+2]);
+		const auto known = colors.find(rgb);
+		if (known != colors.end())
 		{
-			pixel_value = static_cast<unsigned long long int>(pixels[(width * i) + j].red);
-			if (QuantumDepth != 8 && img->depth == QuantumDepth) pixel_value =
-							this->mapUnsignedValue(img->depth, 8, pixel_value);
-			const std::array<const unsigned short, 3> mapping =
-					colorMap->getRGBMapForGrayValue(static_cast<unsigned short>(pixel_value));
-
-			pixels[(width * i) + j].red = static_cast<unsigned char>(mapping[0]);
-			pixels[(width * i) + j].green = static_cast<unsigned char>(mapping[1]);
-			pixels[(width * i) + j].blue = static_cast<unsigned char>(mapping[2]);
-
-			// graphicmagick quantum depth mess which we have to react to at runtime
-			if (QuantumDepth == 16 && img->depth == QuantumDepth) {
-				pixels[(width * i) + j].red =
-					static_cast<unsigned short>(
-						this->mapUnsignedValue(
-							8, 16, static_cast<unsigned long long int>(mapping[0])));
-				pixels[(width * i) + j].green =
-					static_cast<unsigned short>(
-						this->mapUnsignedValue(
-							8, 16, static_cast<unsigned long long int>(mapping[1])));
-				pixels[(width * i) + j].blue =
-					static_cast<unsigned short>(
-						this->mapUnsignedValue(
-							8, 16, static_cast<unsigned long long int>(mapping[2])));
-			} else if (QuantumDepth == 32 && img->depth == QuantumDepth) {
-				pixels[(width * i) + j].red =
-					static_cast<unsigned int>(
-						this->mapUnsignedValue(
-							8, 32, static_cast<unsigned long long int>(mapping[0])));
-				pixels[(width * i) + j].green =
-					static_cast<unsigned int>(
-						this->mapUnsignedValue(
-							8, 32, static_cast<unsigned long long int>(mapping[1])));
-				pixels[(width * i) + j].blue =
-					static_cast<unsigned int>(
-						this->mapUnsignedValue(
-							8, 32, static_cast<unsigned long long int>(mapping[2])));
-			}
-			j++;
+			remap[i] = known->second;
+			continue;
 		}
-		i++;
+
+		memcpy(palette + paletteSize * 3, colorTable + i * 3, 3);
+		remap[i] = static_cast<unsigned char>(paletteSize);
+		colors[rgb] = remap[i];
+		paletteSize++;
 	}
+	tissuestack::imaging::PixelKernels::applyLookupTable(
+		indices.getData(), indices.getData(), numberOfPixels, remap);
+
+	tissuestack::imaging::TissueStackImageEncoder encoder(
+		request->getOutputImageFormat(),
+		indices.getWidth(),
+		indices.getHeight(),
+		1,
+		request->getQualityFactor(),
+		palette,
+		paletteSize);
+	for (unsigned int y=0;y<indices.getHeight();y++)
+		encoder.writeRow(indices.getRow(y));
+
+	return encoder.finish(length);
 }
 
-inline Image * tissuestack::imaging::UncachedImageExtraction::getImageTile0(
-		Image * img,
-		const unsigned int xCoordinate,
-		const unsigned int yCoordinate,
-		const unsigned int width,
-		const unsigned int height,
-		const bool keepOriginalIntact) const
+inline const bool tissuestack::imaging::UncachedImageExtraction::isFlippedVertically(
+		const tissuestack::imaging::TissueStackRawData * image,
+		const tissuestack::imaging::TissueStackDataDimension * actualDimension) const
 {
-	if (img == NULL) return NULL;
+	if ((image->getRawVersion() == tissuestack::imaging::RAW_FILE_VERSION::LEGACY &&
+			image->getFormat() == tissuestack::imaging::FORMAT::RAW) ||
+			image->getRawVersion() != tissuestack::imaging::RAW_FILE_VERSION::LEGACY ||
+			image->getNumberOfDimensions() < 3)
+		return false;
 
-	ExceptionInfo exception;
-	GetExceptionInfo(&exception);
+	const std::vector<std::string> dim_order = image->getDimensionOrder();
+	const char dim = actualDimension->getName().at(0);
 
-	RectangleInfo * tile = static_cast<RectangleInfo *>(malloc(sizeof(*tile)));
-	tile->height = height;
-	tile->width = width;
-	tile->x = xCoordinate;
-	tile->y = yCoordinate;
+	bool flip = false;
+	if (image->getFormat() == tissuestack::imaging::FORMAT::NIFTI ||
+			(image->getFormat() == tissuestack::imaging::FORMAT::MINC &&
+				!((dim == 'x' && dim_order[0].at(0) == 'y' && dim_order[1].at(0) == 'z' && dim_order[2].at(0) == 'x') ||
+				(dim == 'z' && dim_order[0].at(0) == 'z' && dim_order[1].at(0) == 'x' && dim_order[2].at(0) == 'y') ||
+				((dim == 'x' || dim == 'y') && dim_order[0].at(0) == 'y' && dim_order[1].at(0) == 'x' && dim_order[2].at(0) == 'z') ||
+				(dim_order[0].at(0) == 'x' && dim_order[1].at(0) == 'y' && dim_order[2].at(0) == 'z'))))
+		flip = !flip;
 
-	Image * tmp = img;
-	img = CropImage(img, tile, &exception);
+	if ((dim == 'y' || dim == 'z') &&
+			dim_order[0].at(0) == 'x' && dim_order[1].at(0) == 'z' && dim_order[2].at(0) == 'y')
+		flip = !flip;
 
-	free(tile);
-	if (!keepOriginalIntact) DestroyImage(tmp);
-	if (img == NULL)
-	{
-		CatchException(&exception);
+	// two flips cancel each other out
+	return flip;
+}
+
+inline tissuestack::imaging::PixelBuffer * tissuestack::imaging::UncachedImageExtraction::applyLookupTable(
+		const tissuestack::imaging::PixelBuffer * buffer,
+		const unsigned short minimum,
+		const unsigned short maximum,
+		const unsigned short dataset_min,
+		const unsigned short dataset_max,
+		const std::string & color_map_name) const
+{
+	const std::shared_ptr<const tissuestack::imaging::TissueStackLookupTable> table =
+		tissuestack::imaging::TissueStackLookupTableStore::instance()->findLookupTable(
+			minimum, maximum, dataset_min, dataset_max, color_map_name);
+
+	return table->apply(buffer);
+}
+
+inline tissuestack::imaging::PixelBuffer * tissuestack::imaging::UncachedImageExtraction::getImageTile0(
+		const tissuestack::imaging::PixelBuffer * buffer,
+		const unsigned int xCoordinate,
+		const unsigned int yCoordinate,
+		const unsigned int width,
+		const unsigned int height) const
+{
+	if (buffer == nullptr) return nullptr;
+
+	if (xCoordinate >= buffer->getWidth() || yCoordinate >= buffer->getHeight() ||
+			width == 0 || height == 0)
 		THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
 				"Image Extraction: Failed to crop image to get tile!");
-	}
 
-	return img;
+	// tiles at the border are cut off
+	const unsigned int actualWidth =
+		xCoordinate + width > buffer->getWidth() ? buffer->getWidth() - xCoordinate : width;
+	const unsigned int actualHeight =
+		yCoordinate + height > buffer->getHeight() ? buffer->getHeight() - yCoordinate : height;
+
+	tissuestack::imaging::PixelBuffer * tile =
+		new tissuestack::imaging::PixelBuffer(actualWidth, actualHeight, buffer->getChannels());
+	tissuestack::imaging::PixelKernels::crop(
+		buffer->getData(),
+		buffer->getWidth(),
+		buffer->getChannels(),
+		xCoordinate,
+		yCoordinate,
+		actualWidth,
+		actualHeight,
+		tile->getData());
+
+	return tile;
 }
 
 Image * tissuestack::imaging::UncachedImageExtraction::getImageTileForPreTiling(
-		Image * img,
+		const tissuestack::imaging::PixelBuffer * buffer,
 		const unsigned int xCoordinate,
 		const unsigned int yCoordinate,
 		const unsigned int squareLength) const
 {
-	if (img == NULL) return NULL;
+	if (buffer == nullptr) return NULL;
 
 	// check if we don't exceed bounds
 	unsigned int xOffset = xCoordinate * squareLength;
 	unsigned int yOffset = yCoordinate * squareLength;
 
-	if (xOffset >  img->columns || yOffset > img->rows)
-	{
-		DestroyImage(img);
+	if (xOffset >  buffer->getWidth() || yOffset > buffer->getHeight())
 		THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
 			"Image Extraction: tile number(x/y) exceeds the width/height of the image (given the square length)");
-	}
 
 	// delegate
-	return this->getImageTile0(
-		img,
-		xOffset,
-		yOffset,
-		squareLength,
-		squareLength,
-		true);
+	std::unique_ptr<tissuestack::imaging::PixelBuffer> tile(
+		this->getImageTile0(
+			buffer,
+			xOffset,
+			yOffset,
+			squareLength,
+			squareLength));
+
+	return tile->toImage();
 }
 
-
-inline Image * tissuestack::imaging::UncachedImageExtraction::getImageTile(
-		Image * img,
-		const tissuestack::networking::TissueStackImageRequest * request) const
-{
-	if (img == NULL) return NULL;
-
-	// previews are only cropped if they don't fit the viewing window
-	if (request->isPreview() && !request->showOnlyPortionOfImage())
-		return img;
-
-	unsigned int width = request->isPreview() ? request->getWidth() : request->getLengthOfSquare();
-	unsigned int height = request->isPreview() ? request->getHeight() : request->getLengthOfSquare();
-	unsigned int xOffset =
-		request->isPreview() ? request->getXCoordinate() :
-			request->getXCoordinate() * width;
-	unsigned int yOffset =
-		request->isPreview() ? request->getYCoordinate() :
-			request->getYCoordinate() * height;
-
-	// check if we don't exceed bounds
-	if (xOffset >  img->columns || yOffset > img->rows)
-	{
-		DestroyImage(img);
-		THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
-			"Image Extraction: tile number(x/y) exceeds the width/height of the image (given the square length)");
-	}
-
-	// delegate
-	return this->getImageTile0(
-		img,
-		xOffset,
-		yOffset,
-		width,
-		height,
-		false);
-}
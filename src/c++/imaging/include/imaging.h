@@ -21,7 +21,10 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <array>
+#include <list>
 #include <fstream>
+#include <sys/mman.h>
+#include <condition_variable>
 
 // DICOM STUFF
 #ifndef	HAVE_CONFIG_H
@@ -46,6 +49,11 @@ namespace tissuestack
 		// forward declarations
 		class TissueStackImageRequest;
 		class TissueStackQueryRequest;
+		class TissueStackBatchQueryRequest;
+		class TissueStackObliqueRequest;
+		class TissueStackProjectionRequest;
+		class TissueStackStatisticsRequest;
+		class TissueStackLabelIndexRequest;
 	}
 	namespace database
 	{
@@ -79,11 +87,41 @@ namespace tissuestack
 		 * V1 header:
 		 *            |     DIMS   |      COORDS         |   STEPS   |DIMS NAME|ORIG. FORMAT|
 		 *             499:1311:679|-124.2:-327.15:-169.2|0.5:0.5:0.5|x:y:z|3|
+		 *
+		 * V2 header (V1 + number of channels: 1 for 8 bit gray, 3 for 24 bit rgb):
+		 *            |     DIMS   |      COORDS         |   STEPS   |DIMS NAME|ORIG. FORMAT|CHANNELS|
+		 *             499:1311:679|-124.2:-327.15:-169.2|0.5:0.5:0.5|x:y:z|3|1|
+		 *
+		 * V3 header (bricked: one copy of the volume, planes are assembled from the bricks they intersect):
+		 *            |     DIMS   |      COORDS         |   STEPS   |DIMS NAME|ORIG. FORMAT|CHANNELS|BRICK EDGE|FLIPS |
+		 *             499:1311:679|-124.2:-327.15:-169.2|0.5:0.5:0.5|x:y:z|3|1|32|x00y01|
+		 *
+		 * The volume is the z plane's slices stacked (x fastest), cut into bricks (x fastest within and among bricks)
+		 * which are cropped at the volume's edge. The header is followed by one 64 bit file offset per brick,
+		 * 0 meaning the brick is all zeroes and not stored. FLIPS records whether the x and y planes' columns
+		 * and rows run against the volume (as some conversions wrote them).
+		 *
+		 * V4 header (V3 with every brick compressed on its own, see RAW_CODEC):
+		 *            |     DIMS   |      COORDS         |   STEPS   |DIMS NAME|ORIG. FORMAT|CHANNELS|BRICK EDGE|FLIPS |CODEC|
+		 *             499:1311:679|-124.2:-327.15:-169.2|0.5:0.5:0.5|x:y:z|3|1|32|x00y01|1|
+		 *
+		 * Its index has a 64 bit file offset and a 64 bit length per brick. Bricks that would not shrink
+		 * are stored as they are: their length is their uncompressed size.
 		 */
 		enum RAW_FILE_VERSION
 		{
 			LEGACY  = 0,
-			V1 	= 1
+			V1 	= 1,
+			V2	= 2,
+			V3	= 3,
+			V4	= 4
+		};
+
+		enum RAW_CODEC
+		{
+			UNCOMPRESSED	= 0,
+			ZLIB			= 1,
+			LZ4				= 2	// needs liblz4: make USE_LZ4=1
 		};
 
 		enum FORMAT
@@ -118,6 +156,13 @@ namespace tissuestack
 			RGB_24BIT		= 2
 		};
 
+		enum IMAGE_ENCODING
+		{
+			PNG		= 1,
+			JPEG	= 2,
+			WEBP	= 3		// ONLY IF BUILT WITH USE_WEBP
+		};
+
 		class TissueStackLabelLookup final
 		{
 			public:
@@ -131,6 +176,20 @@ namespace tissuestack
 						const std::string & content = "",
 						const tissuestack::database::AtlasInfo * atlasInfo = nullptr);
 				const std::string getLabel(const unsigned short & red, const unsigned short & green, const unsigned short & blue) const;
+				// red, green and blue packed into the lower 24 bits: the key of the label index
+				static const unsigned int packRgb(const unsigned char red, const unsigned char green, const unsigned char blue);
+				// 0 if there is no label for the color, otherwise its index (starting at 1). colors of the same label share it
+				const unsigned short getLabelIndex(const unsigned int rgb) const;
+				const std::string getLabelName(const unsigned short label_index) const;
+				// 0 if no color carries the label
+				const unsigned short findLabelIndex(const std::string & label_name) const;
+				const unsigned short getNumberOfLabels() const;
+				// the label indices of a run of voxels: gray ones (1 channel) are looked up as gray/gray/gray
+				void findLabelIndices(
+					const unsigned char * voxels,
+					const unsigned short channels,
+					const unsigned long long int number_of_voxels,
+					unsigned short * label_indices) const;
 				const std::string getLabelLookupId(bool fullPath=false) const;
 				const tissuestack::database::AtlasInfo * getAtlasInfo() const;
 				const unsigned long long int getDataBaseId() const;
@@ -145,6 +204,17 @@ namespace tissuestack
 				unsigned long long int _database_id;
 				std::array<unsigned short[3], 256> _gray_indexed_rgb_mapping;
 				std::unordered_map<std::string, std::string> _label_lookups;
+				// two levels, no hashing: red/green pick a page of 256 blues in indices. page 0 is all 0 (no label)
+				struct LabelIndex
+				{
+					std::vector<unsigned int> pages;
+					std::vector<unsigned short> indices;
+					std::vector<std::string> names;
+				};
+				// rebuilt as a whole on updates and swapped in atomically, readers work on a snapshot
+				std::shared_ptr<const LabelIndex> _label_index;
+				const std::shared_ptr<const LabelIndex> getLabelIndexSnapshot() const;
+				static inline const unsigned short getLabelIndex(const LabelIndex * index, const unsigned int rgb);
 				const tissuestack::database::AtlasInfo * _atlas_info;
 				friend class TissueStackColorMap;
 				friend class tissuestack::database::LabelLookupDataProvider;
@@ -153,6 +223,7 @@ namespace tissuestack
 				void setUpdateFlag(const bool is_being_Updated);
 				void updateLabelLookup(const std::string & filename);
 				void copyGrayIndexedRgbMapping(std::array<unsigned short[3], 256> & grayIndexedRgbMapping) const;
+				void indexLabels();
 				void setLastModified(const time_t lastModified);
 				void setDataBaseInfo(
 					const unsigned long long int id,
@@ -405,6 +476,10 @@ namespace tissuestack
 				char _2dDimension = '\0';
 		};
 
+		class TissueStackRawPyramid; // forward declaration
+		class TissueStackRawStatistics; // forward declaration
+		class TissueStackLabelSpatialIndex; // forward declaration
+
 		class TissueStackRawData final : public TissueStackImageData
 		{
 			public:
@@ -413,8 +488,66 @@ namespace tissuestack
 				const unsigned long long int getFileSizeInBytes() const;
 				const RAW_TYPE getType() const;
 				const RAW_FILE_VERSION getRawVersion() const;
+				const bool pin();
+				void unpin();
+				const bool isPinned() const;
+				const bool isLockedInMemory() const;
+				const unsigned long long int getPinnedBytes() const;
+				const unsigned long long int getResidentBytes() const;
+				const bool readPinnedData(
+					unsigned char * buffer,
+					const unsigned long long int offset,
+					const unsigned long long int length) const;
+				const TissueStackRawPyramid * getPyramid() const;
+				const TissueStackRawStatistics * getStatistics() const;
+				// built on first use for the data set's label lookup (and again once that changes), nullptr without one
+				const std::shared_ptr<const TissueStackLabelSpatialIndex> getLabelSpatialIndex() const;
+				const bool isBricked() const;
+				const RAW_CODEC getCodec() const;
+				// per data set: neighboring tiles mostly touch the same compressed bricks
+				static const unsigned long long int MAXIMUM_INFLATED_BRICK_CACHE_SIZE_IN_BYTES = 32 * 1024 * 1024;
+				// false if the codec is unknown or not built in, or the brick didn't shrink (nothing is written then)
+				static const bool compressBrick(
+					const RAW_CODEC codec,
+					const unsigned char * in,
+					const unsigned long long int in_length,
+					std::vector<unsigned char> & out);
+				static const bool decompressBrick(
+					const RAW_CODEC codec,
+					const unsigned char * in,
+					const unsigned long long int in_length,
+					unsigned char * out,
+					const unsigned long long int out_length);
+				// writes the given region of a plane's slice into out (rows out_row_length apart)
+				const bool readBrickedSlice(
+					const TissueStackDataDimension * dimension,
+					const unsigned int slice_number,
+					const unsigned int x,
+					const unsigned int y,
+					const unsigned int width,
+					const unsigned int height,
+					unsigned char * out,
+					const unsigned long long int out_row_length) const;
+				// the same for any raw that stores its voxels as is (bricked or one copy per plane)
+				const bool readSliceRegion(
+					const TissueStackDataDimension * dimension,
+					const unsigned int slice_number,
+					const unsigned int x,
+					const unsigned int y,
+					const unsigned int width,
+					const unsigned int height,
+					unsigned char * out,
+					const unsigned long long int out_row_length) const;
 			private:
 				void setRawType(int type);
+				void loadBrickIndex();
+				inline const bool readBytes(
+					unsigned char * buffer,
+					const unsigned long long int offset,
+					const unsigned long long int length) const;
+				inline const std::shared_ptr<const std::vector<unsigned char> > findInflatedBrick(
+					const unsigned long long int brick_number,
+					const unsigned long long int length) const;
 				void setRawVersion(int version);
 				friend class TissueStackImageData;
 				explicit TissueStackRawData(const std::string & filename);
@@ -422,6 +555,204 @@ namespace tissuestack
 				unsigned int _totalHeaderLength = 0;
 				RAW_TYPE	_raw_type = RAW_TYPE::UCHAR_8_BIT;
 				RAW_FILE_VERSION _raw_version = RAW_FILE_VERSION::LEGACY;
+				// the mapping is only ever swapped under _pin_mutex, reads copy from it outside of the lock
+				// and unpin waits for them to finish before it unmaps
+				unsigned char * _pinned_data = nullptr;
+				unsigned long long int _pinned_length = 0;
+				std::atomic<bool> _is_pinned;
+				std::atomic<bool> _is_locked_in_memory;
+				mutable unsigned int _pinned_readers = 0;
+				mutable std::mutex _pin_mutex;
+				mutable std::condition_variable _pinned_readers_done;
+				const TissueStackRawPyramid * _pyramid = nullptr;
+				const TissueStackRawStatistics * _statistics = nullptr;
+				mutable std::mutex _label_index_mutex;
+				mutable std::shared_ptr<const TissueStackLabelSpatialIndex> _label_index;
+				unsigned short _brick_edge = 0;
+				std::string _brick_flips = "x00y00";
+				std::array<unsigned long long int, 3> _volume = {{ 0, 0, 0 }};
+				std::vector<unsigned long long int> _brick_index;
+				std::vector<unsigned long long int> _brick_lengths;
+				RAW_CODEC _codec = RAW_CODEC::UNCOMPRESSED;
+				// decompressed bricks by number, least recently used first (their bytes count as cache bytes)
+				mutable std::mutex _inflated_bricks_mutex;
+				mutable std::list<unsigned long long int> _inflated_brick_usage;
+				mutable std::unordered_map<unsigned long long int,
+					std::pair<std::shared_ptr<const std::vector<unsigned char> >, std::list<unsigned long long int>::iterator> > _inflated_bricks;
+				mutable unsigned long long int _inflated_bricks_size = 0;
+		};
+
+		/*
+		 *             TISSUESTACK PYRAMID SIDECAR (<raw file>.pyramid)
+		 *             ------------------------------------------------
+		 *
+		 * |  MAGIC + VERSION |HEADER LENGTH| RAW SIZE |FILTER|  PER DIMENSION: NAME:W1:H1:OFFSET1:W2:H2:OFFSET2...  |
+		 *  @IaMpYramiD@V1    |179          |3331059846|avg   |x:340:656:0:170:328:77262720|y:...
+		 *
+		 * level n halves level n-1 (rounding up), the slices of a level follow each other
+		 * with the raw's layout (8 bit gray or 24 bit rgb), offsets count from the end of the header
+		 */
+		class TissueStackRawPyramid final
+		{
+			public:
+				static const unsigned short MAXIMUM_NUMBER_OF_LEVELS = 8;
+				// no level is made smaller than a tile
+				static const unsigned int MINIMUM_LEVEL_LENGTH = 256;
+				TissueStackRawPyramid & operator=(const TissueStackRawPyramid&) = delete;
+				TissueStackRawPyramid(const TissueStackRawPyramid&) = delete;
+				static const std::string getSidecarFileName(const std::string & raw_file_name);
+				// returns nullptr if there is no sidecar or it does not fit the raw file (anymore)
+				static TissueStackRawPyramid * fromRawData(const TissueStackRawData * raw);
+				static void build(
+					const TissueStackRawData * raw,
+					const bool average = true);
+				~TissueStackRawPyramid();
+				// the smallest level that has at least the given width and height, 0 meaning the raw itself
+				const unsigned short findLevel(
+					const std::string & dimension_name,
+					const unsigned int minimum_width,
+					const unsigned int minimum_height) const;
+				const unsigned int getWidth(const std::string & dimension_name, const unsigned short level) const;
+				const unsigned int getHeight(const std::string & dimension_name, const unsigned short level) const;
+				// as recorded in the sidecar: false for nearest neighbor levels (the only ones fit for label data)
+				const bool isAveraged() const;
+				const unsigned char * getSlice(
+					const std::string & dimension_name,
+					const unsigned short level,
+					const unsigned int slice_number) const;
+			private:
+				explicit TissueStackRawPyramid(
+					const std::string & sidecar,
+					const unsigned short channels,
+					const std::unordered_map<char, unsigned long long int> & number_of_slices);
+				static void downsample(
+					const unsigned char * in,
+					const unsigned int width,
+					const unsigned int height,
+					const unsigned short channels,
+					unsigned char * out,
+					const bool average);
+				const std::array<unsigned long long int, 3> * findLevelInfo(
+					const std::string & dimension_name,
+					const unsigned short level) const;
+				unsigned short _channels;
+				unsigned long long int _raw_file_size = 0;
+				bool _is_averaged = true;
+				// per dimension and level: width, height and offset into the sidecar
+				std::unordered_map<char, std::vector<std::array<unsigned long long int, 3> > > _levels;
+				std::unordered_map<char, unsigned long long int> _number_of_slices;
+				unsigned char * _data = nullptr;
+				unsigned long long int _length = 0;
+		};
+
+		/*
+		 *             TISSUESTACK STATISTICS SIDECAR (<raw file>.stats)
+		 *             -------------------------------------------------
+		 *
+		 * |  MAGIC + VERSION |HEADER LENGTH| RAW SIZE |CHANNELS|  PER DIMENSION: NAME:NUMBER OF SLICES:OFFSET  |
+		 *  @IaMsTatS@V1      |49           |3331059846|1       |x:678:0|y:1311:705120|z:1000:2068560
+		 *
+		 * per slice: the 256 value counts of each channel, then the bounding box of the non zero voxels
+		 * (left, top, right, bottom with right/bottom exclusive, all 0 for an empty slice), all of them
+		 * 32 bit unsigned integers in host byte order. offsets count from the end of the header
+		 */
+		class TissueStackRawStatistics final
+		{
+			public:
+				TissueStackRawStatistics & operator=(const TissueStackRawStatistics&) = delete;
+				TissueStackRawStatistics(const TissueStackRawStatistics&) = delete;
+				static const std::string getSidecarFileName(const std::string & raw_file_name);
+				// returns nullptr if there is no sidecar or it does not fit the raw file (anymore)
+				static TissueStackRawStatistics * fromRawData(const TissueStackRawData * raw);
+				static void build(const TissueStackRawData * raw);
+				~TissueStackRawStatistics();
+				const unsigned short getNumberOfChannels() const;
+				// adds the slice's value counts (channel after channel) to the given ones, false for an unknown dimension or slice
+				const bool addHistograms(
+					const std::string & dimension_name,
+					const unsigned int slice_number,
+					unsigned long long int * histograms) const;
+				// left, top, right, bottom of the slice's non zero voxels (right/bottom exclusive, all 0 if there are none)
+				const bool getNonZeroBounds(
+					const std::string & dimension_name,
+					const unsigned int slice_number,
+					std::array<unsigned int, 4> & bounds) const;
+				static const unsigned short MAXIMUM_NUMBER_OF_THREADS = 4;
+			private:
+				explicit TissueStackRawStatistics(
+					const std::string & sidecar,
+					const unsigned short channels,
+					const std::unordered_map<char, unsigned long long int> & number_of_slices);
+				static void computeSliceRange(
+					const TissueStackRawData * raw,
+					const TissueStackDataDimension * dimension,
+					const unsigned int first_slice,
+					const unsigned int last_slice,
+					unsigned int * records,
+					bool & succeeded);
+				const unsigned char * findRecord(const std::string & dimension_name, const unsigned int slice_number) const;
+				unsigned short _channels;
+				unsigned long long int _raw_file_size = 0;
+				// per dimension: the offset of its first slice's record into the sidecar
+				std::unordered_map<char, unsigned long long int> _offsets;
+				std::unordered_map<char, unsigned long long int> _number_of_slices;
+				unsigned char * _data = nullptr;
+				unsigned long long int _length = 0;
+		};
+
+		// where the labels of a label data set are: per label of its lookup the number of voxels, the first and last
+		// x, y and z they occur at, their centroid and which slices of each dimension have any of them. gray volumes
+		// with a statistics sidecar are indexed from its per slice histograms, the others by one pass over the z slices
+		class TissueStackLabelSpatialIndex final
+		{
+			public:
+				TissueStackLabelSpatialIndex & operator=(const TissueStackLabelSpatialIndex&) = delete;
+				TissueStackLabelSpatialIndex(const TissueStackLabelSpatialIndex&) = delete;
+				static TissueStackLabelSpatialIndex * build(
+					const TissueStackRawData * raw,
+					const TissueStackLabelLookup * lookup);
+				// false once the lookup is another one or has been reloaded since
+				const bool isUpToDate(const TissueStackLabelLookup * lookup) const;
+				const unsigned long long int getNumberOfVoxels(const unsigned short label_index) const;
+				// first x, y, z and last x, y, z (inclusive), false if the label does not occur
+				const bool getBounds(const unsigned short label_index, std::array<unsigned int, 6> & bounds) const;
+				const std::array<double, 3> getCentroid(const unsigned short label_index) const;
+				// the runs of consecutive slices of the dimension ('x', 'y' or 'z') that have the label: first and last slice
+				const std::vector<std::pair<unsigned int, unsigned int> > getSliceRanges(
+					const unsigned short label_index,
+					const char dimension) const;
+				// the label on a single slice: its voxel count, their bounds (left, top, right, bottom with right/bottom
+				// exclusive) and their centroid in slice coordinates
+				static const unsigned long long int measureSlice(
+					const TissueStackRawData * raw,
+					const TissueStackLabelLookup * lookup,
+					const TissueStackDataDimension * dimension,
+					const unsigned int slice_number,
+					const unsigned short label_index,
+					std::array<unsigned int, 4> & bounds,
+					std::array<double, 2> & centroid);
+				static const unsigned short MAXIMUM_NUMBER_OF_THREADS = 4;
+			private:
+				explicit TissueStackLabelSpatialIndex(
+					const TissueStackLabelLookup * lookup,
+					const std::array<unsigned int, 3> & volume);
+				// false if the sidecar lacks a dimension
+				const bool indexFromStatistics(const TissueStackRawStatistics * statistics);
+				static void indexSliceRange(
+					const TissueStackRawData * raw,
+					const unsigned int first_slice,
+					const unsigned int last_slice,
+					TissueStackLabelSpatialIndex * partial,
+					bool & succeeded);
+				void merge(const TissueStackLabelSpatialIndex * partial);
+				const TissueStackLabelLookup * _lookup;
+				time_t _lookup_modification;
+				std::array<unsigned int, 3> _volume;
+				// per label index (0 is no label): voxels and the sums of their x, y and z
+				std::vector<unsigned long long int> _voxels;
+				std::vector<std::array<unsigned long long int, 3> > _sums;
+				// per axis: a flag per label and position along it
+				std::array<std::vector<unsigned char>, 3> _presence;
 		};
 
 		class TissueStackDataBaseData final : public TissueStackImageData
@@ -620,12 +951,370 @@ namespace tissuestack
 		    	void dumpDataSetStoreIntoDebugLog() const;
 		    	const std::vector<const TissueStackRawData *> getDataSetList() const;
 		    	static const std::string getDataSetStoreDirectory();
+		    	static const std::vector<std::string> getPinnedDataSetsConfiguration();
+		    	void pinConfiguredDataSets();
+		    	const bool pinDataSet(const std::string & id, const bool persist = false);
+		    	const bool unpinDataSet(const std::string & id, const bool persist = false);
+		    	const std::string getPinnedDataSetsAsJson() const;
 			private:
 		    	TissueStackDataSetStore();
+		    	static const bool persistPinnedDataSetsConfiguration(const std::vector<std::string> & pinned);
 		    	std::unordered_map<std::string, const TissueStackDataSet *> _data_sets;
 				static TissueStackDataSetStore * _instance;
 	 	};
 
+		class PixelBuffer final
+		{
+			public:
+				PixelBuffer & operator=(const PixelBuffer&) = delete;
+				PixelBuffer(const PixelBuffer&) = delete;
+				PixelBuffer(const unsigned int width, const unsigned int height, const unsigned short channels);
+				~PixelBuffer();
+
+				PixelBuffer * clone() const;
+				Image * toImage() const;
+				const unsigned int getWidth() const;
+				const unsigned int getHeight() const;
+				const unsigned short getChannels() const;
+				const unsigned long long int getRowLength() const;
+				const unsigned long long int getSizeInBytes() const;
+				unsigned char * getData() const;
+				unsigned char * getRow(const unsigned int row) const;
+			private:
+				const unsigned int _width;
+				const unsigned int _height;
+				const unsigned short _channels;
+				unsigned char * _data = nullptr;
+		};
+
+		// native kernels working on interleaved 8 bit buffers (1 or 3 channels)
+		// the reduction of rows is dispatched at runtime to AVX2, SSE2 or plain C++,
+		// upsampling is done with byte shuffles where SSSE3 is available, table lookups with AVX-512 VBMI permutes
+		class PixelKernels final
+		{
+			public:
+				static const std::string getInstructionSet();
+				static const unsigned int getNearestSampleOffset(
+					const unsigned int position,
+					const unsigned int source_length,
+					const unsigned int destination_length);
+				static void buildWindowLevelTable(
+					unsigned char table[256],
+					const unsigned short minimum,
+					const unsigned short maximum,
+					const unsigned short dataset_min,
+					const unsigned short dataset_max);
+				static void applyLookupTable(
+					const unsigned char * source,
+					unsigned char * destination,
+					const unsigned long long int length,
+					const unsigned char table[256]);
+				static void applyColorLookupTable(
+					const unsigned char * source,
+					const unsigned short source_channels,
+					unsigned char * destination,
+					const unsigned long long int number_of_pixels,
+					const unsigned char table[256][3]);
+				static void resampleNearest(
+					const unsigned char * source,
+					const unsigned int source_width,
+					const unsigned int source_height,
+					const unsigned short channels,
+					unsigned char * destination,
+					const unsigned int destination_width,
+					const unsigned int destination_height);
+				static void crop(
+					const unsigned char * source,
+					const unsigned int source_width,
+					const unsigned short channels,
+					const unsigned int x,
+					const unsigned int y,
+					const unsigned int width,
+					const unsigned int height,
+					unsigned char * destination);
+				static void flipVertically(
+					unsigned char * data,
+					const unsigned int width,
+					const unsigned int height,
+					const unsigned short channels);
+				// element wise reductions into an accumulator, for projections through a stack of slices
+				static void maximumRows(
+					const unsigned char * source,
+					unsigned char * accumulator,
+					const unsigned long long int length);
+				static void minimumRows(
+					const unsigned char * source,
+					unsigned char * accumulator,
+					const unsigned long long int length);
+				static void accumulateRows(
+					const unsigned char * source,
+					unsigned int * sums,
+					const unsigned long long int length);
+				// adds the pixels' values to the histograms of their channels (256 counts per channel)
+				static void countValues(
+					const unsigned char * source,
+					const unsigned short channels,
+					const unsigned long long int number_of_pixels,
+					unsigned int * counts);
+				// 255 for labeled pixels (index != 0) with a 4-neighbor of another label, 0 otherwise
+				static void markLabelBoundaries(
+					const unsigned short * labels,
+					const unsigned int width,
+					const unsigned int height,
+					unsigned char * boundaries);
+			private:
+				PixelKernels();
+				PixelKernels & operator=(const PixelKernels&) = delete;
+				PixelKernels(const PixelKernels&) = delete;
+		};
+
+		// contrast and color map composed into one table: a single lookup per pixel
+		class TissueStackLookupTable final
+		{
+			public:
+				TissueStackLookupTable & operator=(const TissueStackLookupTable&) = delete;
+				TissueStackLookupTable(const TissueStackLookupTable&) = delete;
+				explicit TissueStackLookupTable(
+					const unsigned short minimum,
+					const unsigned short maximum,
+					const unsigned short dataset_min,
+					const unsigned short dataset_max,
+					const TissueStackColorMap * color_map);
+				const bool isColored() const;
+				const bool isIdentity() const;
+				const unsigned char * getPalette() const;
+				PixelBuffer * apply(const PixelBuffer * buffer) const;
+				void applyToRow(
+					const unsigned char * source_row,
+					const unsigned short source_channels,
+					const unsigned long long int * column_offsets,
+					const unsigned int width,
+					unsigned char * destination) const;
+				// gather, map and alpha blend (weight in 1/256th) onto an rgb row in one go, zero source values are transparent
+				void blendRowOnto(
+					const unsigned char * source_row,
+					const unsigned short source_channels,
+					const unsigned long long int * column_offsets,
+					const unsigned int width,
+					const unsigned short weight,
+					unsigned char * destination) const;
+			private:
+				bool _is_colored = false;
+				bool _is_identity = true;
+				unsigned char _gray[256];
+				unsigned char _rgb[256][3];
+		};
+
+		class TissueStackLookupTableStore final
+		{
+			public:
+				static const unsigned int MAXIMUM_NUMBER_OF_TABLES = 4096;
+				TissueStackLookupTableStore & operator=(const TissueStackLookupTableStore&) = delete;
+				TissueStackLookupTableStore(const TissueStackLookupTableStore&) = delete;
+				static TissueStackLookupTableStore * instance();
+				static const bool doesInstanceExist();
+				void purgeInstance();
+				// tables are shared with whoever still renders with them, evicting the least recently used one is safe
+				const std::shared_ptr<const TissueStackLookupTable> findLookupTable(
+					const unsigned short minimum,
+					const unsigned short maximum,
+					const unsigned short dataset_min,
+					const unsigned short dataset_max,
+					const std::string & color_map_name);
+			private:
+				TissueStackLookupTableStore();
+				// signatures from least to most recently used
+				std::list<std::string> _usage;
+				std::unordered_map<std::string,
+					std::pair<std::shared_ptr<const TissueStackLookupTable>, std::list<std::string>::iterator> > _tables;
+				std::mutex _tables_mutex;
+				static TissueStackLookupTableStore * _instance;
+		};
+
+		// encodes png and jpeg straight from 8 bit rows via libpng and libjpeg (webp via libwebp if built with it)
+		// the codec state and the output buffer are kept per thread and reused,
+		// the encoded image remains valid until the same thread encodes the next one
+		class TissueStackImageEncoder final
+		{
+			public:
+				static const int DEFAULT_PNG_COMPRESSION_LEVEL = 6;
+				static const int DEFAULT_JPEG_QUALITY = 75;
+				static const int DEFAULT_WEBP_QUALITY = 80;
+				TissueStackImageEncoder & operator=(const TissueStackImageEncoder&) = delete;
+				TissueStackImageEncoder(const TissueStackImageEncoder&) = delete;
+				explicit TissueStackImageEncoder(
+					const std::string & format,
+					const unsigned int width,
+					const unsigned int height,
+					const unsigned short channels,
+					const float quality_factor,
+					const unsigned char * palette = nullptr,
+					const unsigned short palette_size = 0);
+				~TissueStackImageEncoder();
+				static const bool isSupportedFormat(const std::string & format);
+				static const bool isPaletteSupported(const std::string & format);
+				static void loadSettings();
+				void writeRow(const unsigned char * pixels);
+				const unsigned char * finish(unsigned long long int & length);
+			private:
+				void abort();
+				void abortAfterError();
+				IMAGE_ENCODING _encoding;
+				unsigned int _width;
+				unsigned int _height;
+				unsigned short _channels;
+				bool _is_lossless = true;
+				int _quality = 100;
+				unsigned int _rows_written = 0;
+				bool _is_finished = false;
+				static int _png_compression_level;
+				static int _png_filters;
+				static int _png_compression_strategy;
+				static int _jpeg_quality;
+				static int _webp_quality;
+		};
+
+		// window/level, color map, scaling, quality degradation and cropping as one pass:
+		// all resampling is nearest neighbor so the stages collapse into a row and column mapping
+		// from the tile back into the raw slice, output rows are handed to a callback one by one
+		class TissueStackRenderPipeline final
+		{
+			public:
+				TissueStackRenderPipeline & operator=(const TissueStackRenderPipeline&) = delete;
+				TissueStackRenderPipeline(const TissueStackRenderPipeline&) = delete;
+				// a source width/height of 0 means the slice is read at full resolution (not from a pyramid level)
+				explicit TissueStackRenderPipeline(
+					const TissueStackRawData * image,
+					const TissueStackDataDimension * actualDimension,
+					const tissuestack::networking::TissueStackImageRequest * request,
+					const bool flip_vertically,
+					const unsigned int source_width = 0,
+					const unsigned int source_height = 0,
+					const unsigned short layer = 0);
+				// for images that have been sampled already (e.g. oblique planes): contrast and color map only
+				explicit TissueStackRenderPipeline(
+					const TissueStackRawData * image,
+					const tissuestack::networking::TissueStackImageRequest * request,
+					const unsigned int width,
+					const unsigned int height);
+				const unsigned int getWidth() const;
+				const unsigned int getHeight() const;
+				const unsigned short getChannels() const;
+				const unsigned char * getPalette() const;
+				// the smallest source rectangle the tile is sampled from: x, y, width, height
+				// (label outlines take a voxel more on each side to compare the border voxels with)
+				const std::array<unsigned int, 4> getSourceRegion() const;
+				// the same source region (and the tile's width and height) for a full resolution read,
+				// without the per pixel mappings, lookup table or label selection of a whole pipeline
+				static const std::array<unsigned int, 4> findSourceRegion(
+					const TissueStackRawData * image,
+					const TissueStackDataDimension * actualDimension,
+					const tissuestack::networking::TissueStackImageRequest * request,
+					const bool flip_vertically,
+					unsigned int & width,
+					unsigned int & height);
+				// from then on the data handed to render(Onto) only holds the source region (not the whole slice)
+				void cropToSourceRegion();
+				void render(
+					const unsigned char * data,
+					const std::function<void (const unsigned int row, const unsigned char * pixels)> & row_callback,
+					const bool palette_indices = false) const;
+				// renders the layer onto an rgb image of the pipeline's width and height
+				void renderOnto(
+					const unsigned char * data,
+					unsigned char * rgb_image) const;
+			private:
+				inline void mapToSource(
+					std::vector<unsigned int> & positions,
+					const unsigned int offset,
+					const unsigned int raw_length,
+					const unsigned int anisotropic_length,
+					const unsigned int scaled_length,
+					const unsigned int reduced_length,
+					const bool flip) const;
+				static inline const unsigned int mapToSource(
+					const unsigned int position,
+					const unsigned int raw_length,
+					const unsigned int anisotropic_length,
+					const unsigned int scaled_length,
+					const unsigned int reduced_length,
+					const bool flip);
+				// the scaled and quality reduced image sizes, the tile's offset into them and its size (width, height each)
+				static inline void measureTile(
+					const TissueStackDataDimension * actualDimension,
+					const tissuestack::networking::TissueStackImageRequest * request,
+					std::array<unsigned int, 2> & scaled,
+					std::array<unsigned int, 2> & reduced,
+					std::array<unsigned int, 2> & offset,
+					std::array<unsigned int, 2> & size);
+				inline void findLookupTable(const TissueStackRawData * image, const unsigned short layer);
+				inline void findLabelSelection(const TissueStackRawData * image);
+				// per output pixel: 1 if the label mode keeps it, 0 if it is dropped
+				inline const std::vector<unsigned char> findLabelMask(const unsigned char * data) const;
+				const tissuestack::networking::TissueStackImageRequest * _request;
+				std::shared_ptr<const TissueStackLookupTable> _lookup_table;
+				unsigned short _opacity_weight = 256;
+				unsigned int _raw_width;
+				unsigned short _source_channels;
+				unsigned int _width = 0;
+				unsigned int _height = 0;
+				std::vector<unsigned int> _source_rows;
+				std::vector<unsigned long long int> _column_offsets;
+				std::array<unsigned int, 4> _source_region = {{ 0, 0, 0, 0 }};
+				// label rendering (only for data sets that have a label lookup): outlines or the selected label's mask
+				const TissueStackLabelLookup * _label_lookup = nullptr;
+				bool _draws_label_outlines = false;
+				unsigned short _selected_label = 0;
+		};
+
+		// samples an arbitrary plane from the volume (the z plane's slices stacked): only the row spans of the z slices
+		// the plane passes through are read, the interpolation (fixed point) is spread over a few threads
+		class TissueStackObliqueReslicer final
+		{
+			public:
+				TissueStackObliqueReslicer & operator=(const TissueStackObliqueReslicer&) = delete;
+				TissueStackObliqueReslicer(const TissueStackObliqueReslicer&) = delete;
+				explicit TissueStackObliqueReslicer(
+					const TissueStackRawData * image,
+					const tissuestack::networking::TissueStackObliqueRequest * request);
+				~TissueStackObliqueReslicer();
+				const unsigned short getChannels() const;
+				// width * height * channels, outside the volume is black. the plane stays counted as in flight
+				// until the reslicer goes, it should outlive the plane's encoding
+				unsigned char * reslice();
+				static const unsigned short MAXIMUM_NUMBER_OF_THREADS = 4;
+			private:
+				inline const bool locate(
+					const unsigned int column,
+					const unsigned int row,
+					std::array<unsigned int, 3> & lower,
+					std::array<unsigned int, 3> & upper,
+					std::array<unsigned int, 3> & weights) const;
+				inline const unsigned char * getVoxel(
+					const unsigned int i,
+					const unsigned int j,
+					const unsigned int k) const;
+				void readVoxels();
+				void sampleRows(
+					const unsigned int first_row,
+					const unsigned int last_row,
+					unsigned char * out) const;
+				const TissueStackRawData * _image;
+				const tissuestack::networking::TissueStackObliqueRequest * _request;
+				std::array<unsigned int, 3> _volume = {{ 0, 0, 0 }};
+				unsigned short _channels = 1;
+				// per z slice: its first row read and where its rows start among the spans
+				std::vector<unsigned int> _first_row;
+				std::vector<unsigned long long int> _row_base;
+				// per row read: its first and last column and where they are in the voxels
+				std::vector<unsigned int> _span_start;
+				std::vector<unsigned int> _span_end;
+				std::vector<unsigned long long int> _span_offset;
+				std::vector<unsigned char> _voxels;
+				// voxels and plane, reserved as in flight memory
+				unsigned long long int _reserved_bytes = 0;
+		};
+
 		class UncachedImageExtraction final
 		{
 			public:
@@ -638,23 +1327,47 @@ namespace tissuestack
 					const tissuestack::imaging::TissueStackRawData * image,
 					const tissuestack::networking::TissueStackQueryRequest * request) const;
 
+				// the values of the request's points in the given order, 1 byte (gray) or 3 (rgb) each
+				const std::vector<unsigned char> performBatchQuery(
+					const tissuestack::common::ProcessingStrategy * processing_strategy,
+					const tissuestack::imaging::TissueStackRawData * image,
+					const tissuestack::networking::TissueStackBatchQueryRequest * request) const;
+
+				// the indices of the points sorted by slice, then row and column: one pass over the data
+				static const std::vector<unsigned int> sortPointsBySlice(
+					const std::vector<std::array<unsigned int, 3> > & points);
+
+				// queries the points with the given indices, all on one slice: from the slice data if there is any,
+				// otherwise from the raw, either point by point or in one read of the region they span
+				void queryPointsOfSlice(
+					const tissuestack::imaging::TissueStackRawData * image,
+					const tissuestack::imaging::TissueStackDataDimension * actualDimension,
+					const std::vector<std::array<unsigned int, 3> > & points,
+					const unsigned int * indices,
+					const unsigned int number_of_indices,
+					const unsigned char * slice_data,
+					unsigned char * values) const;
+
+				// reading a whole slice is worth it if there are this many bytes of it or less per point
+				static const unsigned long long int BYTES_READ_PER_QUERIED_POINT = 8192;
+
 				Image * extractImage(
 					const TissueStackRawData * image,
 					const tissuestack::networking::TissueStackImageRequest * request) const;
 
-				Image * extractImageForPreTiling(
+				PixelBuffer * extractImageForPreTiling(
 					const tissuestack::imaging::TissueStackRawData * image,
 					const tissuestack::imaging::TissueStackDataDimension * actualDimension,
 					const unsigned int sliceNumber) const;
 
 				Image * getImageTileForPreTiling(
-						Image * img,
+						const PixelBuffer * buffer,
 						const unsigned int xCoordinate,
 						const unsigned int yCoordinate,
 						const unsigned int squareLength) const;
 
-				Image * applyPreTilingProcessing(
-					Image * img,
+				PixelBuffer * applyPreTilingProcessing(
+					PixelBuffer * buffer,
 					const std::string color_map_name,
 					unsigned long int & width,
 					unsigned long int & height,
@@ -664,17 +1377,88 @@ namespace tissuestack
 					const TissueStackRawData * image,
 					const tissuestack::networking::TissueStackImageRequest * request) const;
 
-				Image * applyPostExtractionTasks(
-					Image * img,
+				const unsigned char * extractSliceOnly(
+					const TissueStackRawData * image,
+					const tissuestack::imaging::TissueStackDataDimension * actualDimension,
+					const unsigned int sliceNumber) const;
+
+				const unsigned char * encodeImage(
+					const TissueStackRawData * image,
+					const tissuestack::networking::TissueStackImageRequest * request,
+					const unsigned char * data,
+					unsigned long long int & length) const;
+
+				// returns nullptr if the raw has no pyramid or no level is small enough to pay off
+				const unsigned char * encodeImageFromPyramid(
+					const TissueStackRawData * image,
+					const tissuestack::networking::TissueStackImageRequest * request,
+					unsigned long long int & length) const;
+
+				// returns nullptr if the raw is not bricked, otherwise reads only the bricks the tile touches
+				const unsigned char * encodeImageFromBricks(
+					const TissueStackRawData * image,
+					const tissuestack::networking::TissueStackImageRequest * request,
+					unsigned long long int & length) const;
+
+				// returns nullptr unless the statistics sidecar says the tile samples none of its slice's non zero voxels.
+				// such tiles only differ by color map, contrast, format, size and quality: they are encoded once and shared
+				const std::shared_ptr<const std::vector<unsigned char> > findBlankTile(
 					const TissueStackRawData * image,
 					const tissuestack::networking::TissueStackImageRequest * request) const;
 
-				Image * degradeImage(
-					Image * img,
+				static const unsigned int MAXIMUM_NUMBER_OF_BLANK_TILES = 1024;
+
+				const unsigned char * encodeObliqueImage(
+					const TissueStackRawData * image,
+					const tissuestack::networking::TissueStackObliqueRequest * request,
+					unsigned long long int & length) const;
+
+				// the projected slice (as extractSliceOnly would give it), the caller has to delete it
+				unsigned char * projectSlices(
+					const TissueStackRawData * image,
+					const tissuestack::networking::TissueStackProjectionRequest * request) const;
+
+				const unsigned char * encodeProjectionImage(
+					const TissueStackRawData * image,
+					const tissuestack::networking::TissueStackProjectionRequest * request,
+					unsigned long long int & length) const;
+
+				static const unsigned short MAXIMUM_NUMBER_OF_PROJECTION_THREADS = 4;
+
+				// per channel histograms (256 counts each) of the request's region through its slices. slices
+				// the lookup has (copies are ours to delete) are taken from there, the others are read from the raw
+				const std::vector<unsigned long long int> computeHistograms(
+					const TissueStackRawData * image,
+					const tissuestack::networking::TissueStackStatisticsRequest * request,
+					const std::function<const unsigned char * (const unsigned int slice_number, bool & is_copy)> &
+						find_cached_slice = nullptr) const;
+
+				// the region's voxels row by row as [first, last) column spans, rows outside of it have none
+				static const std::vector<std::vector<std::pair<unsigned int, unsigned int> > > findRegionSpans(
+					const std::vector<std::array<unsigned int, 2> > & polygon,
+					const unsigned int width,
+					const unsigned int height);
+
+				static const unsigned short MAXIMUM_NUMBER_OF_STATISTICS_THREADS = 4;
+
+				// one slice per data set of the request (all of the same geometry), composited in the given order
+				const unsigned char * encodeCompositeImage(
+					const std::vector<const TissueStackRawData *> & images,
+					const tissuestack::networking::TissueStackImageRequest * request,
+					const std::vector<const unsigned char *> & data,
+					unsigned long long int & length) const;
+
+				PixelBuffer * degradeImage(
+					const PixelBuffer * buffer,
 					const unsigned int width,
 					const unsigned int height,
 					const float quality_factor) const;
 
+				PixelBuffer * createPixelBufferFromDataRead(
+					const tissuestack::imaging::TissueStackRawData * image,
+					const tissuestack::imaging::TissueStackDataDimension * actualDimension,
+					const unsigned char * data) const;
+
 				Image * createImageFromDataRead(
 					const tissuestack::imaging::TissueStackRawData * image,
 					const tissuestack::imaging::TissueStackDataDimension * actualDimension,
@@ -685,50 +1469,83 @@ namespace tissuestack
 					const unsigned char toBitRange,
 					const unsigned long long value) const;
 			private:
+				void projectSliceRange(
+					const tissuestack::imaging::TissueStackRawData * image,
+					const tissuestack::imaging::TissueStackDataDimension * actualDimension,
+					const tissuestack::networking::TissueStackProjectionRequest * request,
+					const unsigned int first_slice,
+					const unsigned int last_slice,
+					unsigned char * extremes,
+					unsigned int * sums,
+					bool & succeeded) const;
+
+				void countRegionValues(
+					const tissuestack::imaging::TissueStackRawData * image,
+					const tissuestack::imaging::TissueStackDataDimension * actualDimension,
+					const tissuestack::networking::TissueStackStatisticsRequest * request,
+					const std::vector<std::vector<std::pair<unsigned int, unsigned int> > > & spans,
+					const unsigned int first_slice,
+					const unsigned int last_slice,
+					const unsigned int first_row,
+					const unsigned int last_row,
+					const unsigned int left,
+					const unsigned int right,
+					const std::function<const unsigned char * (const unsigned int slice_number, bool & is_copy)> &
+						find_cached_slice,
+					unsigned long long int * counts,
+					bool & succeeded) const;
+
 				inline unsigned char * readRawSlice(
 					const tissuestack::imaging::TissueStackRawData * image,
 					const tissuestack::imaging::TissueStackDataDimension * actualDimension,
 					const unsigned int sliceNumber) const;
 
-				void inline changeContrast(
-					Image * img,
+				inline PixelBuffer * applyLookupTable(
+					const PixelBuffer * buffer,
 					const unsigned short minimum,
 					const unsigned short maximum,
 					const unsigned short dataset_min,
 					const unsigned short dataset_max,
-					const unsigned long int width,
-					const unsigned long int height) const;
-
-				void inline applyColorMap(
-					Image * img,
-					const std::string color_map_name,
-					const unsigned long int width,
-					const unsigned long int height) const;
+					const std::string & color_map_name) const;
 
 				inline Image * scaleImage(
 					Image * img,
 					const unsigned int width,
 					const unsigned int height) const;
 
-				inline Image * degradeImage0(
-					Image * img,
+				inline PixelBuffer * scalePixelBuffer(
+					const PixelBuffer * buffer,
 					const unsigned int width,
-					const unsigned int height,
-					const float quality_factor) const;
-
-				inline Image * convertAnythingToRgbImage(Image * img) const;
+					const unsigned int height) const;
 
-				inline Image * getImageTile0(
-						Image * img,
+				inline PixelBuffer * getImageTile0(
+						const PixelBuffer * buffer,
 						const unsigned int xCoordinate,
 						const unsigned int yCoordinate,
 						const unsigned int width,
-						const unsigned int height,
-						const bool keepOriginalIntact) const;
+						const unsigned int height) const;
 
-				inline Image * getImageTile(
-					Image * img,
-					const tissuestack::networking::TissueStackImageRequest * request) const;
+				inline const unsigned char * encodeImage0(
+					const TissueStackRawData * image,
+					const tissuestack::networking::TissueStackImageRequest * request,
+					const unsigned char * data,
+					const unsigned int source_width,
+					const unsigned int source_height,
+					unsigned long long int & length) const;
+				inline const unsigned char * encodeRendered(
+					const TissueStackRenderPipeline & pipeline,
+					const tissuestack::networking::TissueStackImageRequest * request,
+					const unsigned char * data,
+					unsigned long long int & length) const;
+				inline const unsigned char * encodeWithPalette(
+					const TissueStackRenderPipeline & pipeline,
+					const tissuestack::networking::TissueStackImageRequest * request,
+					const unsigned char * data,
+					unsigned long long int & length) const;
+
+				inline const bool isFlippedVertically(
+					const tissuestack::imaging::TissueStackRawData * image,
+					const tissuestack::imaging::TissueStackDataDimension * actualDimension) const;
 
 				inline Image * createImageFromDataRead0(
 					const tissuestack::imaging::TissueStackRawData * image,
@@ -739,6 +1556,12 @@ namespace tissuestack
 					const unsigned char fromBitRange,
 					const unsigned char toBitRange,
 					const unsigned long long value) const;
+
+				// shared blank tiles by key, least recently used first
+				mutable std::mutex _blank_tiles_mutex;
+				mutable std::list<std::string> _blank_tile_usage;
+				mutable std::unordered_map<std::string,
+					std::pair<std::shared_ptr<const std::vector<unsigned char> >, std::list<std::string>::iterator> > _blank_tiles;
 		};
 
 		class SliceCacheEntry final
@@ -747,13 +1570,24 @@ namespace tissuestack
 				SliceCacheEntry & operator=(const SliceCacheEntry&) = delete;
 				SliceCacheEntry(const SliceCacheEntry&) = delete;
 				~SliceCacheEntry();
-				SliceCacheEntry(const unsigned char * cache_data);
+				SliceCacheEntry(
+					const unsigned char * cache_data,
+					const unsigned long long int size_in_bytes,
+					const unsigned long long int access_count = 0,
+					const unsigned long long int uncompressed_size_in_bytes = 0);
 
 				const unsigned char * getCacheData();
+				// a copy of the data as stored (compressed or not) which is the caller's to delete
+				unsigned char * copyCacheData();
+				const bool isCompressed() const;
+				const unsigned long long int getSizeInBytes() const;
+				const unsigned long long int getUncompressedSizeInBytes() const;
 				const unsigned long long int getAccessCount() const;
 				const unsigned long long int getTimeStampForLastAccess() const;
 			private:
 				const unsigned char * _cache_data;
+				unsigned long long int _size_in_bytes;
+				unsigned long long int _uncompressed_size_in_bytes;
 				unsigned long long int _timestamp_accessed;
 				unsigned long long int _access_count;
 		};
@@ -764,17 +1598,32 @@ namespace tissuestack
 				DataSetSliceCache & operator=(const SliceCacheEntry&) = delete;
 				DataSetSliceCache(const SliceCacheEntry&) = delete;
 				~DataSetSliceCache();
-				DataSetSliceCache(const TissueStackRawData * image);
-
+				DataSetSliceCache(const TissueStackRawData * image, const bool use_compression = false);
+				// compressed slices go through the brick codecs: lz4 if built in (it inflates a lot faster), zlib otherwise
+				static const RAW_CODEC SLICE_CODEC;
+
+				SliceCacheEntry * createSliceCacheEntry(
+					const unsigned long int slice,
+					const unsigned char * data,
+					const unsigned long long int access_count = 0) const;
 				SliceCacheEntry * getSlice(const unsigned long int slice) const;
 				const bool setSlice(const unsigned long int slice, SliceCacheEntry *  cache_data);
 				const bool isSliceCached(const unsigned long int slice) const;
 				void eraseSlice(const unsigned long int slice);
 				const unsigned long int getNumberOfCachedSlices() const;
+				const unsigned long long int getSliceSizeInBytes(const unsigned long int slice) const;
+				const bool isCompressionEnabled() const;
+				const unsigned long long int getResidentBytes() const;
+				const unsigned long long int getUncompressedBytes() const;
 				const long int getMostRecentCacheFailure() const;
 				void setMostRecentCacheFailure(const long int slice);
 			private:
 				unsigned long int _numberOfCachedSlices = 0;
+				bool _use_compression = false;
+				unsigned long long int _resident_bytes = 0;
+				unsigned long long int _uncompressed_bytes = 0;
+				// (exclusive) upper slice bound of a dimension paired with the byte size of its slices
+				std::vector<std::pair<unsigned long int, unsigned long long int> > _slice_sizes;
 				long int _mostRecentCacheFailure = -1;
 				SliceCacheEntry ** _cache = nullptr;
 		};
@@ -783,6 +1632,7 @@ namespace tissuestack
 		{
 			public:
 				static const unsigned long long int MINIMUM_FREE_RAM_IN_BYTES;
+				static const unsigned int HOT_SET_SNAPSHOT_SIZE;
 				TissueStackSliceCache & operator=(const TissueStackSliceCache&) = delete;
 				TissueStackSliceCache(const TissueStackSliceCache&) = delete;
 				~TissueStackSliceCache();
@@ -793,10 +1643,23 @@ namespace tissuestack
 
 				const bool isBeingCleanedUp() const;
 				void cleanUpCache();
+				// for reads (and their working memory) the usage figures don't show yet: throws TissueStackServiceUnavailableException
+				// if there isn't enough even after a clean up, otherwise the caller removes the in flight bytes again once done
+				static void reserveInFlightBytes(const unsigned long long int bytes);
 				const bool addCacheEntry(
-					const std::string dataset, const unsigned long int slice, const unsigned char * data);
+					const std::string dataset,
+					const unsigned long int slice,
+					const unsigned char * data,
+					const unsigned long long int access_count = 0);
+				// a peek neither waits for a pending read of the slice nor records a miss
 				const unsigned char * findCacheEntry(
-					const std::string dataset, const unsigned long int slice);
+					const std::string dataset, const unsigned long int slice, bool & is_copy, const bool is_peek = false);
+				void eraseDataSet(const std::string dataset);
+
+				static const std::string getHotSetSnapshotFile();
+				void dumpCacheStatisticsIntoLog();
+				const bool persistHotSetSnapshot();
+				void warmUpFromHotSetSnapshot(const tissuestack::common::ProcessingStrategy * processing_strategy);
 
 			private:
 				static const unsigned long long int SECOND_IN_MILLIS;
@@ -807,13 +1670,66 @@ namespace tissuestack
 				static const unsigned long long int MONTH_IN_MILLIS;
 
 				TissueStackSliceCache();
+				inline const bool isCached(const std::string & dataset, const unsigned long int slice);
+				inline const bool isCompressionConfiguredForDataSet(const std::string & dataset) const;
 				bool _is_being_cleaned;
 				bool _is_empty;
+				std::vector<std::string> _compressed_data_sets;
 				std::mutex _cache_mutex;
 				std::unordered_map<std::string, DataSetSliceCache * > _cache;
 				static TissueStackSliceCache * _instance;
 		};
 
+		class TissueStackTileDiskCache final
+		{
+			public:
+				static const unsigned long long int DEFAULT_MAXIMUM_SIZE_IN_BYTES;
+				TissueStackTileDiskCache & operator=(const TissueStackTileDiskCache&) = delete;
+				TissueStackTileDiskCache(const TissueStackTileDiskCache&) = delete;
+				~TissueStackTileDiskCache();
+
+				static TissueStackTileDiskCache * instance();
+				static const bool doesInstanceExist();
+				void purgeInstance();
+
+				static const std::string getTileDiskCacheDirectory();
+				static const std::string generateCacheKey(
+					const TissueStackRawData * image,
+					const tissuestack::networking::TissueStackImageRequest * request);
+
+				const bool isEnabled() const;
+				const bool addCacheEntry(
+					const std::string & key, const unsigned char * data, const unsigned long long int length);
+				unsigned char * findCacheEntry(
+					const std::string & key, unsigned long long int & length);
+				const unsigned long long int getSizeInBytes() const;
+				const unsigned long long int getNumberOfEntries() const;
+
+			private:
+				static const std::string CACHE_FILE_MAGIC;
+				static const std::string CACHE_FILE_EXTENSION;
+				static const std::string CACHE_TEMP_FILE_EXTENSION;
+
+				TissueStackTileDiskCache();
+				void recoverCacheFromDisk();
+				inline const std::string getFileNameForKey(const std::string & key) const;
+				inline void registerCacheFile(const std::string & file, const unsigned long long int size);
+				inline void evictLeastRecentlyUsedEntries(const unsigned long long int bytes_needed);
+				inline void eraseCacheFile(const std::string & file);
+				inline void eraseCacheFileIfUnchanged(const std::string & file, const struct stat & found);
+
+				bool _is_enabled = false;
+				std::string _cache_directory;
+				unsigned long long int _maximum_size_in_bytes;
+				unsigned long long int _size_in_bytes = 0;
+				// front holds the most recently used cache file
+				std::list<std::string> _lru;
+				std::unordered_map<std::string,
+					std::pair<std::list<std::string>::iterator, unsigned long long int> > _index;
+				std::mutex _cache_mutex;
+				static TissueStackTileDiskCache * _instance;
+		};
+
 		class NoCacheAdapter final
 		{
 			public:
@@ -823,21 +1739,50 @@ namespace tissuestack
 				explicit NoCacheAdapter(const tissuestack::imaging::UncachedImageExtraction * image_extraction);
 				~NoCacheAdapter();
 
-				const Image * extractImage(
+				const unsigned char * encodeImage(
 					const tissuestack::common::ProcessingStrategy * processing_strategy,
 					const TissueStackRawData * image,
-					const tissuestack::networking::TissueStackImageRequest * request) const;
+					const tissuestack::networking::TissueStackImageRequest * request,
+					unsigned long long int & length) const;
+
+				const unsigned char * encodeObliqueImage(
+					const tissuestack::common::ProcessingStrategy * processing_strategy,
+					const TissueStackRawData * image,
+					const tissuestack::networking::TissueStackObliqueRequest * request,
+					unsigned long long int & length) const;
+
+				const unsigned char * encodeProjectionImage(
+					const tissuestack::common::ProcessingStrategy * processing_strategy,
+					const TissueStackRawData * image,
+					const tissuestack::networking::TissueStackProjectionRequest * request,
+					unsigned long long int & length) const;
 
-				Image * applyPostExtractionTasks(
-						Image * img,
-						const tissuestack::imaging::TissueStackRawData * image,
-						const tissuestack::networking::TissueStackImageRequest * request) const;
+				const unsigned char * encodeCompositeImage(
+					const tissuestack::common::ProcessingStrategy * processing_strategy,
+					const std::vector<const TissueStackRawData *> & images,
+					const tissuestack::networking::TissueStackImageRequest * request,
+					unsigned long long int & length) const;
 
 				const std::array<unsigned long long int, 3> performQuery(
 					const tissuestack::common::ProcessingStrategy * processing_strategy,
 					const tissuestack::imaging::TissueStackRawData * image,
 					const tissuestack::networking::TissueStackQueryRequest * request) const;
 
+				const std::vector<unsigned char> performBatchQuery(
+					const tissuestack::common::ProcessingStrategy * processing_strategy,
+					const tissuestack::imaging::TissueStackRawData * image,
+					const tissuestack::networking::TissueStackBatchQueryRequest * request) const;
+
+				const std::vector<unsigned long long int> computeHistograms(
+					const tissuestack::common::ProcessingStrategy * processing_strategy,
+					const tissuestack::imaging::TissueStackRawData * image,
+					const tissuestack::networking::TissueStackStatisticsRequest * request) const;
+
+				const std::shared_ptr<const std::vector<unsigned char> > findBlankTile(
+					const tissuestack::common::ProcessingStrategy * processing_strategy,
+					const tissuestack::imaging::TissueStackRawData * image,
+					const tissuestack::networking::TissueStackImageRequest * request) const;
+
 			private:
 				const UncachedImageExtraction * _uncached_extraction = nullptr;
 		};
@@ -851,19 +1796,34 @@ namespace tissuestack
 				explicit SimpleCacheHeuristics(const tissuestack::imaging::UncachedImageExtraction * image_extraction);
 				~SimpleCacheHeuristics();
 
-				const Image * extractImage(
+				const unsigned char * encodeImage(
 					const tissuestack::common::ProcessingStrategy * processing_strategy,
 					const TissueStackRawData * image,
-					const tissuestack::networking::TissueStackImageRequest * request) const;
+					const tissuestack::networking::TissueStackImageRequest * request,
+					unsigned long long int & length) const;
+
+				const unsigned char * encodeObliqueImage(
+					const tissuestack::common::ProcessingStrategy * processing_strategy,
+					const TissueStackRawData * image,
+					const tissuestack::networking::TissueStackObliqueRequest * request,
+					unsigned long long int & length) const;
+
+				const unsigned char * encodeProjectionImage(
+					const tissuestack::common::ProcessingStrategy * processing_strategy,
+					const TissueStackRawData * image,
+					const tissuestack::networking::TissueStackProjectionRequest * request,
+					unsigned long long int & length) const;
 
-				Image * applyPostExtractionTasks(
-						Image * img,
-						const tissuestack::imaging::TissueStackRawData * image,
-						const tissuestack::networking::TissueStackImageRequest * request) const;
+				const unsigned char * encodeCompositeImage(
+					const tissuestack::common::ProcessingStrategy * processing_strategy,
+					const std::vector<const TissueStackRawData *> & images,
+					const tissuestack::networking::TissueStackImageRequest * request,
+					unsigned long long int & length) const;
 
 				const unsigned char * findCacheHit(
 					const TissueStackRawData * image,
-					const tissuestack::networking::TissueStackImageRequest * request) const;
+					const tissuestack::networking::TissueStackImageRequest * request,
+					bool & is_copy) const;
 
 				void addToCache(
 					const tissuestack::common::ProcessingStrategy * processing_strategy,
@@ -876,8 +1836,45 @@ namespace tissuestack
 					const tissuestack::imaging::TissueStackRawData * image,
 					const tissuestack::networking::TissueStackQueryRequest * request) const;
 
+				const std::vector<unsigned char> performBatchQuery(
+					const tissuestack::common::ProcessingStrategy * processing_strategy,
+					const tissuestack::imaging::TissueStackRawData * image,
+					const tissuestack::networking::TissueStackBatchQueryRequest * request) const;
+
+				const std::vector<unsigned long long int> computeHistograms(
+					const tissuestack::common::ProcessingStrategy * processing_strategy,
+					const tissuestack::imaging::TissueStackRawData * image,
+					const tissuestack::networking::TissueStackStatisticsRequest * request) const;
+
+				const std::shared_ptr<const std::vector<unsigned char> > findBlankTile(
+					const tissuestack::common::ProcessingStrategy * processing_strategy,
+					const tissuestack::imaging::TissueStackRawData * image,
+					const tissuestack::networking::TissueStackImageRequest * request) const;
+
+				static const unsigned long long int MAXIMUM_PROJECTION_CACHE_SIZE_IN_BYTES = 64 * 1024 * 1024;
+				static const unsigned int MAXIMUM_NUMBER_OF_CACHED_STATISTICS = 256;
 			private:
+				// the slice cache numbers the slices of all dimensions consecutively
+				const unsigned long int getCacheSliceIndex(
+					const TissueStackRawData * image,
+					const std::string dimension_name,
+					const unsigned int slice_number) const;
+				// reads the request's slice from the raw, the caller owns the data unless it ends up in the slice cache
+				const unsigned char * readUncachedSlice(
+					const TissueStackRawData * image,
+					const tissuestack::networking::TissueStackImageRequest * request,
+					bool & needs_to_be_added_to_cache) const;
+				const unsigned long long int reserveMemoryForUncachedRead(
+					const TissueStackRawData * image,
+					const tissuestack::imaging::TissueStackDataDimension * actualDimension) const;
 				const UncachedImageExtraction * _uncached_extraction = nullptr;
+				// recently projected slices keyed by data set, dimension, slice range and projection, most recent last
+				mutable std::mutex _projection_mutex;
+				mutable std::vector<std::pair<std::string, std::vector<unsigned char> > > _projections;
+				mutable unsigned long long int _projection_cache_size = 0;
+				// recent region histograms keyed by data set, dimension, slice range and region, most recent last
+				mutable std::mutex _statistics_mutex;
+				mutable std::list<std::pair<std::string, std::vector<unsigned long long int> > > _statistics;
 		};
 
 		template <typename CachingStrategy>
@@ -902,34 +1899,10 @@ namespace tissuestack
 					std::vector<const TissueStackImageData *> imageData;
 					for (auto dataSetFile : request->getDataSetLocations())
 					{
-						const tissuestack::imaging::TissueStackDataSet * dataSet =
-								tissuestack::imaging::TissueStackDataSetStore::instance()->findDataSet(dataSetFile);
-
-						// we have no associated data set, try to create one
-						if (dataSet == nullptr)
-						{
-							std::lock_guard<std::mutex> lock(this->_dataset_addition_mutex);
-
-							try
-							{
-								dataSet = tissuestack::imaging::TissueStackDataSet::fromFile(dataSetFile);
-								tissuestack::imaging::TissueStackDataSetStore::instance()->addDataSet(dataSet);
-							} catch (std::exception & bad)
-							{
-								tissuestack::logging::TissueStackLogger::instance()->error(
-										"Could not create data set from file '%s' for the following reason:\n%s\n",
-										dataSetFile.c_str(), bad.what());
-								THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
-										"Given dataset is not a compatible Tissue Stack Data Set!");
-							}
-						}
-
-						// we only let RAW file requests go through
-						if (!dataSet->getImageData()->isRaw())
-							THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException, "Only TissueStack Raw Files are allowed to be requested online!");
+						const TissueStackImageData * rawData = this->findRawData(dataSetFile);
 
 						const TissueStackDataDimension * dimension  =
-								dataSet->getImageData()->getDimensionByLongName(request->getDimensionName());
+								rawData->getDimensionByLongName(request->getDimensionName());
 						if (dimension == nullptr)
 							THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
 									"Image Dimension could not be found!");
@@ -946,7 +1919,7 @@ namespace tissuestack
 										"The 'y' (pixel) coordinate has to be a positive integer");
 						}
 
-						imageData.push_back(dataSet->getImageData());
+						imageData.push_back(rawData);
 					}
 
 					return imageData;
@@ -984,7 +1957,16 @@ namespace tissuestack
 
 							response << "{\"red\":" << std::to_string(values[0]);
 							response << ", \"green\":" << std::to_string(values[1]);
-							response << ", \"blue\":" << std::to_string(values[2]) << "}";
+							response << ", \"blue\":" << std::to_string(values[2]);
+
+							// label data sets name the structure under the voxel
+							const TissueStackLabelLookup * lookup = imageData->getLookup();
+							const std::string label =
+								lookup == nullptr ? "" :
+									lookup->getLabel(values[0], values[1], values[2]);
+							if (!label.empty())
+								response << ", \"label\": \"" << tissuestack::utils::Misc::maskQuotesInJson(label) << "\"";
+							response << "}";
 							i++;
 						}
 						response << "}}";
@@ -996,6 +1978,278 @@ namespace tissuestack
 					write(file_descriptor, httpResponseHeader.c_str(), httpResponseHeader.length());
 				}
 
+				void processBatchQueryRequest(
+						const tissuestack::common::ProcessingStrategy * processing_strategy,
+						const tissuestack::networking::TissueStackBatchQueryRequest * request,
+						const int file_descriptor)
+				{
+					const std::vector<const TissueStackImageData *> dataSets =
+						this->processRequest(request, file_descriptor);
+
+					std::vector<std::vector<unsigned char> > values;
+					for (const TissueStackImageData * imageData : dataSets)
+					{
+						const tissuestack::imaging::TissueStackRawData * rawData =
+							static_cast<const tissuestack::imaging::TissueStackRawData *>(imageData);
+
+						// the point values are read straight from the raw: image magick's formats are out
+						if (rawData->getRawVersion() == tissuestack::imaging::RAW_FILE_VERSION::LEGACY &&
+								rawData->getFormat() != tissuestack::imaging::FORMAT::RAW)
+							THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
+									"Batch queries are not supported for legacy image formats");
+
+						values.push_back(
+							this->_caching_strategy->performBatchQuery(processing_strategy, rawData, request));
+					}
+
+					const unsigned int numberOfPoints = request->getPoints().size();
+					if (request->isBinary())
+					{
+						// gray values are spread across the 3 channels like the single query does
+						std::vector<unsigned char> binary;
+						binary.reserve(dataSets.size() * numberOfPoints * 3);
+						for (const std::vector<unsigned char> & dataSetValues : values)
+						{
+							const bool isGray = dataSetValues.size() == numberOfPoints;
+							for (unsigned int p=0;p<numberOfPoints;p++)
+								for (unsigned short c=0;c<3;c++)
+									binary.push_back(dataSetValues[isGray ? p : p * 3 + c]);
+						}
+
+						const std::string httpResponseHeader =
+							tissuestack::utils::Misc::composeHttpResponse(
+								"200 OK", "application/octet-stream", "", true);
+						write(file_descriptor, httpResponseHeader.c_str(), httpResponseHeader.length());
+						tissuestack::utils::Misc::streamGzippedDataToDescriptor(
+							binary.data(), binary.size(), file_descriptor);
+						return;
+					}
+
+					std::ostringstream response;
+					if (dataSets.empty())
+						response << tissuestack::common::NO_RESULTS_JSON;
+					else
+					{
+						// gray data sets have one value per point, color ones an array of red, green and blue
+						response << "{\"response\": {";
+						for (unsigned int i=0;i<dataSets.size();i++)
+						{
+							if (i !=0)
+								response << ",";
+							response << "\"" << dataSets[i]->getFileName() << "\" : [";
+
+							const bool isGray = values[i].size() == numberOfPoints;
+							for (unsigned int p=0;p<numberOfPoints;p++)
+							{
+								if (p != 0)
+									response << ",";
+								if (isGray)
+									response << static_cast<unsigned int>(values[i][p]);
+								else
+									response << "[" << static_cast<unsigned int>(values[i][p * 3]) <<
+										"," << static_cast<unsigned int>(values[i][p * 3 + 1]) <<
+										"," << static_cast<unsigned int>(values[i][p * 3 + 2]) << "]";
+							}
+							response << "]";
+						}
+						response << "}}";
+					}
+
+					const std::string httpResponseHeader =
+						tissuestack::utils::Misc::composeHttpResponse(
+							"200 OK", "text/json", response.str());
+					write(file_descriptor, httpResponseHeader.c_str(), httpResponseHeader.length());
+				}
+
+				void processStatisticsRequest(
+						const tissuestack::common::ProcessingStrategy * processing_strategy,
+						const tissuestack::networking::TissueStackStatisticsRequest * request,
+						const int file_descriptor)
+				{
+					std::ostringstream response;
+
+					const std::vector<const TissueStackImageData *> dataSets =
+						this->processRequest(request, file_descriptor);
+					if (dataSets.empty())
+						response << tissuestack::common::NO_RESULTS_JSON;
+					else
+					{
+						// gray data sets have one set of figures, color ones one per channel
+						response << "{\"response\": {";
+						for (unsigned int i=0;i<dataSets.size();i++)
+						{
+							if (i !=0)
+								response << ",";
+							response << "\"" << dataSets[i]->getFileName() << "\" : ";
+
+							const tissuestack::imaging::TissueStackRawData * rawData =
+								static_cast<const tissuestack::imaging::TissueStackRawData *>(dataSets[i]);
+							const std::vector<unsigned long long int> histograms =
+								this->_caching_strategy->computeHistograms(processing_strategy, rawData, request);
+							if (histograms.size() == 256)
+							{
+								response << "{";
+								this->composeStatistics(response, histograms.data(), request->getNumberOfBins());
+							} else
+							{
+								response << "{\"red\": {";
+								this->composeStatistics(response, histograms.data(), request->getNumberOfBins());
+								response << "}, \"green\": {";
+								this->composeStatistics(response, histograms.data() + 256, request->getNumberOfBins());
+								response << "}, \"blue\": {";
+								this->composeStatistics(response, histograms.data() + 512, request->getNumberOfBins());
+								response << "}";
+							}
+
+							// whole slices also get the box around their non zero voxels if it was recorded at conversion time
+							if (request->getPolygon().empty() && rawData->getStatistics() != nullptr)
+							{
+								const TissueStackDataDimension * dimension =
+									rawData->getDimensionByLongName(request->getDimensionName());
+								const unsigned int lastSlice =
+									std::min(request->getLastSliceNumber(),
+										static_cast<unsigned int>(dimension->getNumberOfSlices() - 1));
+								std::array<unsigned int, 4> bounds = {{ UINT_MAX, UINT_MAX, 0, 0 }};
+								std::array<unsigned int, 4> sliceBounds;
+								for (unsigned int s=request->getSliceNumber();s<=lastSlice;s++)
+									if (rawData->getStatistics()->getNonZeroBounds(dimension->getName(), s, sliceBounds) &&
+											sliceBounds[2] > 0)
+									{
+										bounds[0] = std::min(bounds[0], sliceBounds[0]);
+										bounds[1] = std::min(bounds[1], sliceBounds[1]);
+										bounds[2] = std::max(bounds[2], sliceBounds[2]);
+										bounds[3] = std::max(bounds[3], sliceBounds[3]);
+									}
+
+								response << ", \"bounds\": ";
+								if (bounds[2] == 0)
+									response << "null";
+								else
+									response << "[" << bounds[0] << "," << bounds[1] << "," << bounds[2] << "," << bounds[3] << "]";
+							}
+							response << "}";
+						}
+						response << "}}";
+					}
+
+					const std::string httpResponseHeader =
+						tissuestack::utils::Misc::composeHttpResponse(
+							"200 OK", "text/json", response.str());
+					write(file_descriptor, httpResponseHeader.c_str(), httpResponseHeader.length());
+				}
+
+				void processLabelIndexRequest(
+						const tissuestack::common::ProcessingStrategy * processing_strategy,
+						const tissuestack::networking::TissueStackLabelIndexRequest * request,
+						const int file_descriptor)
+				{
+					if (request->getDataSetLocations().empty())
+						THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
+								"Query had no image data returned");
+
+					std::ostringstream response;
+					response << "{\"response\": {";
+					for (unsigned int i=0;i<request->getDataSetLocations().size();i++)
+					{
+						const tissuestack::imaging::TissueStackRawData * rawData =
+							static_cast<const tissuestack::imaging::TissueStackRawData *>(
+								this->findRawData(request->getDataSetLocations()[i]));
+						const TissueStackLabelLookup * lookup = rawData->getLookup();
+						if (lookup == nullptr)
+							THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
+								"Label queries need a data set with a label lookup!");
+
+						// the first query of a data set (or the first after its lookup changed) pays for the index
+						const std::shared_ptr<const TissueStackLabelSpatialIndex> index = rawData->getLabelSpatialIndex();
+
+						// timeout/shutdown check
+						if (request->hasExpired() || processing_strategy->isStopFlagRaised())
+							THROW_TS_EXCEPTION(tissuestack::common::TissueStackObsoleteRequestException,
+								"Old Label Request!");
+
+						if (i !=0)
+							response << ",";
+						response << "\"" << rawData->getFileName() << "\" : ";
+
+						if (request->getLabel().empty())
+						{
+							// all labels present in the data set
+							response << "[";
+							bool isFirst = true;
+							for (unsigned short l=1;l<=lookup->getNumberOfLabels();l++)
+							{
+								if (index->getNumberOfVoxels(l) == 0)
+									continue;
+								if (!isFirst)
+									response << ",";
+								isFirst = false;
+								response << "{";
+								this->composeLabelFigures(response, index.get(), lookup, l);
+								response << "}";
+							}
+							response << "]";
+							continue;
+						}
+
+						const unsigned short label = lookup->findLabelIndex(request->getLabel());
+						if (label == 0)
+							THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
+								"Label is not part of the data set's label lookup!");
+
+						response << "{";
+						this->composeLabelFigures(response, index.get(), lookup, label);
+						response << ", \"slices\": {";
+						const char dimensions[3] = { 'x', 'y', 'z' };
+						for (unsigned short a=0;a<3;a++)
+						{
+							if (a != 0)
+								response << ",";
+							response << "\"" << dimensions[a] << "\": [";
+							const std::vector<std::pair<unsigned int, unsigned int> > ranges =
+								index->getSliceRanges(label, dimensions[a]);
+							for (unsigned int r=0;r<ranges.size();r++)
+							{
+								if (r != 0)
+									response << ",";
+								response << "[" << ranges[r].first << "," << ranges[r].second << "]";
+							}
+							response << "]";
+						}
+						response << "}";
+
+						if (request->hasSlice())
+						{
+							const TissueStackDataDimension * dimension =
+								rawData->getDimensionByLongName(request->getDimensionName());
+							if (dimension == nullptr)
+								THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
+										"Image Dimension could not be found!");
+							if (request->getSliceNumber() >= dimension->getNumberOfSlices())
+								THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
+										"Slice number requested is out of bounds!");
+
+							std::array<unsigned int, 4> bounds;
+							std::array<double, 2> centroid;
+							const unsigned long long int numberOfVoxels =
+								TissueStackLabelSpatialIndex::measureSlice(
+									rawData, lookup, dimension, request->getSliceNumber(), label, bounds, centroid);
+							response << ", \"slice\": {\"voxels\": " << numberOfVoxels << ", \"bounds\": ";
+							if (numberOfVoxels == 0)
+								response << "null, \"centroid\": null}";
+							else
+								response << "[" << bounds[0] << "," << bounds[1] << "," << bounds[2] << "," << bounds[3] <<
+									"], \"centroid\": [" << centroid[0] << "," << centroid[1] << "]}";
+						}
+						response << "}";
+					}
+					response << "}}";
+
+					const std::string httpResponseHeader =
+						tissuestack::utils::Misc::composeHttpResponse(
+							"200 OK", "text/json", response.str());
+					write(file_descriptor, httpResponseHeader.c_str(), httpResponseHeader.length());
+				}
+
 				void processImageRequest(
 						const tissuestack::common::ProcessingStrategy * processing_strategy,
 						const tissuestack::networking::TissueStackImageRequest * request,
@@ -1007,131 +2261,359 @@ namespace tissuestack
 						THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
 								"Query had no image data returned");
 
-					// Note: for now we work with only one image but in the future we can accumulate them
+					// more than one data set means overlays: the first one is the bottom layer
 					const TissueStackImageData * imageData = dataSets[0];
 
 					// some more checks regarding the validity of the image request parameters
-					if (request->getQualityFactor() <= 0.0 || request->getQualityFactor() > 1.0)
-						THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
-								"The range of 'quality factor' has to be greater than 0 but no bigger than 1.0");
-					if (request->getScaleFactor() <= 0.0)
-						THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
-								"The range of 'scale factor' has to be greater than 0");
-					if (request->getColorMapName().empty())
-						THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
-								"Request is missing color map information");
-					if (tissuestack::imaging::TissueStackColorMapStore::instance()->findColorMap(request->getColorMapName()) == nullptr)
-						THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
-								"Request has been given a non-existing color map");
-					if (request->getContrastMinimum() < 0 || request->getContrastMinimum() > 255
-							|| request->getContrastMaximum() < 0 || request->getContrastMaximum() > 255
-							|| request->getContrastMinimum() >= request->getContrastMaximum())
-						THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
-								"Request has been given invalid contrast parameters");
+					this->checkRenderingParameters(request);
 					if (!request->isPreview()) // only for non preview requests
 					{
 						if (request->getLengthOfSquare() < 0 || request->getLengthOfSquare() > 256 * 5)
 							THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
 									"The length of the image square has to range in betwenn 0 and 1280");
 					}
+					if (request->getLabelMode() != tissuestack::networking::TissueStackImageRequest::LabelMode::NONE &&
+							std::none_of(dataSets.begin(), dataSets.end(),
+								[] (const TissueStackImageData * dataSet) { return dataSet->getLookup() != nullptr; }))
+						THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
+								"Label rendering needs a data set with a label lookup");
 
-					// perform extraction
-					Image * img =
-						const_cast<Image *>(
-						this->_caching_strategy->extractImage(
+					// background tiles don't need any data read: a shared encoded tile will do (overlays are rendered as usual)
+					if (dataSets.size() == 1)
+					{
+						const std::shared_ptr<const std::vector<unsigned char> > blankTile =
+							this->_caching_strategy->findBlankTile(
 								processing_strategy,
 								static_cast<const tissuestack::imaging::TissueStackRawData *>(imageData),
-								request));
+								request);
+						if (blankTile)
+						{
+							if (!this->streamEncodedImage(request, blankTile->data(), blankTile->size(), file_descriptor))
+								THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
+									"Failed to gzip image response!");
+							return;
+						}
+					}
 
-					// timeout/shutdown check
-					if (request->hasExpired() || processing_strategy->isStopFlagRaised())
+					// the tile disk cache holds the encoded image, if we find it there we are done
+					std::string diskCacheKey = "";
+					if (tissuestack::imaging::TissueStackTileDiskCache::doesInstanceExist() &&
+							tissuestack::imaging::TissueStackTileDiskCache::instance()->isEnabled())
 					{
-						DestroyImage(img);
-						THROW_TS_EXCEPTION(tissuestack::common::TissueStackObsoleteRequestException,
-							"Old Image Request!");
+						diskCacheKey =
+							tissuestack::imaging::TissueStackTileDiskCache::generateCacheKey(
+								static_cast<const tissuestack::imaging::TissueStackRawData *>(imageData), request);
+						if (this->streamImageFromTileDiskCache(diskCacheKey, request, file_descriptor))
+							return;
 					}
 
-					// apply post processing
-					img =
-						this->_caching_strategy->applyPostExtractionTasks(
-						img,
-						static_cast<const tissuestack::imaging::TissueStackRawData *>(imageData),
-						request);
-					if (img == NULL)
+					// perform extraction, rendering and encoding
+					unsigned long long int length = 0;
+					const unsigned char * encodedImg = nullptr;
+					if (dataSets.size() == 1)
+						encodedImg =
+							this->_caching_strategy->encodeImage(
+									processing_strategy,
+									static_cast<const tissuestack::imaging::TissueStackRawData *>(imageData),
+									request,
+									length);
+					else
+					{
+						std::vector<const tissuestack::imaging::TissueStackRawData *> layers;
+						for (const TissueStackImageData * layer : dataSets)
+							layers.push_back(static_cast<const tissuestack::imaging::TissueStackRawData *>(layer));
+						encodedImg =
+							this->_caching_strategy->encodeCompositeImage(
+									processing_strategy,
+									layers,
+									request,
+									length);
+					}
+
+					if (encodedImg == nullptr || length == 0)
 						THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
-							"Could not apply post extraction tasks to image");
+							"Failed to write image to memory!");
 
 					// timeout/shutdown check
 					if (request->hasExpired() || processing_strategy->isStopFlagRaised())
-					{
-						DestroyImage(img);
 						THROW_TS_EXCEPTION(tissuestack::common::TissueStackObsoleteRequestException,
 							"Old Image Request!");
-					}
 
 					// this is the part were we start to serialize the output of our finished image work
-					std::string formatLowerCase =  request->getOutputImageFormat();
-					std::transform(formatLowerCase.begin(), formatLowerCase.end(), formatLowerCase.begin(), tolower);
-					strcpy(img->magick, formatLowerCase.c_str());
-					std::string image_format("image/");
+					bool failedToGZip = !this->streamEncodedImage(request, encodedImg, length, file_descriptor);
+					if (!failedToGZip && !diskCacheKey.empty())
+						tissuestack::imaging::TissueStackTileDiskCache::instance()->addCacheEntry(
+							diskCacheKey, encodedImg, length);
+					if (failedToGZip)
+						THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
+							"Failed to gzip image response!");
+				};
 
-					// add the header beforehand
-					const std::string httpResponseHeader =
-							 tissuestack::utils::Misc::composeHttpResponse(
-									 "200 OK",
-									 image_format + formatLowerCase,
-									 "",
-									 true
-					);
-
-					ExceptionInfo exception;
-					ImageInfo	*imgInfo = NULL;
-					GetExceptionInfo(&exception);
-					imgInfo = CloneImageInfo((ImageInfo *)NULL);
-					if (imgInfo == NULL)
+				void processObliqueRequest(
+						const tissuestack::common::ProcessingStrategy * processing_strategy,
+						const tissuestack::networking::TissueStackObliqueRequest * request,
+						const int file_descriptor)
+				{
+					if (request->getDataSetLocations().empty())
+						THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
+								"Query had no image data returned");
+
+					// one plane through one data set, there is no slice or tile to check
+					const TissueStackImageData * imageData = this->findRawData(request->getDataSetLocations()[0]);
+					this->checkRenderingParameters(request);
+
+					// the plane is sampled afresh each time: arbitrary orientations make poor cache keys
+					unsigned long long int length = 0;
+					const unsigned char * encodedImg =
+						this->_caching_strategy->encodeObliqueImage(
+								processing_strategy,
+								static_cast<const tissuestack::imaging::TissueStackRawData *>(imageData),
+								request,
+								length);
+
+					if (encodedImg == nullptr || length == 0)
 						THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
-								"Could not create ImageInfo!");
+							"Failed to write image to memory!");
 
-					write(file_descriptor, httpResponseHeader.c_str(), httpResponseHeader.length());
+					// timeout/shutdown check
+					if (request->hasExpired() || processing_strategy->isStopFlagRaised())
+						THROW_TS_EXCEPTION(tissuestack::common::TissueStackObsoleteRequestException,
+							"Old Image Request!");
 
-					/*
-						FILE * handle = fdopen(file_descriptor, "w");
-						imgInfo->file = handle;
+					if (!this->streamEncodedImage(request, encodedImg, length, file_descriptor))
+						THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
+							"Failed to gzip image response!");
+				};
 
-						if (WriteImage(imgInfo, img) == MagickFail)
-						{
-							CatchException(&img->exception);
-							tissuestack::logging::TissueStackLogger::instance()->error(
-								"Failed to write out image: %s\n", img->exception.reason);
-						}
-					*/
+				void processProjectionRequest(
+						const tissuestack::common::ProcessingStrategy * processing_strategy,
+						const tissuestack::networking::TissueStackProjectionRequest * request,
+						const int file_descriptor)
+				{
+					// the first slice of the range is checked like the slice of an image request
+					const std::vector<const TissueStackImageData *> dataSets =
+						this->processRequest(request, file_descriptor);
+					if (dataSets.empty())
+						THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
+								"Query had no image data returned");
+
+					this->checkRenderingParameters(request);
+					if (!request->isPreview() && (request->getLengthOfSquare() < 0 || request->getLengthOfSquare() > 256 * 5))
+						THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
+								"The length of the image square has to range in betwenn 0 and 1280");
 
-					size_t length = 0;
-					unsigned char * memImg =
-						static_cast<unsigned char *>(ImageToBlob(imgInfo, img, &length, &img->exception));
-					if (img) DestroyImage(img);
-					if (imgInfo) DestroyImageInfo(imgInfo);
+					// projections are cached by the caching strategy, the tile disk cache keys would clash with the slice's
+					unsigned long long int length = 0;
+					const unsigned char * encodedImg =
+						this->_caching_strategy->encodeProjectionImage(
+								processing_strategy,
+								static_cast<const tissuestack::imaging::TissueStackRawData *>(dataSets[0]),
+								request,
+								length);
 
-					if (length==0)
-					{
-						CatchException(&img->exception);
+					if (encodedImg == nullptr || length == 0)
 						THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
 							"Failed to write image to memory!");
-					}
 
-					bool failedToGZip = !tissuestack::utils::Misc::streamGzippedDataToDescriptor(
-						memImg, length, file_descriptor);
-					if (memImg) free(memImg);
-					if (failedToGZip)
+					// timeout/shutdown check
+					if (request->hasExpired() || processing_strategy->isStopFlagRaised())
+						THROW_TS_EXCEPTION(tissuestack::common::TissueStackObsoleteRequestException,
+							"Old Image Request!");
+
+					if (!this->streamEncodedImage(request, encodedImg, length, file_descriptor))
 						THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
 							"Failed to gzip image response!");
-					/*
-						fflush(handle);
-						if (handle) fclose(handle);
-					*/
 				};
 
 			private:
+					// name, voxel count, first/last x, y, z and centroid of a label (the label has to occur for the last two)
+					void composeLabelFigures(
+						std::ostringstream & response,
+						const TissueStackLabelSpatialIndex * index,
+						const TissueStackLabelLookup * lookup,
+						const unsigned short label)
+					{
+						response << "\"label\": \"" << tissuestack::utils::Misc::maskQuotesInJson(lookup->getLabelName(label)) <<
+							"\", \"voxels\": " << index->getNumberOfVoxels(label);
+
+						std::array<unsigned int, 6> bounds;
+						if (!index->getBounds(label, bounds))
+						{
+							response << ", \"bounds\": null, \"centroid\": null";
+							return;
+						}
+						const std::array<double, 3> centroid = index->getCentroid(label);
+						response << ", \"bounds\": {\"x\": [" << bounds[0] << "," << bounds[3] <<
+							"], \"y\": [" << bounds[1] << "," << bounds[4] <<
+							"], \"z\": [" << bounds[2] << "," << bounds[5] <<
+							"]}, \"centroid\": {\"x\": " << centroid[0] << ", \"y\": " << centroid[1] <<
+							", \"z\": " << centroid[2] << "}";
+					}
+
+					const TissueStackImageData * findRawData(const std::string & dataSetFile)
+					{
+						const tissuestack::imaging::TissueStackDataSet * dataSet =
+								tissuestack::imaging::TissueStackDataSetStore::instance()->findDataSet(dataSetFile);
+
+						// we have no associated data set, try to create one
+						if (dataSet == nullptr)
+						{
+							std::lock_guard<std::mutex> lock(this->_dataset_addition_mutex);
+
+							try
+							{
+								dataSet = tissuestack::imaging::TissueStackDataSet::fromFile(dataSetFile);
+								tissuestack::imaging::TissueStackDataSetStore::instance()->addDataSet(dataSet);
+							} catch (std::exception & bad)
+							{
+								tissuestack::logging::TissueStackLogger::instance()->error(
+										"Could not create data set from file '%s' for the following reason:\n%s\n",
+										dataSetFile.c_str(), bad.what());
+								THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
+										"Given dataset is not a compatible Tissue Stack Data Set!");
+							}
+						}
+
+						// we only let RAW file requests go through
+						if (!dataSet->getImageData()->isRaw())
+							THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException, "Only TissueStack Raw Files are allowed to be requested online!");
+
+						return dataSet->getImageData();
+					};
+
+					// the figures follow from the 256 value histogram exactly, the histogram is then merged into the bins asked for
+					// (percentiles by nearest rank: the smallest value that has at least that share of the voxels at or below it)
+					void composeStatistics(
+						std::ostringstream & json,
+						const unsigned long long int * histogram,
+						const unsigned short number_of_bins) const
+					{
+						unsigned long long int count = 0;
+						unsigned long long int sum = 0;
+						short minimum = -1, maximum = -1;
+						for (unsigned short v=0;v<256;v++)
+						{
+							if (histogram[v] == 0)
+								continue;
+							if (minimum < 0)
+								minimum = v;
+							maximum = v;
+							count += histogram[v];
+							sum += histogram[v] * v;
+						}
+
+						json << "\"count\": " << count;
+						if (count == 0)
+							json << ", \"min\": null, \"max\": null, \"mean\": null, \"std\": null, \"percentiles\": null";
+						else
+						{
+							const double mean = static_cast<double>(sum) / count;
+							double squares = 0;
+							for (unsigned short v=minimum;v<=maximum;v++)
+								squares += histogram[v] * (v - mean) * (v - mean);
+							json << ", \"min\": " << minimum << ", \"max\": " << maximum
+								<< ", \"mean\": " << mean << ", \"std\": " << sqrt(squares / count);
+
+							json << ", \"percentiles\": {";
+							const unsigned short percentiles[] = { 1, 2, 5, 25, 50, 75, 95, 98, 99 };
+							unsigned long long int cumulative = 0;
+							unsigned short v = minimum;
+							for (unsigned short p=0;p<sizeof(percentiles)/sizeof(percentiles[0]);p++)
+							{
+								const unsigned long long int rank = (count * percentiles[p] + 99) / 100;
+								while (cumulative + histogram[v] < rank)
+									cumulative += histogram[v++];
+								json << (p == 0 ? "" : ", ") << "\"" << percentiles[p] << "\": " << v;
+							}
+							json << "}";
+						}
+
+						std::vector<unsigned long long int> bins(number_of_bins, 0);
+						for (unsigned short v=0;v<256;v++)
+							bins[v * number_of_bins / 256] += histogram[v];
+						json << ", \"histogram\": [";
+						for (unsigned short b=0;b<number_of_bins;b++)
+							json << (b == 0 ? "" : ",") << bins[b];
+						json << "]";
+					};
+
+					void checkRenderingParameters(const tissuestack::networking::TissueStackImageRequest * request) const
+					{
+						// the layers of an overlay are checked the same way
+						for (unsigned short layer=1;layer<request->getNumberOfLayers();layer++)
+						{
+							if (tissuestack::imaging::TissueStackColorMapStore::instance()->findColorMap(request->getLayerColorMapName(layer)) == nullptr)
+								THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
+										"Request has been given a non-existing color map");
+							if (request->getLayerContrastMinimum(layer) > 255 || request->getLayerContrastMaximum(layer) > 255
+									|| request->getLayerContrastMinimum(layer) >= request->getLayerContrastMaximum(layer))
+								THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
+										"Request has been given invalid contrast parameters");
+						}
+
+						if (request->getQualityFactor() <= 0.0 || request->getQualityFactor() > 1.0)
+							THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
+									"The range of 'quality factor' has to be greater than 0 but no bigger than 1.0");
+						if (request->getScaleFactor() <= 0.0)
+							THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
+									"The range of 'scale factor' has to be greater than 0");
+						if (request->getColorMapName().empty())
+							THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
+									"Request is missing color map information");
+						if (tissuestack::imaging::TissueStackColorMapStore::instance()->findColorMap(request->getColorMapName()) == nullptr)
+							THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
+									"Request has been given a non-existing color map");
+						if (request->getContrastMinimum() < 0 || request->getContrastMinimum() > 255
+								|| request->getContrastMaximum() < 0 || request->getContrastMaximum() > 255
+								|| request->getContrastMinimum() >= request->getContrastMaximum())
+							THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
+									"Request has been given invalid contrast parameters");
+					};
+
+					// the encoded image lives in the encoder's per thread buffer: nothing to free
+					const bool streamEncodedImage(
+						const tissuestack::networking::TissueStackImageRequest * request,
+						const unsigned char * encoded_image,
+						const unsigned long long int length,
+						const int file_descriptor) const
+					{
+						std::string formatLowerCase =  request->getOutputImageFormat();
+						std::transform(formatLowerCase.begin(), formatLowerCase.end(), formatLowerCase.begin(), tolower);
+
+						// add the header beforehand
+						const std::string httpResponseHeader =
+								 tissuestack::utils::Misc::composeHttpResponse(
+										 "200 OK",
+										 std::string("image/") + formatLowerCase,
+										 "",
+										 true
+						);
+						write(file_descriptor, httpResponseHeader.c_str(), httpResponseHeader.length());
+
+						return tissuestack::utils::Misc::streamGzippedDataToDescriptor(
+							encoded_image, length, file_descriptor);
+					};
+
+					const bool streamImageFromTileDiskCache(
+						const std::string & key,
+						const tissuestack::networking::TissueStackImageRequest * request,
+						const int file_descriptor)
+					{
+						unsigned long long int length = 0;
+						unsigned char * cachedImg =
+							tissuestack::imaging::TissueStackTileDiskCache::instance()->findCacheEntry(key, length);
+						if (cachedImg == nullptr)
+							return false;
+
+						bool failedToGZip = !this->streamEncodedImage(request, cachedImg, length, file_descriptor);
+						delete [] cachedImg;
+						if (failedToGZip)
+							THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
+								"Failed to gzip image response!");
+
+						return true;
+					};
+
 			 	std::mutex _dataset_addition_mutex;
 				CachingStrategy * _caching_strategy = nullptr;
 		};
@@ -1148,6 +2630,16 @@ namespace tissuestack
 					const tissuestack::services::TissueStackConversionTask * conversion_task,
 					const std::string dimension = "",
 					const bool writeHeader = true);
+				// rewrites a V1 raw whose voxels are all gray as V2 with one channel,
+				// returns false (leaving the raw as is) if it is rgb or could not be rewritten
+				static const bool compactToSingleChannel(const std::string & raw_file);
+				// rewrites an x/y/z volume as bricked V3 (a single copy of the volume) or, given a codec,
+				// compressed V4, returns false (leaving the raw as is) if it could not be rewritten
+				static const bool convertToBricked(
+					const std::string & raw_file,
+					const unsigned short brick_edge = DEFAULT_BRICK_EDGE,
+					const RAW_CODEC codec = RAW_CODEC::UNCOMPRESSED);
+				static const unsigned short DEFAULT_BRICK_EDGE = 32;
 			private:
 				inline void convertSlice(
 					const tissuestack::imaging::TissueStackMincData * minc,
@@ -0,0 +1,135 @@
+/*
+ * This file is part of TissueStack.
+ *
+ * TissueStack is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TissueStack is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TissueStack.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "networking.h"
+
+const std::string tissuestack::networking::TissueStackBatchQueryRequest::SERVICE = "QUERY_BATCH";
+
+tissuestack::networking::TissueStackBatchQueryRequest::TissueStackBatchQueryRequest(
+		std::unordered_map<std::string, std::string> & request_parameters)
+{
+	this->setTimeStampInfoFromRequestParameters(request_parameters);
+	this->setDataSetFromRequestParameters(request_parameters);
+	this->setDimensionFromRequestParameters(request_parameters);
+
+	const std::string points =
+		tissuestack::utils::Misc::findUnorderedMapEntryWithUpperCaseStringKey(request_parameters, "points");
+	const std::string polyline =
+		tissuestack::utils::Misc::findUnorderedMapEntryWithUpperCaseStringKey(request_parameters, "polyline");
+	if (points.empty() == polyline.empty())
+		THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
+			"Either parameter 'points' or parameter 'polyline' has to be supplied!");
+
+	if (!points.empty())
+		this->_points = this->parsePoints(points);
+	else
+		this->samplePolyline(this->parsePoints(polyline));
+
+	if (this->_points.size() > tissuestack::networking::TissueStackBatchQueryRequest::MAXIMUM_NUMBER_OF_POINTS)
+		THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
+			"A batch query must not exceed 65536 points!");
+
+	std::string value = tissuestack::utils::Misc::findUnorderedMapEntryWithUpperCaseStringKey(request_parameters, "format");
+	std::transform(value.begin(), value.end(), value.begin(), tolower);
+	if (value.compare("binary") == 0)
+		this->_is_binary = true;
+	else if (!value.empty() && value.compare("json") != 0)
+		THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
+			"Optional Parameter 'format' can only be 'json' or 'binary'!");
+
+	// we have passed all preliminary checks => assign us the new type
+	this->setType(tissuestack::common::Request::Type::TS_BATCH_QUERY);
+}
+
+inline const std::vector<std::array<unsigned int, 3> > tissuestack::networking::TissueStackBatchQueryRequest::parsePoints(
+	const std::string & value) const
+{
+	std::vector<std::array<unsigned int, 3> > points;
+	for (auto point : tissuestack::utils::Misc::tokenizeString(value, ','))
+	{
+		const std::vector<std::string> coordinates = tissuestack::utils::Misc::tokenizeString(point, ':');
+		if (coordinates.size() != 3)
+			THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
+				"Points have to be given as 'x:y:slice'!");
+
+		std::array<unsigned int, 3> coordinate;
+		for (unsigned short i=0;i<3;i++)
+		{
+			char * end = nullptr;
+			const unsigned long number = strtoul(coordinates[i].c_str(), &end, 10);
+			if (end == coordinates[i].c_str() || *end != '\0' || number > UINT_MAX)
+				THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
+					"Points have to be given as 'x:y:slice' with positive integers!");
+			coordinate[i] = static_cast<unsigned int>(number);
+		}
+		points.push_back(coordinate);
+
+		if (points.size() > tissuestack::networking::TissueStackBatchQueryRequest::MAXIMUM_NUMBER_OF_POINTS)
+			THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
+				"A batch query must not exceed 65536 points!");
+	}
+
+	return points;
+}
+
+void tissuestack::networking::TissueStackBatchQueryRequest::samplePolyline(
+	const std::vector<std::array<unsigned int, 3> > & vertices)
+{
+	if (vertices.empty())
+		return;
+
+	// one sample per voxel step along the longest axis of each segment, the joints are sampled once
+	this->_points.push_back(vertices[0]);
+	for (unsigned int v=1;v<vertices.size();v++)
+	{
+		const std::array<unsigned int, 3> & from = vertices[v-1];
+		const std::array<unsigned int, 3> & to = vertices[v];
+
+		long long int steps = 0;
+		for (unsigned short i=0;i<3;i++)
+			steps = std::max(steps, llabs(static_cast<long long int>(to[i]) - static_cast<long long int>(from[i])));
+		if (this->_points.size() + steps > tissuestack::networking::TissueStackBatchQueryRequest::MAXIMUM_NUMBER_OF_POINTS)
+			THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
+				"A batch query must not exceed 65536 points!");
+
+		for (long long int s=1;s<=steps;s++)
+		{
+			std::array<unsigned int, 3> sample;
+			for (unsigned short i=0;i<3;i++)
+				sample[i] =
+					static_cast<unsigned int>(
+						llround(
+							static_cast<double>(from[i]) +
+							(static_cast<double>(to[i]) - static_cast<double>(from[i])) * s / steps));
+			this->_points.push_back(sample);
+		}
+	}
+}
+
+const std::string tissuestack::networking::TissueStackBatchQueryRequest::getContent() const
+{
+	return std::string("TS_BATCH_QUERY");
+}
+
+const std::vector<std::array<unsigned int, 3> > & tissuestack::networking::TissueStackBatchQueryRequest::getPoints() const
+{
+	return this->_points;
+}
+
+const bool tissuestack::networking::TissueStackBatchQueryRequest::isBinary() const
+{
+	return this->_is_binary;
+}
@@ -132,7 +132,57 @@ void tissuestack::networking::TissueStackImageRequest::setImageRequestMembersFro
 	this->setDataSetFromRequestParameters(request_parameters);
 	this->setDimensionFromRequestParameters(request_parameters);
 	this->setSliceFromRequestParameters(request_parameters);
+	this->setRenderingFromRequestParameters(request_parameters);
 
+	// the tile coordinates and the square length are not meaningful for previews
+	this->setCoordinatesFromRequestParameters(request_parameters, this->_is_preview);
+	std::string value = "";
+	if (!this->_is_preview)
+	{
+		value = tissuestack::utils::Misc::findUnorderedMapEntryWithUpperCaseStringKey(request_parameters, "square");
+		if (!value.empty())
+		{
+			try
+			{
+				this->_length_of_square = strtoul(value.c_str(), NULL, 10);
+			} catch (...)
+			{
+				THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException, "Optional Parameter 'square' is not a valid positive integer!");
+			}
+		}
+	} else
+	{
+		// optional width and height
+		value = tissuestack::utils::Misc::findUnorderedMapEntryWithUpperCaseStringKey(request_parameters, "width");
+		if (!value.empty())
+		{
+			try
+			{
+				this->_width = strtoul(value.c_str(), NULL, 10);
+			} catch (...)
+			{
+				THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException, "Optional Parameter 'width' is not a valid positive integer!");
+			}
+		}
+		value = tissuestack::utils::Misc::findUnorderedMapEntryWithUpperCaseStringKey(request_parameters, "height");
+		if (!value.empty())
+		{
+			try
+			{
+				this->_height = strtoul(value.c_str(), NULL, 10);
+			} catch (...)
+			{
+				THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException, "Optional Parameter 'height' is not a valid positive integer!");
+			}
+		}
+	}
+
+	// we have passed all preliminary checks => assign us the new type
+	this->setType(tissuestack::common::Request::Type::TS_IMAGE);
+}
+
+void tissuestack::networking::TissueStackImageRequest::setRenderingFromRequestParameters(const std::unordered_map<std::string, std::string> & request_parameters)
+{
 	std::string value = tissuestack::utils::Misc::findUnorderedMapEntryWithUpperCaseStringKey(request_parameters, "scale");
 	if (!value.empty())
 	{
@@ -163,19 +213,34 @@ void tissuestack::networking::TissueStackImageRequest::setImageRequestMembersFro
 
 	std::transform(this->_output_image_format.begin(), this->_output_image_format.end(), this->_output_image_format.begin(), toupper);
 
+#ifdef USE_WEBP
+	if (this->_output_image_format.compare("PNG") != 0 && this->_output_image_format.compare("JPEG") != 0 &&
+			this->_output_image_format.compare("WEBP") != 0)
+		THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException, "Parameter 'image_type' can only be 'PNG', 'JPEG' or 'WEBP'!");
+#else
 	if (this->_output_image_format.compare("PNG") != 0 && this->_output_image_format.compare("JPEG") != 0)
 		THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException, "Parameter 'image_type' can only be 'PNG' or 'JPEG'!");
+#endif
 
+	// for overlays color map, contrast and opacity can be given per data set (colon separated as the data sets are),
+	// the first entry applies to the first data set and is the one for single data set requests
 	value = tissuestack::utils::Misc::findUnorderedMapEntryWithUpperCaseStringKey(request_parameters, "colormap");
 	if (!value.empty())
-		this->_color_map_name = value;
+	{
+		this->_layer_color_map_names = tissuestack::utils::Misc::tokenizeString(value, ':');
+		if (!this->_layer_color_map_names.empty())
+			this->_color_map_name = this->_layer_color_map_names[0];
+	}
 
 	value = tissuestack::utils::Misc::findUnorderedMapEntryWithUpperCaseStringKey(request_parameters, "min");
 	if (!value.empty())
 	{
 		try
 		{
-			this->_contrast_min = static_cast<unsigned short>(atoi(value.c_str()));
+			for (auto token : tissuestack::utils::Misc::tokenizeString(value, ':'))
+				this->_layer_contrast_minima.push_back(static_cast<unsigned short>(atoi(token.c_str())));
+			if (!this->_layer_contrast_minima.empty())
+				this->_contrast_min = this->_layer_contrast_minima[0];
 		} catch (...)
 		{
 			THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException, "Optional Parameter 'min' is not a valid positve integer!");
@@ -187,57 +252,41 @@ void tissuestack::networking::TissueStackImageRequest::setImageRequestMembersFro
 	{
 		try
 		{
-			this->_contrast_max = static_cast<unsigned short>(atoi(value.c_str()));
+			for (auto token : tissuestack::utils::Misc::tokenizeString(value, ':'))
+				this->_layer_contrast_maxima.push_back(static_cast<unsigned short>(atoi(token.c_str())));
+			if (!this->_layer_contrast_maxima.empty())
+				this->_contrast_max = this->_layer_contrast_maxima[0];
 		} catch (...)
 		{
 			THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException, "Optional Parameter 'max' is not a valid positve integer!");
 		}
 	}
 
-	// the tile coordinates and the square length are not meaningful for previews
-	this->setCoordinatesFromRequestParameters(request_parameters, this->_is_preview);
-	if (!this->_is_preview)
-	{
-		value = tissuestack::utils::Misc::findUnorderedMapEntryWithUpperCaseStringKey(request_parameters, "square");
-		if (!value.empty())
-		{
-			try
-			{
-				this->_length_of_square = strtoul(value.c_str(), NULL, 10);
-			} catch (...)
-			{
-				THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException, "Optional Parameter 'square' is not a valid positive integer!");
-			}
-		}
-	} else
+	value = tissuestack::utils::Misc::findUnorderedMapEntryWithUpperCaseStringKey(request_parameters, "opacity");
+	for (auto token : tissuestack::utils::Misc::tokenizeString(value, ':'))
 	{
-		// optional width and height
-		value = tissuestack::utils::Misc::findUnorderedMapEntryWithUpperCaseStringKey(request_parameters, "width");
-		if (!value.empty())
-		{
-			try
-			{
-				this->_width = strtoul(value.c_str(), NULL, 10);
-			} catch (...)
-			{
-				THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException, "Optional Parameter 'width' is not a valid positive integer!");
-			}
-		}
-		value = tissuestack::utils::Misc::findUnorderedMapEntryWithUpperCaseStringKey(request_parameters, "height");
-		if (!value.empty())
-		{
-			try
-			{
-				this->_height = strtoul(value.c_str(), NULL, 10);
-			} catch (...)
-			{
-				THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException, "Optional Parameter 'height' is not a valid positive integer!");
-			}
-		}
+		char * end = nullptr;
+		const float opacity = strtof(token.c_str(), &end);
+		if (end == token.c_str() || *end != '\0' || !(opacity >= 0 && opacity <= 1))
+			THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
+				"Optional Parameter 'opacity' has to be a number between 0 and 1!");
+		this->_layer_opacities.push_back(opacity);
 	}
 
-	// we have passed all preliminary checks => assign us the new type
-	this->setType(tissuestack::common::Request::Type::TS_IMAGE);
+	value = tissuestack::utils::Misc::findUnorderedMapEntryWithUpperCaseStringKey(request_parameters, "label_mode");
+	std::transform(value.begin(), value.end(), value.begin(), toupper);
+	if (value.compare("OUTLINE") == 0)
+		this->_label_mode = LabelMode::OUTLINE;
+	else if (value.compare("HIGHLIGHT") == 0)
+		this->_label_mode = LabelMode::HIGHLIGHT;
+	else if (!value.empty())
+		THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
+			"Optional Parameter 'label_mode' can only be 'outline' or 'highlight'!");
+
+	this->_selected_label = tissuestack::utils::Misc::findUnorderedMapEntryWithUpperCaseStringKey(request_parameters, "label");
+	if (this->_label_mode == LabelMode::HIGHLIGHT && this->_selected_label.empty())
+		THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
+			"Parameter 'label' is mandatory for label_mode 'highlight'!");
 }
 
 tissuestack::networking::TissueStackImageRequest::TissueStackImageRequest(
@@ -283,6 +332,68 @@ const std::vector<std::string> tissuestack::networking::TissueStackImageRequest:
 	return this->_datasets;
 }
 
+const unsigned short tissuestack::networking::TissueStackImageRequest::getNumberOfLayers() const
+{
+	return static_cast<unsigned short>(this->_datasets.size());
+}
+
+const std::string tissuestack::networking::TissueStackImageRequest::getLayerColorMapName(const unsigned short layer) const
+{
+	// layers without an entry of their own take the last one given
+	if (this->_layer_color_map_names.empty())
+		return this->_color_map_name;
+
+	return this->_layer_color_map_names[std::min(
+		static_cast<unsigned long>(layer), static_cast<unsigned long>(this->_layer_color_map_names.size() - 1))];
+}
+
+const unsigned short tissuestack::networking::TissueStackImageRequest::getLayerContrastMinimum(const unsigned short layer) const
+{
+	if (this->_layer_contrast_minima.empty())
+		return this->_contrast_min;
+
+	return this->_layer_contrast_minima[std::min(
+		static_cast<unsigned long>(layer), static_cast<unsigned long>(this->_layer_contrast_minima.size() - 1))];
+}
+
+const unsigned short tissuestack::networking::TissueStackImageRequest::getLayerContrastMaximum(const unsigned short layer) const
+{
+	if (this->_layer_contrast_maxima.empty())
+		return this->_contrast_max;
+
+	return this->_layer_contrast_maxima[std::min(
+		static_cast<unsigned long>(layer), static_cast<unsigned long>(this->_layer_contrast_maxima.size() - 1))];
+}
+
+const float tissuestack::networking::TissueStackImageRequest::getLayerOpacity(const unsigned short layer) const
+{
+	if (this->_layer_opacities.empty())
+		return 1.0;
+
+	return this->_layer_opacities[std::min(
+		static_cast<unsigned long>(layer), static_cast<unsigned long>(this->_layer_opacities.size() - 1))];
+}
+
+const tissuestack::networking::TissueStackImageRequest::LabelMode tissuestack::networking::TissueStackImageRequest::getLabelMode() const
+{
+	return this->_label_mode;
+}
+
+const std::string tissuestack::networking::TissueStackImageRequest::getLabelModeName() const
+{
+	if (this->_label_mode == LabelMode::OUTLINE)
+		return std::string("outline");
+	if (this->_label_mode == LabelMode::HIGHLIGHT)
+		return std::string("highlight");
+
+	return std::string("");
+}
+
+const std::string tissuestack::networking::TissueStackImageRequest::getSelectedLabel() const
+{
+	return this->_selected_label;
+}
+
 const std::string tissuestack::networking::TissueStackImageRequest::getDimensionName() const
 {
 	return this->_dimension_name;
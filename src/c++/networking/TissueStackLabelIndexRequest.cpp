@@ -0,0 +1,58 @@
+/*
+ * This file is part of TissueStack.
+ *
+ * TissueStack is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TissueStack is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TissueStack.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "networking.h"
+
+const std::string tissuestack::networking::TissueStackLabelIndexRequest::SERVICE = "LABELS";
+
+tissuestack::networking::TissueStackLabelIndexRequest::TissueStackLabelIndexRequest(
+		std::unordered_map<std::string, std::string> & request_parameters)
+{
+	this->setTimeStampInfoFromRequestParameters(request_parameters);
+	this->setDataSetFromRequestParameters(request_parameters);
+
+	this->_label = tissuestack::utils::Misc::findUnorderedMapEntryWithUpperCaseStringKey(request_parameters, "label");
+
+	// a slice is optional but then needs both its dimension and number
+	if (!tissuestack::utils::Misc::findUnorderedMapEntryWithUpperCaseStringKey(request_parameters, "dimension").empty() ||
+			!tissuestack::utils::Misc::findUnorderedMapEntryWithUpperCaseStringKey(request_parameters, "slice").empty())
+	{
+		if (this->_label.empty())
+			THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
+				"Optional Parameters 'dimension' and 'slice' need a 'label' to measure!");
+		this->setDimensionFromRequestParameters(request_parameters);
+		this->setSliceFromRequestParameters(request_parameters);
+		this->_has_slice = true;
+	}
+
+	// we have passed all preliminary checks => assign us the new type
+	this->setType(tissuestack::common::Request::Type::TS_LABELS);
+}
+
+const std::string tissuestack::networking::TissueStackLabelIndexRequest::getContent() const
+{
+	return std::string("TS_LABELS");
+}
+
+const std::string tissuestack::networking::TissueStackLabelIndexRequest::getLabel() const
+{
+	return this->_label;
+}
+
+const bool tissuestack::networking::TissueStackLabelIndexRequest::hasSlice() const
+{
+	return this->_has_slice;
+}
@@ -0,0 +1,124 @@
+/*
+ * This file is part of TissueStack.
+ *
+ * TissueStack is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TissueStack is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TissueStack.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "networking.h"
+
+const std::string tissuestack::networking::TissueStackObliqueRequest::SERVICE = "OBLIQUE";
+
+tissuestack::networking::TissueStackObliqueRequest::TissueStackObliqueRequest(
+		std::unordered_map<std::string, std::string> & request_parameters)
+{
+	this->setTimeStampInfoFromRequestParameters(request_parameters);
+	this->setDataSetFromRequestParameters(request_parameters);
+	this->setRenderingFromRequestParameters(request_parameters);
+
+	this->_origin = this->parseVector(request_parameters, "origin");
+	this->_column_direction = this->parseVector(request_parameters, "u");
+	this->_row_direction = this->parseVector(request_parameters, "v");
+	this->_plane_width = this->parseLength(request_parameters, "width");
+	this->_plane_height = this->parseLength(request_parameters, "height");
+
+	// the directions have to span a plane
+	const std::array<float, 3> & u = this->_column_direction;
+	const std::array<float, 3> & v = this->_row_direction;
+	const float normal =
+		fabs(u[1] * v[2] - u[2] * v[1]) + fabs(u[2] * v[0] - u[0] * v[2]) + fabs(u[0] * v[1] - u[1] * v[0]);
+	if (normal < 1e-6)
+		THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
+			"Parameters 'u' and 'v' must not be parallel!");
+
+	std::string value = tissuestack::utils::Misc::findUnorderedMapEntryWithUpperCaseStringKey(request_parameters, "interpolation");
+	std::transform(value.begin(), value.end(), value.begin(), tolower);
+	if (value.compare("nearest") == 0)
+		this->_is_trilinear = false;
+	else if (!value.empty() && value.compare("linear") != 0)
+		THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
+			"Optional Parameter 'interpolation' can only be 'nearest' or 'linear'!");
+
+	// we have passed all preliminary checks => assign us the new type
+	this->setType(tissuestack::common::Request::Type::TS_OBLIQUE);
+}
+
+inline const std::array<float, 3> tissuestack::networking::TissueStackObliqueRequest::parseVector(
+	const std::unordered_map<std::string, std::string> & request_parameters,
+	const std::string & name) const
+{
+	const std::string value = tissuestack::utils::Misc::findUnorderedMapEntryWithUpperCaseStringKey(request_parameters, name);
+	const std::vector<std::string> tokens = tissuestack::utils::Misc::tokenizeString(value, ':');
+	if (tokens.size() != 3)
+		THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
+			"Mandatory parameters 'origin', 'u' and 'v' have to be 3 numbers separated by ':'!");
+
+	std::array<float, 3> vector;
+	for (unsigned short i=0;i<3;i++)
+	{
+		char * end = nullptr;
+		vector[i] = strtof(tokens[i].c_str(), &end);
+		if (end == tokens[i].c_str() || *end != '\0' || !std::isfinite(vector[i]))
+			THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
+				"Mandatory parameters 'origin', 'u' and 'v' have to be 3 numbers separated by ':'!");
+	}
+
+	return vector;
+}
+
+inline const unsigned int tissuestack::networking::TissueStackObliqueRequest::parseLength(
+	const std::unordered_map<std::string, std::string> & request_parameters,
+	const std::string & name) const
+{
+	const std::string value = tissuestack::utils::Misc::findUnorderedMapEntryWithUpperCaseStringKey(request_parameters, name);
+	const unsigned long length = value.empty() ? 0 : strtoul(value.c_str(), NULL, 10);
+	if (length == 0 || length > tissuestack::networking::TissueStackObliqueRequest::MAXIMUM_PLANE_LENGTH)
+		THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
+			"Mandatory parameters 'width' and 'height' have to be positive integers no bigger than 2048!");
+
+	return static_cast<unsigned int>(length);
+}
+
+const std::string tissuestack::networking::TissueStackObliqueRequest::getContent() const
+{
+	return std::string("TS_OBLIQUE");
+}
+
+const std::array<float, 3> tissuestack::networking::TissueStackObliqueRequest::getOrigin() const
+{
+	return this->_origin;
+}
+
+const std::array<float, 3> tissuestack::networking::TissueStackObliqueRequest::getColumnDirection() const
+{
+	return this->_column_direction;
+}
+
+const std::array<float, 3> tissuestack::networking::TissueStackObliqueRequest::getRowDirection() const
+{
+	return this->_row_direction;
+}
+
+const unsigned int tissuestack::networking::TissueStackObliqueRequest::getPlaneWidth() const
+{
+	return this->_plane_width;
+}
+
+const unsigned int tissuestack::networking::TissueStackObliqueRequest::getPlaneHeight() const
+{
+	return this->_plane_height;
+}
+
+const bool tissuestack::networking::TissueStackObliqueRequest::isTrilinear() const
+{
+	return this->_is_trilinear;
+}
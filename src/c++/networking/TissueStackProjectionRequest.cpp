@@ -0,0 +1,78 @@
+/*
+ * This file is part of TissueStack.
+ *
+ * TissueStack is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TissueStack is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TissueStack.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "networking.h"
+
+const std::string tissuestack::networking::TissueStackProjectionRequest::SERVICE = "PROJECTION";
+
+tissuestack::networking::TissueStackProjectionRequest::TissueStackProjectionRequest(
+		std::unordered_map<std::string, std::string> & request_parameters) :
+			TissueStackImageRequest(
+				request_parameters,
+				tissuestack::utils::Misc::findUnorderedMapEntryWithUpperCaseStringKey(request_parameters, "x").empty())
+{
+	std::string value = tissuestack::utils::Misc::findUnorderedMapEntryWithUpperCaseStringKey(request_parameters, "to");
+	if (!value.empty())
+	{
+		char * end = nullptr;
+		const unsigned long last = strtoul(value.c_str(), &end, 10);
+		if (end == value.c_str() || *end != '\0' || last > UINT_MAX - 1)
+			THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
+				"Optional Parameter 'to' is not a valid positive integer!");
+		this->_last_slice_number = static_cast<unsigned int>(last);
+		if (this->_last_slice_number < this->getSliceNumber())
+			THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
+				"Optional Parameter 'to' must not be smaller than 'slice'!");
+	}
+
+	value = tissuestack::utils::Misc::findUnorderedMapEntryWithUpperCaseStringKey(request_parameters, "projection");
+	std::transform(value.begin(), value.end(), value.begin(), tolower);
+	if (value.compare("min") == 0)
+		this->_projection = Projection::MINIMUM;
+	else if (value.compare("mean") == 0)
+		this->_projection = Projection::MEAN;
+	else if (!value.empty() && value.compare("max") != 0)
+		THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
+			"Optional Parameter 'projection' can only be 'max', 'min' or 'mean'!");
+
+	// we have passed all preliminary checks => assign us the new type
+	this->setType(tissuestack::common::Request::Type::TS_PROJECTION);
+}
+
+const std::string tissuestack::networking::TissueStackProjectionRequest::getContent() const
+{
+	return std::string("TS_PROJECTION");
+}
+
+const unsigned int tissuestack::networking::TissueStackProjectionRequest::getLastSliceNumber() const
+{
+	return this->_last_slice_number;
+}
+
+const tissuestack::networking::TissueStackProjectionRequest::Projection tissuestack::networking::TissueStackProjectionRequest::getProjection() const
+{
+	return this->_projection;
+}
+
+const std::string tissuestack::networking::TissueStackProjectionRequest::getProjectionName() const
+{
+	if (this->_projection == Projection::MINIMUM)
+		return std::string("min");
+	if (this->_projection == Projection::MEAN)
+		return std::string("mean");
+
+	return std::string("max");
+}
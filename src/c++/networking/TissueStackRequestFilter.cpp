@@ -61,6 +61,16 @@ const tissuestack::common::Request * const tissuestack::networking::TissueStackR
 		return_request = new tissuestack::networking::TissueStackImageRequest(parameters, true);
 	else if (tissuestack::networking::TissueStackQueryRequest::SERVICE.compare(service) == 0)
 		return_request = new tissuestack::networking::TissueStackQueryRequest(parameters);
+	else if (tissuestack::networking::TissueStackBatchQueryRequest::SERVICE.compare(service) == 0)
+		return_request = new tissuestack::networking::TissueStackBatchQueryRequest(parameters);
+	else if (tissuestack::networking::TissueStackObliqueRequest::SERVICE.compare(service) == 0)
+		return_request = new tissuestack::networking::TissueStackObliqueRequest(parameters);
+	else if (tissuestack::networking::TissueStackProjectionRequest::SERVICE.compare(service) == 0)
+		return_request = new tissuestack::networking::TissueStackProjectionRequest(parameters);
+	else if (tissuestack::networking::TissueStackStatisticsRequest::SERVICE.compare(service) == 0)
+		return_request = new tissuestack::networking::TissueStackStatisticsRequest(parameters);
+	else if (tissuestack::networking::TissueStackLabelIndexRequest::SERVICE.compare(service) == 0)
+		return_request = new tissuestack::networking::TissueStackLabelIndexRequest(parameters);
 	else if (tissuestack::networking::TissueStackServicesRequest::SERVICE.compare(service) == 0)
 	{
 		return_request =
@@ -75,7 +85,7 @@ const tissuestack::common::Request * const tissuestack::networking::TissueStackR
 
 	if (return_request == nullptr)
 		THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
-						"A TissueStack request has to be: 'IMAGE', 'IMAGE_PREVIEW, 'QUERY', 'TILING','CONVERSION', 'SERVICES' or VERSION!");
+						"A TissueStack request has to be: 'IMAGE', 'IMAGE_PREVIEW, 'QUERY', 'QUERY_BATCH', 'OBLIQUE', 'PROJECTION', 'STATISTICS', 'LABELS', 'TILING','CONVERSION', 'SERVICES' or VERSION!");
 
 	// a general isObsolete check. for most but not all requests that equates to a superseded timestamp check
 	// for conversion/tiling, this can be used to catch duplicate conversion/tiling requests
@@ -0,0 +1,127 @@
+/*
+ * This file is part of TissueStack.
+ *
+ * TissueStack is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TissueStack is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TissueStack.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "networking.h"
+
+const std::string tissuestack::networking::TissueStackStatisticsRequest::SERVICE = "STATISTICS";
+
+tissuestack::networking::TissueStackStatisticsRequest::TissueStackStatisticsRequest(
+		std::unordered_map<std::string, std::string> & request_parameters)
+{
+	this->setTimeStampInfoFromRequestParameters(request_parameters);
+	this->setDataSetFromRequestParameters(request_parameters);
+	this->setDimensionFromRequestParameters(request_parameters);
+	this->setSliceFromRequestParameters(request_parameters);
+
+	this->_last_slice_number = this->getSliceNumber();
+	std::string value = tissuestack::utils::Misc::findUnorderedMapEntryWithUpperCaseStringKey(request_parameters, "to");
+	if (!value.empty())
+	{
+		this->_last_slice_number = this->parseNumber(value);
+		if (this->_last_slice_number < this->getSliceNumber())
+			THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
+				"Optional Parameter 'to' must not be smaller than 'slice'!");
+	}
+
+	const std::string rectangle =
+		tissuestack::utils::Misc::findUnorderedMapEntryWithUpperCaseStringKey(request_parameters, "rectangle");
+	const std::string polygon =
+		tissuestack::utils::Misc::findUnorderedMapEntryWithUpperCaseStringKey(request_parameters, "polygon");
+	if (!rectangle.empty() && !polygon.empty())
+		THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
+			"Parameters 'rectangle' and 'polygon' are mutually exclusive!");
+
+	if (!rectangle.empty())
+	{
+		const std::vector<std::string> tokens = tissuestack::utils::Misc::tokenizeString(rectangle, ':');
+		if (tokens.size() != 4)
+			THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
+				"Parameter 'rectangle' has to be given as 'x:y:width:height'!");
+
+		const unsigned int x = this->parseNumber(tokens[0]);
+		const unsigned int y = this->parseNumber(tokens[1]);
+		const unsigned int width = this->parseNumber(tokens[2]);
+		const unsigned int height = this->parseNumber(tokens[3]);
+		if (width == 0 || height == 0 || x > UINT_MAX - width || y > UINT_MAX - height)
+			THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
+				"Parameter 'rectangle' has to have a positive width and height!");
+
+		// a rectangle is just another polygon
+		this->_polygon = { {{x, y}}, {{x + width, y}}, {{x + width, y + height}}, {{x, y + height}} };
+	} else if (!polygon.empty())
+	{
+		for (auto vertex : tissuestack::utils::Misc::tokenizeString(polygon, ','))
+		{
+			const std::vector<std::string> coordinates = tissuestack::utils::Misc::tokenizeString(vertex, ':');
+			if (coordinates.size() != 2)
+				THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
+					"Polygon vertices have to be given as 'x:y'!");
+			this->_polygon.push_back({{ this->parseNumber(coordinates[0]), this->parseNumber(coordinates[1]) }});
+
+			if (this->_polygon.size() > tissuestack::networking::TissueStackStatisticsRequest::MAXIMUM_NUMBER_OF_POLYGON_VERTICES)
+				THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
+					"A polygon must not exceed 1024 vertices!");
+		}
+		if (this->_polygon.size() < 3)
+			THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
+				"A polygon needs at least 3 vertices!");
+	}
+
+	value = tissuestack::utils::Misc::findUnorderedMapEntryWithUpperCaseStringKey(request_parameters, "bins");
+	if (!value.empty())
+	{
+		const unsigned int bins = this->parseNumber(value);
+		if (bins == 0 || bins > 256)
+			THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
+				"Optional Parameter 'bins' has to range in between 1 and 256!");
+		this->_number_of_bins = static_cast<unsigned short>(bins);
+	}
+
+	// we have passed all preliminary checks => assign us the new type
+	this->setType(tissuestack::common::Request::Type::TS_STATISTICS);
+}
+
+inline const unsigned int tissuestack::networking::TissueStackStatisticsRequest::parseNumber(
+	const std::string & value) const
+{
+	char * end = nullptr;
+	const unsigned long number = strtoul(value.c_str(), &end, 10);
+	if (end == value.c_str() || *end != '\0' || number > UINT_MAX - 1)
+		THROW_TS_EXCEPTION(tissuestack::common::TissueStackInvalidRequestException,
+			"Statistics parameters have to be positive integers!");
+
+	return static_cast<unsigned int>(number);
+}
+
+const std::string tissuestack::networking::TissueStackStatisticsRequest::getContent() const
+{
+	return std::string("TS_STATISTICS");
+}
+
+const unsigned int tissuestack::networking::TissueStackStatisticsRequest::getLastSliceNumber() const
+{
+	return this->_last_slice_number;
+}
+
+const std::vector<std::array<unsigned int, 2> > & tissuestack::networking::TissueStackStatisticsRequest::getPolygon() const
+{
+	return this->_polygon;
+}
+
+const unsigned short tissuestack::networking::TissueStackStatisticsRequest::getNumberOfBins() const
+{
+	return this->_number_of_bins;
+}
@@ -77,6 +77,14 @@ namespace tissuestack
     class TissueStackImageRequest : public tissuestack::common::Request
     {
 		public:
+    		// label data sets (the ones with a label lookup) can be drawn as the outlines of their labels or as the
+    		// mask of the 'label' given by name. with 'outline' a given label restricts the outlines to that one
+    		enum class LabelMode
+    		{
+    			NONE,
+    			OUTLINE,
+    			HIGHLIGHT
+    		};
     		static const std::string SERVICE1;
     		static const std::string SERVICE2;
 			TissueStackImageRequest & operator=(const TissueStackImageRequest&) = delete;
@@ -102,6 +110,15 @@ namespace tissuestack
 			const bool showOnlyPortionOfImage() const;
 			const bool isPreview() const;
 			const bool hasExpired() const;
+			// overlays: one layer per data set, drawn in the given order
+			const unsigned short getNumberOfLayers() const;
+			const std::string getLayerColorMapName(const unsigned short layer) const;
+			const unsigned short getLayerContrastMinimum(const unsigned short layer) const;
+			const unsigned short getLayerContrastMaximum(const unsigned short layer) const;
+			const float getLayerOpacity(const unsigned short layer) const;
+			const LabelMode getLabelMode() const;
+			const std::string getLabelModeName() const;
+			const std::string getSelectedLabel() const;
 		protected:
 			TissueStackImageRequest();
 			void setDataSetFromRequestParameters(const std::unordered_map<std::string, std::string> & request_parameters);
@@ -109,6 +126,7 @@ namespace tissuestack
 			void setDimensionFromRequestParameters(const std::unordered_map<std::string, std::string> & request_parameters);
 			void setSliceFromRequestParameters(const std::unordered_map<std::string, std::string> & request_parameters);
 			void setCoordinatesFromRequestParameters(const std::unordered_map<std::string, std::string> & request_parameters, const bool is_preview = false);
+			void setRenderingFromRequestParameters(const std::unordered_map<std::string, std::string> & request_parameters);
 		private:
 			void setImageRequestMembersFromRequestParameters(const std::unordered_map<std::string, std::string> & request_parameters);
 			bool _is_preview = false;
@@ -126,6 +144,12 @@ namespace tissuestack
 			std::string _output_image_format = "PNG";
 			unsigned short _contrast_min = 0;
 			unsigned short _contrast_max = 255;
+			std::vector<std::string> _layer_color_map_names;
+			std::vector<unsigned short> _layer_contrast_minima;
+			std::vector<unsigned short> _layer_contrast_maxima;
+			std::vector<float> _layer_opacities;
+			LabelMode _label_mode = LabelMode::NONE;
+			std::string _selected_label = "";
 			unsigned long long int _request_id = 0;
 			unsigned long long int _request_timestamp = 0;
     };
@@ -140,6 +164,127 @@ namespace tissuestack
 			const std::string getContent() const;
     };
 
+    // the values of many voxels of a dimension's slices in one go: either a list of points 'x:y:slice' (comma separated)
+    // or a polyline through such points which is sampled voxel by voxel, e.g. dimension=z&polyline=10:10:5,100:40:5
+    // format=binary answers with 3 bytes (red, green, blue) per point, the data sets one after the other
+    class TissueStackBatchQueryRequest final : public TissueStackImageRequest
+    {
+		public:
+    		static const std::string SERVICE;
+    		static const unsigned int MAXIMUM_NUMBER_OF_POINTS = 65536;
+    		TissueStackBatchQueryRequest & operator=(const TissueStackBatchQueryRequest&) = delete;
+    		TissueStackBatchQueryRequest(const TissueStackBatchQueryRequest&) = delete;
+			explicit TissueStackBatchQueryRequest(std::unordered_map<std::string, std::string> & request_parameters);
+			const std::string getContent() const;
+			// x, y, slice
+			const std::vector<std::array<unsigned int, 3> > & getPoints() const;
+			const bool isBinary() const;
+		private:
+			inline const std::vector<std::array<unsigned int, 3> > parsePoints(const std::string & value) const;
+			void samplePolyline(const std::vector<std::array<unsigned int, 3> > & vertices);
+			std::vector<std::array<unsigned int, 3> > _points;
+			bool _is_binary = false;
+    };
+
+    // an arbitrary plane through the volume: the origin and the steps per output column and row are given in voxels
+    // (i along x, j along y, k along z, i.e. column, row and slice of the z plane), e.g. origin=0:0:10&u=1:0:0.5&v=0:1:0
+    // contrast, color map and image format are those of an image request
+    class TissueStackObliqueRequest final : public TissueStackImageRequest
+    {
+		public:
+    		static const std::string SERVICE;
+    		static const unsigned int MAXIMUM_PLANE_LENGTH = 2048;
+    		TissueStackObliqueRequest & operator=(const TissueStackObliqueRequest&) = delete;
+    		TissueStackObliqueRequest(const TissueStackObliqueRequest&) = delete;
+			explicit TissueStackObliqueRequest(std::unordered_map<std::string, std::string> & request_parameters);
+			const std::string getContent() const;
+			const std::array<float, 3> getOrigin() const;
+			const std::array<float, 3> getColumnDirection() const;
+			const std::array<float, 3> getRowDirection() const;
+			const unsigned int getPlaneWidth() const;
+			const unsigned int getPlaneHeight() const;
+			const bool isTrilinear() const;
+		private:
+			inline const std::array<float, 3> parseVector(
+				const std::unordered_map<std::string, std::string> & request_parameters,
+				const std::string & name) const;
+			inline const unsigned int parseLength(
+				const std::unordered_map<std::string, std::string> & request_parameters,
+				const std::string & name) const;
+			std::array<float, 3> _origin;
+			std::array<float, 3> _column_direction;
+			std::array<float, 3> _row_direction;
+			unsigned int _plane_width = 0;
+			unsigned int _plane_height = 0;
+			bool _is_trilinear = true;
+    };
+
+    // a maximum, minimum or mean intensity projection through the slices 'slice' to 'to' (default: the last) of a dimension,
+    // rendered like a preview or, if 'x' and 'y' are given, like a tile, e.g. dimension=z&slice=10&to=60&projection=max
+    class TissueStackProjectionRequest final : public TissueStackImageRequest
+    {
+		public:
+    		enum class Projection
+    		{
+    			MAXIMUM,
+    			MINIMUM,
+    			MEAN
+    		};
+    		static const std::string SERVICE;
+    		TissueStackProjectionRequest & operator=(const TissueStackProjectionRequest&) = delete;
+    		TissueStackProjectionRequest(const TissueStackProjectionRequest&) = delete;
+			explicit TissueStackProjectionRequest(std::unordered_map<std::string, std::string> & request_parameters);
+			const std::string getContent() const;
+			const unsigned int getLastSliceNumber() const;
+			const Projection getProjection() const;
+			const std::string getProjectionName() const;
+		private:
+			unsigned int _last_slice_number = UINT_MAX;
+			Projection _projection = Projection::MAXIMUM;
+    };
+
+    // count, minimum, maximum, mean, standard deviation and histogram of the voxels within a region of the slices
+    // 'slice' to 'to' (default: just 'slice'). The region is a rectangle 'x:y:width:height', a polygon 'x:y,x:y,...'
+    // (voxels whose centers lie inside) or, if neither is given, the whole slice, e.g. dimension=z&slice=3&rectangle=10:10:50:20
+    // whole slices come from the statistics sidecar of the raw if it has one, together with the box around the non zero voxels
+    class TissueStackStatisticsRequest final : public TissueStackImageRequest
+    {
+		public:
+    		static const std::string SERVICE;
+    		static const unsigned int MAXIMUM_NUMBER_OF_POLYGON_VERTICES = 1024;
+    		TissueStackStatisticsRequest & operator=(const TissueStackStatisticsRequest&) = delete;
+    		TissueStackStatisticsRequest(const TissueStackStatisticsRequest&) = delete;
+			explicit TissueStackStatisticsRequest(std::unordered_map<std::string, std::string> & request_parameters);
+			const std::string getContent() const;
+			const unsigned int getLastSliceNumber() const;
+			// the region's outline in voxel corner coordinates, empty for the whole slice
+			const std::vector<std::array<unsigned int, 2> > & getPolygon() const;
+			const unsigned short getNumberOfBins() const;
+		private:
+			inline const unsigned int parseNumber(const std::string & value) const;
+			unsigned int _last_slice_number = 0;
+			std::vector<std::array<unsigned int, 2> > _polygon;
+			unsigned short _number_of_bins = 256;
+    };
+
+    // where the labels of a label data set are, answered from its label index: every label's voxel count, bounds and
+    // centroid or, given a 'label' by name, that one's together with the slices of each dimension that contain it.
+    // with 'dimension' and 'slice' that label is also measured on the slice, e.g. dataset=...&label=Cortex&dimension=z&slice=30
+    class TissueStackLabelIndexRequest final : public TissueStackImageRequest
+    {
+		public:
+    		static const std::string SERVICE;
+    		TissueStackLabelIndexRequest & operator=(const TissueStackLabelIndexRequest&) = delete;
+    		TissueStackLabelIndexRequest(const TissueStackLabelIndexRequest&) = delete;
+			explicit TissueStackLabelIndexRequest(std::unordered_map<std::string, std::string> & request_parameters);
+			const std::string getContent() const;
+			const std::string getLabel() const;
+			const bool hasSlice() const;
+		private:
+			std::string _label = "";
+			bool _has_slice = false;
+    };
+
     class TissueStackPreTilingRequest final : public tissuestack::common::Request
     {
 		public:
@@ -29,6 +29,8 @@ tissuestack::services::TissueStackAdminService::TissueStackAdminService() {
 		std::vector<std::string>{ "FILE"});
 	this->addMandatoryParametersForRequest("PROGRESS",
 		std::vector<std::string>{ "TASK_ID"});
+	this->addMandatoryParametersForRequest("PINNED",
+		std::vector<std::string>{});
 	/* need session */
 	this->addMandatoryParametersForRequest("UPLOAD",
 		std::vector<std::string>{ "SESSION"});
@@ -46,6 +48,10 @@ tissuestack::services::TissueStackAdminService::TissueStackAdminService() {
 		std::vector<std::string>{ "SESSION", "FILE", "NEW_FILE"});
 	this->addMandatoryParametersForRequest("DELETE_DATASET",
 		std::vector<std::string>{ "SESSION", "ID"});
+	this->addMandatoryParametersForRequest("PIN",
+		std::vector<std::string>{ "SESSION", "ID"});
+	this->addMandatoryParametersForRequest("UNPIN",
+		std::vector<std::string>{ "SESSION", "ID"});
 };
 
 tissuestack::services::TissueStackAdminService::~TissueStackAdminService() {};
@@ -74,6 +80,8 @@ void tissuestack::services::TissueStackAdminService::streamResponse(
 		json = this->handleUploadProgressRequest(request);
 	else if (action.compare("PROGRESS") == 0)
 		json = this->handleProgressRequest(request);
+	else if (action.compare("PINNED") == 0)
+		json = this->handlePinnedDataSetsRequest(request);
 	else
 	{
 		// the following resources need a valid session
@@ -104,6 +112,10 @@ void tissuestack::services::TissueStackAdminService::streamResponse(
 			json = this->handleFileDeletionRequest(request);
 		else if (action.compare("FILE_RENAME") == 0)
 			json = this->handleFileRenameRequest(request);
+		else if (action.compare("PIN") == 0)
+			json = this->handlePinRequest(request);
+		else if (action.compare("UNPIN") == 0)
+			json = this->handleUnpinRequest(request);
 	}
 
 	const std::string response =
@@ -137,6 +149,47 @@ const std::string tissuestack::services::TissueStackAdminService::handleDataSetD
 	return std::string("{\"response\": {\"result\": \"dataset deleted\"}}");
 }
 
+const std::string tissuestack::services::TissueStackAdminService::handlePinnedDataSetsRequest(
+	const tissuestack::networking::TissueStackServicesRequest * request) const
+{
+	return std::string("{\"response\": ") +
+		tissuestack::imaging::TissueStackDataSetStore::instance()->getPinnedDataSetsAsJson() + "}";
+}
+
+const std::string tissuestack::services::TissueStackAdminService::handlePinRequest(
+	const tissuestack::networking::TissueStackServicesRequest * request) const
+{
+	const unsigned long long int id =
+		strtoull(request->getRequestParameter("ID", true).c_str(), NULL, 10);
+
+	const tissuestack::imaging::TissueStackDataSet * dataSet =
+			tissuestack::imaging::TissueStackDataSetStore::instance()->findDataSetByDataBaseId(id);
+	if (dataSet == nullptr)
+		return std::string("{\"response\": {\"result\": \"given dataset (id) does not exist!\"}}");
+
+	if (!tissuestack::imaging::TissueStackDataSetStore::instance()->pinDataSet(dataSet->getDataSetId(), true))
+		THROW_TS_EXCEPTION(tissuestack::common::TissueStackApplicationException,
+			"Failed to pin data set: it has to be a raw file and fit into memory!");
+
+	return std::string("{\"response\": {\"result\": \"dataset pinned\"}}");
+}
+
+const std::string tissuestack::services::TissueStackAdminService::handleUnpinRequest(
+	const tissuestack::networking::TissueStackServicesRequest * request) const
+{
+	const unsigned long long int id =
+		strtoull(request->getRequestParameter("ID", true).c_str(), NULL, 10);
+
+	const tissuestack::imaging::TissueStackDataSet * dataSet =
+			tissuestack::imaging::TissueStackDataSetStore::instance()->findDataSetByDataBaseId(id);
+	if (dataSet == nullptr)
+		return std::string("{\"response\": {\"result\": \"given dataset (id) does not exist!\"}}");
+
+	tissuestack::imaging::TissueStackDataSetStore::instance()->unpinDataSet(dataSet->getDataSetId(), true);
+
+	return std::string("{\"response\": {\"result\": \"dataset unpinned\"}}");
+}
+
 const std::string tissuestack::services::TissueStackAdminService::handleSetTilingRequest(
 	const tissuestack::networking::TissueStackServicesRequest * request) const
 {
@@ -70,6 +70,83 @@ void handle_signals(int sig) {
 	}
 };
 
+// downsampled levels for zoomed out views are written next to the raw file
+const bool build_pyramid(const std::string & raw_file, const std::string & filter)
+{
+	if (filter.empty())
+		return true;
+
+	try
+	{
+		std::unique_ptr<const tissuestack::imaging::TissueStackImageData> raw(
+			tissuestack::imaging::TissueStackImageData::fromFile(raw_file));
+		if (!raw || !raw->isRaw())
+		{
+			std::cerr << "Failed to build pyramid: " << raw_file << " is not a RAW file!" << std::endl;
+			return false;
+		}
+
+		std::cout << "Building pyramid levels for " << raw_file << "..." << std::endl;
+		tissuestack::imaging::TissueStackRawPyramid::build(
+			static_cast<const tissuestack::imaging::TissueStackRawData *>(raw.get()),
+			filter.compare("nearest") != 0);
+		std::cout << "Pyramid finished." << std::endl;
+	} catch (const std::exception & any)
+	{
+		std::cerr << "Failed to build pyramid: " << any.what() << std::endl;
+		return false;
+	}
+
+	return true;
+};
+
+// per slice histograms and non zero bounds are written next to the raw file, after anything that rewrites the raw
+const bool build_statistics(const std::string & raw_file)
+{
+	try
+	{
+		std::unique_ptr<const tissuestack::imaging::TissueStackImageData> raw(
+			tissuestack::imaging::TissueStackImageData::fromFile(raw_file));
+		if (!raw || !raw->isRaw())
+		{
+			std::cerr << "Failed to compute statistics: " << raw_file << " is not a RAW file!" << std::endl;
+			return false;
+		}
+
+		std::cout << "Computing slice statistics for " << raw_file << "..." << std::endl;
+		tissuestack::imaging::TissueStackRawStatistics::build(
+			static_cast<const tissuestack::imaging::TissueStackRawData *>(raw.get()));
+		std::cout << "Statistics finished." << std::endl;
+	} catch (const std::exception & any)
+	{
+		std::cerr << "Failed to compute statistics: " << any.what() << std::endl;
+		return false;
+	}
+
+	return true;
+};
+
+// a single copy of the volume in bricks (compressed one by one if a codec is given) replaces the three planes
+const bool build_bricks(
+	const std::string & raw_file,
+	const unsigned short brick_edge,
+	const tissuestack::imaging::RAW_CODEC codec)
+{
+	if (brick_edge == 0)
+		return true;
+
+	std::cout << "Rewriting " << raw_file << " in bricks of " << brick_edge << "^3" <<
+		(codec == tissuestack::imaging::RAW_CODEC::UNCOMPRESSED ? "" : " (compressed)") << "..." << std::endl;
+	if (!tissuestack::imaging::RawConverter::convertToBricked(raw_file, brick_edge, codec))
+	{
+		std::cerr << "Failed to brick RAW: it has to be a RAW with x, y and z (and a codec that was built in)!" << std::endl;
+		return false;
+	}
+	std::cout << "Bricking finished." << std::endl;
+
+	return true;
+};
+
 void install_signal_handler()
 {
 	struct sigaction act;
@@ -91,6 +168,12 @@ int		main(int argc, char **argv)
 	parent = getpid();
 
 	std::string in_file = "";
+	std::string pyramid_filter = "";
+	bool pyramid_requested = false;
+	bool label_data = false;
+	bool statistics_only = false;
+	unsigned short brick_edge = 0;
+	tissuestack::imaging::RAW_CODEC codec = tissuestack::imaging::RAW_CODEC::UNCOMPRESSED;
 
 	int c = 0;
 	while (1)
@@ -98,11 +181,16 @@ int		main(int argc, char **argv)
 		static struct option long_options[] = {
 			{"in",  required_argument, 0, 'i'},
 			{"out", required_argument, 0, 'o'},
+			{"pyramid", optional_argument, 0, 'p'},
+			{"bricks", optional_argument, 0, 'b'},
+			{"compress", optional_argument, 0, 'z'},
+			{"statistics", no_argument, 0, 's'},
+			{"labels", no_argument, 0, 'l'},
 			{0, 0, 0, 0}
 		};
 
 		int option_index = 0;
-		c = getopt_long (argc, argv, "i:o:", long_options, &option_index);
+		c = getopt_long (argc, argv, "i:o:p::b::z::sl", long_options, &option_index);
 		if (c == -1)
 			break;
 
@@ -121,22 +209,90 @@ int		main(int argc, char **argv)
 				out_file = tmp;
 				break;
 
+			case 'p':
+				pyramid_requested = true;
+				pyramid_filter = tmp;
+				if (!pyramid_filter.empty() && pyramid_filter.compare("avg") != 0 && pyramid_filter.compare("nearest") != 0)
+				{
+					std::cerr << "Pyramid filter has to be either 'avg' or 'nearest' (label data)!" << std::endl;
+					exit(-1);
+				}
+				break;
+
+			case 'b':
+				brick_edge =
+					tmp.empty() ?
+						tissuestack::imaging::RawConverter::DEFAULT_BRICK_EDGE :
+						static_cast<unsigned short>(atoi(tmp.c_str()));
+				if (brick_edge < 8 || brick_edge > 256)
+				{
+					std::cerr << "Brick edge has to be between 8 and 256!" << std::endl;
+					exit(-1);
+				}
+				break;
+
+			case 'z':
+				// lz4 inflates a lot faster than zlib and every tile inflates the bricks it touches: the default if built in
+				if (tmp.empty())
+#ifdef USE_LZ4
+					codec = tissuestack::imaging::RAW_CODEC::LZ4;
+#else
+					codec = tissuestack::imaging::RAW_CODEC::ZLIB;
+#endif
+				else if (tmp.compare("zlib") == 0)
+					codec = tissuestack::imaging::RAW_CODEC::ZLIB;
+				else if (tmp.compare("lz4") == 0)
+					codec = tissuestack::imaging::RAW_CODEC::LZ4;
+				else
+				{
+					std::cerr << "Codec has to be either 'zlib' or 'lz4'!" << std::endl;
+					exit(-1);
+				}
+				break;
+
+			case 's':
+				statistics_only = true;
+				break;
+
+			case 'l':
+				label_data = true;
+				break;
+
 			case '?':
 				exit (0);   /* getopt_long already printed an error message. */
 				break;
 
 			default:
 				std::cout << "Usage: " << argv[0] <<
-					" -i IN_FILE (*.mnc,*.nii,*.nii.gz, *.dcm, *.ima, *.zip) -o OUT_FILE (*.raw)\n";
+					" -i IN_FILE (*.mnc,*.nii,*.nii.gz, *.dcm, *.ima, *.zip) -o OUT_FILE (*.raw) [-p[avg|nearest]] [-l] [-b[EDGE]] [-z[zlib|lz4]]\n" <<
+					"       " << argv[0] << " -i RAW_FILE [-p[avg|nearest]] [-l] [-b[EDGE]] [-z[zlib|lz4]] [-s]\n";
 				exit(0);
 		}
 	}
 
+	// averaging label ids makes up ids (and colors) that exist nowhere in the data
+	if (pyramid_requested && pyramid_filter.empty())
+		pyramid_filter = label_data ? "nearest" : "avg";
+	if (label_data && pyramid_filter.compare("avg") == 0)
+	{
+		std::cerr << "Pyramid levels of label data (-l) have to be built with 'nearest'!" << std::endl;
+		exit(-1);
+	}
+
+	// compression works on bricks
+	if (codec != tissuestack::imaging::RAW_CODEC::UNCOMPRESSED && brick_edge == 0)
+		brick_edge = tissuestack::imaging::RawConverter::DEFAULT_BRICK_EDGE;
+
+	// an existing raw file only gets bricked and/or its pyramid (re)built, its statistics follow
+	if (!in_file.empty() && out_file.empty() && (!pyramid_filter.empty() || brick_edge != 0 || statistics_only))
+		exit(build_bricks(in_file, brick_edge, codec) && build_pyramid(in_file, pyramid_filter) &&
+				build_statistics(in_file) ? EXIT_SUCCESS : EXIT_FAILURE);
+
 	// check for mandatory params
 	if (in_file.empty() || out_file.empty())
 	{
 		std::cerr << "Usage: " << argv[0] <<
-			" -i IN_FILE (*.mnc,*.nii,*.nii.gz) -o OUT_FILE\n";
+			" -i IN_FILE (*.mnc,*.nii,*.nii.gz) -o OUT_FILE [-p[avg|nearest]] [-l] [-b[EDGE]] [-z[zlib|lz4]]\n";
 		exit(-1);
 	}
 
@@ -220,6 +376,10 @@ int		main(int argc, char **argv)
 				}
 			}
 			OfflineExecutor->convert(conversion, dimParam);
+			if (tissuestack::utils::System::fileExists(out_file) &&
+					(!build_bricks(out_file, brick_edge, codec) || !build_pyramid(out_file, pyramid_filter) ||
+						!build_statistics(out_file)))
+				exit(EXIT_FAILURE);
 			exit(EXIT_SUCCESS);
 		}
 
@@ -280,8 +440,15 @@ int		main(int argc, char **argv)
 		if (conversion) delete conversion;
 
 		if (tissuestack::utils::System::fileExists(out_file))
+		{
 			std::cout << "\nConversion finished successfully." << std::endl;
-		else
+			// the children wrote their planes only, the parent gets to look at the whole raw
+			if (tissuestack::imaging::RawConverter::compactToSingleChannel(out_file))
+				std::cout << "Stored gray data as single channel RAW." << std::endl;
+			build_bricks(out_file, brick_edge, codec);
+			build_pyramid(out_file, pyramid_filter);
+			build_statistics(out_file);
+		} else
 			std::cerr << "\nConversion aborted." << std::endl;
 	} catch (const std::exception & any)
 	{
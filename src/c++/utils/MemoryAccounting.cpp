@@ -0,0 +1,303 @@
+/*
+ * This file is part of TissueStack.
+ *
+ * TissueStack is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TissueStack is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TissueStack.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "utils.h"
+
+const std::string tissuestack::utils::MemoryAccounting::DEFAULT_CGROUP_ROOT = "/sys/fs/cgroup";
+const std::string tissuestack::utils::MemoryAccounting::PROC_SELF_CGROUP = "/proc/self/cgroup";
+
+tissuestack::utils::MemoryAccounting::MemoryAccounting(
+	const std::string & cgroup_root, const std::string & proc_self_cgroup) :
+		_cache_bytes(0), _pinned_bytes(0), _in_flight_bytes(0)
+{
+	this->detectCGroup(cgroup_root, proc_self_cgroup);
+	this->_total_ram = tissuestack::utils::System::getTotalRam();
+	this->_memory_limit = this->resolveMemoryLimit();
+}
+
+tissuestack::utils::MemoryAccounting * tissuestack::utils::MemoryAccounting::instance(const std::string & cgroup_root)
+{
+	std::lock_guard<std::mutex> lock(tissuestack::utils::MemoryAccounting::_instance_mutex);
+
+	if (tissuestack::utils::MemoryAccounting::_instance == nullptr)
+		tissuestack::utils::MemoryAccounting::_instance =
+			new tissuestack::utils::MemoryAccounting(
+				cgroup_root.empty() ? tissuestack::utils::MemoryAccounting::DEFAULT_CGROUP_ROOT : cgroup_root);
+
+	return tissuestack::utils::MemoryAccounting::_instance;
+}
+
+const bool tissuestack::utils::MemoryAccounting::doesInstanceExist()
+{
+	return (tissuestack::utils::MemoryAccounting::_instance != nullptr);
+}
+
+void tissuestack::utils::MemoryAccounting::purgeInstance()
+{
+	delete tissuestack::utils::MemoryAccounting::_instance;
+	tissuestack::utils::MemoryAccounting::_instance = nullptr;
+}
+
+inline void tissuestack::utils::MemoryAccounting::detectCGroup(
+	const std::string & cgroup_root, const std::string & proc_self_cgroup)
+{
+	this->_cgroup_root = cgroup_root;
+	while (this->_cgroup_root.length() > 1 && this->_cgroup_root.at(this->_cgroup_root.length()-1) == '/')
+		this->_cgroup_root = this->_cgroup_root.substr(0, this->_cgroup_root.length()-1);
+
+	// the unified hierarchy (v2) has a controllers file at its root, v1 has a memory sub hierarchy
+	if (tissuestack::utils::System::fileExists(this->_cgroup_root + "/cgroup.controllers"))
+		this->_cgroup_version = 2;
+	else if (tissuestack::utils::System::directoryExists(this->_cgroup_root + "/memory"))
+		this->_cgroup_version = 1;
+	else
+	{
+		this->_cgroup_version = 0;
+		return;
+	}
+
+	// find our own group: '0::/path' for v2, 'N:memory[,...]:/path' for v1
+	std::string ownGroup = "";
+	const std::vector<std::string> lines =
+		tissuestack::utils::System::readTextFileLineByLine(proc_self_cgroup);
+	for (auto line : lines)
+	{
+		const size_t firstColon = line.find(':');
+		const size_t secondColon = line.find(':', firstColon == std::string::npos ? 0 : firstColon+1);
+		if (firstColon == std::string::npos || secondColon == std::string::npos)
+			continue;
+
+		const std::string controllers = line.substr(firstColon+1, secondColon-firstColon-1);
+		const std::string path = line.substr(secondColon+1);
+
+		if (this->_cgroup_version == 2 && controllers.empty())
+		{
+			ownGroup = path;
+			break;
+		}
+
+		if (this->_cgroup_version == 1)
+		{
+			bool isMemoryController = false;
+			for (auto c : tissuestack::utils::Misc::tokenizeString(controllers, ','))
+				if (c.compare("memory") == 0)
+					isMemoryController = true;
+			if (isMemoryController)
+			{
+				ownGroup = path;
+				break;
+			}
+		}
+	}
+	if (ownGroup.compare("/") == 0)
+		ownGroup = "";
+
+	const std::string hierarchy =
+		this->_cgroup_version == 2 ? this->_cgroup_root : this->_cgroup_root + "/memory";
+	const std::string usageFile =
+		this->_cgroup_version == 2 ? "/memory.current" : "/memory.usage_in_bytes";
+
+	// within a container (cgroup namespace) the path we see is usually not mounted => fall back onto the root
+	this->_cgroup_memory_directory = hierarchy + ownGroup;
+	if (!tissuestack::utils::System::fileExists(this->_cgroup_memory_directory + usageFile))
+		this->_cgroup_memory_directory = hierarchy;
+}
+
+inline const unsigned long long int tissuestack::utils::MemoryAccounting::readCGroupValue(const std::string & file) const
+{
+	const unsigned long long int NO_VALUE = std::numeric_limits<unsigned long long int>::max();
+
+	const std::vector<std::string> lines =
+		tissuestack::utils::System::readTextFileLineByLine(file);
+	if (lines.empty() || lines[0].empty() || lines[0].compare("max") == 0)
+		return NO_VALUE;
+
+	if (!tissuestack::utils::Misc::isNumber(lines[0]))
+		return NO_VALUE;
+
+	return strtoull(lines[0].c_str(), NULL, 10);
+}
+
+inline const unsigned long long int tissuestack::utils::MemoryAccounting::readCGroupStatValue(
+	const std::string & file, const std::string & key) const
+{
+	const std::vector<std::string> lines =
+		tissuestack::utils::System::readTextFileLineByLine(file);
+	for (auto line : lines)
+	{
+		const std::vector<std::string> tokens = tissuestack::utils::Misc::tokenizeString(line, ' ');
+		if (tokens.size() == 2 && tokens[0].compare(key) == 0 && tissuestack::utils::Misc::isNumber(tokens[1]))
+			return strtoull(tokens[1].c_str(), NULL, 10);
+	}
+
+	return 0;
+}
+
+const unsigned short tissuestack::utils::MemoryAccounting::getCGroupVersion() const
+{
+	return this->_cgroup_version;
+}
+
+const std::string tissuestack::utils::MemoryAccounting::getCGroupMemoryDirectory() const
+{
+	return this->_cgroup_memory_directory;
+}
+
+inline const unsigned long long int tissuestack::utils::MemoryAccounting::resolveMemoryLimit() const
+{
+	const unsigned long long int totalRam = this->_total_ram;
+	if (this->_cgroup_version == 0)
+		return totalRam;
+
+	const std::string limitFile =
+		this->_cgroup_version == 2 ? "/memory.max" : "/memory.limit_in_bytes";
+
+	// limits are inherited: the lowest one up the hierarchy is the one that counts
+	unsigned long long int limit = totalRam;
+	std::string dir = this->_cgroup_memory_directory;
+	while (dir.length() >= this->_cgroup_root.length())
+	{
+		const unsigned long long int value = this->readCGroupValue(dir + limitFile);
+		if (value < limit)
+			limit = value;
+
+		const size_t lastSlash = dir.find_last_of('/');
+		if (lastSlash == std::string::npos || lastSlash == 0)
+			break;
+		dir = dir.substr(0, lastSlash);
+	}
+
+	return limit;
+}
+
+const unsigned long long int tissuestack::utils::MemoryAccounting::getMemoryLimit() const
+{
+	return this->_memory_limit;
+}
+
+const bool tissuestack::utils::MemoryAccounting::isLimitedByCGroup() const
+{
+	return this->_memory_limit < this->_total_ram;
+}
+
+const unsigned long long int tissuestack::utils::MemoryAccounting::getMemoryUsage() const
+{
+	std::lock_guard<std::mutex> lock(this->_usage_mutex);
+
+	const unsigned long long int now = tissuestack::utils::System::getSystemTimeInMillis();
+	const unsigned long long int residentBytes = this->_cache_bytes + this->_pinned_bytes;
+	if (this->_measurement_time == 0 || now < this->_measurement_time ||
+			now - this->_measurement_time >= tissuestack::utils::MemoryAccounting::USAGE_REFRESH_INTERVAL_IN_MILLIS)
+	{
+		this->_measured_usage = this->measureMemoryUsage();
+		this->_resident_bytes_at_measurement = residentBytes;
+		this->_measurement_time = now;
+		return this->_measured_usage;
+	}
+
+	// in between measurements the slice cache and pinning are what moves our usage along
+	if (residentBytes >= this->_resident_bytes_at_measurement)
+		return this->_measured_usage + (residentBytes - this->_resident_bytes_at_measurement);
+	const unsigned long long int released = this->_resident_bytes_at_measurement - residentBytes;
+	return this->_measured_usage > released ? this->_measured_usage - released : 0;
+}
+
+const unsigned long long int tissuestack::utils::MemoryAccounting::measureMemoryUsage() const
+{
+	if (!this->isLimitedByCGroup())
+		return tissuestack::utils::System::getUsedRam();
+
+	unsigned long long int usage = 0;
+	unsigned long long int reclaimable = 0;
+	if (this->_cgroup_version == 2)
+	{
+		usage = this->readCGroupValue(this->_cgroup_memory_directory + "/memory.current");
+		reclaimable = this->readCGroupStatValue(this->_cgroup_memory_directory + "/memory.stat", "inactive_file");
+	} else
+	{
+		usage = this->readCGroupValue(this->_cgroup_memory_directory + "/memory.usage_in_bytes");
+		reclaimable = this->readCGroupStatValue(this->_cgroup_memory_directory + "/memory.stat", "total_inactive_file");
+	}
+
+	// unreadable: we had better assume the worst
+	if (usage == std::numeric_limits<unsigned long long int>::max())
+		return this->_memory_limit;
+
+	// inactive page cache is given back by the kernel before the oom killer comes knocking
+	return usage > reclaimable ? usage - reclaimable : 0;
+}
+
+const unsigned long long int tissuestack::utils::MemoryAccounting::getAvailableMemory() const
+{
+	// without a cgroup limit this is total minus used ram, i.e. the free ram
+	const unsigned long long int usage = this->getMemoryUsage();
+
+	return this->_memory_limit > usage ? this->_memory_limit - usage : 0;
+}
+
+const bool tissuestack::utils::MemoryAccounting::canAccommodate(
+	const unsigned long long int bytes, const unsigned long long int reserve) const
+{
+	return this->getAvailableMemory() > bytes + reserve;
+}
+
+void tissuestack::utils::MemoryAccounting::addCacheBytes(const unsigned long long int bytes)
+{
+	this->_cache_bytes += bytes;
+}
+
+void tissuestack::utils::MemoryAccounting::removeCacheBytes(const unsigned long long int bytes)
+{
+	this->_cache_bytes -= bytes;
+}
+
+const unsigned long long int tissuestack::utils::MemoryAccounting::getCacheBytes() const
+{
+	return this->_cache_bytes;
+}
+
+void tissuestack::utils::MemoryAccounting::addPinnedBytes(const unsigned long long int bytes)
+{
+	this->_pinned_bytes += bytes;
+}
+
+void tissuestack::utils::MemoryAccounting::removePinnedBytes(const unsigned long long int bytes)
+{
+	this->_pinned_bytes -= bytes;
+}
+
+const unsigned long long int tissuestack::utils::MemoryAccounting::getPinnedBytes() const
+{
+	return this->_pinned_bytes;
+}
+
+void tissuestack::utils::MemoryAccounting::addInFlightBytes(const unsigned long long int bytes)
+{
+	this->_in_flight_bytes += bytes;
+}
+
+void tissuestack::utils::MemoryAccounting::removeInFlightBytes(const unsigned long long int bytes)
+{
+	this->_in_flight_bytes -= bytes;
+}
+
+const unsigned long long int tissuestack::utils::MemoryAccounting::getInFlightBytes() const
+{
+	return this->_in_flight_bytes;
+}
+
+tissuestack::utils::MemoryAccounting * tissuestack::utils::MemoryAccounting::_instance = nullptr;
+std::mutex tissuestack::utils::MemoryAccounting::_instance_mutex;
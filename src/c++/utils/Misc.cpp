@@ -188,7 +188,7 @@ const std::string tissuestack::utils::Misc::composeHttpResponse(
 	return response.str();
 }
 
-const bool tissuestack::utils::Misc::streamGzippedDataToDescriptor(unsigned char * data, const unsigned int length, const int descriptor)
+const bool tissuestack::utils::Misc::streamGzippedDataToDescriptor(const unsigned char * data, const unsigned int length, const int descriptor)
 {
 	const unsigned int CHUNK = 16384;
 	unsigned char out[CHUNK];
@@ -204,7 +204,7 @@ const bool tissuestack::utils::Misc::streamGzippedDataToDescriptor(unsigned char
 	if (ret < 0)
 		return false;
 
-	strm.next_in = data;
+	strm.next_in = const_cast<unsigned char *>(data);
 	strm.avail_in = length;
 	strm.next_out = out;
 	strm.avail_out = CHUNK;
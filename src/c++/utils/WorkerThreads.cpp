@@ -0,0 +1,69 @@
+/*
+ * This file is part of TissueStack.
+ *
+ * TissueStack is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TissueStack is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TissueStack.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "utils.h"
+
+tissuestack::utils::WorkerThreads::~WorkerThreads()
+{
+	// only reached without join() if the creator is unwinding: don't throw on top of that
+	this->joinAll();
+}
+
+void tissuestack::utils::WorkerThreads::start(const std::function<void()> & work)
+{
+	std::thread thread(
+		[this, work] ()
+		{
+			try
+			{
+				work();
+			} catch (...)
+			{
+				std::lock_guard<std::mutex> lock(this->_exception_mutex);
+				if (!this->_exception)
+					this->_exception = std::current_exception();
+			}
+		});
+
+	try
+	{
+		this->_threads.push_back(std::move(thread));
+	} catch (...)
+	{
+		thread.join();
+		throw;
+	}
+}
+
+void tissuestack::utils::WorkerThreads::join()
+{
+	this->joinAll();
+
+	if (this->_exception)
+	{
+		std::exception_ptr exception = this->_exception;
+		this->_exception = nullptr;
+		std::rethrow_exception(exception);
+	}
+}
+
+void tissuestack::utils::WorkerThreads::joinAll()
+{
+	for (auto & thread : this->_threads)
+		if (thread.joinable())
+			thread.join();
+	this->_threads.clear();
+}
@@ -47,6 +47,10 @@
 
 #include <stdexcept>
 #include <uuid/uuid.h>
+#include <atomic>
+#include <mutex>
+#include <functional>
+#include <exception>
 
 #include <zlib.h>
 #include <zip.h>
@@ -104,7 +108,7 @@ namespace tissuestack
     	static const std::string sanitizeSqlQuote(const std::string & quoted_value);
     	static const std::string eraseCharacterFromString(const std::string & someString, const char unwantedCharacter);
     	static const std::string eliminateWhitespaceAndUnwantedEscapeCharacters(const std::string & someString);
-    	static const bool streamGzippedDataToDescriptor(unsigned char * data, const unsigned int length, const int descriptor);
+    	static const bool streamGzippedDataToDescriptor(const unsigned char * data, const unsigned int length, const int descriptor);
     	static const std::vector<std::string> getContentsOfZipArchive(const std::string & archive);
     	static const bool extractZippedFileFromArchive(
     		const std::string & archive,
@@ -118,6 +122,83 @@ namespace tissuestack
     	Misc(const Misc&) = delete;
     };
 
+    class MemoryAccounting final
+    {
+      public:
+        static const std::string DEFAULT_CGROUP_ROOT;
+        static const std::string PROC_SELF_CGROUP;
+        // usage is measured at most this often, in between it is moved along by what the slice cache and pinning add and drop
+        static const unsigned long long int USAGE_REFRESH_INTERVAL_IN_MILLIS = 250;
+        MemoryAccounting & operator=(const MemoryAccounting&) = delete;
+        MemoryAccounting(const MemoryAccounting&) = delete;
+        // public so that it can be pointed at a fake cgroup hierarchy, the server uses the instance
+        explicit MemoryAccounting(
+        	const std::string & cgroup_root = DEFAULT_CGROUP_ROOT,
+        	const std::string & proc_self_cgroup = PROC_SELF_CGROUP);
+        static MemoryAccounting * instance(const std::string & cgroup_root = "");
+        static const bool doesInstanceExist();
+        void purgeInstance();
+
+        const unsigned short getCGroupVersion() const;
+        const std::string getCGroupMemoryDirectory() const;
+        const bool isLimitedByCGroup() const;
+        const unsigned long long int getMemoryLimit() const;
+        const unsigned long long int getMemoryUsage() const;
+        const unsigned long long int getAvailableMemory() const;
+        const bool canAccommodate(
+        	const unsigned long long int bytes, const unsigned long long int reserve) const;
+
+        void addCacheBytes(const unsigned long long int bytes);
+        void removeCacheBytes(const unsigned long long int bytes);
+        const unsigned long long int getCacheBytes() const;
+        // data sets pinned (and locked) into memory
+        void addPinnedBytes(const unsigned long long int bytes);
+        void removePinnedBytes(const unsigned long long int bytes);
+        const unsigned long long int getPinnedBytes() const;
+        void addInFlightBytes(const unsigned long long int bytes);
+        void removeInFlightBytes(const unsigned long long int bytes);
+        const unsigned long long int getInFlightBytes() const;
+      private:
+        inline void detectCGroup(const std::string & cgroup_root, const std::string & proc_self_cgroup);
+        inline const unsigned long long int readCGroupValue(const std::string & file) const;
+        inline const unsigned long long int readCGroupStatValue(const std::string & file, const std::string & key) const;
+        inline const unsigned long long int resolveMemoryLimit() const;
+        const unsigned long long int measureMemoryUsage() const;
+        unsigned short _cgroup_version = 0;
+        std::string _cgroup_root;
+        std::string _cgroup_memory_directory;
+        // limits hardly ever change at runtime: they are resolved once
+        unsigned long long int _total_ram = 0;
+        unsigned long long int _memory_limit = 0;
+        mutable std::mutex _usage_mutex;
+        mutable unsigned long long int _measured_usage = 0;
+        mutable unsigned long long int _resident_bytes_at_measurement = 0;
+        mutable unsigned long long int _measurement_time = 0;
+        std::atomic<unsigned long long int> _cache_bytes;
+        std::atomic<unsigned long long int> _pinned_bytes;
+        std::atomic<unsigned long long int> _in_flight_bytes;
+        static MemoryAccounting * _instance;
+        static std::mutex _instance_mutex;
+    };
+
+    // threads that are joined even if their creator throws, the first
+    // exception any of them ran into is rethrown by join()
+    class WorkerThreads final
+    {
+      public:
+        WorkerThreads() = default;
+        WorkerThreads & operator=(const WorkerThreads&) = delete;
+        WorkerThreads(const WorkerThreads&) = delete;
+        ~WorkerThreads();
+        void start(const std::function<void()> & work);
+        void join();
+      private:
+        void joinAll();
+        std::vector<std::thread> _threads;
+        std::mutex _exception_mutex;
+        std::exception_ptr _exception;
+    };
+
     class Timer
       {
         public:
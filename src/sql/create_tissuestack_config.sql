@@ -13,6 +13,15 @@ INSERT INTO configuration VALUES('colormaps_directory', '/opt/tissuestack/colorm
 INSERT INTO configuration VALUES('tasks_directory', '/opt/tissuestack/tasks', 'directory that houses task queue files (absolute system path on server)');
 INSERT INTO configuration VALUES('data_directory', '/opt/tissuestack/data', 'data directory (absolute system path on server)');
 INSERT INTO configuration VALUES('temp_directory', '/tmp', 'temporary directory (absolute system path on server)');
+INSERT INTO configuration VALUES('tile_disk_cache_directory', '/opt/tissuestack/tile_cache', 'directory that houses the server''s rendered tile cache (absolute system path on server)');
+INSERT INTO configuration VALUES('tile_disk_cache_size', '1073741824', 'the maximum number of bytes the rendered tile cache may use on disk: 0 switches it off');
+INSERT INTO configuration VALUES('slice_cache_compression', '', 'data sets whose cached slices are kept compressed in memory (lz4 if the server is built with USE_LZ4, zlib otherwise): comma separated file names, * for all (requires a restart)');
+INSERT INTO configuration VALUES('pinned_data_sets', '', 'raw data sets (comma separated file names) that are locked into memory at start up and never evicted');
+INSERT INTO configuration VALUES('png_compression_level', '6', 'zlib level (0-9) for png tiles at full quality (requires a restart)');
+INSERT INTO configuration VALUES('png_filter', '', 'png row filter: none, sub, up, avg, paeth or empty for adaptive (requires a restart)');
+INSERT INTO configuration VALUES('png_compression_strategy', '', 'zlib strategy for png tiles: filtered, rle, huffman or empty for default (requires a restart)');
+INSERT INTO configuration VALUES('jpeg_quality', '75', 'jpeg quality (1-100) at full quality, the request''s quality factor scales it (requires a restart)');
+INSERT INTO configuration VALUES('webp_quality', 'lossless', 'webp tiles (server built with USE_WEBP=1): ''lossless'' or a lossy quality (1-100) at full quality, degraded tiles are always lossy (requires a restart)');
 INSERT INTO configuration VALUES('ands_dataset_xml', '/opt/tissuestack/ands/datasets.xml', 'ands data set xml');
 INSERT INTO configuration VALUES('max_upload_size', '10000000000', 'the maximum number of bytes allowed to upload in one go');
 INSERT INTO configuration VALUES('default_drawing_interval', '100', 'default drawing interval');
@@ -60,3 +60,16 @@ ALTER TABLE dataset_planes DROP COLUMN zoom_levels;
 ALTER TABLE dataset_planes DROP COLUMN one_to_one_zoom_level;
 UPDATE configuration SET value='/opt/tissuestack/tasks',description='directory that houses task queue files (absolute system path on server)' WHERE name='tasks_directory';
 UPDATE configuration SET value='100', description='default drawing interval' WHERE name='default_drawing_interval';
+-- disk cache for rendered tiles
+INSERT INTO configuration VALUES('tile_disk_cache_directory', '/opt/tissuestack/tile_cache', 'directory that houses the server''s rendered tile cache (absolute system path on server)');
+INSERT INTO configuration VALUES('tile_disk_cache_size', '1073741824', 'the maximum number of bytes the rendered tile cache may use on disk: 0 switches it off');
+-- optional compression of in-memory slice cache entries
+INSERT INTO configuration VALUES('slice_cache_compression', '', 'data sets whose cached slices are kept compressed in memory (lz4 if the server is built with USE_LZ4, zlib otherwise): comma separated file names, * for all (requires a restart)');
+-- data sets pinned into memory
+INSERT INTO configuration VALUES('pinned_data_sets', '', 'raw data sets (comma separated file names) that are locked into memory at start up and never evicted');
+-- png/jpeg encoder settings
+INSERT INTO configuration VALUES('png_compression_level', '6', 'zlib level (0-9) for png tiles at full quality (requires a restart)');
+INSERT INTO configuration VALUES('png_filter', '', 'png row filter: none, sub, up, avg, paeth or empty for adaptive (requires a restart)');
+INSERT INTO configuration VALUES('png_compression_strategy', '', 'zlib strategy for png tiles: filtered, rle, huffman or empty for default (requires a restart)');
+INSERT INTO configuration VALUES('jpeg_quality', '75', 'jpeg quality (1-100) at full quality, the request''s quality factor scales it (requires a restart)');
+INSERT INTO configuration VALUES('webp_quality', 'lossless', 'webp tiles (server built with USE_WEBP=1): ''lossless'' or a lossy quality (1-100) at full quality, degraded tiles are always lossy (requires a restart)');